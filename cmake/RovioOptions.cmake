@@ -0,0 +1,19 @@
+# Compile time configuration of the filter, shared by the catkin package and the standalone rovio_core build
+set(ROVIO_NMAXFEATURE 25 CACHE STRING "Number of features for ROVIO")
+set(ROVIO_NCAM 2 CACHE STRING "Number of enabled cameras")
+set(ROVIO_NLEVELS 4 CACHE STRING "Number of image leavels for the features")
+set(ROVIO_PATCHSIZE 8 CACHE STRING "Size of patch (edge length in pixel)")
+set(ROVIO_NPOSE 0 CACHE STRING "Additional estimated poses for external pose measurements")
+set(ROVIO_CAMERA_MODEL "" CACHE STRING "Camera model to specialize the projection for (RADTAN, REFRAC, EQUIDIST, EQUIREFRAC or DS, empty for runtime selection only)")
+set(ROVIO_PROFILING OFF CACHE BOOL "Time the filter stages and publish the statistics on rovio/profiling")
+add_definitions(-DROVIO_NMAXFEATURE=${ROVIO_NMAXFEATURE})
+add_definitions(-DROVIO_NCAM=${ROVIO_NCAM})
+add_definitions(-DROVIO_NLEVELS=${ROVIO_NLEVELS})
+add_definitions(-DROVIO_PATCHSIZE=${ROVIO_PATCHSIZE})
+add_definitions(-DROVIO_NPOSE=${ROVIO_NPOSE})
+if(NOT ROVIO_CAMERA_MODEL STREQUAL "")
+	add_definitions(-DROVIO_CAMERA_MODEL=rovio::Camera::${ROVIO_CAMERA_MODEL})
+endif()
+if(ROVIO_PROFILING)
+	add_definitions(-DROVIO_PROFILING)
+endif()
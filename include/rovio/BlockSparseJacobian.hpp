@@ -0,0 +1,132 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_BLOCKSPARSEJACOBIAN_HPP_
+#define ROVIO_BLOCKSPARSEJACOBIAN_HPP_
+
+#include "lightweight_filtering/common.hpp"
+#include <vector>
+
+namespace rovio{
+
+/** \brief Measurement Jacobian, stored as a set of dense column blocks.
+ *
+ *  Measurement Jacobians of the filter (e.g. of the image update) are only nonzero in a few blocks of the state
+ *  (pose, velocity, extrinsics, single feature). Storing only these blocks allows to compute the products with the
+ *  covariance in O(D*k) instead of O(D^2), where k is the number of nonzero columns.
+ *
+ *  @tparam Rows - Number of rows of the Jacobian (Eigen::Dynamic for stacked measurements).
+ */
+template<int Rows>
+class BlockSparseJacobian{
+ public:
+  typedef Eigen::Matrix<double,Rows,Eigen::Dynamic> mtValues;
+  int cols_;  /**<Number of columns of the full (dense) Jacobian.*/
+  std::vector<int> blockStart_;  /**<Column index of each block in the full Jacobian.*/
+  std::vector<int> blockSize_;  /**<Number of columns of each block.*/
+  std::vector<int> blockOffset_;  /**<Column index of each block in \ref values_.*/
+  mtValues values_;  /**<Nonzero columns of the Jacobian, stored contiguously.*/
+
+  /** \brief Constructor
+   */
+  BlockSparseJacobian(){
+    cols_ = 0;
+  }
+
+  /** \brief Destructor
+   */
+  virtual ~BlockSparseJacobian(){}
+
+  /** \brief Extracts the nonzero column blocks of a dense Jacobian.
+   *
+   *   @param F - Dense Jacobian (Rows x D).
+   */
+  template<typename Derived>
+  void setFromDense(const Eigen::MatrixBase<Derived>& F){
+    assert(Rows == Eigen::Dynamic || F.rows() == Rows);
+    cols_ = F.cols();
+    blockStart_.clear();
+    blockSize_.clear();
+    blockOffset_.clear();
+    int nonZeroCols = 0;
+    bool inBlock = false;
+    for(int j=0;j<cols_;j++){
+      if(!F.col(j).isZero(0.0)){
+        if(!inBlock){
+          blockStart_.push_back(j);
+          blockSize_.push_back(0);
+          blockOffset_.push_back(nonZeroCols);
+          inBlock = true;
+        }
+        blockSize_.back()++;
+        nonZeroCols++;
+      } else {
+        inBlock = false;
+      }
+    }
+    values_.resize(F.rows(),nonZeroCols);
+    for(unsigned int i=0;i<blockStart_.size();i++){
+      values_.middleCols(blockOffset_[i],blockSize_[i]) = F.middleCols(blockStart_[i],blockSize_[i]);
+    }
+  }
+
+  /** \brief Returns the number of nonzero columns.
+   */
+  int nonZeroCols() const{
+    return values_.cols();
+  }
+
+  /** \brief Computes P*F^T by gathering the columns of P which correspond to the nonzero blocks of F.
+   *
+   *   @param P   - Covariance matrix (D x D).
+   *   @param PFt - Output (D x Rows).
+   */
+  void multiplyCovTransposed(const MXD& P, MXD& PFt) const{
+    PFt.setZero(P.rows(),values_.rows());
+    for(unsigned int i=0;i<blockStart_.size();i++){
+      PFt.noalias() += P.middleCols(blockStart_[i],blockSize_[i])*values_.middleCols(blockOffset_[i],blockSize_[i]).transpose();
+    }
+  }
+
+  /** \brief Computes F*X by gathering the rows of X which correspond to the nonzero blocks of F.
+   *
+   *   @param X   - Input (D x m).
+   *   @param out - Output (Rows x m).
+   */
+  void multiply(const MXD& X, MXD& out) const{
+    out.setZero(values_.rows(),X.cols());
+    for(unsigned int i=0;i<blockStart_.size();i++){
+      out.noalias() += values_.middleCols(blockOffset_[i],blockSize_[i])*X.middleRows(blockStart_[i],blockSize_[i]);
+    }
+  }
+};
+
+}
+
+
+#endif /* ROVIO_BLOCKSPARSEJACOBIAN_HPP_ */
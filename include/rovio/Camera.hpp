@@ -37,6 +37,20 @@
 
 namespace rovio{
 
+/** \brief Structure-of-arrays buffer for batched projections, see Camera::bearingToPixelBatch.
+ *
+ *  @tparam N - Capacity.
+ */
+template<int N>
+struct ProjectionBatch{
+  int n_; /**<Number of used entries.*/
+  double x_[N], y_[N], z_[N]; /**<Bearing vectors (in camera coordinates | unit length not necessary).*/
+  double u_[N], v_[N]; /**<(Distorted) pixel coordinates.*/
+  double J_[6][N]; /**<Jacobians of the pixel coordinates w.r.t. the bearing vector (2x3, row-major).*/
+  bool valid_[N]; /**<Whether the bearing vector points in front of the camera (otherwise the outputs are undefined).*/
+  ProjectionBatch(): n_(0){};
+};
+
 class Camera{
  public:
   /** \brief Distortion model of the camera.
@@ -63,6 +77,22 @@ class Camera{
   double valid_radius_;
   //@}
 
+  //@{
+  /** \brief Image size (from the calibration file, 0 if unknown). */
+  int imageWidth_, imageHeight_;
+  //@}
+
+  //@{
+  /** \brief Bearing lookup table (undistorted unit plane coordinates on a regular pixel grid).
+   *         For the refractive models only the refractive index independent (equidistant) part is tabulated, such that the
+   *         table stays valid while the refractive index is estimated.
+   *         bearingLutStep_ is the grid spacing in pixels, 0 disables the table. The table is built in load(). */
+  int bearingLutStep_;
+  int bearingLutCols_, bearingLutRows_;
+  std::vector<Eigen::Vector2d> bearingLut_;
+  std::vector<unsigned char> bearingLutValid_;
+  //@}
+
   /** \brief Constructor.
    *
    *  Initializes the camera object as pinhole camera, i.e. all distortion coefficients are set to zero.
@@ -111,6 +141,20 @@ class Camera{
    */
   void load(const std::string& filename);
 
+  /** \brief Builds the bearing lookup table (\ref bearingLut_) for the current calibration.
+   *
+   *   Only done if bearingLutStep_ > 0 and the image size is known. Otherwise the table is cleared.
+   */
+  void buildBearingLut();
+
+  /** \brief Bilinearly interpolates the undistorted unit plane coordinates of a pixel from the bearing lookup table.
+   *
+   *   @param c    - (Distorted) pixel.
+   *   @param ybar - Interpolated undistorted point coordinates on the unit plane.
+   *   @return True, if the pixel is covered by valid table entries.
+   */
+  bool lookupBearingLut(const cv::Point2f& c, Eigen::Vector2d& ybar) const;
+
   /** \brief Distorts a point on the unit plane (in camera coordinates) according to the Radtan distortion model.
    *
    *   @param in  - Undistorted point coordinates on the unit plane (in camera coordinates).
@@ -286,6 +330,25 @@ class Camera{
    *   @return True, if process successful.
    */
   bool pixelToBearing(const cv::Point2f& c,Eigen::Vector3d& vec) const;
+
+  /** \brief Undistorts a point on the unit plane by Gauss-Newton optimization, using the set distortion model.
+   *
+   *   @param y        - Distorted point coordinates on the unit plane.
+   *   @param ybar     - Initial guess and output of the undistorted point coordinates on the unit plane.
+   *   @param max_iter - Maximal number of iterations.
+   *   @return True, if converged.
+   */
+  bool undistortIterative(const Eigen::Vector2d& y, Eigen::Vector2d& ybar, const int max_iter = 100) const;
+
+  /** \brief Undistorts a point on the unit plane by Gauss-Newton optimization, using only the equidistant part of the model
+   *         (the refractive index independent part of the refractive models).
+   *
+   *   @param y        - Distorted point coordinates on the unit plane.
+   *   @param ybar     - Initial guess and output of the undistorted point coordinates on the unit plane.
+   *   @param max_iter - Maximal number of iterations.
+   *   @return True, if converged.
+   */
+  bool undistortEquidistIterative(const Eigen::Vector2d& y, Eigen::Vector2d& ybar, const int max_iter = 100) const;
   
   /** \brief Get the bearing vector, corresponding to a specific (distorted) pixel.
    *
@@ -321,6 +384,59 @@ class Camera{
    */
   bool pixelToBearing(const cv::Point2f& c,LWF::NormalVectorElement& n, const double& refrac_index) const;
 
+  /** \brief Projection kernel, statically specialized on the distortion model. All bearingToPixel overloads forward to it.
+   *
+   *  The optional outputs are skipped if null, once inlined into a fixed overload the checks fold away.
+   *
+   *   @tparam type         - Distortion model (#ModelType).
+   *   @param vec           - Bearing vector (in camera coordinates | unit length not necessary).
+   *   @param c             - (Distorted) pixel coordinates.
+   *   @param J             - Jacobian of the projection w.r.t. the bearing vector (optional).
+   *   @param Jdpdn         - Jacobian of the projection w.r.t. the refractive index (optional, requires J and refrac_index).
+   *   @param refrac_index  - Refractive index of the medium (optional).
+   *   @return True, if process successful.
+   */
+  template<int type>
+  bool bearingToPixelModel(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>* J, Eigen::Matrix<double,2,1>* Jdpdn, const double* refrac_index) const;
+
+  /** \brief Forwards to the projection kernel of the set distortion model. Cameras of the model configured by the CMake
+   *         option ROVIO_CAMERA_MODEL are projected by the inlined kernel, all others by bearingToPixelRuntime.
+   */
+  bool bearingToPixelDispatch(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>* J, Eigen::Matrix<double,2,1>* Jdpdn, const double* refrac_index) const;
+
+  /** \brief Selects the projection kernel by a runtime switch over #type_ (once per projection, not per distortion call).
+   */
+  bool bearingToPixelRuntime(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>* J, Eigen::Matrix<double,2,1>* Jdpdn, const double* refrac_index) const;
+
+  /** \brief Projects all bearing vectors of a batch and computes the Jacobians, using the set distortion model.
+   *
+   *  The model is resolved once for the whole batch. The loop body is branch-free (w.r.t. the data), reads and writes
+   *  contiguous arrays and calls the inline distortion kernels only, such that the compiler can vectorize it.
+   *  Equivalent to bearingToPixel(vec,c,J) per entry.
+   *
+   *   @param batch - Bearing vectors (input) and pixel coordinates, Jacobians and validity (output).
+   */
+  template<int N>
+  void bearingToPixelBatch(ProjectionBatch<N>& batch) const;
+
+  /** \brief Batched projection kernel (see bearingToPixelBatch), statically specialized on the distortion model.
+   */
+  template<int type, int N>
+  void bearingToPixelBatchModel(ProjectionBatch<N>& batch) const;
+
+  /** \brief Iterative undistortion (see undistortIterative), statically specialized on the distortion model.
+   */
+  template<int type>
+  bool undistortIterativeModel(const Eigen::Vector2d& y, Eigen::Vector2d& ybar, const int max_iter) const;
+
+  /** \brief Back-projection (see pixelToBearing), statically specialized on the distortion model.
+   */
+  template<int type>
+  bool pixelToBearingModel(const cv::Point2f& c,Eigen::Vector3d& vec) const;
+
+  /** \brief Selects the back-projection kernel by a runtime switch over #type_.
+   */
+  bool pixelToBearingRuntime(const cv::Point2f& c,Eigen::Vector3d& vec) const;
 
   /** \brief Function testing the camera model by randomly mapping bearing vectors to pixel coordinates and vice versa.
    */
@@ -329,5 +445,6 @@ class Camera{
 
 }
 
+#include "rovio/CameraModels.hpp"
 
 #endif /* ROVIO_CAMERA_HPP_ */
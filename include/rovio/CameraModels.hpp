@@ -0,0 +1,603 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_CAMERAMODELS_HPP_
+#define ROVIO_CAMERAMODELS_HPP_
+
+#include "rovio/Camera.hpp"
+
+namespace rovio{
+
+  /* The distortion kernels are defined inline, such that the dispatch in Camera::distort and the statically specialized
+   * CameraModel below can be inlined into the projection code. */
+
+  inline void Camera::distortRadtan(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
+    const double x2 = in(0) * in(0);
+    const double y2 = in(1) * in(1);
+    const double xy = in(0) * in(1);
+    const double r2 = x2 + y2;
+    const double kr = (1 + ((k3_ * r2 + k2_) * r2 + k1_) * r2);
+    out(0) = in(0) * kr + p1_ * 2 * xy + p2_ * (r2 + 2 * x2);
+    out(1) = in(1) * kr + p1_ * (r2 + 2 * y2) + p2_ * 2 * xy;
+  }
+
+  inline void Camera::distortRadtan(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
+    const double x2 = in(0) * in(0);
+    const double y2 = in(1) * in(1);
+    const double xy = in(0) * in(1);
+    const double r2 = x2 + y2;
+    const double kr = (1 + ((k3_ * r2 + k2_) * r2 + k1_) * r2);
+    out(0) = in(0) * kr + p1_ * 2 * xy + p2_ * (r2 + 2 * x2);
+    out(1) = in(1) * kr + p1_ * (r2 + 2 * y2) + p2_ * 2 * xy;
+    J(0,0) = kr + 2.0 * k1_ * x2 + 4.0 * k2_ * x2 * r2 + 6.0 * k3_ * x2 * r2 * r2 + 2.0 * p1_ * in(1) + 6.0 * p2_ * in(0);
+    J(0,1) = 2.0 * k1_ * xy + 4.0 * k2_ * xy * r2 + 6.0 * k3_ * xy * r2 * r2 + 2 * p1_ * in(0) + 2 * p2_ * in(1);
+    J(1,0) = J(0,1);
+    J(1,1) = kr + 2.0 * k1_ * y2 + 4.0 * k2_ * y2 * r2 + 6.0 * k3_ * y2 * r2 * r2 + 6.0 * p1_ * in(1) + 2.0 * p2_ * in(0);
+  }
+
+  inline void Camera::distortRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
+    const double x2 = in(0) * in(0);
+    const double y2 = in(1) * in(1);
+    const double x_y = in(0) * in(1);
+    const double r2 = x2 + y2;
+    const double n = refrac_ind_;
+    const double n2 = n * n;
+
+    const double m_distort = n/sqrt(1 + r2 - (n2*r2));
+    out(0) = in(0) * m_distort;
+    out(1) = in(1) * m_distort;
+
+
+  }
+  inline void Camera::distortEquiRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
+    Eigen::Vector2d temp;
+    distortRefractive(in, temp);
+    distortEquidist(temp, out);
+
+  }
+
+  inline void Camera::distortRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index) const{
+    const double x2 = in(0) * in(0);
+    const double y2 = in(1) * in(1);
+    const double x_y = in(0) * in(1);
+    const double r2 = x2 + y2;
+    const double n = refrac_index;    // refractive index from state
+    const double n2 = n * n;
+
+    const double m_distort = n/sqrt(1 + r2 - (n2*r2));
+    out(0) = in(0) * m_distort;
+    out(1) = in(1) * m_distort;
+
+  }
+
+  inline void Camera::distortRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
+    const double x2 = in(0) * in(0);
+    const double y2 = in(1) * in(1);
+    const double x_y = in(0) * in(1);
+    const double r2 = x2 + y2;
+    const double n = refrac_ind_;
+    const double n2 = n * n;
+
+    const double m_distort = n/sqrt(1 + r2 - (n2*r2));
+    out(0) = in(0) * m_distort;
+    out(1) = in(1) * m_distort;
+
+    const double g = 1  + r2 - (n2*r2);
+
+    J(0,0) = n*pow(g, -2.0)*(sqrt(g)*x2*(n2 - 1) + pow(g, 1.5));
+    J(0,1) = n*pow(g, -1.5)*x_y*(n2 - 1);
+    J(1,0) = n*pow(g, -1.5)*x_y*(n2 - 1);
+    J(1,1) = n*pow(g, -2.0)*(sqrt(g)*y2*(n2 - 1) + pow(g, 1.5));
+  }
+
+  inline void Camera::distortEquiRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
+    Eigen::Vector2d temp;
+    Eigen::Matrix2d J_temp_refrac;
+    Eigen::Matrix2d J_temp_equi;
+
+    distortRefractive(in, temp, J_temp_refrac);
+    distortEquidist(temp, out, J_temp_equi);
+    J = J_temp_equi * J_temp_refrac;
+  }
+
+  inline void Camera::distortEquiRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J_equi, Eigen::Matrix2d& J_refrac) const{
+    Eigen::Vector2d temp;
+
+    distortRefractive(in, temp, J_refrac);
+    distortEquidist(temp, out, J_equi);
+  }
+
+  inline void Camera::distortRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index ,Eigen::Matrix2d& J) const{
+    const double x2 = in(0) * in(0);
+    const double y2 = in(1) * in(1);
+    const double x_y = in(0) * in(1);
+    const double r2 = x2 + y2;
+    const double n = refrac_index; // refractive index from state
+    const double n2 = n * n;
+
+    const double m_distort = n/sqrt(1 + r2 - (n2*r2));
+    out(0) = in(0) * m_distort;
+    out(1) = in(1) * m_distort;
+
+    const double g = 1  + r2 - (n2*r2);
+
+    J(0,0) = n*pow(g, -2.0)*(sqrt(g)*x2*(n2 - 1) + pow(g, 1.5));
+    J(0,1) = n*pow(g, -1.5)*x_y*(n2 - 1);
+    J(1,0) = n*pow(g, -1.5)*x_y*(n2 - 1);
+    J(1,1) = n*pow(g, -2.0)*(sqrt(g)*y2*(n2 - 1) + pow(g, 1.5));
+  }
+
+  inline void Camera::distortEquiRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index, Eigen::Matrix2d& J) const{
+    Eigen::Vector2d temp;
+    Eigen::Matrix2d J_temp_refrac;
+    Eigen::Matrix2d J_temp_equi;
+
+    distortRefractive(in, temp, refrac_index, J_temp_refrac);
+    distortEquidist(temp, out, J_temp_equi);
+    J = J_temp_equi * J_temp_refrac;
+  }
+
+  inline void Camera::distortEquidist(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
+    const double x2 = in(0) * in(0);
+    const double y2 = in(1) * in(1);
+    const double r = std::sqrt(x2 + y2); // 1/r*x
+
+    if(r < 1e-8){
+      out(0) = in(0);
+      out(1) = in(1);
+      return;
+    }
+
+    const double th = atan(r); // 1/(r^2 + 1)
+    const double th2 = th*th;
+    const double th4 = th2*th2;
+    const double th6 = th2*th4;
+    const double th8 = th2*th6;
+    const double thd = th * (1.0 + k1_ * th2 + k2_ * th4 + k3_ * th6 + k4_ * th8);
+    const double s = thd/r;
+
+    out(0) = in(0) * s;
+    out(1) = in(1) * s;
+  }
+
+  inline void Camera::distortEquidist(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
+    const double x2 = in(0) * in(0);
+    const double y2 = in(1) * in(1);
+    const double r = std::sqrt(x2 + y2);
+
+    if(r < 1e-8){
+      out(0) = in(0);
+      out(1) = in(1);
+      J.setIdentity();
+      return;
+    }
+
+    const double r_x = 1/r*in(0);
+    const double r_y = 1/r*in(1);
+
+    const double th = atan(r); // 1/(r^2 + 1)
+    const double th_r = 1/(r*r+1);
+    const double th2 = th*th;
+    const double th4 = th2*th2;
+    const double th6 = th2*th4;
+    const double th8 = th2*th6;
+    const double thd = th * (1.0 + k1_ * th2 + k2_ * th4 + k3_ * th6 + k4_ * th8);
+    const double thd_th = 1.0 + 3 * k1_ * th2 + 5* k2_ * th4 + 7 * k3_ * th6 + 9 * k4_ * th8;
+    const double s = thd/r;
+    const double s_r = thd_th*th_r/r - thd/(r*r);
+
+    out(0) = in(0) * s;
+    out(1) = in(1) * s;
+
+    J(0,0) = s + in(0)*s_r*r_x;
+    J(0,1) = in(0)*s_r*r_y;
+    J(1,0) = in(1)*s_r*r_x;
+    J(1,1) = s + in(1)*s_r*r_y;
+  }
+
+  inline void Camera::distortDoubleSphere(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
+
+      const double x2 = in(0) * in(0);
+      const double y2 = in(1) * in(1);
+
+      if((x2 + y2) < 1e-16){
+        out(0) = in(0);
+        out(1) = in(1);
+        return;
+      }
+
+      const double d1 = std::sqrt(x2 + y2 + 1.0);
+      const double d2 = std::sqrt(x2 + y2 + (k1_*d1 + 1.0)*(k1_*d1 + 1.0));
+      const double scaling = 1.0f/(k2_*d2 + (1-k2_)*(k1_*d1+1.0));
+
+      out(0) = in(0) * scaling;
+      out(1) = in(1) * scaling;
+  }
+
+  inline void Camera::distortDoubleSphere(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
+    const double x2 = in(0) * in(0);
+    const double y2 = in(1) * in(1);
+
+    if((x2 + y2) < 1e-16){
+      out(0) = in(0);
+      out(1) = in(1);
+      J.setIdentity();
+      return;
+    }
+
+    const double d1 = std::sqrt(x2 + y2 + 1.0);
+    const double d2 = std::sqrt(x2 + y2 + (k1_*d1 + 1.0)*(k1_*d1 + 1.0));
+    const double s = 1.0f/(k2_*d2 + (1-k2_)*(k1_*d1+1.0));
+
+    out(0) = in(0) * s;
+    out(1) = in(1) * s;
+
+    const double d1dx = in(0)/d1;
+    const double d1dy = in(1)/d1;
+    const double d2dx = (in(0) + d1dx*k1_*(d1*k1_ + 1.0))/(d2);
+    const double d2dy = (in(1) + d1dy*k1_*(d1*k1_ + 1.0))/(d2);
+
+    J(0,0) = -in(0)*(d2dx*k2_ - d1dx*k1_*(k2_ - 1.0))*s*s + s;
+    J(0,1) = -s*s*in(0)*(d2dy*k2_ - d1dy*k1_*(k2_ - 1.0));
+    J(1,0) = -s*s*in(1)*(d2dx*k2_ - d1dx*k1_*(k2_ - 1.0));
+    J(1,1) = -in(1)*(d2dy*k2_ - d1dy*k1_*(k2_ - 1.0))*s*s + s;
+  }
+
+/** \brief Statically specialized camera model.
+ *
+ *  Maps the runtime #Camera::ModelType onto the corresponding distortion kernels at compile time. The projection kernels
+ *  (Camera::bearingToPixelModel, Camera::pixelToBearingModel) are templated on the model and call these directly, such
+ *  that the model is resolved once per projection instead of once per distortion call.
+ *
+ *  @tparam type - Distortion model.
+ */
+template<int type>
+struct CameraModel;
+
+template<>
+struct CameraModel<Camera::RADTAN>{
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out){
+    cam.distortRadtan(in,out);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J){
+    cam.distortRadtan(in,out,J);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index){
+    cam.distortRadtan(in,out);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index, Eigen::Matrix2d& J){
+    cam.distortRadtan(in,out,J);
+  }
+};
+
+template<>
+struct CameraModel<Camera::REFRAC>{
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out){
+    cam.distortRefractive(in,out);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J){
+    cam.distortRefractive(in,out,J);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index){
+    cam.distortRefractive(in,out,refrac_index);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index, Eigen::Matrix2d& J){
+    cam.distortRefractive(in,out,refrac_index,J);
+  }
+};
+
+template<>
+struct CameraModel<Camera::EQUIDIST>{
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out){
+    cam.distortEquidist(in,out);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J){
+    cam.distortEquidist(in,out,J);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index){
+    cam.distortEquidist(in,out);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index, Eigen::Matrix2d& J){
+    cam.distortEquidist(in,out,J);
+  }
+};
+
+template<>
+struct CameraModel<Camera::EQUIREFRAC>{
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out){
+    cam.distortEquiRefractive(in,out);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J){
+    cam.distortEquiRefractive(in,out,J);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index){
+    cam.distortEquiRefractive(in,out); // The refractive index of the camera is used (unchanged behavior).
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index, Eigen::Matrix2d& J){
+    cam.distortEquiRefractive(in,out,refrac_index,J);
+  }
+};
+
+template<>
+struct CameraModel<Camera::DS>{
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out){
+    cam.distortDoubleSphere(in,out);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J){
+    cam.distortDoubleSphere(in,out,J);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index){
+    cam.distortDoubleSphere(in,out);
+  }
+  static inline void distort(const Camera& cam, const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index, Eigen::Matrix2d& J){
+    cam.distortDoubleSphere(in,out,J);
+  }
+};
+
+
+  template<int type>
+  inline bool Camera::bearingToPixelModel(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>* J, Eigen::Matrix<double,2,1>* Jdpdn, const double* refrac_index) const{
+    // Project
+    if(vec(2)<=0) return false;
+    const Eigen::Vector2d undistorted = Eigen::Vector2d(vec(0)/vec(2),vec(1)/vec(2));
+
+    // Distort
+    Eigen::Vector2d distorted;
+    Eigen::Matrix2d J2;
+    Eigen::Matrix2d J_equi = Eigen::Matrix2d::Identity();
+    if(J == nullptr){
+      if(refrac_index == nullptr){
+        CameraModel<type>::distort(*this,undistorted,distorted);
+      } else {
+        CameraModel<type>::distort(*this,undistorted,distorted,*refrac_index);
+      }
+    } else if(Jdpdn != nullptr && type == EQUIREFRAC){
+      // temporary fix for equirefractive
+      Eigen::Matrix2d J_refrac;
+      distortEquiRefractive(undistorted,distorted,J_equi,J_refrac);
+      J2 = J_equi * J_refrac;
+    } else if(refrac_index == nullptr){
+      CameraModel<type>::distort(*this,undistorted,distorted,J2);
+    } else {
+      CameraModel<type>::distort(*this,undistorted,distorted,*refrac_index,J2);
+    }
+
+    // Shift origin and scale
+    c.x = static_cast<float>(K_(0, 0)*distorted(0) + K_(0, 2));
+    c.y = static_cast<float>(K_(1, 1)*distorted(1) + K_(1, 2));
+    if(J == nullptr) return true;
+
+    Eigen::Matrix<double,2,3> J1; J1.setZero();
+    J1(0,0) = 1.0/vec(2);
+    J1(0,2) = -vec(0)/pow(vec(2),2);
+    J1(1,1) = 1.0/vec(2);
+    J1(1,2) = -vec(1)/pow(vec(2),2);
+    Eigen::Matrix2d J3; J3.setZero();
+    J3(0,0) = K_(0, 0);
+    J3(1,1) = K_(1, 1);
+    *J = J3*J2*J1;
+    if(Jdpdn == nullptr) return true;
+
+    // Jacobian of distorted point w.r.t. refractive index
+    const double n = *refrac_index;
+    const double r2 = undistorted(0)*undistorted(0) + undistorted(1)*undistorted(1);
+    const double g = 1 + r2 - (n*n*r2);
+    // common_term = \frac{\g^{1/2}*n^2*r^2 + g^{3/2}}{g^2}
+    const double common_term = (sqrt(g)*n*n*r2 + pow(g, 1.5))/(g*g);
+    (*Jdpdn)(0) = undistorted(0)*common_term;
+    (*Jdpdn)(1) = undistorted(1)*common_term;
+    *Jdpdn = K_.block<2,2>(0,0)*J_equi*(*Jdpdn);
+    return true;
+  }
+
+  inline bool Camera::bearingToPixelDispatch(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>* J, Eigen::Matrix<double,2,1>* Jdpdn, const double* refrac_index) const{
+#ifdef ROVIO_CAMERA_MODEL
+    if(type_ == ROVIO_CAMERA_MODEL){
+      return bearingToPixelModel<ROVIO_CAMERA_MODEL>(vec,c,J,Jdpdn,refrac_index);
+    }
+#endif
+    return bearingToPixelRuntime(vec,c,J,Jdpdn,refrac_index);
+  }
+
+  inline bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c) const{
+    return bearingToPixelDispatch(vec,c,nullptr,nullptr,nullptr);
+  }
+
+  inline bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c, const double& refrac_index) const{
+    return bearingToPixelDispatch(vec,c,nullptr,nullptr,&refrac_index);
+  }
+
+  inline bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>& J) const{
+    return bearingToPixelDispatch(vec,c,&J,nullptr,nullptr);
+  }
+
+  inline bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>& J, const double& refrac_index) const{
+    return bearingToPixelDispatch(vec,c,&J,nullptr,&refrac_index);
+  }
+
+  inline bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>& J, Eigen::Matrix<double,2,1>& Jdpdn, const double& refrac_index) const{
+    return bearingToPixelDispatch(vec,c,&J,&Jdpdn,&refrac_index);
+  }
+
+  inline bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c) const{
+    return bearingToPixel(n.getVec(),c);
+  }
+
+  inline bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c, const double& refrac_index) const{
+    return bearingToPixel(n.getVec(),c,refrac_index);
+  }
+
+  inline bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c, Eigen::Matrix<double,2,2>& J) const{
+    Eigen::Matrix<double,2,3> J2;
+    const bool success = bearingToPixel(n.getVec(),c,J2);
+    J = J2*n.getM();
+    return success;
+  }
+
+  inline bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c, Eigen::Matrix<double,2,2>& J, const double& refrac_index) const{
+    Eigen::Matrix<double,2,3> J2;
+    const bool success = bearingToPixel(n.getVec(),c,J2,refrac_index);
+    J = J2*n.getM();
+    return success;
+  }
+
+  inline bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c, Eigen::Matrix<double,2,2>& J, Eigen::Matrix<double,2,1>& Jdpdn, const double& refrac_index) const{
+    Eigen::Matrix<double,2,3> J2;
+    const bool success = bearingToPixel(n.getVec(),c,J2,Jdpdn,refrac_index);
+    J = J2*n.getM();
+    return success;
+  }
+
+  template<int type, int N>
+  inline void Camera::bearingToPixelBatchModel(ProjectionBatch<N>& batch) const{
+    const double fx = K_(0, 0);
+    const double fy = K_(1, 1);
+    const double cx = K_(0, 2);
+    const double cy = K_(1, 2);
+    for(int i=0;i<batch.n_;i++){
+      // Project (entries behind the camera are evaluated at z = 1 and flagged invalid)
+      batch.valid_[i] = batch.z_[i] > 0;
+      const double iz = batch.valid_[i] ? 1.0/batch.z_[i] : 1.0;
+      const Eigen::Vector2d undistorted(batch.x_[i]*iz,batch.y_[i]*iz);
+
+      // Distort
+      Eigen::Vector2d distorted;
+      Eigen::Matrix2d J2;
+      CameraModel<type>::distort(*this,undistorted,distorted,J2);
+
+      // Shift origin and scale, J = diag(fx,fy)*J2*[iz 0 -x*iz^2; 0 iz -y*iz^2]
+      batch.u_[i] = fx*distorted(0) + cx;
+      batch.v_[i] = fy*distorted(1) + cy;
+      const double ux = undistorted(0)*iz;
+      const double uy = undistorted(1)*iz;
+      batch.J_[0][i] = fx*J2(0,0)*iz;
+      batch.J_[1][i] = fx*J2(0,1)*iz;
+      batch.J_[2][i] = -fx*(J2(0,0)*ux + J2(0,1)*uy);
+      batch.J_[3][i] = fy*J2(1,0)*iz;
+      batch.J_[4][i] = fy*J2(1,1)*iz;
+      batch.J_[5][i] = -fy*(J2(1,0)*ux + J2(1,1)*uy);
+    }
+  }
+
+  template<int N>
+  inline void Camera::bearingToPixelBatch(ProjectionBatch<N>& batch) const{
+#ifdef ROVIO_CAMERA_MODEL
+    if(type_ == ROVIO_CAMERA_MODEL){
+      bearingToPixelBatchModel<ROVIO_CAMERA_MODEL>(batch);
+      return;
+    }
+#endif
+    switch(type_){
+      case REFRAC:
+        bearingToPixelBatchModel<REFRAC>(batch);
+        break;
+      case EQUIDIST:
+        bearingToPixelBatchModel<EQUIDIST>(batch);
+        break;
+      case EQUIREFRAC:
+        bearingToPixelBatchModel<EQUIREFRAC>(batch);
+        break;
+      case DS:
+        bearingToPixelBatchModel<DS>(batch);
+        break;
+      default:
+        bearingToPixelBatchModel<RADTAN>(batch);
+        break;
+    }
+  }
+
+  template<int type>
+  inline bool Camera::undistortIterativeModel(const Eigen::Vector2d& y, Eigen::Vector2d& ybar, const int max_iter) const{
+    const double tolerance = 1e-10;
+    Eigen::Matrix2d J;
+    Eigen::Vector2d y_tmp; // current guess (distorted)
+    Eigen::Vector2d e;
+    Eigen::Vector2d du;
+    for (int i = 0; i < max_iter; i++) {
+      CameraModel<type>::distort(*this,ybar,y_tmp,J);
+      e = y - y_tmp;
+      du = (J.transpose() * J).inverse() * J.transpose() * e;
+      ybar += du;
+      if (e.dot(e) <= tolerance){
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template<int type>
+  inline bool Camera::pixelToBearingModel(const cv::Point2f& c,Eigen::Vector3d& vec) const{
+    // Shift origin and scale
+    Eigen::Vector2d y;
+    y(0) = (static_cast<double>(c.x) - K_(0, 2)) / K_(0, 0);
+    y(1) = (static_cast<double>(c.y) - K_(1, 2)) / K_(1, 1);
+
+    // Undistort by optimizing, the lookup table (if available) provides the initial guess and only a few polishing steps remain
+    Eigen::Vector2d ybar = y; // current guess (undistorted)
+    bool success = false;
+    if(lookupBearingLut(c,ybar)){
+      success = undistortIterativeModel<type>(y,ybar,5);
+      if(!success) ybar = y;
+    }
+    if(!success){
+      success = undistortIterativeModel<type>(y,ybar,100);
+    }
+    if(success){
+      y = ybar;
+      vec = Eigen::Vector3d(y(0),y(1),1.0).normalized();
+    }
+    return success;
+  }
+
+  inline bool Camera::pixelToBearing(const cv::Point2f& c,Eigen::Vector3d& vec) const{
+#ifdef ROVIO_CAMERA_MODEL
+    if(type_ == ROVIO_CAMERA_MODEL){
+      return pixelToBearingModel<ROVIO_CAMERA_MODEL>(c,vec);
+    }
+#endif
+    return pixelToBearingRuntime(c,vec);
+  }
+
+  inline bool Camera::pixelToBearing(const cv::Point2f& c,LWF::NormalVectorElement& n) const{
+    Eigen::Vector3d vec;
+    bool success;
+    if (type_==REFRAC || type_==EQUIREFRAC){
+      success = pixelToBearingAnalytical(c,vec);
+    }
+    else{
+      success = pixelToBearing(c,vec);
+    }
+
+    n.setFromVector(vec);
+    return success;
+  }
+
+}
+
+
+#endif /* ROVIO_CAMERAMODELS_HPP_ */
@@ -123,8 +123,8 @@ class TransformFeatureOutputCT:public LWF::CoordinateTransform<STATE,FeatureOutp
     mpMultiCamera_->transformFeature(outputCamID_,input.CfP(ID_),input.dep(ID_),output.c(),output.d());
     if(input.CfP(ID_).trackWarping_ && input.CfP(ID_).com_warp_nor()){
       const int& camID = input.CfP(ID_).camID_;
-      const QPD qDC = input.qCM(outputCamID_)*input.qCM(camID).inverted(); // TODO: avoid double computation
-      const V3D CrCD = input.qCM(camID).rotate(V3D(input.MrMC(outputCamID_)-input.MrMC(camID)));
+      const QPD& qDC = mpMultiCamera_->qDC_[outputCamID_][camID]; // Cached by updateMultiCameraExtrinsics
+      const V3D& CrCD = mpMultiCamera_->CrCD_[outputCamID_][camID];
       const V3D CrCP = input.dep(ID_).getDistance()*input.CfP(ID_).get_nor().getVec();
       const V3D DrDP = qDC.rotate(V3D(CrCP-CrCD));
       const double d_out = DrDP.norm();
@@ -141,8 +141,8 @@ class TransformFeatureOutputCT:public LWF::CoordinateTransform<STATE,FeatureOutp
     if(camID != outputCamID_){
       input.updateMultiCameraExtrinsics(mpMultiCamera_);
       // input.updateRefIndex(mpMultiCamera_);
-      const QPD qDC = input.qCM(outputCamID_)*input.qCM(camID).inverted(); // TODO: avoid double computation
-      const V3D CrCD = input.qCM(camID).rotate(V3D(input.MrMC(outputCamID_)-input.MrMC(camID)));
+      const QPD& qDC = mpMultiCamera_->qDC_[outputCamID_][camID]; // Cached by updateMultiCameraExtrinsics
+      const V3D& CrCD = mpMultiCamera_->CrCD_[outputCamID_][camID];
       const V3D CrCP = input.dep(ID_).getDistance()*input.CfP(ID_).get_nor().getVec();
       const V3D DrDP = qDC.rotate(V3D(CrCP-CrCD));
       const double d_out = DrDP.norm();
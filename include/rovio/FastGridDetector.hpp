@@ -0,0 +1,216 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_FASTGRIDDETECTOR_HPP_
+#define ROVIO_FASTGRIDDETECTOR_HPP_
+
+#include <algorithm>
+#include <vector>
+#include <opencv2/features2d/features2d.hpp>
+#include "rovio/ImagePyramid.hpp"
+
+namespace rovio{
+
+/** \brief Grid-bucketed FAST corner detector with per-cell adaptive thresholds.
+ *
+ *  The image of a pyramid level is divided into a regular grid. FAST is only run on cells which are not covered
+ *  by already tracked features and which intersect the valid image radius. In each cell the best
+ *  \ref maxPerCell_ corners (by FAST response) are retained, such that the number of candidates is bounded by
+ *  gridCols_*gridRows_*maxPerCell_ per level. The threshold of each cell is adapted over time: it is lowered if the
+ *  cell yields too few corners and raised if it yields many more than needed.
+ *
+ *  @tparam nLevels - Number of pyramid levels.
+ */
+template<int nLevels>
+class FastGridDetector{
+ public:
+  int gridCols_; /**<Number of grid cells along the image width.*/
+  int gridRows_; /**<Number of grid cells along the image height.*/
+  int maxPerCell_; /**<Maximal number of corners retained per cell.*/
+  int minThreshold_; /**<Lower bound for the adaptive FAST threshold.*/
+  int maxThreshold_; /**<Upper bound for the adaptive FAST threshold.*/
+  int thresholdStep_; /**<Step by which the threshold of a cell is adapted.*/
+
+  /** \brief Constructor.
+   */
+  FastGridDetector(){
+    gridCols_ = 8;
+    gridRows_ = 6;
+    maxPerCell_ = 3;
+    minThreshold_ = 4;
+    maxThreshold_ = 60;
+    thresholdStep_ = 2;
+  }
+
+  /** \brief Destructor.
+   */
+  virtual ~FastGridDetector(){}
+
+  /** \brief Detects FAST corners on a pyramid level.
+   *
+   * @param pyr                - Image pyramid.
+   * @param l                  - Pyramid level at which the corners should be extracted.
+   * @param initialThreshold   - Threshold used for cells which have not been processed before.
+   * @param occupied           - Pixel coordinates (on level 0) of already tracked features, the corresponding cells are skipped.
+   * @param candidates         - List of the extracted corner coordinates (defined on pyramid level 0), new corners are appended.
+   * @param valid_radius       - Radius inside which a feature is considered valid (as ratio of shortest image side)
+   */
+  void detect(const ImagePyramid<nLevels>& pyr, const int l, const int initialThreshold, const std::vector<cv::Point2f>& occupied,
+              FeatureCoordinatesVec& candidates, const double valid_radius = std::numeric_limits<double>::max()){
+    const cv::Mat& img = pyr.imgs_[l];
+    if(img.empty() || gridCols_ <= 0 || gridRows_ <= 0) return;
+    const int nCells = gridCols_*gridRows_;
+    const int cellW = (img.cols+gridCols_-1)/gridCols_;
+    const int cellH = (img.rows+gridRows_-1)/gridRows_;
+    if((int)thresholds_[l].size() != nCells){
+      thresholds_[l].assign(nCells,std::min(std::max(initialThreshold,minThreshold_),maxThreshold_));
+    }
+
+    // Mark cells which already contain a tracked feature
+    cellOccupied_.assign(nCells,false);
+    for(const auto& c : occupied){
+      const cv::Point2f cl = pyr.levelTranformCoordinates(FeatureCoordinates(c),0,l).get_c();
+      const int cx = (int)std::floor(cl.x/cellW);
+      const int cy = (int)std::floor(cl.y/cellH);
+      if(cx >= 0 && cx < gridCols_ && cy >= 0 && cy < gridRows_) cellOccupied_[cy*gridCols_+cx] = true;
+    }
+
+    const double centerX = img.cols/2.0;
+    const double centerY = img.rows/2.0;
+    const double max_valid_dist = valid_radius*std::min(img.cols, img.rows);
+    const double max_valid_dist2 = max_valid_dist*max_valid_dist;
+    const int border = 3; // FAST does not detect corners closer than 3 pixels to the image border
+    candidates.reserve(candidates.size()+nCells*maxPerCell_);
+    for(int cy=0;cy<gridRows_;cy++){
+      for(int cx=0;cx<gridCols_;cx++){
+        const int cellID = cy*gridCols_+cx;
+        if(cellOccupied_[cellID]) continue;
+        const cv::Rect cell(cx*cellW,cy*cellH,std::min(cellW,img.cols-cx*cellW),std::min(cellH,img.rows-cy*cellH));
+        if(cell.width <= 0 || cell.height <= 0) continue;
+
+        // Skip cells which lie completely outside of the valid radius
+        const double dx = std::max(0.0,std::max(cell.x-centerX,centerX-(cell.x+cell.width)));
+        const double dy = std::max(0.0,std::max(cell.y-centerY,centerY-(cell.y+cell.height)));
+        if(dx*dx+dy*dy > max_valid_dist2) continue;
+
+        // Detect on the cell extended by the FAST border (clamped to the image)
+        const int x0 = std::max(cell.x-border,0);
+        const int y0 = std::max(cell.y-border,0);
+        const int x1 = std::min(cell.x+cell.width+border,img.cols);
+        const int y1 = std::min(cell.y+cell.height+border,img.rows);
+        const cv::Mat roi = img(cv::Rect(x0,y0,x1-x0,y1-y0));
+        int& th = thresholds_[l][cellID];
+        detectInCell(roi,cv::Point2f(x0,y0),cell,th,centerX,centerY,max_valid_dist2);
+        const bool isRetried = cellKeypoints_.empty() && th > minThreshold_;
+        if(isRetried){
+          // Retry once with a lowered threshold (this is the adaptation of the cell for this frame)
+          th = std::max(th-thresholdStep_,minThreshold_);
+          detectInCell(roi,cv::Point2f(x0,y0),cell,th,centerX,centerY,max_valid_dist2);
+        }
+
+        // Adapt threshold for the next frame (at most one step per frame)
+        const int n = cellKeypoints_.size();
+        if(!isRetried){
+          if(n < maxPerCell_){
+            th = std::max(th-thresholdStep_,minThreshold_);
+          } else if(n > 4*maxPerCell_){
+            th = std::min(th+thresholdStep_,maxThreshold_);
+          }
+        }
+
+        // Retain the best corners of the cell
+        if(n > maxPerCell_){
+          std::partial_sort(cellKeypoints_.begin(),cellKeypoints_.begin()+maxPerCell_,cellKeypoints_.end(),
+                            [](const cv::KeyPoint& a, const cv::KeyPoint& b){return a.response > b.response;});
+          cellKeypoints_.resize(maxPerCell_);
+        }
+        for(const auto& kp : cellKeypoints_){
+          candidates.push_back(pyr.levelTranformCoordinates(FeatureCoordinates(kp.pt),l,0));
+        }
+      }
+    }
+  }
+
+  /** \brief Resets the adaptive thresholds (they get reinitialized at the next detection).
+   */
+  void reset(){
+    for(int l=0;l<nLevels;l++){
+      thresholds_[l].clear();
+    }
+  }
+
+  /** \brief Copies the adaptive thresholds out (e.g. to restore them after a rollback of the filter).
+   *
+   * @param thresholds - Thresholds of each cell, per level.
+   */
+  void getThresholds(std::vector<int> (&thresholds)[nLevels]) const{
+    for(int l=0;l<nLevels;l++){
+      thresholds[l] = thresholds_[l];
+    }
+  }
+
+  /** \brief Sets the adaptive thresholds, see \ref getThresholds.
+   *
+   * @param thresholds - Thresholds of each cell, per level.
+   */
+  void setThresholds(const std::vector<int> (&thresholds)[nLevels]){
+    for(int l=0;l<nLevels;l++){
+      thresholds_[l] = thresholds[l];
+    }
+  }
+
+ private:
+  /** \brief Runs FAST on an image region and keeps the corners lying inside the cell and the valid radius.
+   *
+   *  The result is stored in \ref cellKeypoints_ (in level coordinates).
+   */
+  void detectInCell(const cv::Mat& roi, const cv::Point2f& offset, const cv::Rect& cell, const int th,
+                    const double centerX, const double centerY, const double max_valid_dist2){
+    keypoints_.clear();
+    cellKeypoints_.clear();
+    cv::FAST(roi,keypoints_,th,true);
+    for(auto& kp : keypoints_){
+      kp.pt += offset;
+      if(kp.pt.x < cell.x || kp.pt.y < cell.y || kp.pt.x >= cell.x+cell.width || kp.pt.y >= cell.y+cell.height) continue;
+      const double x_dist = kp.pt.x - centerX;
+      const double y_dist = kp.pt.y - centerY;
+      if(x_dist*x_dist + y_dist*y_dist > max_valid_dist2) continue;
+      cellKeypoints_.push_back(kp);
+    }
+  }
+
+  std::vector<int> thresholds_[nLevels]; /**<Adaptive FAST threshold of each cell, per level.*/
+  std::vector<bool> cellOccupied_; /**<Temporary, cells containing tracked features.*/
+  std::vector<cv::KeyPoint> keypoints_; /**<Temporary, corners of the extended cell.*/
+  std::vector<cv::KeyPoint> cellKeypoints_; /**<Temporary, valid corners of the cell.*/
+};
+
+}
+
+
+#endif /* ROVIO_FASTGRIDDETECTOR_HPP_ */
@@ -173,6 +173,13 @@ class FeatureCoordinates{
    */
   void set_nor(const LWF::NormalVectorElement& nor, const bool resetWarp = true);
 
+  /** \brief Stores the pixel coordinates \ref c_ of the current (valid) bearing vector, as computed outside of the
+   *         class (e.g. by Camera::bearingToPixelBatch). The bearing vector and the warping stay valid.
+   *
+   *  @param c - Projection of \ref nor_ into the camera.
+   */
+  void set_projected_c(const cv::Point2f& c);
+
   /** \brief Compute the pixel warping. If necessary derives it from the bearing warping.
    *
    * @return Whether the computation was successfull.
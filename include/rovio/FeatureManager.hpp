@@ -122,6 +122,101 @@ class FeatureManager{
 };
 
 
+/** \brief Flat bucket structure used for the candidate selection.
+ *
+ *  Every bucket is an intrusive doubly linked list over the candidate indices, stored in preallocated arrays.
+ *  After the first use no allocations are done as long as the number of buckets and candidates does not grow.
+ *  Copying does not copy the content (it is a pure temporary).
+ */
+class CandidateBuckets{
+ public:
+  CandidateBuckets(){}
+  CandidateBuckets(const CandidateBuckets&){}
+  CandidateBuckets& operator=(const CandidateBuckets&){
+    return *this;
+  }
+
+  /** \brief Empties all buckets and prepares the structure for a given number of buckets and candidates.
+   */
+  void reset(const int nBuckets, const int nCandidates){
+    head_.assign(nBuckets,-1);
+    next_.assign(nCandidates,-1);
+    prev_.assign(nCandidates,-1);
+    bucket_.assign(nCandidates,-1);
+  }
+
+  /** \brief Inserts a candidate (which is not in a bucket) into a bucket.
+   */
+  void insert(const int bucketID, const int i){
+    bucket_[i] = bucketID;
+    prev_[i] = -1;
+    next_[i] = head_[bucketID];
+    if(head_[bucketID] != -1) prev_[head_[bucketID]] = i;
+    head_[bucketID] = i;
+  }
+
+  /** \brief Removes a candidate from its bucket.
+   */
+  void erase(const int i){
+    const int bucketID = bucket_[i];
+    if(bucketID < 0) return;
+    if(prev_[i] != -1){
+      next_[prev_[i]] = next_[i];
+    } else {
+      head_[bucketID] = next_[i];
+    }
+    if(next_[i] != -1) prev_[next_[i]] = prev_[i];
+    bucket_[i] = -1;
+  }
+
+  /** \brief Moves a candidate into another bucket.
+   */
+  void move(const int i, const int bucketID){
+    erase(i);
+    insert(bucketID,i);
+  }
+
+  /** \brief Returns the first candidate of a bucket (-1 if empty).
+   */
+  int front(const int bucketID) const{
+    return head_[bucketID];
+  }
+
+  /** \brief Returns the candidate following i in its bucket (-1 if last).
+   */
+  int next(const int i) const{
+    return next_[i];
+  }
+
+  bool empty(const int bucketID) const{
+    return head_[bucketID] == -1;
+  }
+
+ private:
+  std::vector<int> head_;
+  std::vector<int> next_;
+  std::vector<int> prev_;
+  std::vector<int> bucket_;
+};
+
+/** \brief Temporaries for the candidate selection (see FeatureSetManager::addBestCandidates).
+ *
+ *  Copying does not copy the content, such that copying the FeatureSetManager stays cheap.
+ */
+template<int nLevels,int patchSize>
+class CandidateSelectionBuffer{
+ public:
+  CandidateSelectionBuffer(){}
+  CandidateSelectionBuffer(const CandidateSelectionBuffer&){}
+  CandidateSelectionBuffer& operator=(const CandidateSelectionBuffer&){
+    return *this;
+  }
+  Patch<patchSize> patch_; /**<Single level patch used for the cheap pre-scoring.*/
+  std::vector<std::pair<float,int>> preScores_; /**<Pairs of pre-score and candidate index.*/
+  std::vector<MultilevelPatch<nLevels,patchSize>> patches_; /**<Multilevel patches of the surviving candidates.*/
+  CandidateBuckets buckets_; /**<Buckets over the surviving candidates.*/
+};
+
 /** \brief Class, storing and handling multiple features
  *
  * @tparam nLevels   - Total number of pyramid levels for each MultilevelPatchFeature in the set.
@@ -136,6 +231,7 @@ class FeatureSetManager{
   bool isValid_[nMax];  /**<Array, defining if there is a valid MultilevelPatchFeature at the considered array index. */
   int maxIdx_;  /**<Current maximum array/set index. Number of MultilevelPatchFeature, which have already been inserted into the set. */
   const MultiCamera<nCam>* mpMultiCamera_;
+  CandidateSelectionBuffer<nLevels,patchSize> candidateBuffer_;  /**<Temporaries of addBestCandidates.*/
 
   /** \brief Constructor
    */
@@ -247,9 +343,10 @@ class FeatureSetManager{
 
   /** \brief Adds the best MultilevelPatchFeature%s from a candidates list to an existing MultilevelPatchSet.
    *
-   *  This function takes a given feature candidate list and builds, in a first step,
-   *  MultilevelPatchFeature%s out of it using a given image pyramid. For each MultilevelPatchFeature the
-   *  corresponding Shi-Tomasi Score is computed.
+   *  This function takes a given feature candidate list and, if there are more than cullingFactor*maxAddedFeature
+   *  candidates, pre-scores them with the Shi-Tomasi score of a single patch at level l1 and only keeps the best ones.
+   *  For the remaining candidates it builds MultilevelPatchFeature%s using a given image pyramid and computes the
+   *  corresponding Shi-Tomasi Score.
    *  In a second step, the candidate MultilevelPatchFeature%s are sorted and
    *  placed into buckets, depending on their individual Shi-Tomasi Score. MultilevelPatchFeature%s in a high bucket
    *  (high bucket index) have higher Shi-Tomasi Scores than MultilevelPatchFeature%s which have been placed into a
@@ -275,6 +372,7 @@ class FeatureSetManager{
    * @param requireMax             - Should the adding of maxAddedFeature be enforced?
    * @param minScore               - Shi-Tomasi Score threshold for the best (highest Shi-Tomasi Score) MultilevelPatchFeature extracted from the candidates list.
    *                                 If the best MultilevelPatchFeature has a Shi-Tomasi Score less than or equal this threshold, the function aborts and returns an empty map.
+   * @param cullingFactor          - At most cullingFactor*maxAddedFeature candidates are fully evaluated (if <= 0 all candidates are evaluated).
    *
    * @return an unordered_set, holding the indizes of the MultilevelPatchSet, at which the new MultilevelPatchFeature%s have been added (from the candidates list).
    */
@@ -283,44 +381,65 @@ class FeatureSetManager{
   // @todo check inFrame, only if COVARIANCE not too large
   std::unordered_set<unsigned int> addBestCandidates(const FeatureCoordinatesVec& candidates, const ImagePyramid<nLevels>& pyr, const int camID, const double initTime,
                                                      const int l1, const int l2, const int maxAddedFeature, const int nDetectionBuckets, const double scoreDetectionExponent,
-                                                     const double penaltyDistance, const double zeroDistancePenalty, const bool requireMax, const float minScore){
+                                                     const double penaltyDistance, const double zeroDistancePenalty, const bool requireMax, const float minScore,
+                                                     const double cullingFactor = 0.0){
     std::unordered_set<unsigned int> newFeatureIDs;
-    std::vector<MultilevelPatch<nLevels,patchSize>> multilevelPatches;
-    multilevelPatches.reserve(candidates.size());
-
-    // Create MultilevelPatches from the candidates list and compute their Shi-Tomasi Score.
-    float maxScore = -1.0;
+    std::vector<std::pair<float,int>>& preScores = candidateBuffer_.preScores_;
+    std::vector<MultilevelPatch<nLevels,patchSize>>& multilevelPatches = candidateBuffer_.patches_;
+    CandidateBuckets& buckets = candidateBuffer_.buckets_;
+
+    // Pre-score the candidates lying in the frame (single level patch), only if culling is required.
+    const int maxEvaluated = cullingFactor > 0.0 ? std::max((int)std::ceil(cullingFactor*maxAddedFeature),1) : (int)candidates.size();
+    const bool doCulling = (int)candidates.size() > maxEvaluated;
+    preScores.clear();
     for(int i=0;i<candidates.size();i++){
-      multilevelPatches.emplace_back();
-      if(multilevelPatches.back().isMultilevelPatchInFrame(pyr,candidates[i],l2,true)){
-        multilevelPatches.back().extractMultilevelPatchFromImage(pyr,candidates[i],l2,true);
-        multilevelPatches.back().computeMultilevelShiTomasiScore(l1,l2);
-        if(multilevelPatches.back().s_ > maxScore) maxScore = multilevelPatches.back().s_;
-      } else {
-        multilevelPatches.back().s_ = -1;
+      if(MultilevelPatch<nLevels,patchSize>::isMultilevelPatchInFrame(pyr,candidates[i],l2,true)){
+        float preScore = 0.0;
+        if(doCulling){
+          const FeatureCoordinates c = pyr.levelTranformCoordinates(candidates[i],0,l1);
+          if(!Patch<patchSize>::isPatchInFrame(pyr.imgs_[l1],c,true)) continue;
+          candidateBuffer_.patch_.extractPatchFromImage(pyr.imgs_[l1],c,true);
+          preScore = candidateBuffer_.patch_.getScore();
+        }
+        preScores.emplace_back(preScore,i);
       }
     }
+    if((int)preScores.size() > maxEvaluated){
+      std::nth_element(preScores.begin(),preScores.begin()+maxEvaluated,preScores.end(),
+                       [](const std::pair<float,int>& a, const std::pair<float,int>& b){return a.first > b.first;});
+      preScores.resize(maxEvaluated);
+    }
+
+    // Create MultilevelPatches from the surviving candidates and compute their Shi-Tomasi Score.
+    const int nSurvivors = preScores.size();
+    if(multilevelPatches.size() < nSurvivors) multilevelPatches.resize(nSurvivors);
+    float maxScore = -1.0;
+    for(int k=0;k<nSurvivors;k++){
+      multilevelPatches[k].reset();
+      multilevelPatches[k].extractMultilevelPatchFromImage(pyr,candidates[preScores[k].second],l2,true);
+      multilevelPatches[k].computeMultilevelShiTomasiScore(l1,l2);
+      if(multilevelPatches[k].s_ > maxScore) maxScore = multilevelPatches[k].s_;
+    }
     if(maxScore <= minScore){
       return newFeatureIDs;
     }
 
-    // Make buckets and fill based on score
-    std::vector<std::unordered_set<int>> buckets(nDetectionBuckets,std::unordered_set<int>());
+    // Make buckets and fill based on score (buckets hold survivor indices k)
+    buckets.reset(nDetectionBuckets,nSurvivors);
     unsigned int newBucketID;
     float relScore;
-    for(int i=0;i<candidates.size();i++){
-      relScore = (multilevelPatches[i].s_-minScore)/(maxScore-minScore);
+    for(int k=0;k<nSurvivors;k++){
+      relScore = (multilevelPatches[k].s_-minScore)/(maxScore-minScore);
       if(relScore > 0.0){
         newBucketID = std::ceil((nDetectionBuckets-1)*(pow(relScore,static_cast<float>(scoreDetectionExponent))));
         if(newBucketID>nDetectionBuckets-1) newBucketID = nDetectionBuckets-1;
-        buckets[newBucketID].insert(i);
+        buckets.insert(newBucketID,k);
       }
     }
 
     // Move buckets based on current features
     double d2;
     double t2 = pow(penaltyDistance,2);
-    bool doDelete;
     FeatureCoordinates featureCoordinates;
     FeatureDistance featureDistance;
     for(unsigned int i=0;i<nMax;i++){
@@ -328,22 +447,17 @@ class FeatureSetManager{
         mpMultiCamera_->transformFeature(camID,*(features_[i].mpCoordinates_),*(features_[i].mpDistance_),featureCoordinates,featureDistance);
         if(featureCoordinates.isInFront()){
           for (unsigned int bucketID = 1;bucketID < nDetectionBuckets;bucketID++) {
-            for (auto it_cand = buckets[bucketID].begin();it_cand != buckets[bucketID].end();) {
-              doDelete = false;
-              
-              d2 = std::pow(featureCoordinates.get_c().x - candidates[*it_cand].get_c().x,2) + std::pow(featureCoordinates.get_c().y - candidates[*it_cand].get_c().y,2);  // Squared distance between the existing feature and the candidate feature.
+            for (int k = buckets.front(bucketID);k != -1;) {
+              const int next = buckets.next(k);
+              const cv::Point2f& c = candidates[preScores[k].second].get_c();
+              d2 = std::pow(featureCoordinates.get_c().x - c.x,2) + std::pow(featureCoordinates.get_c().y - c.y,2);  // Squared distance between the existing feature and the candidate feature.
               if(d2<t2){
                 newBucketID = std::max((int)(bucketID - (t2-d2)/t2*zeroDistancePenalty),0);
                 if(bucketID != newBucketID){
-                  buckets[newBucketID].insert(*it_cand);
-                  doDelete = true;
+                  buckets.move(k,newBucketID);
                 }
               }
-              if(doDelete){
-                buckets[bucketID].erase(it_cand++);
-              } else {
-                ++it_cand;
-              }
+              k = next;
             }
           }
         }
@@ -353,35 +467,32 @@ class FeatureSetManager{
     // Incrementally add features and update candidate buckets (Check distance of candidates with respect to the newly inserted feature).
     int addedCount = 0;
     for (int bucketID = nDetectionBuckets-1;bucketID >= 0+static_cast<int>(!requireMax);bucketID--) {
-      while(!buckets[bucketID].empty() && addedCount < maxAddedFeature && getValidCount() != nMax) {
-        const int nf = *(buckets[bucketID].begin());
-        buckets[bucketID].erase(nf);
+      while(!buckets.empty(bucketID) && addedCount < maxAddedFeature && getValidCount() != nMax) {
+        const int nk = buckets.front(bucketID);
+        const int nf = preScores[nk].second;
+        buckets.erase(nk);
         const int ind = makeNewFeature(camID);
         features_[ind].mpCoordinates_->set_c(candidates[nf].get_c());
         features_[ind].mpCoordinates_->camID_ = camID;
         features_[ind].mpCoordinates_->set_warp_identity();
         features_[ind].mpCoordinates_->mpCamera_ = &mpMultiCamera_->cameras_[camID];
-        *(features_[ind].mpMultilevelPatch_) = multilevelPatches[nf];
+        *(features_[ind].mpMultilevelPatch_) = multilevelPatches[nk];
         if(ind >= 0){
           newFeatureIDs.insert(ind);
         }
         addedCount++;
         for (unsigned int bucketID2 = 1;bucketID2 <= bucketID;bucketID2++) {
-          for (auto it_cand = buckets[bucketID2].begin();it_cand != buckets[bucketID2].end();) {
-            doDelete = false;
-            d2 = std::pow(candidates[nf].get_c().x - candidates[*it_cand].get_c().x,2) + std::pow(candidates[nf].get_c().y - candidates[*it_cand].get_c().y,2);
+          for (int k = buckets.front(bucketID2);k != -1;) {
+            const int next = buckets.next(k);
+            const cv::Point2f& c = candidates[preScores[k].second].get_c();
+            d2 = std::pow(candidates[nf].get_c().x - c.x,2) + std::pow(candidates[nf].get_c().y - c.y,2);
             if(d2<t2){
               newBucketID = std::max((int)(bucketID2 - (t2-d2)/t2*zeroDistancePenalty),0);
               if(bucketID2 != newBucketID){
-                buckets[newBucketID].insert(*it_cand);
-                doDelete = true;
+                buckets.move(k,newBucketID);
               }
             }
-            if(doDelete){
-              buckets[bucketID2].erase(it_cand++);
-            } else {
-              ++it_cand;
-            }
+            k = next;
           }
         }
       }
@@ -59,6 +59,7 @@ class FeatureStatistics{
   double jointLocalVisibility_; /**Quality value in the range [0, 1], 1 means that the feature was always visible in some frame.*/
   int minGlobalQualityRange_; /**Minimum of frames for maximal quality.*/
   double lastPatchUpdate_;   /**<Time of last patch update.*/
+  int alignIterations_[nCam];   /**<Number of Gauss-Newton iterations of the last alignment in each camera (for profiling).*/
 
   /** \brief Get the local visibility quality of the MultilevelPatchFeature.
    *
@@ -97,6 +98,7 @@ class FeatureStatistics{
       status_[i] = UNKNOWN;
       localQuality_[i] = 1.0;
       localVisibility_[i] = 1.0;
+      alignIterations_[i] = 0;
     }
     totCount_ = 0;
     trackedCount_ = 0;
@@ -144,6 +146,7 @@ class FeatureStatistics{
       cumulativeTrackingStatus_[i][status_[i]]++;
       statistics_[i][currentTime_] = status_[i];
       status_[i] = UNKNOWN;
+      alignIterations_[i] = 0;
     }
     totCount_++;
     currentTime_ = currentTime;
@@ -0,0 +1,446 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_FILTERCHECKPOINT_HPP_
+#define ROVIO_FILTERCHECKPOINT_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lightweight_filtering/common.hpp"
+#include "rovio/FeatureCoordinates.hpp"
+#include "rovio/FeatureDistance.hpp"
+#include "rovio/FeatureStatistics.hpp"
+#include "rovio/MultiCamera.hpp"
+#include "rovio/MultilevelPatch.hpp"
+
+namespace rovio{
+
+/** \brief Header at the beginning of a checkpoint file.
+ *
+ *  The header is followed by the core states, the features (one block per slot of the feature set) and the
+ *  full covariance matrix (row-major), all in native byte order (see \ref byteOrder_).
+ */
+struct FilterCheckpointHeader{
+  char magic_[8]; /**<"ROVIOCKP".*/
+  uint32_t version_;
+  uint32_t byteOrder_; /**<0x01020304 in the byte order of the writer.*/
+  uint32_t nMax_; /**<Number of features of the filter state.*/
+  uint32_t nLevels_; /**<Number of pyramid levels of the patches.*/
+  uint32_t patchSize_; /**<Patch size.*/
+  uint32_t nCam_; /**<Number of cameras.*/
+  uint32_t nPose_; /**<Number of additional poses.*/
+  uint32_t stateDim_; /**<Dimension of the error state.*/
+  uint32_t doVECalibration_; /**<If non-zero, the extrinsics are estimated.*/
+  double t_; /**<Time of the filter state.*/
+};
+
+/** \brief Binary checkpoint of a filter state, used for warm restarts.
+ *
+ *  Holds the state with the converged calibration (IMU biases, extrinsics and refractive index), the full covariance
+ *  and the features with their patches. Tracking statistics are not stored, they restart on \ref restore.
+ *  \ref capture is cheap (copies only), \ref save and \ref load do the file I/O and can run on another thread.
+ *
+ *  @tparam FILTERSTATE - Filter state.
+ */
+template<typename FILTERSTATE>
+class FilterCheckpoint{
+ public:
+  typedef typename FILTERSTATE::mtState mtState;
+  static constexpr uint32_t version_ = 2;
+  static constexpr uint32_t byteOrder_ = 0x01020304;
+  static constexpr int nLevels_ = mtState::nLevels_;
+  static constexpr int patchSize_ = mtState::patchSize_;
+
+  double t_; /**<Time of the captured filter state.*/
+  mtState state_; /**<Captured state.*/
+  MXD cov_; /**<Captured covariance.*/
+  bool isValid_[mtState::nMax_]; /**<Valid features.*/
+  int idx_[mtState::nMax_]; /**<Feature IDs.*/
+  int maxIdx_; /**<Next feature ID of the feature set.*/
+  MultilevelPatch<nLevels_,patchSize_> patches_[mtState::nMax_]; /**<Patches of the features.*/
+
+  /** \brief Constructor.
+   */
+  FilterCheckpoint(): t_(0.0), cov_((int)(mtState::D_),(int)(mtState::D_)), maxIdx_(0){
+    cov_.setZero();
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      isValid_[i] = false;
+      idx_[i] = -1;
+    }
+  }
+
+  /** \brief Copies a filter state into the checkpoint.
+   *
+   *   @param filterState - Filter state.
+   */
+  void capture(const FILTERSTATE& filterState){
+    t_ = filterState.t_;
+    state_ = filterState.state_;
+    cov_ = filterState.cov_;
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      isValid_[i] = filterState.fsm_.isValid_[i];
+      if(!isValid_[i]) continue;
+      idx_[i] = filterState.fsm_.features_[i].idx_;
+      patches_[i] = *filterState.fsm_.features_[i].mpMultilevelPatch_;
+    }
+    maxIdx_ = filterState.fsm_.maxIdx_;
+  }
+
+  /** \brief Writes the checkpoint to a file.
+   *
+   *   The data is written to filename.tmp, which is synced to disk (together with its directory) and renamed on
+   *   success, such that an existing checkpoint is only replaced by a complete one, also across power losses.
+   *
+   *   @param filename - Checkpoint file.
+   *   @return false if the file could not be written.
+   */
+  bool save(const std::string& filename) const{
+    const std::string tmpFilename = filename + ".tmp";
+    {
+      std::ofstream os(tmpFilename, std::ios::binary | std::ios::trunc);
+      if(!os) return false;
+      FilterCheckpointHeader header;
+      memset(&header,0,sizeof(header));
+      memcpy(header.magic_,"ROVIOCKP",8);
+      header.version_ = version_;
+      header.byteOrder_ = byteOrder_;
+      header.nMax_ = mtState::nMax_;
+      header.nLevels_ = nLevels_;
+      header.patchSize_ = patchSize_;
+      header.nCam_ = mtState::nCam_;
+      header.nPose_ = mtState::nPose_;
+      header.stateDim_ = mtState::D_;
+      header.doVECalibration_ = state_.aux().doVECalibration_ ? 1 : 0;
+      header.t_ = t_;
+      writeRaw(os,header);
+      writeVector(os,state_.WrWM());
+      writeVector(os,state_.MvM());
+      writeVector(os,state_.acb());
+      writeVector(os,state_.gyb());
+      writeQuaternion(os,state_.qWM());
+      for(int camID=0;camID<mtState::nCam_;camID++){
+        writeVector(os,state_.template get<mtState::_vep>(camID));
+        writeQuaternion(os,state_.template get<mtState::_vea>(camID));
+      }
+      writeRaw(os,state_.ref());
+      for(int i=0;i<mtState::nPose_;i++){
+        writeVector(os,state_.poseLin(i));
+        writeQuaternion(os,state_.poseRot(i));
+      }
+      writeRaw(os,static_cast<int32_t>(maxIdx_));
+      for(unsigned int i=0;i<mtState::nMax_;i++){
+        writeRaw(os,static_cast<uint8_t>(isValid_[i] ? 1 : 0));
+        if(!isValid_[i]) continue;
+        const FeatureCoordinates& c = state_.CfP(i);
+        writeRaw(os,static_cast<int32_t>(idx_[i]));
+        writeRaw(os,static_cast<int32_t>(c.camID_));
+        writeQuaternion(os,c.get_nor().q_);
+        writeRaw(os,static_cast<uint8_t>(c.valid_warp_nor_ ? 1 : 0));
+        os.write(reinterpret_cast<const char*>(c.warp_nor_.data()),4*sizeof(double));
+        writeRaw(os,static_cast<int32_t>(state_.dep(i).type_));
+        writeRaw(os,state_.dep(i).p_);
+        for(int l=0;l<nLevels_;l++){
+          writeRaw(os,static_cast<uint8_t>(patches_[i].isValidPatch_[l] ? 1 : 0));
+          os.write(reinterpret_cast<const char*>(patches_[i].patches_[l].patch_),sizeof(patches_[i].patches_[l].patch_));
+          os.write(reinterpret_cast<const char*>(patches_[i].patches_[l].patchWithBorder_),sizeof(patches_[i].patches_[l].patchWithBorder_));
+        }
+        writeRaw(os,patches_[i].s_);
+      }
+      for(int r=0;r<mtState::D_;r++){
+        for(int c=0;c<mtState::D_;c++){
+          writeRaw(os,cov_(r,c));
+        }
+      }
+      os.flush();
+      if(!os) return false;
+    }
+    const size_t slash = filename.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : filename.substr(0,slash));
+    if(!syncPath(tmpFilename,O_WRONLY) || !syncPath(directory,O_RDONLY)) return false;
+    if(std::rename(tmpFilename.c_str(),filename.c_str()) != 0) return false;
+    return syncPath(directory,O_RDONLY); // Persist the rename
+  }
+
+  /** \brief Reads the checkpoint from a file.
+   *
+   *   @param filename - Checkpoint file.
+   *   @param error    - Reason if the checkpoint could not be read.
+   *   @return false if the file could not be read or was written by a filter with different dimensions.
+   */
+  bool load(const std::string& filename, std::string& error){
+    std::ifstream is(filename, std::ios::binary);
+    if(!is){
+      error = "cannot open file";
+      return false;
+    }
+    FilterCheckpointHeader header;
+    if(!readRaw(is,header) || memcmp(header.magic_,"ROVIOCKP",8) != 0){
+      error = "not a checkpoint file";
+      return false;
+    }
+    if(header.version_ != version_){
+      error = "unsupported version " + std::to_string(header.version_);
+      return false;
+    }
+    if(header.byteOrder_ != byteOrder_){
+      error = "written on a machine with a different byte order";
+      return false;
+    }
+    if(header.nMax_ != mtState::nMax_ || header.nLevels_ != nLevels_ || header.patchSize_ != patchSize_
+        || header.nCam_ != mtState::nCam_ || header.nPose_ != mtState::nPose_ || header.stateDim_ != mtState::D_){
+      error = "written by a filter with different dimensions";
+      return false;
+    }
+    t_ = header.t_;
+    state_.aux().doVECalibration_ = header.doVECalibration_ != 0;
+    readVector(is,state_.WrWM());
+    readVector(is,state_.MvM());
+    readVector(is,state_.acb());
+    readVector(is,state_.gyb());
+    readQuaternion(is,state_.qWM());
+    for(int camID=0;camID<mtState::nCam_;camID++){
+      readVector(is,state_.template get<mtState::_vep>(camID));
+      readQuaternion(is,state_.template get<mtState::_vea>(camID));
+    }
+    readRaw(is,state_.ref());
+    for(int i=0;i<mtState::nPose_;i++){
+      readVector(is,state_.poseLin(i));
+      readQuaternion(is,state_.poseRot(i));
+    }
+    int32_t maxIdx = 0;
+    readRaw(is,maxIdx);
+    maxIdx_ = maxIdx;
+    for(unsigned int i=0;i<mtState::nMax_ && is;i++){
+      uint8_t isValid = 0;
+      readRaw(is,isValid);
+      isValid_[i] = isValid != 0;
+      if(!isValid_[i]) continue;
+      FeatureCoordinates& c = state_.CfP(i);
+      int32_t idx = 0, camID = 0, type = 0;
+      uint8_t validWarp = 0;
+      readRaw(is,idx);
+      readRaw(is,camID);
+      idx_[i] = idx;
+      c.camID_ = camID;
+      readQuaternion(is,c.nor_.q_);
+      c.valid_nor_ = true;
+      c.valid_c_ = false;
+      readRaw(is,validWarp);
+      is.read(reinterpret_cast<char*>(c.warp_nor_.data()),4*sizeof(double));
+      c.valid_warp_nor_ = validWarp != 0;
+      c.valid_warp_c_ = false;
+      readRaw(is,type);
+      state_.dep(i).setType(static_cast<int>(type));
+      readRaw(is,state_.dep(i).p_);
+      patches_[i].reset();
+      for(int l=0;l<nLevels_;l++){
+        uint8_t isValidPatch = 0;
+        readRaw(is,isValidPatch);
+        patches_[i].isValidPatch_[l] = isValidPatch != 0;
+        is.read(reinterpret_cast<char*>(patches_[i].patches_[l].patch_),sizeof(patches_[i].patches_[l].patch_));
+        is.read(reinterpret_cast<char*>(patches_[i].patches_[l].patchWithBorder_),sizeof(patches_[i].patches_[l].patchWithBorder_));
+        patches_[i].patches_[l].validGradientParameters_ = false;
+      }
+      readRaw(is,patches_[i].s_);
+    }
+    for(int r=0;r<mtState::D_;r++){
+      for(int c=0;c<mtState::D_;c++){
+        readRaw(is,cov_(r,c));
+      }
+    }
+    if(!is){
+      error = "file is truncated";
+      return false;
+    }
+    return true;
+  }
+
+  /** \brief Writes the checkpoint into a (freshly reset) filter state.
+   *
+   *  The time of the filter state is kept. A full restore replaces the state, the covariance and the features, a
+   *  calibration restore only sets the IMU biases, the extrinsics (if estimated by both) and the refractive index
+   *  together with their covariance block and keeps the rest of the reset state. The extrinsics are only restored if
+   *  they are estimated by both the checkpoint and the filter state, otherwise the configured ones are kept.
+   *
+   *   @param filterState     - Filter state, should be reset.
+   *   @param mpMultiCamera   - Cameras of the filter.
+   *   @param calibrationOnly - Restore only the calibration states.
+   *   @param error           - Reason if the checkpoint could not be restored.
+   *   @return false if nothing was restored.
+   */
+  bool restore(FILTERSTATE& filterState, MultiCamera<mtState::nCam_>* mpMultiCamera, const bool calibrationOnly, std::string& error) const{
+    mtState& state = filterState.state_;
+    const bool restoreExtrinsics = state.aux().doVECalibration_ && state_.aux().doVECalibration_;
+    if(!calibrationOnly){
+      for(unsigned int i=0;i<mtState::nMax_;i++){
+        if(isValid_[i] && state_.dep(i).type_ != state.dep(i).type_){
+          error = "features use a different depth parametrization";
+          return false;
+        }
+      }
+    }
+
+    // Calibration
+    state.acb() = state_.acb();
+    state.gyb() = state_.gyb();
+    state.ref() = state_.ref();
+    if(restoreExtrinsics){
+      for(int camID=0;camID<mtState::nCam_;camID++){
+        state.template get<mtState::_vep>(camID) = state_.template get<mtState::_vep>(camID);
+        state.template get<mtState::_vea>(camID) = state_.template get<mtState::_vea>(camID);
+      }
+    }
+    if(calibrationOnly){
+      std::vector<int> ids;
+      for(int j=0;j<3;j++){
+        ids.push_back(mtState::template getId<mtState::_acb>()+j);
+        ids.push_back(mtState::template getId<mtState::_gyb>()+j);
+      }
+      ids.push_back(mtState::template getId<mtState::_ref>());
+      if(restoreExtrinsics){
+        for(int camID=0;camID<mtState::nCam_;camID++){
+          for(int j=0;j<3;j++){
+            ids.push_back(mtState::template getId<mtState::_vep>(camID)+j);
+            ids.push_back(mtState::template getId<mtState::_vea>(camID)+j);
+          }
+        }
+      }
+      for(int a : ids){
+        filterState.cov_.row(a).setZero();
+        filterState.cov_.col(a).setZero();
+      }
+      for(int a : ids){
+        for(int b : ids){
+          filterState.cov_(a,b) = cov_(a,b);
+        }
+      }
+      state.updateRefIndex(mpMultiCamera);  // Forced (no epsilon): the cameras must match the restored index exactly
+      return true;
+    }
+
+    // Full state
+    state.WrWM() = state_.WrWM();
+    state.MvM() = state_.MvM();
+    state.qWM() = state_.qWM();
+    for(int i=0;i<mtState::nPose_;i++){
+      state.poseLin(i) = state_.poseLin(i);
+      state.poseRot(i) = state_.poseRot(i);
+    }
+    const MXD resetCov = filterState.cov_;
+    filterState.cov_ = cov_;
+    if(!restoreExtrinsics){
+      for(int camID=0;camID<mtState::nCam_;camID++){ // Keep the reset covariance of the configured extrinsics
+        for(int j=0;j<3;j++){
+          const int vep = mtState::template getId<mtState::_vep>(camID)+j;
+          const int vea = mtState::template getId<mtState::_vea>(camID)+j;
+          filterState.cov_.row(vep).setZero();
+          filterState.cov_.col(vep).setZero();
+          filterState.cov_.row(vea).setZero();
+          filterState.cov_.col(vea).setZero();
+          filterState.cov_(vep,vep) = resetCov(vep,vep);
+          filterState.cov_(vea,vea) = resetCov(vea,vea);
+        }
+      }
+    }
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      filterState.fsm_.isValid_[i] = false;
+    }
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      const int camID = state_.CfP(i).camID_;
+      if(!isValid_[i] || camID < 0 || camID >= mtState::nCam_) continue;
+      auto& f = filterState.fsm_.features_[i];
+      filterState.fsm_.isValid_[i] = true;
+      f.idx_ = idx_[i];
+      f.mpCoordinates_->camID_ = camID;
+      f.mpCoordinates_->mpCamera_ = &mpMultiCamera->cameras_[camID];
+      f.mpCoordinates_->set_nor(state_.CfP(i).get_nor());
+      if(state_.CfP(i).valid_warp_nor_){
+        f.mpCoordinates_->set_warp_nor(state_.CfP(i).warp_nor_);
+      }
+      f.mpDistance_->p_ = state_.dep(i).p_;
+      *f.mpMultilevelPatch_ = patches_[i];
+      f.mpStatistics_->resetStatistics(filterState.t_);
+      f.mpStatistics_->status_[camID] = TRACKED;
+      f.mpStatistics_->lastPatchUpdate_ = filterState.t_;
+    }
+    filterState.fsm_.maxIdx_ = std::max(filterState.fsm_.maxIdx_,maxIdx_);
+    if(restoreExtrinsics) state.updateMultiCameraExtrinsics(mpMultiCamera);
+    state.updateRefIndex(mpMultiCamera);  // Forced (no epsilon): the cameras must match the restored index exactly
+    return true;
+  }
+
+ private:
+  /** \brief Flushes a file or directory to disk.
+   *
+   *   @param path  - File or directory.
+   *   @param flags - Open flags (O_RDONLY for directories).
+   *   @return false if the path could not be opened or synced.
+   */
+  static bool syncPath(const std::string& path, const int flags){
+    const int fd = ::open(path.c_str(), flags);
+    if(fd < 0) return false;
+    const bool isSynced = ::fsync(fd) == 0;
+    return ::close(fd) == 0 && isSynced;
+  }
+  template<typename T>
+  static void writeRaw(std::ostream& os, const T& value){
+    os.write(reinterpret_cast<const char*>(&value),sizeof(T));
+  }
+  template<typename T>
+  static bool readRaw(std::istream& is, T& value){
+    return static_cast<bool>(is.read(reinterpret_cast<char*>(&value),sizeof(T)));
+  }
+  static void writeVector(std::ostream& os, const V3D& v){
+    os.write(reinterpret_cast<const char*>(v.data()),3*sizeof(double));
+  }
+  static void readVector(std::istream& is, V3D& v){
+    is.read(reinterpret_cast<char*>(v.data()),3*sizeof(double));
+  }
+  static void writeQuaternion(std::ostream& os, const QPD& q){
+    const double wxyz[4] = {q.toImplementation().w(),q.toImplementation().x(),q.toImplementation().y(),q.toImplementation().z()};
+    os.write(reinterpret_cast<const char*>(wxyz),4*sizeof(double));
+  }
+  static void readQuaternion(std::istream& is, QPD& q){
+    double wxyz[4];
+    is.read(reinterpret_cast<char*>(wxyz),4*sizeof(double));
+    q = QPD(wxyz[0],wxyz[1],wxyz[2],wxyz[3]);
+    q.fix();
+  }
+};
+
+}
+
+
+#endif /* ROVIO_FILTERCHECKPOINT_HPP_ */
@@ -37,6 +37,7 @@
 #include "rovio/RobocentricFeatureElement.hpp"
 #include "rovio/FeatureManager.hpp"
 #include "rovio/MultiCamera.hpp"
+#include "rovio/FrameOverlay.hpp"
 
 namespace rovio {
 
@@ -70,7 +71,12 @@ class StateAuxiliary: public LWF::AuxiliaryBase<StateAuxiliary<nMax,nLevels,patc
     for(unsigned int i=0;i<nCam;i++){
       qCM_[i].setIdentity();
       MrMC_[i].setZero();
+      isExtrinsicsFrozen_[i] = false;
+      extrinsicsConvergedSince_[i] = -1.0;
     }
+    isRefFrozen_ = false;
+    refConvergedSince_ = -1.0;
+    innovationNis_ = 2.0;
     poseMeasRot_.setIdentity();
     poseMeasLin_.setZero();
   };
@@ -88,6 +94,11 @@ class StateAuxiliary: public LWF::AuxiliaryBase<StateAuxiliary<nMax,nLevels,patc
   QPD qCM_[nCam];  /**<Quaternion Array: IMU coordinates to camera coordinates.*/
   V3D MrMC_[nCam];  /**<Position Vector Array: Vectors pointing from IMU to the camera frame, expressed in the IMU frame.*/
   bool doVECalibration_;  /**<Do Camera-IMU extrinsic parameter calibration?*/
+  bool isExtrinsicsFrozen_[nCam];  /**<Are the extrinsics of the camera frozen (decoupled from the covariance and no longer updated)?*/
+  bool isRefFrozen_;  /**<Is the refractive index frozen?*/
+  double extrinsicsConvergedSince_[nCam];  /**<Time since which the extrinsics of the camera fulfill the convergence thresholds (<0: not converged).*/
+  double refConvergedSince_;  /**<Time since which the refractive index fulfills the convergence threshold (<0: not converged).*/
+  double innovationNis_;  /**<Running average of the normalized innovation squared of the image measurements.*/
   int activeFeature_;  /**< Active Feature ID. ID of the currently updated feature. Needed in the image update procedure.*/
   int activeCameraCounter_;  /**<Counter for iterating through the cameras, used such that when updating a feature we always start with the camId where the feature is expressed in.*/
   double timeSinceLastInertialMotion_;  /**<Time since the IMU showed motion last.*/
@@ -454,19 +465,18 @@ StateAuxiliary<nMax,nLevels,patchSize,nCam>>{
    */
   void updateMultiCameraExtrinsics(MultiCamera<nCam>* mpMultiCamera) const{
     for(int i=0;i<nCam;i++){
-      mpMultiCamera->BrBC_[i] = MrMC(i);
-      mpMultiCamera->qCB_[i] = qCM(i);
+      mpMultiCamera->setExtrinsics(i,MrMC(i),qCM(i));
     }
   }
 
   /**
-   * @brief Update refractive index
-   * @param ref - new refractive index
+   * @brief Update refractive index of the cameras (no-op if it did not change by more than epsilon)
+   * @param mpMultiCamera - cameras to update
+   * @param epsilon - minimal change of the refractive index which is pushed to the cameras
+   * @return true, if the cameras were updated
    */
-  void updateRefIndex(MultiCamera<nCam>* mpMultiCamera){
-    for(int i=0;i<nCam;i++){
-      mpMultiCamera->cameras_[i].refrac_ind_ = ref();
-    }
+  bool updateRefIndex(MultiCamera<nCam>* mpMultiCamera, const double epsilon = 0.0) const{
+    return mpMultiCamera->setRefractiveIndex(ref(),epsilon);
   }
     
 };
@@ -575,14 +585,15 @@ class FilterState: public LWF::FilterState<State<nMax,nLevels,patchSize,nCam,nPo
   mutable rovio::TransformFeatureOutputCT<mtState> transformFeatureOutputCT_;
   mutable FeatureOutput featureOutput_;
   mutable MXD featureOutputCov_;
-  cv::Mat img_[nCam];     /**<Mainly used for drawing.*/
-  cv::Mat patchDrawing_;  /**<Mainly used for drawing.*/
-  cv::Mat patchDrawingClean_;  /**<Mainly used for drawing.*/
+  cv::Mat img_[nCam];     /**<Rendered frame, see \ref renderFrame.*/
+  FrameOverlay overlay_[nCam]; /**<Drawing primitives of the last image update (rendered on demand).*/
+  cv::Mat patchDrawing_;  /**<Mainly used for drawing. Shared between state copies, reallocated before drawing into it.*/
+  cv::Mat patchDrawingClean_;  /**<Mainly used for drawing. Shared between state copies, reallocated before drawing into it.*/
   int drawPB_;  /**<Size of border around patch.*/
   int drawPS_;  /**<Size of patch with border for drawing.*/
   double imgTime_;        /**<Time of the last image, which was processed.*/
   int imageCounter_;      /**<Total number of images, used so far for updates. Same as total number of update steps.*/
-  ImagePyramid<nLevels> prevPyr_[nCam]; /**<Previous image pyramid.*/
+  ImagePyramid<nLevels> prevPyr_[nCam]; /**<Previous image pyramid. Shared (copy-on-write) with the image measurement and other state copies.*/
   bool plotPoseMeas_; /**<Should the pose measurement be plotted.*/
   mutable MultilevelPatch<nLevels,patchSize> mlpErrorLog_[nMax];  /**<Multilevel patch containing log of error.*/
 
@@ -603,6 +614,19 @@ class FilterState: public LWF::FilterState<State<nMax,nLevels,patchSize,nCam,nPo
    */
   virtual ~FilterState(){};
 
+  /** \brief Renders the overlay of a camera onto the last processed image into \ref img_.
+   *
+   *  @param camID - Camera ID.
+   *  @return false if nothing was recorded for the camera.
+   */
+  bool renderFrame(const int camID){
+    if(!overlay_[camID].isEnabled_ || prevPyr_[camID].imgs_[0].empty()) return false;
+    releaseIfShared(img_[camID]); // May be shared with other state copies
+    cv::cvtColor(prevPyr_[camID].imgs_[0], img_[camID], cv::COLOR_GRAY2BGR);
+    overlay_[camID].render(img_[camID]);
+    return true;
+  }
+
   /** \brief Sets the multicamera pointer
    *
    * @param mpMultiCamera - multicamera pointer;
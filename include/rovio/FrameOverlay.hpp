@@ -0,0 +1,235 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_FRAMEOVERLAY_HPP_
+#define ROVIO_FRAMEOVERLAY_HPP_
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "rovio/FeatureCoordinates.hpp"
+
+namespace rovio{
+
+/** \brief Drawing primitives of a camera frame, recorded during the update and rendered later.
+ *
+ *  Recording only stores the geometry (no image is touched), such that the drawing can be done on demand, e.g. on
+ *  the publisher thread and only if the frame is actually shown or subscribed. If disabled, all add methods return
+ *  immediately.
+ */
+class FrameOverlay{
+ public:
+  enum PrimitiveType{
+    POINT,
+    ELLIPSE,
+    LINE,
+    TEXT
+  };
+
+  /** \brief Drawing primitive.
+   */
+  struct Primitive{
+    PrimitiveType type_;
+    cv::Point2f p1_; /**<Center, start point or text origin.*/
+    cv::Point2f p2_; /**<End point (LINE).*/
+    cv::Size size_; /**<Half axes (POINT, ELLIPSE).*/
+    float angle_; /**<Rotation of the ellipse [deg].*/
+    float scale_; /**<Font scale (TEXT).*/
+    int thickness_;
+    cv::Scalar color_;
+    std::string text_;
+  };
+
+  /** \brief Attitude indicator in the top left corner.
+   */
+  struct Horizon{
+    bool isSet_;
+    double roll_;
+    double pitch_;
+    int imageCounter_;
+  };
+
+  bool isEnabled_; /**<If false, nothing is recorded.*/
+  std::vector<Primitive> primitives_;
+  Horizon horizon_;
+
+  FrameOverlay(): isEnabled_(false){
+    horizon_.isSet_ = false;
+  }
+
+  /** \brief Removes all primitives and sets whether new primitives are recorded.
+   */
+  void reset(const bool isEnabled){
+    isEnabled_ = isEnabled;
+    primitives_.clear();
+    horizon_.isSet_ = false;
+  }
+
+  /** \brief Records a filled point (see FeatureCoordinates::drawPoint).
+   */
+  void addPoint(const FeatureCoordinates& c, const cv::Scalar& color, const float s = 2){
+    if(!isEnabled_) return;
+    Primitive& p = add(POINT,color);
+    p.p1_ = c.get_c();
+    p.size_ = cv::Size(s,s);
+  }
+
+  /** \brief Records the uncertainty ellipse of the coordinates (see FeatureCoordinates::drawEllipse).
+   */
+  void addEllipse(const FeatureCoordinates& c, const cv::Scalar& color, const double scaleFactor = 2.0, const bool withCenterPoint = true){
+    if(!isEnabled_) return;
+    if(withCenterPoint) addPoint(c,color);
+    Primitive& p = add(ELLIPSE,color);
+    p.p1_ = c.get_c();
+    p.size_ = cv::Size(std::max(static_cast<int>(scaleFactor*c.sigma1_+0.5),1),std::max(static_cast<int>(scaleFactor*c.sigma2_+0.5),1));
+    p.angle_ = c.sigmaAngle_*180/M_PI;
+  }
+
+  /** \brief Records a line.
+   */
+  void addLine(const cv::Point2f& p1, const cv::Point2f& p2, const cv::Scalar& color, const int thickness = 1){
+    if(!isEnabled_) return;
+    Primitive& p = add(LINE,color);
+    p.p1_ = p1;
+    p.p2_ = p2;
+    p.thickness_ = thickness;
+  }
+
+  /** \brief Records a text at the coordinates (see FeatureCoordinates::drawText).
+   */
+  void addText(const FeatureCoordinates& c, const std::string& s, const cv::Scalar& color){
+    if(!isEnabled_) return;
+    addText(c.get_c(),s,color);
+  }
+
+  /** \brief Records a text.
+   */
+  void addText(const cv::Point2f& origin, const std::string& s, const cv::Scalar& color, const float scale = 0.4){
+    if(!isEnabled_) return;
+    Primitive& p = add(TEXT,color);
+    p.p1_ = origin;
+    p.scale_ = scale;
+    p.text_ = s;
+  }
+
+  /** \brief Records the (warped) border of a patch (see Patch::drawPatchBorder).
+   *
+   *   @param c          - Coordinates of the patch (with warping).
+   *   @param halfLength - Half edge length of the patch [pixel].
+   *   @param color      - Color.
+   */
+  void addPatchBorder(const FeatureCoordinates& c, const double halfLength, const cv::Scalar& color){
+    if(!isEnabled_ || !c.isInFront() || !c.com_warp_c()) return;
+    const cv::Point2f c1 = c.get_patchCorner(halfLength,halfLength).get_c();
+    const cv::Point2f c2 = c.get_patchCorner(halfLength,-halfLength).get_c();
+    const cv::Point2f c3 = c.get_patchCorner(-halfLength,-halfLength).get_c();
+    const cv::Point2f c4 = c.get_patchCorner(-halfLength,halfLength).get_c();
+    addLine(c1,c2,color);
+    addLine(c2,c3,color);
+    addLine(c3,c4,color);
+    addLine(c4,c1,color);
+  }
+
+  /** \brief Records the attitude indicator.
+   */
+  void setHorizon(const double roll, const double pitch, const int imageCounter){
+    if(!isEnabled_) return;
+    horizon_.isSet_ = true;
+    horizon_.roll_ = roll;
+    horizon_.pitch_ = pitch;
+    horizon_.imageCounter_ = imageCounter;
+  }
+
+  /** \brief Draws all primitives into an image.
+   *
+   *   @param img - BGR image (usually the grayscale frame converted to BGR).
+   */
+  void render(cv::Mat& img) const{
+    for(const Primitive& p : primitives_){
+      switch(p.type_){
+        case POINT:
+          cv::ellipse(img,p.p1_,p.size_,0,0,360,p.color_,-1,8,0);
+          break;
+        case ELLIPSE:
+          cv::ellipse(img,p.p1_,p.size_,p.angle_,0,360,p.color_,1,8,0);
+          break;
+        case LINE:
+          cv::line(img,p.p1_,p.p2_,p.color_,p.thickness_);
+          break;
+        case TEXT:
+          cv::putText(img,p.text_,p.p1_,cv::FONT_HERSHEY_SIMPLEX,p.scale_,p.color_);
+          break;
+      }
+    }
+    if(horizon_.isSet_) renderHorizon(img);
+  }
+
+ private:
+  Primitive& add(const PrimitiveType type, const cv::Scalar& color){
+    primitives_.emplace_back();
+    Primitive& p = primitives_.back();
+    p.type_ = type;
+    p.color_ = color;
+    p.thickness_ = 1;
+    return p;
+  }
+
+  void renderHorizon(cv::Mat& img) const{
+    cv::rectangle(img,cv::Point2f(0,0),cv::Point2f(82,92),cv::Scalar(50,50,50),-1,8,0);
+    cv::rectangle(img,cv::Point2f(0,0),cv::Point2f(80,90),cv::Scalar(100,100,100),-1,8,0);
+    cv::putText(img,std::to_string(horizon_.imageCounter_),cv::Point2f(5,85),cv::FONT_HERSHEY_SIMPLEX, 0.4, cv::Scalar(255,0,0));
+    cv::Point2f rollCenter = cv::Point2f(40,40);
+    cv::Scalar rollColor1(50,50,50);
+    cv::Scalar rollColor2(200,200,200);
+    cv::Scalar rollColor3(120,120,120);
+    cv::circle(img,rollCenter,32,rollColor1,-1,8,0);
+    cv::circle(img,rollCenter,30,rollColor2,-1,8,0);
+    const double roll = horizon_.roll_;
+    const double pitch = horizon_.pitch_;
+    double pixelFor10Pitch = 5.0;
+    double pitchOffsetAngle = -asin(pitch/M_PI*180.0/10.0*pixelFor10Pitch/30.0);
+    cv::Point2f rollVector2 = cv::Point2f(25,0);
+    cv::Point2f rollVector3 = cv::Point2f(10,0);
+    std::vector<cv::Point> pts;
+    cv::ellipse2Poly(rollCenter,cv::Size(30,30),0,(roll-pitchOffsetAngle)/M_PI*180,(roll+pitchOffsetAngle)/M_PI*180+180,1,pts);
+    cv::Point *points;
+    points = &pts[0];
+    int nbtab = pts.size();
+    cv::fillPoly(img,(const cv::Point**)&points,&nbtab,1,rollColor3);
+    cv::line(img,rollCenter+rollVector2,rollCenter+rollVector3,rollColor1, 2);
+    cv::line(img,rollCenter-rollVector2,rollCenter-rollVector3,rollColor1, 2);
+    cv::ellipse(img,rollCenter,cv::Size(10,10),0,0,180,rollColor1,2,8,0);
+    cv::circle(img,rollCenter,2,rollColor1,-1,8,0);
+  }
+};
+
+}
+
+
+#endif /* ROVIO_FRAMEOVERLAY_HPP_ */
@@ -14,11 +14,12 @@ class RovioHealthMonitor {
  public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-    RovioHealthMonitor() : num_subsequent_unhealthy_updates_(0) {}
+    RovioHealthMonitor() : num_subsequent_unhealthy_updates_(0), is_safe_pose_updated_(false) {}
 
     // Returns true if healthy; false if unhealthy and reset was triggered.
     bool shouldResetEstimator(const std::vector<float>& distance_covs_in, const StandardOutput& imu_output) {
         float feature_distance_covariance_median = 0;
+        is_safe_pose_updated_ = false;
         std::vector<float> distance_covs = distance_covs_in;
         if (!distance_covs.empty()) {
             const size_t middle_index = distance_covs.size() / 2;
@@ -50,6 +51,7 @@ class RovioHealthMonitor {
                     last_safe_pose_.failsafe_WrWB = imu_output.WrWB();
                     last_safe_pose_.failsafe_qBW = imu_output.qBW();
                     last_safe_pose_.feature_distance_covariance_median = feature_distance_covariance_median;
+                    is_safe_pose_updated_ = true;
                 }
             }
             num_subsequent_unhealthy_updates_ = 0;
@@ -63,6 +65,9 @@ class RovioHealthMonitor {
         return last_safe_pose_.failsafe_qBW;
     }
 
+    // True if the last call of shouldResetEstimator refreshed the failsafe pose (i.e. the state was healthy).
+    bool isSafePoseUpdated() const { return is_safe_pose_updated_; }
+
  private:
     struct RovioFailsafePose {
         RovioFailsafePose()
@@ -76,6 +81,7 @@ class RovioHealthMonitor {
 
     RovioFailsafePose last_safe_pose_;
     int num_subsequent_unhealthy_updates_;
+    bool is_safe_pose_updated_;
 
     // The landmark covariance is not a good measure for divergence if we are static.
     static constexpr float kVelocityToConsiderStatic = 0.1f;
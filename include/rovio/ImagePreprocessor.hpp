@@ -0,0 +1,154 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_IMAGEPREPROCESSOR_HPP_
+#define ROVIO_IMAGEPREPROCESSOR_HPP_
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include "rovio/ImagePyramid.hpp"
+
+namespace rovio{
+
+/** \brief Image preprocessing stage (CLAHE, bilateral filter, median blur and gamma correction).
+ *
+ *   The stage is configured once, the CLAHE object and the gamma lookup table are cached. Every pass either
+ *   reads from the input image and writes into the output image or works in place (using an internal scratch
+ *   buffer for filters which cannot operate in place), i.e. no intermediate 8-bit conversions are done for
+ *   8-bit input images. Each camera should use its own instance (the CLAHE object is not thread-safe), which
+ *   then allows to run the stage on a per-camera worker thread.
+ */
+class ImagePreprocessor{
+ public:
+  bool histogramEqualize_; /**<Apply CLAHE (only for images within the 8-bit range).*/
+  double claheClipLimit_; /**<Contrast limit of CLAHE.*/
+  double claheGridSize_; /**<Number of CLAHE tiles per image side.*/
+  bool bilateralBlur_; /**<Apply a bilateral filter after CLAHE.*/
+  bool medianBlur_; /**<Apply a median blur after CLAHE.*/
+  int medianKernelSize_; /**<Kernel size of the median blur.*/
+  double gamma_; /**<Gamma used for gamma correction (1.0 disables it).*/
+  bool lastInputWas8bit_; /**<False if the last input image exceeded the 8-bit range (CLAHE and blurs were skipped).*/
+
+  /** \brief Constructor. All passes are disabled.
+   */
+  ImagePreprocessor(){
+    histogramEqualize_ = false;
+    claheClipLimit_ = 2.0;
+    claheGridSize_ = 8.0;
+    bilateralBlur_ = false;
+    medianBlur_ = false;
+    medianKernelSize_ = 5;
+    gamma_ = 1.0;
+    lastInputWas8bit_ = true;
+    configure();
+  }
+
+  /** \brief Destructor.
+   */
+  virtual ~ImagePreprocessor(){}
+
+  /** \brief Builds the cached CLAHE object and gamma lookup table. Must be called after changing the parameters.
+   */
+  void configure(){
+    if(histogramEqualize_){
+      if(clahe_.empty()) clahe_ = cv::createCLAHE();
+      clahe_->setClipLimit(claheClipLimit_);
+      clahe_->setTilesGridSize(cv::Size(claheGridSize_, claheGridSize_));
+    }
+    doGamma_ = gamma_ != 1.0;
+    gammaLut_.create(1, 256, CV_8U);
+    for(int i = 0; i < 256; i++){
+      gammaLut_.at<uchar>(i) = cv::saturate_cast<uchar>(pow(i / 255.0, gamma_) * 255.0);
+    }
+  }
+
+  /** \brief Checks if any pass is enabled.
+   *
+   *   @return true, if process() can modify an image.
+   */
+  bool isActive() const{
+    return histogramEqualize_ || doGamma_;
+  }
+
+  /** \brief Applies the enabled passes.
+   *
+   *   dst is made exclusive before writing (see \ref releaseIfShared), such that it can be the level 0 buffer of an
+   *   image pyramid whose previous content is still referenced by a pending measurement.
+   *
+   *   @param src - Input image (not modified).
+   *   @param dst - Output image.
+   *   @return true, if dst contains the result. If false no pass was applied and src should be used as is.
+   */
+  bool process(const cv::Mat& src, cv::Mat& dst){
+    bool hasResult = false;
+    lastInputWas8bit_ = true;
+    if(histogramEqualize_){
+      if(src.type() != CV_8UC1){
+        // The check for the actual value range is only required for non 8-bit input
+        double imgMin, imgMax;
+        cv::minMaxLoc(src, &imgMin, &imgMax);
+        lastInputWas8bit_ = imgMax <= 255.0;
+      }
+      if(lastInputWas8bit_){
+        releaseIfShared(dst);
+        releaseIfShared(scratch_);
+        if(src.type() != CV_8UC1){
+          src.convertTo(scratch_, CV_8UC1);
+          clahe_->apply(scratch_, dst);
+        } else {
+          clahe_->apply(src, dst);
+        }
+        if(bilateralBlur_){
+          cv::bilateralFilter(dst, scratch_, 9, 50, 50);
+          cv::swap(dst, scratch_);
+        }
+        if(medianBlur_){
+          cv::medianBlur(dst, scratch_, medianKernelSize_);
+          cv::swap(dst, scratch_);
+        }
+        hasResult = true;
+      }
+    }
+    if(doGamma_){
+      if(!hasResult) releaseIfShared(dst);
+      cv::LUT(hasResult ? dst : src, gammaLut_, dst);
+      hasResult = true;
+    }
+    return hasResult;
+  }
+
+ private:
+  cv::Ptr<cv::CLAHE> clahe_; /**<Cached CLAHE object.*/
+  cv::Mat gammaLut_; /**<Cached gamma lookup table.*/
+  bool doGamma_; /**<Is gamma correction enabled.*/
+  cv::Mat scratch_; /**<Scratch buffer for passes which cannot be done in place.*/
+};
+
+}
+
+
+#endif /* ROVIO_IMAGEPREPROCESSOR_HPP_ */
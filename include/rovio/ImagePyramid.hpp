@@ -34,35 +34,139 @@
 #include <opencv2/highgui/highgui.hpp>
 #include "rovio/FeatureCoordinates.hpp"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 namespace rovio{
 
+/** \brief Downsampling kernel used for the construction of the image pyramid.
+ */
+enum PyramidKernel{
+  PYR_BOX = 0,     //!< 2x2 box filter (see halfSample), vectorized if SSE2/NEON is available.
+  PYR_GAUSSIAN = 1 //!< 5x5 Gaussian filter (cv::pyrDown).
+};
+
+/** \brief Halfsamples two rows of an image with a 2x2 box filter and optionally copies them.
+ *
+ *   The SIMD and the scalar path both compute (a+b+c+d)/4 with truncation, i.e. the output is bit-identical.
+ *
+ *   @param top     - Pointer to the upper input row.
+ *   @param bot     - Pointer to the lower input row.
+ *   @param out     - Pointer to the output row (halfsampled).
+ *   @param cols    - Number of output columns.
+ *   @param copyTop - If not nullptr, the upper input row is copied to this location (2*cols bytes).
+ *   @param copyBot - If not nullptr, the lower input row is copied to this location (2*cols bytes).
+ */
+inline void halfSampleRow(const uint8_t* top, const uint8_t* bot, uint8_t* out, const int cols, uint8_t* copyTop = nullptr, uint8_t* copyBot = nullptr){
+  int x = 0;
+#if defined(__SSE2__)
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  for(; x+16<=cols; x+=16){
+    const __m128i t0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top+2*x));
+    const __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top+2*x+16));
+    const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bot+2*x));
+    const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bot+2*x+16));
+    if(copyTop != nullptr){
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(copyTop+2*x),t0);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(copyTop+2*x+16),t1);
+    }
+    if(copyBot != nullptr){
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(copyBot+2*x),b0);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(copyBot+2*x+16),b1);
+    }
+    // Even bytes via masking, odd bytes via shifting, summed in 16bit
+    __m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(t0,mask),_mm_srli_epi16(t0,8)),
+                               _mm_add_epi16(_mm_and_si128(b0,mask),_mm_srli_epi16(b0,8)));
+    __m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(t1,mask),_mm_srli_epi16(t1,8)),
+                               _mm_add_epi16(_mm_and_si128(b1,mask),_mm_srli_epi16(b1,8)));
+    s0 = _mm_srli_epi16(s0,2);
+    s1 = _mm_srli_epi16(s1,2);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out+x),_mm_packus_epi16(s0,s1));
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for(; x+16<=cols; x+=16){
+    const uint8x16_t t0 = vld1q_u8(top+2*x);
+    const uint8x16_t t1 = vld1q_u8(top+2*x+16);
+    const uint8x16_t b0 = vld1q_u8(bot+2*x);
+    const uint8x16_t b1 = vld1q_u8(bot+2*x+16);
+    if(copyTop != nullptr){
+      vst1q_u8(copyTop+2*x,t0);
+      vst1q_u8(copyTop+2*x+16,t1);
+    }
+    if(copyBot != nullptr){
+      vst1q_u8(copyBot+2*x,b0);
+      vst1q_u8(copyBot+2*x+16,b1);
+    }
+    const uint16x8_t s0 = vpadalq_u8(vpaddlq_u8(t0),b0);
+    const uint16x8_t s1 = vpadalq_u8(vpaddlq_u8(t1),b1);
+    vst1q_u8(out+x,vcombine_u8(vshrn_n_u16(s0,2),vshrn_n_u16(s1,2)));
+  }
+#endif
+  if(copyTop != nullptr) memcpy(copyTop+2*x,top+2*x,2*(cols-x));
+  if(copyBot != nullptr) memcpy(copyBot+2*x,bot+2*x,2*(cols-x));
+  for(; x<cols; ++x){
+    out[x] = (top[2*x]+top[2*x+1]+bot[2*x]+bot[2*x+1])/4;
+  }
+}
+
 /** \brief Halfsamples an image.
  *
  *   @param imgIn - Input image.
  *   @param imgOut - Output image (halfsampled).
+ *   @param imgCopy - If not nullptr, imgIn is copied into this image in the same pass (fused copy and downsampling).
  */
-void halfSample(const cv::Mat& imgIn,cv::Mat& imgOut){
+inline void halfSample(const cv::Mat& imgIn,cv::Mat& imgOut,cv::Mat* imgCopy = nullptr){
+  if(imgIn.type() != CV_8UC1){
+    if(imgCopy != nullptr) imgIn.copyTo(*imgCopy);
+    cv::resize(imgIn(cv::Rect(0,0,2*(imgIn.cols/2),2*(imgIn.rows/2))),imgOut,cv::Size(imgIn.cols/2,imgIn.rows/2),0,0,cv::INTER_AREA);
+    return;
+  }
   imgOut.create(imgIn.rows/2,imgIn.cols/2,imgIn.type());
-  const int refStepIn = imgIn.step.p[0];
-  const int refStepOut = imgOut.step.p[0];
-  uint8_t* imgPtrInTop;
-  uint8_t* imgPtrInBot;
-  uint8_t* imgPtrOut;
+  if(imgCopy != nullptr) imgCopy->create(imgIn.rows,imgIn.cols,imgIn.type());
   for(int y=0; y<imgOut.rows; ++y){
-    imgPtrInTop =  imgIn.data + 2*y*refStepIn;
-    imgPtrInBot =  imgIn.data + (2*y+1)*refStepIn;
-    imgPtrOut = imgOut.data + y*refStepOut;
-    for(int x=0; x<imgOut.cols; ++x, ++imgPtrOut, imgPtrInTop += 2, imgPtrInBot += 2)
-    {
-      *imgPtrOut = (imgPtrInTop[0]+imgPtrInTop[1]+imgPtrInBot[0]+imgPtrInBot[1])/4;
+    halfSampleRow(imgIn.ptr<uint8_t>(2*y),imgIn.ptr<uint8_t>(2*y+1),imgOut.ptr<uint8_t>(y),imgOut.cols,
+                  imgCopy != nullptr ? imgCopy->ptr<uint8_t>(2*y) : nullptr,
+                  imgCopy != nullptr ? imgCopy->ptr<uint8_t>(2*y+1) : nullptr);
+  }
+  if(imgCopy != nullptr){
+    // Remainders not covered by the halfsampling (odd number of rows or columns)
+    if(imgIn.cols%2 == 1){
+      for(int y=0; y<2*imgOut.rows; ++y){
+        imgCopy->at<uint8_t>(y,imgIn.cols-1) = imgIn.at<uint8_t>(y,imgIn.cols-1);
+      }
+    }
+    if(imgIn.rows%2 == 1){
+      memcpy(imgCopy->ptr<uint8_t>(imgIn.rows-1),imgIn.ptr<uint8_t>(imgIn.rows-1),imgIn.cols);
     }
   }
 }
 
+/** \brief Releases an image if its buffer is shared with other cv::Mat headers or not owned by opencv.
+ *
+ *   Writing into an image afterwards (e.g. via create/copyTo) is then guaranteed to not alter the data
+ *   seen by other (shallow) copies. If the buffer is exclusively owned it is kept and can be reused.
+ *
+ *   @param img - Image which should be made exclusive.
+ */
+inline void releaseIfShared(cv::Mat& img){
+  if(img.empty()) return;
+#if (CV_MAJOR_VERSION < 3)
+  if(img.refcount == nullptr || *img.refcount > 1) img.release();
+#else
+  if(img.u == nullptr || img.u->refcount > 1) img.release();
+#endif
+}
+
 /** \brief Image pyramid with selectable number of levels.
+ *
+ *   The levels always hold reference-counted buffers (the input image is copied into level 0). Copies of a pyramid
+ *   (copy construction and assignment) share these buffers and are therefore cheap. All methods writing into the pyramid release shared buffers first (copy-on-write), such
+ *   that the content seen by other copies is never altered. Use \ref clone for an explicit deep copy.
  *
  *   @tparam n_levels - Number of pyramid levels.
- *   @todo: complete rule of three
  */
 template<int n_levels>
 class ImagePyramid{
@@ -79,31 +183,79 @@ class ImagePyramid{
    *   @param useCv - Set to true, if opencv (cv::pyrDown) should be used for the pyramid creation.
    */
   void computeFromImage(const cv::Mat& img, const bool useCv = false){
-    img.copyTo(imgs_[0]);
-    centers_[0] = cv::Point2f(0,0);
+    computeFromImage(img,useCv ? PYR_GAUSSIAN : PYR_BOX);
+  }
+
+  /** \brief Initializes the image pyramid from an input image (level 0) using a specific downsampling kernel.
+   *
+   *   For the box kernel the copy of level 0 is fused with the computation of level 1. The image centers are
+   *   shifted according to the used kernel (the Gaussian kernel of cv::pyrDown introduces an additional offset).
+   *
+   *   @param img    - Input image (level 0).
+   *   @param kernel - Downsampling kernel, see \ref PyramidKernel.
+   */
+  void computeFromImage(const cv::Mat& img, const PyramidKernel kernel){
+    for(int i=0; i<n_levels; ++i){
+      releaseIfShared(imgs_[i]);
+    }
+    if(n_levels == 1){
+      img.copyTo(imgs_[0]);
+    } else if(kernel == PYR_BOX){
+      halfSample(img,imgs_[1],&imgs_[0]);
+    } else {
+      img.copyTo(imgs_[0]);
+      cv::pyrDown(imgs_[0],imgs_[1],cv::Size(imgs_[0].cols/2, imgs_[0].rows/2));
+    }
+    computeHigherLevels(kernel,2);
+  }
+
+  /** \brief Computes the higher pyramid levels from the image currently stored at level 0.
+   *
+   *   Can be used after writing directly into imgs_[0] (e.g. in-place preprocessing), in which case
+   *   \ref releaseIfShared should be called on imgs_[0] before writing.
+   *
+   *   @param kernel - Downsampling kernel, see \ref PyramidKernel.
+   */
+  void computeFromLevel0(const PyramidKernel kernel){
     for(int i=1; i<n_levels; ++i){
-      if(!useCv){
-        halfSample(imgs_[i-1],imgs_[i]);
-        centers_[i].x = centers_[i-1].x-pow(0.5,2-i)*(float)(imgs_[i-1].rows%2);
-        centers_[i].y = centers_[i-1].y-pow(0.5,2-i)*(float)(imgs_[i-1].cols%2);
-      } else {
-        cv::pyrDown(imgs_[i-1],imgs_[i],cv::Size(imgs_[i-1].cols/2, imgs_[i-1].rows/2));
-        centers_[i].x = centers_[i-1].x-pow(0.5,2-i)*(float)((imgs_[i-1].rows%2)+1);
-        centers_[i].y = centers_[i-1].y-pow(0.5,2-i)*(float)((imgs_[i-1].cols%2)+1);
-      }
+      releaseIfShared(imgs_[i]);
+    }
+    computeHigherLevels(kernel,1);
+  }
+
+  /** \brief Swaps the content (image headers and centers) with another pyramid, no image data is copied.
+   *
+   *   @param other - Pyramid to swap with.
+   */
+  void swap(ImagePyramid<n_levels>& other){
+    for(unsigned int i=0;i<n_levels;i++){
+      cv::swap(imgs_[i],other.imgs_[i]);
+      std::swap(centers_[i],other.centers_[i]);
     }
   }
 
-  /** \brief Copies the image pyramid.
+  /** \brief Copies the image pyramid by sharing the image buffers (no pixel data is copied).
    */
   ImagePyramid<n_levels>& operator=(const ImagePyramid<n_levels> &rhs) {
     for(unsigned int i=0;i<n_levels;i++){
-      rhs.imgs_[i].copyTo(imgs_[i]);
+      imgs_[i] = rhs.imgs_[i];
       centers_[i] = rhs.centers_[i];
     }
     return *this;
   }
 
+  /** \brief Deep-copies the image pyramid into another pyramid.
+   *
+   *   @param other - Target pyramid, its previous buffers are released if shared.
+   */
+  void clone(ImagePyramid<n_levels>& other) const{
+    for(unsigned int i=0;i<n_levels;i++){
+      releaseIfShared(other.imgs_[i]);
+      imgs_[i].copyTo(other.imgs_[i]);
+      other.centers_[i] = centers_[i];
+    }
+  }
+
   /** \brief Transforms pixel coordinates between two pyramid levels.
    *
    * @Note Invalidates camera and bearing vector, since the camera model is not valid for arbitrary image levels.
@@ -142,8 +294,6 @@ class ImagePyramid{
 
     cv::FastFeatureDetector feature_detector_fast(detectionThreshold, true);
     feature_detector_fast.detect(imgs_[l], keypoints);
-     
-    }
 #else
     auto feature_detector_fast = cv::FastFeatureDetector::create(detectionThreshold, true, cv::FastFeatureDetector::TYPE_9_16);
     feature_detector_fast->detect(imgs_[l], keypoints);
@@ -175,6 +325,32 @@ class ImagePyramid{
       }
     }
   }
+
+ private:
+  /** \brief Downsamples the levels starting at a given level and sets the corresponding \ref centers_.
+   *
+   *   @param kernel     - Downsampling kernel, see \ref PyramidKernel.
+   *   @param startLevel - First level which is computed from its predecessor (lower levels must be valid).
+   */
+  void computeHigherLevels(const PyramidKernel kernel, const int startLevel){
+    centers_[0] = cv::Point2f(0,0);
+    for(int i=1; i<n_levels; ++i){
+      if(i>=startLevel){
+        if(kernel == PYR_BOX){
+          halfSample(imgs_[i-1],imgs_[i]);
+        } else {
+          cv::pyrDown(imgs_[i-1],imgs_[i],cv::Size(imgs_[i-1].cols/2, imgs_[i-1].rows/2));
+        }
+      }
+      if(kernel == PYR_BOX){
+        centers_[i].x = centers_[i-1].x-pow(0.5,2-i)*(float)(imgs_[i-1].rows%2);
+        centers_[i].y = centers_[i-1].y-pow(0.5,2-i)*(float)(imgs_[i-1].cols%2);
+      } else {
+        centers_[i].x = centers_[i-1].x-pow(0.5,2-i)*(float)((imgs_[i-1].rows%2)+1);
+        centers_[i].y = centers_[i-1].y-pow(0.5,2-i)*(float)((imgs_[i-1].cols%2)+1);
+      }
+    }
+  }
 };
 
 }
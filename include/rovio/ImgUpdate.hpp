@@ -39,6 +39,16 @@
 #include "rovio/CoordinateTransform/PixelOutput.hpp"
 #include "rovio/ZeroVelocityUpdate.hpp"
 #include "rovio/MultilevelPatchAlignment.hpp"
+#include "rovio/FastGridDetector.hpp"
+#include "rovio/BlockSparseJacobian.hpp"
+#include "rovio/SymmetricCovariance.hpp"
+#include "rovio/ThreadPool.hpp"
+#include "rovio/Profiler.hpp"
+#include "rovio/exceptions.hpp"
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <limits>
 
 namespace rovio {
 
@@ -174,6 +184,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
   using Base::successfulUpdate_;
   using Base::cancelIteration_;
   using Base::candidateCounter_;
+  using Base::outlierDetection_;
   typedef typename Base::mtState mtState;
   typedef typename Base::mtFilterState mtFilterState;
   typedef typename Base::mtInnovation mtInnovation;
@@ -199,6 +210,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
   double minTrackedAndFreeFeatures_;
   double minRelativeSTScore_;
   double minAbsoluteSTScore_;
+  double candidateCullingFactor_; /**<At most candidateCullingFactor_ times the number of features to add are fully scored (<=0: all). The culling is global and happens before the spatial bucketing, it favours clustered strong corners.*/
   double minTimeBetweenPatchUpdate_;
   bool doVisualMotionDetection_; /**<Do visual motion detection*/
   double rateOfMovingFeaturesTh_; /**<What percentage of feature must be moving for image motion detection*/
@@ -229,8 +241,53 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
   double nObservThersh_;               /**<Threshold for the observability check for refractive index*/
   double lineThresh_;                  /**<Threshold for the classifying line features*/
   int alignMaxUniSample_;
+  double alignFrameBudget_; /**<Time budget for the alignment of all features within one frame in ms (<=0: unlimited).*/
+  double refIndexUpdateEpsilon_; /**<Minimal change of the estimated refractive index which is pushed to the cameras.*/
+  std::chrono::steady_clock::time_point alignFrameDeadline_; /**<Deadline of the alignment in the current frame.*/
   bool useCrossCameraMeasurements_; /**<Should features be matched across cameras.*/
+  bool useCpuGovernor_; /**<If true, the number of updated features and the cross-camera updates are adapted to \ref governorFrameBudget_, see \ref updateCpuGovernor.*/
+  double governorFrameBudget_; /**<Processing time budget of the image update per frame in ms.*/
+  int governorMinActiveFeatures_; /**<Lower bound on the number of features updated per frame by the governor.*/
+  double governorRecoveryRatio_; /**<Fraction of the budget below which the governor restores processing.*/
+  int governorActiveFeatureLimit_; /**<Current maximal number of features updated per frame.*/
+  bool governorSkipCrossCamera_; /**<If true, the governor currently skips the cross-camera updates.*/
+  /** \brief State of the image update which adapts across frames, see \ref saveAdaptiveState.
+   */
+  struct AdaptiveState{
+    std::vector<int> fastGridThresholds_[mtState::nCam_][mtState::nLevels_]; /**<Adaptive FAST thresholds of the grid detectors.*/
+    int governorActiveFeatureLimit_; /**<See \ref governorActiveFeatureLimit_.*/
+    bool governorSkipCrossCamera_; /**<See \ref governorSkipCrossCamera_.*/
+  };
+  bool isActiveFeature_[mtState::nMax_]; /**<Features selected to be updated in the current frame, see \ref selectActiveFeatures.*/
+  std::chrono::steady_clock::time_point governorFrameStart_; /**<Start of the processing of the current frame.*/
+  bool useInformationGainScheduling_; /**<If true, only the (feature, camera) updates with the largest expected information gain are performed, see \ref scheduleUpdates.*/
+  int informationGainMaxUpdates_; /**<Maximal number of (feature, camera) updates per frame for the information gain scheduling.*/
+  bool isScheduled_[mtState::nMax_][mtState::nCam_]; /**<Scheduled (feature, camera) updates of the current frame.*/
+  int firstScheduledCounter_[mtState::nMax_]; /**<Camera counter of the first scheduled update of each feature (the statistics are increased there).*/
+  int lastScheduledUpdates_; /**<Number of scheduled in-frame updates of the last frame.*/
+  int lastSkippedUpdates_; /**<Number of in-frame updates skipped by the scheduling in the last frame.*/
+  bool freezeCalibration_; /**<If true, converged extrinsics and refractive index are frozen, see \ref updateCalibrationFreezing.*/
+  double freezeExtrinsicsPosStd_; /**<Standard deviation of the extrinsic translation below which it is considered converged [m].*/
+  double freezeExtrinsicsAttStd_; /**<Standard deviation of the extrinsic rotation below which it is considered converged [rad].*/
+  double freezeRefStd_; /**<Standard deviation of the refractive index below which it is considered converged.*/
+  double freezeMinConvergedTime_; /**<Time the convergence thresholds must be fulfilled before a state is frozen [s].*/
+  double freezeNisTh_; /**<States are only frozen if the averaged normalized innovation squared is below this.*/
+  double unfreezeNisTh_; /**<All frozen states are re-activated if the averaged normalized innovation squared exceeds this.*/
+  double freezeNisAveragingWeight_; /**<Weight of the current frame in the running average of the normalized innovation squared.*/
+  double unfreezeCovarianceGain_; /**<Gain applied on the variance of re-activated states.*/
+  mutable double frameNisSum_; /**<Sum of the normalized innovation squared of the measurements of the current frame.*/
+  mutable int frameNisCount_; /**<Number of measurements in \ref frameNisSum_.*/
+  bool useBlockSparseUpdate_; /**<If true, the EKF update (reprojection error mode) exploits the block sparsity of the measurement Jacobian.*/
+  bool useBatchUpdate_; /**<If true, all accepted features of a frame are stacked into a single EKF update (reprojection error mode only).*/
+  bool batchUpdateQRCompression_; /**<If true, the stacked measurement of the batch update is compressed by a QR decomposition.*/
+  bool batchProjection_; /**<If true, all features are projected into all cameras at the start of the update and the alignment is seeded from these (prior) predictions.*/
+  bool useSpeculativeAlignment_; /**<If true (and not in direct mode), all features are aligned in parallel at the start of the update, see \ref alignAllFeatures.*/
+  int speculativeAlignmentThreads_; /**<Number of threads used for the speculative alignment.*/
+  double speculativeRealignTh_; /**<A feature is re-aligned if its prediction moved by more than this [pixel] since the speculative alignment.*/
   bool doStereoInitialization_; /**<Should a stereo match be used for feature initialization.*/
+  bool stereoEpipolarSearch_; /**<If true, the stereo match is searched along the epipolar curve, see \ref searchEpipolarMatch (otherwise 2D alignment from the initial depth).*/
+  double stereoMinDistance_; /**<Minimal distance of the epipolar search.*/
+  double stereoMaxDistance_; /**<Maximal distance of the epipolar search (<=0: infinity).*/
   bool addGlobalBest_;
   bool histogramEqualize_;
   bool bilateralBlur_;
@@ -244,6 +301,13 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
   double maxAllowedFeatureDistance_;
   double minAllowedFeatureDistance_;
   int medianKernelSize_;
+  int pyramidKernel_; /**<Downsampling kernel used for the image pyramid (0: box filter, 1: Gaussian), see \ref PyramidKernel.*/
+  bool useGridDetection_; /**<If true, candidates are detected with the grid-bucketed FAST detector (\ref FastGridDetector).*/
+  int fastGridCols_; /**<Number of detection grid cells along the image width.*/
+  int fastGridRows_; /**<Number of detection grid cells along the image height.*/
+  int fastGridMaxPerCell_; /**<Maximal number of candidates per grid cell and level.*/
+  int fastGridMinThreshold_; /**<Lower bound of the adaptive FAST threshold.*/
+  int fastGridMaxThreshold_; /**<Upper bound of the adaptive FAST threshold.*/
 
   // Temporary
   mutable PixelOutputCT pixelOutputCT_;
@@ -253,11 +317,21 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
   mutable FeatureOutput featureOutput_;
   mutable MXD featureOutputCov_;
   mutable MXD featureOutputJac_;
+  mutable FeatureOutput predictedFeatureOutput_[mtState::nMax_][mtState::nCam_]; /**<Batched feature predictions, see \ref predictAllFeatures.*/
+  mutable MXD predictedFeatureOutputCov_[mtState::nMax_][mtState::nCam_]; /**<Covariances of the batched feature predictions.*/
+  mutable bool isPredicted_[mtState::nMax_][mtState::nCam_]; /**<Validity of the batched feature predictions.*/
+  mutable PixelOutput predictedPixelOutput_[mtState::nMax_][mtState::nCam_]; /**<Batched pixel predictions.*/
+  mutable MXD predictedPixelOutputCov_[mtState::nMax_][mtState::nCam_]; /**<Covariances of the batched pixel predictions.*/
+  mutable ProjectionBatch<mtState::nMax_> projectionBatch_; /**<Structure-of-arrays buffer of the batched projection (one camera at a time).*/
+  mutable int projectionBatchFeature_[mtState::nMax_]; /**<Feature ID of each entry of \ref projectionBatch_.*/
   mutable MultilevelPatch<mtState::nLevels_,mtState::patchSize_> mlpTemp1_;
   mutable MultilevelPatch<mtState::nLevels_,mtState::patchSize_> mlpTemp2_;
   mutable FeatureCoordinates alignedCoordinates_;
   mutable FeatureCoordinates tempCoordinates_;
+  mutable FeatureDistance tempDistance_;
   mutable FeatureCoordinatesVec candidates_[mtState::nCam_];
+  mutable FastGridDetector<mtState::nLevels_> fastGridDetector_[mtState::nCam_];
+  mutable std::vector<cv::Point2f> trackedPixels_;
   //mutable std::vector<FeatureCoordinatesVec> candidates_;
   mutable cv::Point2f c_temp_;
   mutable Eigen::Matrix2d c_J_;
@@ -268,9 +342,52 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
   mutable Eigen::MatrixXd canditateGenerationDifVec_;
   mutable Eigen::MatrixXd canditateGenerationPy_;
   mutable Eigen::EigenSolver<Eigen::MatrixXd> candidateGenerationES_;
+  mutable MXD candidateGenerationPHt_;
+  mutable BlockSparseJacobian<2> sparseH_; /**<Block-sparse measurement Jacobian, see \ref performUpdateBlockSparseEKF.*/
+
+  // Temporaries of the block-sparse update
+  mutable MXD sparseUpdateH_;
+  mutable MXD sparseUpdateHn_;
+  mutable MXD sparseUpdatePy_;
+  mutable MXD sparseUpdatePHt_;
+  mutable MXD sparseUpdateInnVector_;
+  mutable MXD sparseUpdateVec_;
+  mutable mtInnovation sparseUpdateY_;
+  mutable mtInnovation sparseUpdateYIdentity_;
+  mutable mtNoise sparseUpdateNoise_;
+  mutable MXD sparseUpdateR_;
+
+  // Stacked measurement of the batch update
+  static constexpr int maxBatchRows_ = mtInnovation::D_*mtState::nMax_*mtState::nCam_;
+  mutable BlockSparseJacobian<Eigen::Dynamic> batchH_; /**<Block-sparse stacked (whitened) measurement Jacobian.*/
+  mutable MXD batchHStack_;
+  mutable MXD batchInnStack_;
+  mutable MXD batchInnVector_;
+  mutable MXD batchPy_;
+  mutable MXD batchPHt_;
+  int batchRows_; /**<Number of stacked rows in the current frame.*/
+  bool isBatchStacked_[mtState::nMax_][mtState::nCam_]; /**<Feature/camera pairs stacked into the batch update of the current frame.*/
 
   mutable MultilevelPatchAlignment<mtState::nLevels_,mtState::patchSize_> alignment_; /**<Patch aligner*/
-  mutable cv::Mat drawImg_; /**<Image currently used for drawing*/
+
+  /** \brief Result of the speculative alignment of a feature in a camera, see \ref alignAllFeatures.
+   */
+  struct SpeculativeAlignment{
+    bool isValid_;  /**<True if the feature was aligned in the current frame.*/
+    cv::Point2f predictedC_;  /**<Predicted pixel coordinates, from which the alignment was started.*/
+    bool isAligned_;  /**<Result of the alignment.*/
+    bool isInFrameAfterAlignment_;  /**<True if the aligned patch is fully in the frame.*/
+    float avgError_;  /**<Average intensity error of the aligned patch (only if patchRejectionTh_ >= 0).*/
+    int iterationCount_;  /**<Number of alignment iterations.*/
+    FeatureCoordinates alignedCoordinates_;  /**<Aligned coordinates.*/
+    MultilevelPatch<mtState::nLevels_,mtState::patchSize_> mlpError_;  /**<Error patch of the alignment.*/
+  };
+  mutable SpeculativeAlignment speculativeAlignments_[mtState::nMax_][mtState::nCam_];
+  mutable MultilevelPatchAlignment<mtState::nLevels_,mtState::patchSize_> speculativeAligners_[mtState::nMax_]; /**<One aligner per feature (thread-safety).*/
+  mutable MultilevelPatch<mtState::nLevels_,mtState::patchSize_> speculativeMlpTemp_[mtState::nMax_];
+  std::shared_ptr<ThreadPool> alignmentThreadPool_; /**<Thread pool of the speculative alignment (created on first use).*/
+  mutable FrameOverlay* mpDrawOverlay_; /**<Overlay of the camera currently used for drawing (rendered later, see FilterState::renderFrame).*/
+  bool hasFrameSubscribers_; /**<Set by the node, if false the overlays are only recorded for doFrameVisualisation.*/
   mutable Eigen::Matrix4d relativeCameraMotion_; /**<Relative pose between current and previous frame*/
 
   /** \brief Constructor.
@@ -283,7 +400,17 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
       featureOutputJac_((int)(FeatureOutput::D_),(int)(mtState::D_)),
       canditateGenerationH_(2,(int)(mtState::D_)),
       canditateGenerationDifVec_((int)(mtState::D_),1),
-      canditateGenerationPy_(2,2){
+      canditateGenerationPy_(2,2),
+      candidateGenerationPHt_((int)(mtState::D_),2),
+      sparseUpdateH_((int)(mtInnovation::D_),(int)(mtState::D_)),
+      sparseUpdateHn_((int)(mtInnovation::D_),(int)(mtNoise::D_)),
+      sparseUpdatePy_((int)(mtInnovation::D_),(int)(mtInnovation::D_)),
+      sparseUpdatePHt_((int)(mtState::D_),(int)(mtInnovation::D_)),
+      sparseUpdateInnVector_((int)(mtInnovation::D_),1),
+      sparseUpdateVec_((int)(mtState::D_),1),
+      sparseUpdateR_((int)(mtInnovation::D_),(int)(mtInnovation::D_)),
+      batchHStack_((int)(maxBatchRows_),(int)(mtState::D_)),
+      batchInnStack_((int)(maxBatchRows_),1){
     mpMultiCamera_ = nullptr;
     initCovFeature_.setIdentity();
     initDepth_ = 0.5;
@@ -302,6 +429,8 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     showCandidates_ = false;
     visualizePatches_ = false;
     publishFrames_ = false;
+    hasFrameSubscribers_ = false;
+    mpDrawOverlay_ = &disabledOverlay();
     verbose_ = false;
     healthCheck_ = false;
     trackingUpperBound_ = 0.9;
@@ -309,6 +438,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     minTrackedAndFreeFeatures_ = 0.5;
     minRelativeSTScore_ = 0.2;
     minAbsoluteSTScore_ = 0.2;
+    candidateCullingFactor_ = 0.0;
     minTimeBetweenPatchUpdate_ = 1.0;
     patchRejectionTh_ = 10.0;
     removeNegativeFeatureAfterUpdate_ = true;
@@ -326,8 +456,54 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     nObservThersh_ = 0.2;
     lineThresh_ = 2.0;
     alignMaxUniSample_ = 5;
+    alignFrameBudget_ = 0.0;
+    refIndexUpdateEpsilon_ = 1e-6;
     useCrossCameraMeasurements_ = true;
+    useCpuGovernor_ = false;
+    governorFrameBudget_ = 30.0;
+    governorMinActiveFeatures_ = 10;
+    governorRecoveryRatio_ = 0.7;
+    governorActiveFeatureLimit_ = mtState::nMax_;
+    governorSkipCrossCamera_ = false;
+    useInformationGainScheduling_ = false;
+    informationGainMaxUpdates_ = 50;
+    lastScheduledUpdates_ = 0;
+    lastSkippedUpdates_ = 0;
+    freezeCalibration_ = false;
+    freezeExtrinsicsPosStd_ = 1e-3;
+    freezeExtrinsicsAttStd_ = 2e-3;
+    freezeRefStd_ = 1e-3;
+    freezeMinConvergedTime_ = 10.0;
+    freezeNisTh_ = 3.0;
+    unfreezeNisTh_ = 6.0;
+    freezeNisAveragingWeight_ = 0.05;
+    unfreezeCovarianceGain_ = 100.0;
+    frameNisSum_ = 0.0;
+    frameNisCount_ = 0;
+    for(int i=0;i<mtState::nMax_;i++){
+      isActiveFeature_[i] = true;
+      firstScheduledCounter_[i] = 0;
+      for(int j=0;j<mtState::nCam_;j++){
+        isScheduled_[i][j] = true;
+      }
+    }
+    useBlockSparseUpdate_ = false;
+    useBatchUpdate_ = false;
+    batchUpdateQRCompression_ = true;
+    batchRows_ = 0;
+    batchProjection_ = false;
+    useSpeculativeAlignment_ = false;
+    speculativeAlignmentThreads_ = 4;
+    speculativeRealignTh_ = 0.5;
+    for(int i=0;i<mtState::nMax_;i++){
+      for(int j=0;j<mtState::nCam_;j++){
+        speculativeAlignments_[i][j].isValid_ = false;
+      }
+    }
     doStereoInitialization_ = true;
+    stereoEpipolarSearch_ = false;
+    stereoMinDistance_ = 0.2;
+    stereoMaxDistance_ = 20.0;
     addGlobalBest_ = false;
     histogramEqualize_ = false;
     medianBlur_ = false;
@@ -340,6 +516,13 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     maxAllowedFeatureDistance_ = 10.0;
     minAllowedFeatureDistance_ = 0.0;
     medianKernelSize_ = 5;
+    pyramidKernel_ = PYR_GAUSSIAN;
+    useGridDetection_ = false;
+    fastGridCols_ = 8;
+    fastGridRows_ = 6;
+    fastGridMaxPerCell_ = 3;
+    fastGridMinThreshold_ = 4;
+    fastGridMaxThreshold_ = 60;
     doubleRegister_.registerDiagonalMatrix("initCovFeature",initCovFeature_);
     doubleRegister_.registerScalar("initDepth",initDepth_);
     doubleRegister_.registerScalar("startDetectionTh",startDetectionTh_);
@@ -351,6 +534,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     doubleRegister_.registerScalar("minTrackedAndFreeFeatures",minTrackedAndFreeFeatures_);
     doubleRegister_.registerScalar("minRelativeSTScore",minRelativeSTScore_);
     doubleRegister_.registerScalar("minAbsoluteSTScore",minAbsoluteSTScore_);
+    doubleRegister_.registerScalar("candidateCullingFactor",candidateCullingFactor_);
     doubleRegister_.registerScalar("minTimeBetweenPatchUpdate",minTimeBetweenPatchUpdate_);
     doubleRegister_.registerScalar("patchRejectionTh",patchRejectionTh_);
     doubleRegister_.registerScalar("MotionDetection.rateOfMovingFeaturesTh",rateOfMovingFeaturesTh_);
@@ -369,6 +553,11 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     intRegister_.registerScalar("nDetectionBuckets",nDetectionBuckets_);
     intRegister_.registerScalar("MotionDetection.minFeatureCountForNoMotionDetection",minFeatureCountForNoMotionDetection_);
     intRegister_.registerScalar("alignMaxUniSample",alignMaxUniSample_);
+    doubleRegister_.registerScalar("alignFrameBudget",alignFrameBudget_);
+    doubleRegister_.registerScalar("refIndexUpdateEpsilon",refIndexUpdateEpsilon_);
+    boolRegister_.registerScalar("alignCoarseToFine",alignment_.useCoarseToFine_);
+    doubleRegister_.registerScalar("alignMinLevelPixUpd",alignment_.minLevelPixUpd_);
+    doubleRegister_.registerScalar("alignCoarseErrorThreshold",alignment_.coarseErrorThreshold_);
     boolRegister_.registerScalar("MotionDetection.isEnabled",doVisualMotionDetection_);
     boolRegister_.registerScalar("useDirectMethod",useDirectMethod_);
     boolRegister_.registerScalar("refractiveCalibration",refractiveCalibration_);
@@ -379,7 +568,17 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     boolRegister_.registerScalar("publishFrames", publishFrames_);
     boolRegister_.registerScalar("removeNegativeFeatureAfterUpdate",removeNegativeFeatureAfterUpdate_);
     boolRegister_.registerScalar("useCrossCameraMeasurements",useCrossCameraMeasurements_);
+    boolRegister_.registerScalar("useBlockSparseUpdate",useBlockSparseUpdate_);
+    boolRegister_.registerScalar("useBatchUpdate",useBatchUpdate_);
+    boolRegister_.registerScalar("batchUpdateQRCompression",batchUpdateQRCompression_);
+    boolRegister_.registerScalar("batchProjection",batchProjection_);
+    boolRegister_.registerScalar("useSpeculativeAlignment",useSpeculativeAlignment_);
+    intRegister_.registerScalar("speculativeAlignmentThreads",speculativeAlignmentThreads_);
+    doubleRegister_.registerScalar("speculativeRealignTh",speculativeRealignTh_);
     boolRegister_.registerScalar("doStereoInitialization",doStereoInitialization_);
+    boolRegister_.registerScalar("stereoEpipolarSearch",stereoEpipolarSearch_);
+    doubleRegister_.registerScalar("stereoMinDistance",stereoMinDistance_);
+    doubleRegister_.registerScalar("stereoMaxDistance",stereoMaxDistance_);
     boolRegister_.registerScalar("addGlobalBest",addGlobalBest_);
     boolRegister_.registerScalar("histogramEqualize",histogramEqualize_);
     boolRegister_.registerScalar("useIntensityOffsetForAlignment",alignment_.useIntensityOffset_);
@@ -408,6 +607,28 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     doubleRegister_.registerScalar("maxAllowedFeatureDistance",maxAllowedFeatureDistance_);
     doubleRegister_.registerScalar("minAllowedFeatureDistance",minAllowedFeatureDistance_);
     intRegister_.registerScalar("medianKernelSize", medianKernelSize_);
+    intRegister_.registerScalar("pyramidKernel", pyramidKernel_);
+    boolRegister_.registerScalar("GridDetection.isEnabled",useGridDetection_);
+    intRegister_.registerScalar("GridDetection.cols",fastGridCols_);
+    intRegister_.registerScalar("GridDetection.rows",fastGridRows_);
+    intRegister_.registerScalar("GridDetection.maxPerCell",fastGridMaxPerCell_);
+    intRegister_.registerScalar("GridDetection.minThreshold",fastGridMinThreshold_);
+    intRegister_.registerScalar("GridDetection.maxThreshold",fastGridMaxThreshold_);
+    boolRegister_.registerScalar("CpuGovernor.isEnabled",useCpuGovernor_);
+    doubleRegister_.registerScalar("CpuGovernor.frameBudget",governorFrameBudget_);
+    intRegister_.registerScalar("CpuGovernor.minActiveFeatures",governorMinActiveFeatures_);
+    doubleRegister_.registerScalar("CpuGovernor.recoveryRatio",governorRecoveryRatio_);
+    boolRegister_.registerScalar("InformationGainScheduling.isEnabled",useInformationGainScheduling_);
+    intRegister_.registerScalar("InformationGainScheduling.maxUpdates",informationGainMaxUpdates_);
+    boolRegister_.registerScalar("CalibrationFreezing.isEnabled",freezeCalibration_);
+    doubleRegister_.registerScalar("CalibrationFreezing.extrinsicsPosStd",freezeExtrinsicsPosStd_);
+    doubleRegister_.registerScalar("CalibrationFreezing.extrinsicsAttStd",freezeExtrinsicsAttStd_);
+    doubleRegister_.registerScalar("CalibrationFreezing.refStd",freezeRefStd_);
+    doubleRegister_.registerScalar("CalibrationFreezing.minConvergedTime",freezeMinConvergedTime_);
+    doubleRegister_.registerScalar("CalibrationFreezing.freezeNisTh",freezeNisTh_);
+    doubleRegister_.registerScalar("CalibrationFreezing.unfreezeNisTh",unfreezeNisTh_);
+    doubleRegister_.registerScalar("CalibrationFreezing.nisAveragingWeight",freezeNisAveragingWeight_);
+    doubleRegister_.registerScalar("CalibrationFreezing.unfreezeCovarianceGain",unfreezeCovarianceGain_);
 
   };
 
@@ -419,6 +640,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
    */
   void refreshProperties(){
     if(isZeroVelocityUpdateEnabled_) assert(doVisualMotionDetection_);
+    if(pyramidKernel_ != PYR_BOX && pyramidKernel_ != PYR_GAUSSIAN) ROVIO_THROW(rovio::PyramidKernelException);
     if(useDirectMethod_){
       updnoiP_.setIdentity();
       updnoiP_ = updnoiP_*updateNoiseInt_;
@@ -429,6 +651,17 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     alignment_.huberNormThreshold_ = static_cast<float>(alignmentHuberNormThreshold_);
     alignment_.computeWeightings(alignmentGaussianWeightingSigma_);
     alignment_.gradientExponent_ = static_cast<float>(alignmentGradientExponent_);
+    for(int i=0;i<mtState::nMax_;i++){
+      speculativeAligners_[i] = alignment_;
+    }
+    for(int camID=0;camID<mtState::nCam_;camID++){
+      fastGridDetector_[camID].gridCols_ = fastGridCols_;
+      fastGridDetector_[camID].gridRows_ = fastGridRows_;
+      fastGridDetector_[camID].maxPerCell_ = fastGridMaxPerCell_;
+      fastGridDetector_[camID].minThreshold_ = fastGridMinThreshold_;
+      fastGridDetector_[camID].maxThreshold_ = fastGridMaxThreshold_;
+      fastGridDetector_[camID].reset();
+    }
   };
 
   /** \brief Sets the multicamera pointer
@@ -457,11 +690,11 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     transformFeatureOutputCT_.transformState(state,featureOutput_);
 
     if(useDirectMethod_){
-      if(doFrameVisualisation_ && featureOutput_.c().com_c()){
+      if(isDrawing() && featureOutput_.c().com_c()){
         if(activeCamID==camID){
-          featureOutput_.c().drawPoint(drawImg_, cv::Scalar(0,175,175));
+          mpDrawOverlay_->addPoint(featureOutput_.c(), cv::Scalar(0,175,175));
         } else {
-          featureOutput_.c().drawPoint(drawImg_, cv::Scalar(175,175,0));
+          mpDrawOverlay_->addPoint(featureOutput_.c(), cv::Scalar(175,175,0));
         }
       }
       if(alignment_.getLinearAlignEquationsReduced(meas_.aux().pyr_[activeCamID],*state.aux().mpCurrentFeature_->mpMultilevelPatch_,featureOutput_.c(),endLevel_,startLevel_,A_red_,b_red_)){
@@ -507,7 +740,10 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
         int ref_ind = mtState::template getId<mtState::_ref>();
         canditateGenerationH_.col(ref_ind) = -Jdpdn;
       }
-      canditateGenerationPy_ = canditateGenerationH_*filterState.cov_*canditateGenerationH_.transpose();
+      removeFrozenColumns(canditateGenerationH_,candidate);
+      sparseH_.setFromDense(canditateGenerationH_);
+      sparseH_.multiplyCovTransposed(filterState.cov_,candidateGenerationPHt_);
+      sparseH_.multiply(candidateGenerationPHt_,canditateGenerationPy_);
       candidateGenerationES_.compute(canditateGenerationPy_);
     }
 
@@ -520,7 +756,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
           + pow(v*alignConvergencePixelRange_,2)/candidateGenerationES_.eigenvalues()(1).real() < pow(alignCoverageRatio_,2)){
         Eigen::Vector2d dy = u*alignConvergencePixelRange_*candidateGenerationES_.eigenvectors().col(0).real()
             + v*alignConvergencePixelRange_*candidateGenerationES_.eigenvectors().col(1).real();
-        canditateGenerationDifVec_ = -filterState.cov_*canditateGenerationH_.transpose()*canditateGenerationPy_.inverse()*dy;
+        canditateGenerationDifVec_ = -candidateGenerationPHt_*(canditateGenerationPy_.inverse()*dy);
         candidate.boxPlus(canditateGenerationDifVec_,candidate);
         return true;
       }
@@ -539,7 +775,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     if(!hasConverged_){
       if(verbose_) std::cout << "    \033[31mREJECTED (iterations did no converge)\033[0m" << std::endl;
       if(mlpTemp1_.isMultilevelPatchInFrame(meas_.aux().pyr_[activeCamID],featureOutput_.c(),startLevel_,false)){
-        featureOutput_.c().drawPoint(drawImg_, cv::Scalar(255,0,0),1.0);
+        mpDrawOverlay_->addPoint(featureOutput_.c(), cv::Scalar(255,0,0),1.0);
       }
       return false;
     }
@@ -553,7 +789,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
       const float avgError = mlpTemp1_.computeAverageDifference(*state.aux().mpCurrentFeature_->mpMultilevelPatch_,endLevel_,startLevel_);
       if(avgError > patchRejectionTh_){
         if(verbose_) std::cout << "    \033[31mREJECTED (error too large: " << avgError << ")\033[0m" << std::endl;
-        featureOutput_.c().drawPoint(drawImg_, cv::Scalar(255,255,0),1.0);
+        mpDrawOverlay_->addPoint(featureOutput_.c(), cv::Scalar(255,255,0),1.0);
         return false;
       }
 
@@ -573,9 +809,9 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
                 | (discriminativeSamplingGain_ > 1.0 & sampleError > discriminativeSamplingGain_*avgError);
             countAboveThreshold += isAboveThreshold;
             if(isAboveThreshold){
-              sample.c().drawPoint(drawImg_, cv::Scalar(0,255,0),2.0);
+              mpDrawOverlay_->addPoint(sample.c(), cv::Scalar(0,255,0),2.0);
             } else {
-              sample.c().drawPoint(drawImg_, cv::Scalar(0,0,255),2.0);
+              mpDrawOverlay_->addPoint(sample.c(), cv::Scalar(0,0,255),2.0);
             }
           }
         }
@@ -586,7 +822,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
       }
     }
 
-    featureOutput_.c().drawPoint(drawImg_, cv::Scalar(0,0,255),1.0);
+    mpDrawOverlay_->addPoint(featureOutput_.c(), cv::Scalar(0,0,255),1.0);
     return true;
   }
 
@@ -606,11 +842,11 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     transformFeatureOutputCT_.transformState(state,featureOutput_);
 
     if(useDirectMethod_){
-      if ((doFrameVisualisation_ || publishFrames_) && featureOutput_.c().com_c()) {
+      if (isDrawing() && featureOutput_.c().com_c()) {
         if (activeCamID == camID) {
-          featureOutput_.c().drawPoint(drawImg_, cv::Scalar(0, 175, 175));
+          mpDrawOverlay_->addPoint(featureOutput_.c(), cv::Scalar(0, 175, 175));
         } else {
-          featureOutput_.c().drawPoint(drawImg_, cv::Scalar(175, 175, 0));
+          mpDrawOverlay_->addPoint(featureOutput_.c(), cv::Scalar(175, 175, 0));
         }
       }
       if(alignment_.getLinearAlignEquationsReduced(meas_.aux().pyr_[activeCamID],*state.aux().mpCurrentFeature_->mpMultilevelPatch_,featureOutput_.c(),endLevel_,startLevel_,A_red_,b_red_)){
@@ -671,13 +907,13 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
         cv::Point2f epipolar_line_end;
         epipolar_line_end.x = featureOutput_.c().get_c().x + 50*epipolar_line_uvec(0);
         epipolar_line_end.y = featureOutput_.c().get_c().y + 50*epipolar_line_uvec(1);
-        cv::line(drawImg_, featureOutput_.c().get_c(), epipolar_line_end, cv::Scalar(255, 10, 0), 1, 8, 0);
+        mpDrawOverlay_->addLine(featureOutput_.c().get_c(), epipolar_line_end, cv::Scalar(255, 10, 0));
 
         // Plotting the delta pixel
         cv::Point2f delta_pixel_end;
         delta_pixel_end.x = featureOutput_.c().get_c().x + 50*delta_pixel(0);
         delta_pixel_end.y = featureOutput_.c().get_c().y + 50*delta_pixel(1);
-        cv::line(drawImg_, featureOutput_.c().get_c(), delta_pixel_end, cv::Scalar(0, 10, 255), 1, 8, 0);
+        mpDrawOverlay_->addLine(featureOutput_.c().get_c(), delta_pixel_end, cv::Scalar(0, 10, 255));
 
         Eigen::Vector2d tangent_vec;
         tangent_vec(0) = -point(1);
@@ -687,7 +923,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
         cv::Point2f radial_line_end;
         radial_line_end.x = featureOutput_.c().get_c().x - 50*tangent_vec(1);
         radial_line_end.y = featureOutput_.c().get_c().y + 50*tangent_vec(0);
-        cv::line(drawImg_, featureOutput_.c().get_c(), radial_line_end, cv::Scalar(0, 255, 0), 1, 8, 0);
+        mpDrawOverlay_->addLine(featureOutput_.c().get_c(), radial_line_end, cv::Scalar(0, 255, 0));
 
 
         double cos_theta = epipolar_line_uvec.transpose()*tangent_vec;
@@ -705,7 +941,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
         // Color of text changing linearly based on the metric
         auto color = cv::Scalar(255*metric,0, 255*(1-metric));
 
-        // featureOutput_.c().drawText(drawImg_, "___Obs" , color);
+        // mpDrawOverlay_->addText(featureOutput_.c(), "___Obs" , color);
         
         bool line_cond = (featureOutput_.c().sigma1_/featureOutput_.c().sigma2_) > lineThresh_;
 
@@ -722,7 +958,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
           // to reject points with high sigma
           // if (featureOutput_.c().sigma1_ > nObservThersh_ || line_cond || angle > 0.025){
           //   F.col(ref_ind) = F.col(ref_ind)*0.0;
-          //   featureOutput_.c().drawText(drawImg_, "_____Rejected" , cv::Scalar(0, 255, 0));
+          //   mpDrawOverlay_->addText(featureOutput_.c(), "_____Rejected" , cv::Scalar(0, 255, 0));
           // }
 
         }
@@ -734,7 +970,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
           double cos_angle = featureOutput_.c().eigenVector2_.transpose()*epipolar_line_uvec;
           // if (abs(cos_angle) > 0.7){
           //   F = F*0.0;
-          //   featureOutput_.c().drawText(drawImg_, "_____Rejected" , cv::Scalar(0, 10, 255));
+          //   mpDrawOverlay_->addText(featureOutput_.c(), "_____Rejected" , cv::Scalar(0, 10, 255));
           // }
         }
 
@@ -794,15 +1030,34 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
         F.col(ref_ind) = -Jdpdn; /* Jdpdn is the jacobian of bearing to pixel function w.r.t. refractive index*/
 
         if (metric > nObservThersh_){
-          featureOutput_.c().drawText(drawImg_, "____High Obs" , cv::Scalar(255, 10, 0));
+          mpDrawOverlay_->addText(featureOutput_.c(), "____High Obs" , cv::Scalar(255, 10, 0));
         }
         else{
-          featureOutput_.c().drawText(drawImg_, "____Low Obs" , cv::Scalar(10, 10, 255));
+          mpDrawOverlay_->addText(featureOutput_.c(), "____Low Obs" , cv::Scalar(10, 10, 255));
         }
 
       }
 
     }
+    removeFrozenColumns(F,state);
+  }
+
+  /** \brief Removes the columns of the frozen calibration states from a measurement Jacobian, such that these states
+   *  are neither corrected nor correlated by the update (see \ref updateCalibrationFreezing).
+   *
+   *   @param H     - Measurement Jacobian.
+   *   @param state - Filter state.
+   */
+  void removeFrozenColumns(MXD& H, const mtState& state) const{
+    if(state.aux().isRefFrozen_){
+      H.col(mtState::template getId<mtState::_ref>()).setZero();
+    }
+    for(int i=0;i<mtState::nCam_;i++){
+      if(state.aux().isExtrinsicsFrozen_[i]){
+        H.template middleCols<3>(mtState::template getId<mtState::_vep>(i)).setZero();
+        H.template middleCols<3>(mtState::template getId<mtState::_vea>(i)).setZero();
+      }
+    }
   }
 
   /** \brief Computes the Jacobian for the update step of the filter.
@@ -815,6 +1070,594 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     G.template block<2,2>(mtInnovation::template getId<mtInnovation::_pix>(),mtNoise::template getId<mtNoise::_pix>()) = Eigen::Matrix2d::Identity();
   }
 
+  /** \brief Performs the image update.
+   *
+   *  Replaces the update loop of the base class if \ref useBlockSparseUpdate_ or \ref useBatchUpdate_ is set and the
+   *  filter runs in EKF mode (reprojection error). Otherwise the update of the base class is used.
+   *  In batch mode the features are gated and stacked one by one (on the predicted state) and a single update is
+   *  performed before the common post-processing. After it the features with invalid distance are removed and the
+   *  tracking status of the stacked features is set on the updated state.
+   *
+   *   @param filterState - Filter state.
+   *   @param meas        - Update measurement.
+   *   @return 0 if successful.
+   */
+  int performUpdate(mtFilterState& filterState, const mtMeas& meas){
+    ROVIO_PROFILE_SCOPE("img_update");
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      for(int j=0;j<mtState::nCam_;j++){
+        isBatchStacked_[i][j] = false;
+      }
+    }
+    if((!useBlockSparseUpdate_ && !useBatchUpdate_) || filterState.mode_ != LWF::ModeEKF){
+      return Base::performUpdate(filterState,meas);
+    }
+    bool isFinished = true;
+    batchRows_ = 0;
+    do {
+      preProcess(filterState,meas,isFinished);
+      if(!isFinished){
+        if(useBatchUpdate_){
+          stackBatchMeasurement(filterState,meas);
+        } else {
+          performUpdateBlockSparseEKF(filterState,meas);
+        }
+      } else if(useBatchUpdate_){
+        performBatchUpdate(filterState);
+        removeInvalidDistanceFeatures(filterState);
+        updateBatchStatus(filterState,meas);
+      }
+      postProcess(filterState,meas,outlierDetection_,isFinished);
+      filterState.state_.fix();
+    } while(!isFinished);
+    return 0;
+  }
+
+  /** \brief Gates the measurement of the currently active feature and appends it to the stacked batch measurement.
+   *
+   *  The outlier detection is done with the innovation covariance of the predicted state. Accepted measurements are
+   *  whitened by their noise, such that the stacked measurement has unit noise.
+   *
+   *   @param filterState - Filter state.
+   *   @param meas        - Update measurement.
+   */
+  void stackBatchMeasurement(mtFilterState& filterState, const mtMeas& meas){
+    meas_ = meas;
+    jacState(sparseUpdateH_,filterState.state_);
+    jacNoise(sparseUpdateHn_,filterState.state_);
+    sparseUpdateNoise_.setIdentity();
+    evalInnovation(sparseUpdateY_,filterState.state_,sparseUpdateNoise_);
+    sparseUpdateYIdentity_.setIdentity();
+    sparseUpdateY_.boxMinus(sparseUpdateYIdentity_,sparseUpdateInnVector_);
+    sparseUpdateR_ = sparseUpdateHn_*updnoiP_*sparseUpdateHn_.transpose();
+
+    // Gating on the predicted state (every feature/camera pair is stacked at most once)
+    assert(batchRows_ + (int)(mtInnovation::D_) <= (int)(maxBatchRows_));
+    batchHStack_.middleRows(batchRows_,mtInnovation::D_) = sparseUpdateH_;
+    sparseH_.setFromDense(sparseUpdateH_);
+    sparseH_.multiplyCovTransposed(filterState.cov_,sparseUpdatePHt_);
+    sparseH_.multiply(sparseUpdatePHt_,sparseUpdatePy_);
+    sparseUpdatePy_ += sparseUpdateR_;
+    outlierDetection_.doOutlierDetection(sparseUpdateInnVector_,sparseUpdatePy_,sparseUpdateH_);
+    if(outlierDetection_.isOutlier(0)) return;
+    const int ID = filterState.state_.aux().activeFeature_;
+    isBatchStacked_[ID][(filterState.state_.aux().activeCameraCounter_ + filterState.fsm_.features_[ID].mpCoordinates_->camID_)%mtState::nCam_] = true;
+
+    // Whitening
+    const Eigen::Matrix<double,mtInnovation::D_,mtInnovation::D_> L = sparseUpdateR_.llt().matrixL();
+    L.template triangularView<Eigen::Lower>().solveInPlace(batchHStack_.middleRows(batchRows_,mtInnovation::D_));
+    batchInnStack_.middleRows(batchRows_,mtInnovation::D_) = L.template triangularView<Eigen::Lower>().solve(sparseUpdateInnVector_);
+    batchRows_ += mtInnovation::D_;
+  }
+
+  /** \brief Single EKF update with the stacked measurement of all accepted features.
+   *
+   *  If \ref batchUpdateQRCompression_ is set and there are more stacked rows than involved state columns, the stacked
+   *  measurement is first reduced by a QR decomposition (since the stacked noise is white this does not change the
+   *  update).
+   *
+   *   @param filterState - Filter state.
+   */
+  void performBatchUpdate(mtFilterState& filterState){
+    if(batchRows_ == 0) return;
+    ROVIO_PROFILE_SCOPE("ekf_update");
+    batchH_.setFromDense(batchHStack_.topRows(batchRows_));
+    batchInnVector_ = batchInnStack_.topRows(batchRows_);
+    if(batchUpdateQRCompression_ && batchRows_ > batchH_.nonZeroCols()){
+      const int k = batchH_.nonZeroCols();
+      Eigen::HouseholderQR<MXD> qr(batchH_.values_);
+      batchInnVector_.applyOnTheLeft(qr.householderQ().transpose());
+      batchInnVector_.conservativeResize(k,1);
+      batchH_.values_ = qr.matrixQR().topRows(k).template triangularView<Eigen::Upper>();
+    }
+    if(verbose_) std::cout << "    Batch update with " << batchRows_ << " rows (" << batchH_.values_.rows() << " after compression)" << std::endl;
+    const int m = batchH_.values_.rows();
+    batchH_.multiplyCovTransposed(filterState.cov_,batchPHt_);
+    batchH_.multiply(batchPHt_,batchPy_);
+    batchPy_ += MXD::Identity(m,m);
+    if(!computeSquareRootGain(batchPHt_,batchPy_,batchInnVector_)) return;
+    sparseUpdateVec_.noalias() = -batchPHt_*batchInnVector_;
+    filterState.state_.boxPlus(sparseUpdateVec_,filterState.state_);
+    symmetricDowndate(filterState.cov_,batchPHt_);
+  }
+
+  /** \brief Sets the tracking status of the feature/camera pairs of the batch update on the updated state (the
+   *  post-processing of the individual features runs before the batch update, see \ref performUpdate).
+   *
+   *   @param filterState - Filter state.
+   *   @param meas        - Update measurement.
+   */
+  void updateBatchStatus(mtFilterState& filterState, const mtMeas& meas){
+    for(unsigned int ID=0;ID<mtState::nMax_;ID++){
+      if(!filterState.fsm_.isValid_[ID]) continue;
+      for(int activeCamID=0;activeCamID<mtState::nCam_;activeCamID++){
+        if(isBatchStacked_[ID][activeCamID]){
+          updateFeatureStatus(filterState,meas,outlierDetection_,ID,activeCamID,true);
+        }
+      }
+    }
+  }
+
+  /** \brief EKF update of the currently active feature, handling the measurement Jacobian as block-sparse operator.
+   *
+   *  The Jacobian is only nonzero in the pose, velocity, extrinsics and refractive index blocks and in the block of the
+   *  updated feature. P*H^T is computed by gathering the corresponding columns of the covariance and the covariance is
+   *  updated by a symmetric rank-2 correction (lower triangle only, see \ref symmetricDowndate), such that no D x D
+   *  temporaries are required.
+   *
+   *   @param filterState - Filter state.
+   *   @param meas        - Update measurement.
+   */
+  void performUpdateBlockSparseEKF(mtFilterState& filterState, const mtMeas& meas){
+    ROVIO_PROFILE_SCOPE("ekf_update");
+    meas_ = meas;
+    jacState(sparseUpdateH_,filterState.state_);
+    jacNoise(sparseUpdateHn_,filterState.state_);
+    sparseUpdateNoise_.setIdentity();
+    evalInnovation(sparseUpdateY_,filterState.state_,sparseUpdateNoise_);
+    sparseUpdateYIdentity_.setIdentity();
+    sparseUpdateY_.boxMinus(sparseUpdateYIdentity_,sparseUpdateInnVector_);
+
+    sparseH_.setFromDense(sparseUpdateH_);
+    sparseH_.multiplyCovTransposed(filterState.cov_,sparseUpdatePHt_);
+    sparseH_.multiply(sparseUpdatePHt_,sparseUpdatePy_);
+    sparseUpdatePy_ += sparseUpdateHn_*updnoiP_*sparseUpdateHn_.transpose();
+
+    // Outlier detection
+    outlierDetection_.doOutlierDetection(sparseUpdateInnVector_,sparseUpdatePy_,sparseUpdateH_);
+    if(outlierDetection_.isOutlier(0)) return;
+
+    // Kalman update in square-root form
+    if(!computeSquareRootGain(sparseUpdatePHt_,sparseUpdatePy_,sparseUpdateInnVector_)) return;
+    sparseUpdateVec_.noalias() = -sparseUpdatePHt_*sparseUpdateInnVector_;
+    filterState.state_.boxPlus(sparseUpdateVec_,filterState.state_);
+    symmetricDowndate(filterState.cov_,sparseUpdatePHt_);
+  }
+
+  /** \brief Transforms a feature into a camera frame and computes the covariance of the transformed feature.
+   *
+   *  The Jacobian of \ref TransformFeatureOutputCT is only nonzero in the block of the feature and in the extrinsics
+   *  blocks of the two involved cameras. Only these (at most 15) columns are gathered, such that the covariance
+   *  propagation does not scale with the state dimension. Frozen extrinsics are treated as known.
+   *
+   *   @param state     - Filter state.
+   *   @param cov       - Filter covariance.
+   *   @param ID        - Feature ID.
+   *   @param camID     - Target camera ID.
+   *   @param output    - Transformed feature.
+   *   @param outputCov - Covariance of the transformed feature.
+   */
+  void transformFeatureOutput(const mtState& state, const MXD& cov, const int ID, const int camID, FeatureOutput& output, MXD& outputCov) const{
+    transformFeatureOutputCT_.setFeatureID(ID);
+    transformFeatureOutputCT_.setOutputCameraID(camID);
+    transformFeatureOutputCT_.transformState(state,output);
+    transformFeatureOutputCT_.jacTransform(featureOutputJac_,state);
+
+    int blockStart[5];
+    int nBlocks = 0;
+    blockStart[nBlocks++] = mtState::template getId<mtState::_fea>(ID);
+    const int& featureCamID = state.CfP(ID).camID_;
+    if(featureCamID != camID && state.aux().doVECalibration_){
+      const int cams[2] = {featureCamID,camID};
+      for(int i=0;i<2;i++){
+        if(state.aux().isExtrinsicsFrozen_[cams[i]]) continue;
+        blockStart[nBlocks++] = mtState::template getId<mtState::_vea>(cams[i]);
+        blockStart[nBlocks++] = mtState::template getId<mtState::_vep>(cams[i]);
+      }
+    }
+    Eigen::Matrix<double,3,15> J;
+    Eigen::Matrix<double,15,15> P;
+    for(int i=0;i<nBlocks;i++){
+      J.template block<3,3>(0,3*i) = featureOutputJac_.template block<3,3>(0,blockStart[i]);
+      for(int j=0;j<nBlocks;j++){
+        P.template block<3,3>(3*i,3*j) = cov.template block<3,3>(blockStart[i],blockStart[j]);
+      }
+    }
+    const int n = 3*nBlocks;
+    outputCov = J.leftCols(n)*P.topLeftCorner(n,n)*J.leftCols(n).transpose();
+  }
+
+  /** \brief Batch stage of the image update: transforms all valid features into all cameras used for their update.
+   *
+   *  The predictions are based on the state at the beginning of the update, i.e., they do not include the changes
+   *  of the preceding feature updates within the same frame. The transformed bearing vectors are then projected per
+   *  camera in one structure-of-arrays pass (Camera::bearingToPixelBatch), which yields the predicted pixels and
+   *  pixel covariances read by the update loop.
+   *
+   *   @param filterState - Filter state.
+   */
+  void predictAllFeatures(mtFilterState& filterState) const{
+    filterState.state_.updateMultiCameraExtrinsics(mpMultiCamera_);
+    filterState.state_.updateRefIndex(mpMultiCamera_,refIndexUpdateEpsilon_);
+    const int nPredictedCams = useCrossCameraUpdates() ? mtState::nCam_ : 1;
+    for(int i=0;i<mtState::nMax_;i++){
+      for(int j=0;j<mtState::nCam_;j++){
+        isPredicted_[i][j] = false;
+      }
+      if(filterState.fsm_.isValid_[i] && isActiveFeature_[i]){
+        const int camID = filterState.state_.CfP(i).camID_;
+        for(int j=0;j<nPredictedCams;j++){
+          const int activeCamID = (j + camID)%mtState::nCam_;
+          transformFeatureOutput(filterState.state_,filterState.cov_,i,activeCamID,predictedFeatureOutput_[i][activeCamID],predictedFeatureOutputCov_[i][activeCamID]);
+          isPredicted_[i][activeCamID] = true;
+        }
+      }
+    }
+
+    // Project all predictions of a camera in one structure-of-arrays pass (pixel coordinates and Jacobians)
+    Eigen::Matrix<double,2,3> J;
+    Eigen::Matrix2d Jpix;
+    for(int camID=0;camID<mtState::nCam_;camID++){
+      ProjectionBatch<mtState::nMax_>& batch = projectionBatch_;
+      batch.n_ = 0;
+      for(int i=0;i<mtState::nMax_;i++){
+        if(!isPredicted_[i][camID]) continue;
+        const Eigen::Vector3d vec = predictedFeatureOutput_[i][camID].c().get_nor().getVec();
+        batch.x_[batch.n_] = vec(0);
+        batch.y_[batch.n_] = vec(1);
+        batch.z_[batch.n_] = vec(2);
+        projectionBatchFeature_[batch.n_] = i;
+        batch.n_++;
+      }
+      if(batch.n_ == 0) continue;
+      mpMultiCamera_->cameras_[camID].bearingToPixelBatch(batch);
+      for(int k=0;k<batch.n_;k++){
+        const int i = projectionBatchFeature_[k];
+        FeatureCoordinates& c = predictedFeatureOutput_[i][camID].c();
+        if(!batch.valid_[k]) continue; // Behind the camera, rejected by the frame check of the update loop
+        c.set_projected_c(cv::Point2f(static_cast<float>(batch.u_[k]),static_cast<float>(batch.v_[k])));
+        predictedPixelOutput_[i][camID].template get<PixelOutput::_pix>() = Eigen::Vector2d(c.get_c().x,c.get_c().y);
+        J << batch.J_[0][k], batch.J_[1][k], batch.J_[2][k], batch.J_[3][k], batch.J_[4][k], batch.J_[5][k];
+        Jpix = J*c.get_nor().getM();
+        predictedPixelOutputCov_[i][camID] = Jpix*predictedFeatureOutputCov_[i][camID].template block<2,2>(FeatureOutput::template getId<FeatureOutput::_fea>(),FeatureOutput::template getId<FeatureOutput::_fea>())*Jpix.transpose();
+      }
+    }
+  }
+  /** \brief Speculative alignment stage of the image update: aligns all valid features in all cameras used for their
+   *         update in parallel (\ref speculativeAlignmentThreads_).
+   *
+   *  The alignments are started from the predictions of \ref predictAllFeatures, i.e., they do not include the changes
+   *  of the preceding feature updates within the same frame. The sequential update loop uses the result if the current
+   *  prediction did not move by more than \ref speculativeRealignTh_ and re-aligns the feature otherwise.
+   *  Each feature is handled by one job (with its own aligner), such that its patch is only accessed by one thread.
+   *
+   *   @param filterState - Filter state.
+   *   @param meas        - Update measurement.
+   */
+  void alignAllFeatures(mtFilterState& filterState, const mtMeas& meas){
+    ROVIO_PROFILE_SCOPE("speculative_alignment");
+    if(!batchProjection_ && !useInformationGainScheduling_) predictAllFeatures(filterState);
+    if(!alignmentThreadPool_ || alignmentThreadPool_->size() != std::max(speculativeAlignmentThreads_,1)){
+      alignmentThreadPool_.reset(new ThreadPool(std::max(speculativeAlignmentThreads_,1)));
+    }
+    int featureIDs[mtState::nMax_];
+    int nFeatures = 0;
+    for(int i=0;i<mtState::nMax_;i++){
+      for(int j=0;j<mtState::nCam_;j++){
+        speculativeAlignments_[i][j].isValid_ = false;
+        if(isPredicted_[i][j]){
+          pixelOutputCT_.transformState(predictedFeatureOutput_[i][j],pixelOutput_);
+          pixelOutputCT_.transformCovMat(predictedFeatureOutput_[i][j],predictedFeatureOutputCov_[i][j],pixelOutputCov_);
+          predictedFeatureOutput_[i][j].c().setPixelCov(pixelOutputCov_);
+        }
+      }
+      if(filterState.fsm_.isValid_[i] && isActiveFeature_[i]) featureIDs[nFeatures++] = i;
+    }
+    alignmentThreadPool_->parallelFor(nFeatures,[&](int k){
+      const int i = featureIDs[k];
+      const FeatureManager<mtState::nLevels_,mtState::patchSize_,mtState::nCam_>& f = filterState.fsm_.features_[i];
+      const int camID = f.mpCoordinates_->camID_;
+      MultilevelPatchAlignment<mtState::nLevels_,mtState::patchSize_>& aligner = speculativeAligners_[i];
+      MultilevelPatch<mtState::nLevels_,mtState::patchSize_>& mlpTemp = speculativeMlpTemp_[i];
+      for(int j=0;j<mtState::nCam_;j++){
+        if(!isPredicted_[i][j] || !isScheduled_[i][j]) continue;
+        const FeatureCoordinates& cInit = predictedFeatureOutput_[i][j].c();
+        if(!mlpTemp.isMultilevelPatchInFrame(filterState.prevPyr_[camID],cInit,startLevel_,false)) continue;
+        SpeculativeAlignment& result = speculativeAlignments_[i][j];
+        result.predictedC_ = cInit.get_c();
+        result.isAligned_ = aligner.align2DAdaptive(result.alignedCoordinates_,meas.aux().pyr_[j],*f.mpMultilevelPatch_,cInit,startLevel_,endLevel_,
+                                                    alignConvergencePixelRange_,alignCoverageRatio_,alignMaxUniSample_);
+        result.iterationCount_ = aligner.iterationCount_;
+        result.mlpError_ = aligner.mlpError_;
+        result.isInFrameAfterAlignment_ = result.isAligned_ && mlpTemp.isMultilevelPatchInFrame(meas.aux().pyr_[j],result.alignedCoordinates_,startLevel_,false);
+        result.avgError_ = 0.0;
+        if(result.isInFrameAfterAlignment_ && patchRejectionTh_ >= 0){
+          mlpTemp.extractMultilevelPatchFromImage(meas.aux().pyr_[j],result.alignedCoordinates_,startLevel_,false);
+          result.avgError_ = mlpTemp.computeAverageDifference(*f.mpMultilevelPatch_,endLevel_,startLevel_);
+        }
+        result.isValid_ = true;
+      }
+    });
+  }
+
+
+  /** \brief Returns whether the features are currently also updated in the other cameras.
+   */
+  bool useCrossCameraUpdates() const{
+    return useCrossCameraMeasurements_ && !(useCpuGovernor_ && governorSkipCrossCamera_);
+  }
+
+  /** \brief Selects the features which are updated in the current frame (\ref isActiveFeature_).
+   *
+   *  If the governor limits the number of features, the valid features are ranked by the product of their average
+   *  local tracking quality and the Shi-Tomasi score of their patch. The score is scaled by the number of frames since
+   *  the last update of the feature, such that skipped features are eventually updated again. The statistics of
+   *  skipped features are kept as they are (they are not increased in \ref preProcess).
+   *
+   *   @param filterState - Filter state (before the current frame is processed).
+   */
+  void selectActiveFeatures(const mtFilterState& filterState){
+    for(int i=0;i<mtState::nMax_;i++){
+      isActiveFeature_[i] = true;
+    }
+    if(!useCpuGovernor_ || (int)(filterState.fsm_.getValidCount()) <= governorActiveFeatureLimit_) return;
+    const double frameInterval = std::max(filterState.t_-filterState.imgTime_,1e-6);
+    std::vector<std::pair<double,int>> ranking;
+    ranking.reserve(mtState::nMax_);
+    for(int i=0;i<mtState::nMax_;i++){
+      if(filterState.fsm_.isValid_[i]){
+        const FeatureManager<mtState::nLevels_,mtState::patchSize_,mtState::nCam_>& f = filterState.fsm_.features_[i];
+        const double skippedFrames = std::max((filterState.t_-f.mpStatistics_->currentTime_)/frameInterval,1.0);
+        ranking.push_back(std::make_pair(f.mpStatistics_->getAverageLocalQuality()*f.mpMultilevelPatch_->s_*skippedFrames,i));
+        isActiveFeature_[i] = false;
+      }
+    }
+    std::partial_sort(ranking.begin(),ranking.begin()+governorActiveFeatureLimit_,ranking.end(),std::greater<std::pair<double,int>>());
+    for(int k=0;k<governorActiveFeatureLimit_;k++){
+      isActiveFeature_[ranking[k].second] = true;
+    }
+  }
+
+  /** \brief Schedules the (feature, camera) updates of the current frame (\ref isScheduled_).
+   *
+   *  With \ref useInformationGainScheduling_ the expected information gain of each predicted in-frame measurement is
+   *  approximated from its predicted pixel covariance \f$\Sigma\f$ and the pixel update noise \f$\sigma^2\f$ as
+   *  \f$\frac{1}{2}\log\det(I+\Sigma/\sigma^2)\f$, and only the \ref informationGainMaxUpdates_ best measurements are
+   *  performed. The gains are all evaluated on the prior, i.e., the correlation between the measurements is neglected.
+   *  Measurements which are predicted out of frame stay scheduled (they are rejected early anyway).
+   *  Requires the predictions of \ref predictAllFeatures, the pixel covariances are read from
+   *  \ref predictedPixelOutputCov_.
+   *
+   *   @param filterState - Filter state.
+   */
+  void scheduleUpdates(const mtFilterState& filterState){
+    for(int i=0;i<mtState::nMax_;i++){
+      firstScheduledCounter_[i] = 0;
+      for(int j=0;j<mtState::nCam_;j++){
+        isScheduled_[i][j] = true;
+      }
+    }
+    if(!useInformationGainScheduling_) return;
+    const int nCams = useCrossCameraUpdates() ? mtState::nCam_ : 1;
+    std::vector<std::pair<double,std::pair<int,int>>> ranking;
+    ranking.reserve(mtState::nMax_*nCams);
+    for(int i=0;i<mtState::nMax_;i++){
+      if(!filterState.fsm_.isValid_[i] || !isActiveFeature_[i]) continue;
+      const int camID = filterState.fsm_.features_[i].mpCoordinates_->camID_;
+      for(int j=0;j<mtState::nCam_;j++){
+        if(!isPredicted_[i][j]) continue;
+        const FeatureOutput& prediction = predictedFeatureOutput_[i][j];
+        if(!mlpTemp1_.isMultilevelPatchInFrame(filterState.prevPyr_[camID],prediction.c(),startLevel_,false)) continue;
+        const Eigen::Matrix2d S = Eigen::Matrix2d::Identity() + predictedPixelOutputCov_[i][j].template topLeftCorner<2,2>()/updateNoisePix_;
+        ranking.push_back(std::make_pair(0.5*std::log(S.determinant()),std::make_pair(i,j)));
+        isScheduled_[i][j] = false;
+      }
+    }
+    const int nScheduled = std::min((int)(ranking.size()),std::max(informationGainMaxUpdates_,0));
+    std::partial_sort(ranking.begin(),ranking.begin()+nScheduled,ranking.end(),std::greater<std::pair<double,std::pair<int,int>>>());
+    for(int k=0;k<nScheduled;k++){
+      isScheduled_[ranking[k].second.first][ranking[k].second.second] = true;
+    }
+    for(int i=0;i<mtState::nMax_;i++){
+      if(!filterState.fsm_.isValid_[i] || !isActiveFeature_[i]) continue;
+      const int camID = filterState.fsm_.features_[i].mpCoordinates_->camID_;
+      while(firstScheduledCounter_[i] < nCams && !isScheduled_[i][(firstScheduledCounter_[i]+camID)%mtState::nCam_]){
+        firstScheduledCounter_[i]++;
+      }
+    }
+    lastScheduledUpdates_ = nScheduled;
+    lastSkippedUpdates_ = (int)(ranking.size())-nScheduled;
+    if(verbose_) std::cout << "Information gain scheduling: " << nScheduled << " updates scheduled, " << lastSkippedUpdates_ << " skipped" << std::endl;
+  }
+
+  /** \brief Adapts the processing of the next frame to the measured processing time of the current one.
+   *
+   *  If the budget is exceeded, the cross-camera updates are dropped first and then the number of updated features is
+   *  reduced proportionally (down to \ref governorMinActiveFeatures_). Below \ref governorRecoveryRatio_ of the budget
+   *  the processing is restored in reverse order.
+   */
+  void updateCpuGovernor(){
+    if(!useCpuGovernor_) return;
+    const double frameTime = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-governorFrameStart_).count();
+    const int minActiveFeatures = std::min(std::max(governorMinActiveFeatures_,1),(int)(mtState::nMax_));
+    if(frameTime > governorFrameBudget_){
+      if(useCrossCameraMeasurements_ && mtState::nCam_ > 1 && !governorSkipCrossCamera_){
+        governorSkipCrossCamera_ = true;
+      } else {
+        governorActiveFeatureLimit_ = std::max(minActiveFeatures,std::min(governorActiveFeatureLimit_-1,(int)(governorActiveFeatureLimit_*governorFrameBudget_/frameTime)));
+      }
+      if(verbose_) std::cout << "CPU governor: frame time " << frameTime << " ms, updating " << governorActiveFeatureLimit_ << " features" << (governorSkipCrossCamera_ ? " (no cross-camera updates)" : "") << std::endl;
+    } else if(frameTime < governorRecoveryRatio_*governorFrameBudget_){
+      if(governorActiveFeatureLimit_ < (int)(mtState::nMax_)){
+        governorActiveFeatureLimit_++;
+      } else {
+        governorSkipCrossCamera_ = false;
+      }
+    }
+  }
+
+  /** \brief Copies the state which the image update adapts across frames (adaptive FAST thresholds and CPU governor
+   *         limits), such that a rolled back filter can be replayed with the state of its checkpoint.
+   *
+   *   @param state - Adaptive state.
+   */
+  void saveAdaptiveState(AdaptiveState& state) const{
+    for(int camID=0;camID<mtState::nCam_;camID++){
+      fastGridDetector_[camID].getThresholds(state.fastGridThresholds_[camID]);
+    }
+    state.governorActiveFeatureLimit_ = governorActiveFeatureLimit_;
+    state.governorSkipCrossCamera_ = governorSkipCrossCamera_;
+  }
+
+  /** \brief Restores the adaptive state of \ref saveAdaptiveState and drops the per-frame caches (speculative
+   *         alignments and batched predictions), which belong to the frames after it.
+   *
+   *   @param state - Adaptive state.
+   */
+  void restoreAdaptiveState(const AdaptiveState& state){
+    for(int camID=0;camID<mtState::nCam_;camID++){
+      fastGridDetector_[camID].setThresholds(state.fastGridThresholds_[camID]);
+    }
+    governorActiveFeatureLimit_ = state.governorActiveFeatureLimit_;
+    governorSkipCrossCamera_ = state.governorSkipCrossCamera_;
+    for(int i=0;i<mtState::nMax_;i++){
+      for(int j=0;j<mtState::nCam_;j++){
+        speculativeAlignments_[i][j].isValid_ = false;
+        isPredicted_[i][j] = false;
+      }
+    }
+  }
+
+  /** \brief Adds the normalized innovation squared of an aligned measurement to the statistics of the current frame.
+   *
+   *  The innovation is taken w.r.t. the prediction of the currently active feature (\ref featureOutput_) with the
+   *  predicted pixel covariance (\ref pixelOutputCov_) plus the pixel update noise. Only available if the alignment is
+   *  done in \ref preProcess (reprojection error), in direct mode the frozen states are not re-activated.
+   *
+   *   @param measured - Aligned feature coordinates.
+   */
+  void accumulateInnovation(const FeatureCoordinates& measured) const{
+    const Eigen::Vector2d e(measured.get_c().x-featureOutput_.c().get_c().x,measured.get_c().y-featureOutput_.c().get_c().y);
+    const Eigen::Matrix2d Py = pixelOutputCov_+updateNoisePix_*Eigen::Matrix2d::Identity();
+    frameNisSum_ += e.dot(Py.ldlt().solve(e));
+    frameNisCount_++;
+  }
+
+  /** \brief Freezes converged calibration states and re-activates them if the innovations grow.
+   *
+   *  The extrinsics of a camera (or the refractive index) are considered converged once the standard deviations of
+   *  their covariance blocks stay below the thresholds for \ref freezeMinConvergedTime_. They are frozen if in addition
+   *  the running average of the normalized innovation squared is below \ref freezeNisTh_ (2 is expected for
+   *  consistent pixel measurements). Freezing fixes the current estimate: the correlations with all other states are
+   *  removed and the states are excluded from the prediction (\ref ImuPrediction) and from the update Jacobians (see
+   *  \ref removeFrozenColumns), such that they stay constant and are pushed unchanged to the camera models. If the
+   *  averaged innovation exceeds \ref unfreezeNisTh_ all frozen states are re-activated with their variance scaled by
+   *  \ref unfreezeCovarianceGain_.
+   *
+   *  \note The filter dimension is fixed at compile time, the frozen states are decoupled rather than removed.
+   *
+   *   @param filterState - Filter state.
+   */
+  void updateCalibrationFreezing(mtFilterState& filterState){
+    freezeUncalibratedStates(filterState);
+    if(!freezeCalibration_) return;
+    auto& aux = filterState.state_.aux();
+    MXD& cov = filterState.cov_;
+    if(frameNisCount_ > 0){
+      aux.innovationNis_ = (1.0-freezeNisAveragingWeight_)*aux.innovationNis_ + freezeNisAveragingWeight_*frameNisSum_/frameNisCount_;
+    }
+
+    // Re-activation
+    if(aux.innovationNis_ > unfreezeNisTh_){
+      for(int i=0;i<mtState::nCam_;i++){
+        if(aux.isExtrinsicsFrozen_[i]){
+          if(verbose_) std::cout << "Re-activating the extrinsics of camera " << i << " (NIS " << aux.innovationNis_ << ")" << std::endl;
+          cov.diagonal().template segment<3>(mtState::template getId<mtState::_vep>(i)) *= unfreezeCovarianceGain_;
+          cov.diagonal().template segment<3>(mtState::template getId<mtState::_vea>(i)) *= unfreezeCovarianceGain_;
+          aux.isExtrinsicsFrozen_[i] = false;
+        }
+        aux.extrinsicsConvergedSince_[i] = -1.0;
+      }
+      if(refractiveCalibration_ && aux.isRefFrozen_){
+        if(verbose_) std::cout << "Re-activating the refractive index (NIS " << aux.innovationNis_ << ")" << std::endl;
+        cov(mtState::template getId<mtState::_ref>(),mtState::template getId<mtState::_ref>()) *= unfreezeCovarianceGain_;
+        aux.isRefFrozen_ = false;
+      }
+      aux.refConvergedSince_ = -1.0;
+      return;
+    }
+
+    // Convergence detection
+    const bool isConsistent = aux.innovationNis_ <= freezeNisTh_;
+    if(aux.doVECalibration_){
+      for(int i=0;i<mtState::nCam_;i++){
+        if(aux.isExtrinsicsFrozen_[i]) continue;
+        const int vep = mtState::template getId<mtState::_vep>(i);
+        const int vea = mtState::template getId<mtState::_vea>(i);
+        if(cov.diagonal().template segment<3>(vep).maxCoeff() > freezeExtrinsicsPosStd_*freezeExtrinsicsPosStd_
+            || cov.diagonal().template segment<3>(vea).maxCoeff() > freezeExtrinsicsAttStd_*freezeExtrinsicsAttStd_){
+          aux.extrinsicsConvergedSince_[i] = -1.0;
+        } else if(aux.extrinsicsConvergedSince_[i] < 0.0){
+          aux.extrinsicsConvergedSince_[i] = filterState.t_;
+        } else if(isConsistent && filterState.t_-aux.extrinsicsConvergedSince_[i] >= freezeMinConvergedTime_){
+          if(verbose_) std::cout << "Freezing the extrinsics of camera " << i << std::endl;
+          decoupleCovarianceBlock(cov,vep,3);
+          decoupleCovarianceBlock(cov,vea,3);
+          aux.isExtrinsicsFrozen_[i] = true;
+        }
+      }
+    }
+    if(refractiveCalibration_ && !aux.isRefFrozen_){
+      const int ref = mtState::template getId<mtState::_ref>();
+      if(cov(ref,ref) > freezeRefStd_*freezeRefStd_){
+        aux.refConvergedSince_ = -1.0;
+      } else if(aux.refConvergedSince_ < 0.0){
+        aux.refConvergedSince_ = filterState.t_;
+      } else if(isConsistent && filterState.t_-aux.refConvergedSince_ >= freezeMinConvergedTime_){
+        if(verbose_) std::cout << "Freezing the refractive index" << std::endl;
+        decoupleCovarianceBlock(cov,ref,1);
+        aux.isRefFrozen_ = true;
+      }
+    }
+  }
+
+  /** \brief Freezes the calibration states which are not estimated online, i.e., the refractive index if
+   *  \ref refractiveCalibration_ is off. These states then receive no process noise and are skipped by the structured
+   *  covariance prediction (see ImuPrediction::activeCoreEnd). Called on the initial state and on every update, such
+   *  that restored states are frozen as well.
+   *
+   *   @param filterState - Filter state.
+   */
+  void freezeUncalibratedStates(mtFilterState& filterState) const{
+    if(!refractiveCalibration_ && !filterState.state_.aux().isRefFrozen_){
+      decoupleCovarianceBlock(filterState.cov_,mtState::template getId<mtState::_ref>(),1);
+      filterState.state_.aux().isRefFrozen_ = true;
+    }
+  }
+
+  /** \brief Removes the correlations of a block of states with all other states (the variances are kept).
+   *
+   *   @param cov   - Filter covariance.
+   *   @param start - Index of the first state of the block.
+   *   @param n     - Size of the block.
+   */
+  static void decoupleCovarianceBlock(MXD& cov, const int start, const int n){
+    const Eigen::VectorXd var = cov.diagonal().segment(start,n);
+    cov.middleRows(start,n).setZero();
+    cov.middleCols(start,n).setZero();
+    cov.diagonal().segment(start,n) = var;
+  }
+
   /** \brief Prepares the filter state for the update.
    *
    *   @param filterState - Filter state.
@@ -822,12 +1665,15 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
    *   @todo sort feature by covariance and use more accurate ones first
    */
   void commonPreProcess(mtFilterState& filterState, const mtMeas& meas){
+    ROVIO_PROFILE_SCOPE("img_common_pre_process");
     assert(filterState.t_ == meas.aux().imgTime_);
+    governorFrameStart_ = std::chrono::steady_clock::now();
+    selectActiveFeatures(filterState);
+    frameNisSum_ = 0.0;
+    frameNisCount_ = 0;
 
     for(int i=0;i<mtState::nCam_;i++){
-      if(doFrameVisualisation_ || publishFrames_){
-        cvtColor(meas.aux().pyr_[i].imgs_[0], filterState.img_[i], cv::COLOR_GRAY2BGR);
-      }
+      filterState.overlay_[i].reset(isDrawing());
     }
     filterState.imgTime_ = filterState.t_;
     filterState.imageCounter_++;
@@ -837,6 +1683,14 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     }
     filterState.state_.aux().activeFeature_ = 0;
     filterState.state_.aux().activeCameraCounter_ = 0;
+    alignFrameDeadline_ = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<int64_t>(alignFrameBudget_*1e3));
+    if(batchProjection_ || useInformationGainScheduling_){
+      predictAllFeatures(filterState);
+    }
+    scheduleUpdates(filterState);
+    if(useSpeculativeAlignment_ && !useDirectMethod_){
+      alignAllFeatures(filterState,meas);
+    }
 
 
     /* Detect Image changes by looking at the feature patches between current and previous image (both at the current feature location)
@@ -895,16 +1749,17 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
 
     // Actualize camera extrinsics (gets also update in calls to TransformFeatureOutputCT)
     state.updateMultiCameraExtrinsics(mpMultiCamera_);
-    state.updateRefIndex(mpMultiCamera_);
+    state.updateRefIndex(mpMultiCamera_,refIndexUpdateEpsilon_);
 
     while(ID < mtState::nMax_ && foundValidMeasurement == false){
-      if(filterState.fsm_.isValid_[ID]){
+      if(filterState.fsm_.isValid_[ID] && isActiveFeature_[ID]
+          && isScheduled_[ID][(activeCamCounter + filterState.fsm_.features_[ID].mpCoordinates_->camID_)%mtState::nCam_]){
         // Data handling stuff
         FeatureManager<mtState::nLevels_,mtState::patchSize_,mtState::nCam_>& f = filterState.fsm_.features_[ID];
         const int camID = f.mpCoordinates_->camID_;
         const int activeCamID = (activeCamCounter + camID)%mtState::nCam_;
-        drawImg_ = filterState.img_[activeCamID];
-        if(activeCamCounter==0){
+        mpDrawOverlay_ = &filterState.overlay_[activeCamID];
+        if(activeCamCounter==firstScheduledCounter_[ID]){
           f.mpStatistics_->increaseStatistics(filterState.t_);
           if(verbose_){
             std::cout << "=========== Feature " << f.idx_ << " ==================================================== " << std::endl;
@@ -924,10 +1779,12 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
         }
 
         // Get coordinates in target frame
-        transformFeatureOutputCT_.setFeatureID(ID);
-        transformFeatureOutputCT_.setOutputCameraID(activeCamID);
-        transformFeatureOutputCT_.transformState(state,featureOutput_);
-        transformFeatureOutputCT_.transformCovMat(state,cov,featureOutputCov_);
+        if(batchProjection_ && isPredicted_[ID][activeCamID]){
+          featureOutput_ = predictedFeatureOutput_[ID][activeCamID];
+          featureOutputCov_ = predictedFeatureOutputCov_[ID][activeCamID];
+        } else {
+          transformFeatureOutput(state,cov,ID,activeCamID,featureOutput_,featureOutputCov_);
+        }
         if(verbose_) std::cout << "    Normal in camera frame: " << featureOutput_.c().get_nor().getVec().transpose() << std::endl;
 
         // Check if feature in target frame
@@ -935,18 +1792,23 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
           f.mpStatistics_->status_[activeCamID] = NOT_IN_FRAME;
           if(verbose_) std::cout << "    NOT in frame" << std::endl;
         } else {
-          pixelOutputCT_.transformState(featureOutput_,pixelOutput_);
-          pixelOutputCT_.transformCovMat(featureOutput_,featureOutputCov_,pixelOutputCov_);
+          if(batchProjection_ && isPredicted_[ID][activeCamID]){
+            pixelOutput_ = predictedPixelOutput_[ID][activeCamID];
+            pixelOutputCov_ = predictedPixelOutputCov_[ID][activeCamID];
+          } else {
+            pixelOutputCT_.transformState(featureOutput_,pixelOutput_);
+            pixelOutputCT_.transformCovMat(featureOutput_,featureOutputCov_,pixelOutputCov_);
+          }
           featureOutput_.c().setPixelCov(pixelOutputCov_);
 
           // Visualization
-          if (doFrameVisualisation_ || publishFrames_) {
+          if(isDrawing()){
             if (activeCamID == camID) {
-              featureOutput_.c().drawEllipse(drawImg_, cv::Scalar(0, 175, 175), 2.0, true);
-              featureOutput_.c().drawText(drawImg_, std::to_string(f.idx_), cv::Scalar(0, 175, 175));
+              mpDrawOverlay_->addEllipse(featureOutput_.c(), cv::Scalar(0, 175, 175), 2.0, true);
+              mpDrawOverlay_->addText(featureOutput_.c(), std::to_string(f.idx_), cv::Scalar(0, 175, 175));
             } else {
-              featureOutput_.c().drawEllipse(drawImg_, cv::Scalar(175, 175, 0), 2.0, true);
-              featureOutput_.c().drawText(drawImg_, std::to_string(f.idx_), cv::Scalar(175, 175, 0));
+              mpDrawOverlay_->addEllipse(featureOutput_.c(), cv::Scalar(175, 175, 0), 2.0, true);
+              mpDrawOverlay_->addText(featureOutput_.c(), std::to_string(f.idx_), cv::Scalar(175, 175, 0));
             }
           }
           // Comment by Mohit: Drawing multilevelPatch that are in the current active Camera
@@ -975,12 +1837,41 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
             }
             foundValidMeasurement = true;
           } else {
-            if(alignment_.align2DAdaptive(alignedCoordinates_,meas.aux().pyr_[activeCamID],*f.mpMultilevelPatch_,featureOutput_.c(),startLevel_,endLevel_,
-                                          alignConvergencePixelRange_,alignCoverageRatio_,alignMaxUniSample_)){
+            const SpeculativeAlignment& speculative = speculativeAlignments_[ID][activeCamID];
+            const bool useSpeculative = useSpeculativeAlignment_ && speculative.isValid_
+                && cv::norm(featureOutput_.c().get_c()-speculative.predictedC_) <= speculativeRealignTh_;
+            bool aligned;
+            if(useSpeculative){
+              if(verbose_) std::cout << "    Using speculative alignment" << std::endl;
+              aligned = speculative.isAligned_;
+              alignedCoordinates_ = speculative.alignedCoordinates_;
+              alignment_.iterationCount_ = speculative.iterationCount_;
+              alignment_.mlpError_ = speculative.mlpError_;
+            } else {
+              // Split the remaining frame budget equally among the remaining features
+              alignment_.useDeadline_ = alignFrameBudget_ > 0.0;
+              if(alignment_.useDeadline_){
+                int remainingFeatures = 0;
+                for(int i=ID;i<mtState::nMax_;i++){
+                  if(filterState.fsm_.isValid_[i] && isActiveFeature_[i]) remainingFeatures++;
+                }
+                const auto now = std::chrono::steady_clock::now();
+                alignment_.deadline_ = now + (alignFrameDeadline_-now)/std::max(remainingFeatures,1);
+              }
+              ROVIO_PROFILE_SCOPE("feature_alignment");
+              aligned = alignment_.align2DAdaptive(alignedCoordinates_,meas.aux().pyr_[activeCamID],*f.mpMultilevelPatch_,featureOutput_.c(),startLevel_,endLevel_,
+                                                   alignConvergencePixelRange_,alignCoverageRatio_,alignMaxUniSample_);
+              alignment_.useDeadline_ = false;
+            }
+            f.mpStatistics_->alignIterations_[activeCamID] = alignment_.iterationCount_;
+            if(verbose_) std::cout << "    Alignment iterations: " << alignment_.iterationCount_ << std::endl;
+            if(aligned){
               if(verbose_) std::cout << "    Found match: " << alignedCoordinates_.get_nor().getVec().transpose() << std::endl;
-              if(mlpTemp1_.isMultilevelPatchInFrame(meas.aux().pyr_[activeCamID],alignedCoordinates_,startLevel_,false)){
+              if(useSpeculative ? speculative.isInFrameAfterAlignment_ : mlpTemp1_.isMultilevelPatchInFrame(meas.aux().pyr_[activeCamID],alignedCoordinates_,startLevel_,false)){
                 float avgError = 0.0;
-                if(patchRejectionTh_ >= 0){
+                if(useSpeculative){
+                  avgError = speculative.avgError_;
+                } else if(patchRejectionTh_ >= 0){
                   mlpTemp1_.extractMultilevelPatchFromImage(meas.aux().pyr_[activeCamID],alignedCoordinates_,startLevel_,false);
                   avgError = mlpTemp1_.computeAverageDifference(*f.mpMultilevelPatch_,endLevel_,startLevel_);
                 }
@@ -988,8 +1879,9 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
                   f.mpStatistics_->status_[activeCamID] = FAILED_ALIGNEMENT;
                   if(verbose_) std::cout << "    \033[31mREJECTED (error too large)\033[0m" << std::endl;
                 } else {
-                  if (doFrameVisualisation_ || publishFrames_) alignedCoordinates_.drawPoint(drawImg_, cv::Scalar(255, 0, 255));
+                  if(isDrawing()) mpDrawOverlay_->addPoint(alignedCoordinates_, cv::Scalar(255, 0, 255));
                   state.aux().feaCoorMeas_[ID] = alignedCoordinates_;
+                  if(freezeCalibration_) accumulateInnovation(alignedCoordinates_);
                   foundValidMeasurement = true;
                 }
               } else {
@@ -1005,7 +1897,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
       }
       if(foundValidMeasurement == false){
         activeCamCounter++;
-        if(activeCamCounter == mtState::nCam_ || !useCrossCameraMeasurements_){
+        if(activeCamCounter == mtState::nCam_ || !useCrossCameraUpdates()){
           activeCamCounter = 0;
           ID++;
         }
@@ -1034,103 +1926,234 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     if(isFinished){
       commonPostProcess(filterState,meas);
     } else {
-      FeatureManager<mtState::nLevels_,mtState::patchSize_,mtState::nCam_>& f = filterState.fsm_.features_[ID];
-      const int camID = f.mpCoordinates_->camID_;
+      const int camID = filterState.fsm_.features_[ID].mpCoordinates_->camID_;
       const int activeCamID = (activeCamCounter + camID)%mtState::nCam_;
 
-      // Remove negative feature
-      if(removeNegativeFeatureAfterUpdate_){
-        for(unsigned int i=0;i<mtState::nMax_;i++){
-          if(filterState.fsm_.isValid_[i]){
-            if(filterState.state_.dep(i).getDistance() < minAllowedFeatureDistance_ ||
-               filterState.state_.dep(i).getDistance() > maxAllowedFeatureDistance_){
-              if(verbose_) std::cout << "    \033[33mRemoved feature " << filterState.fsm_.features_[i].idx_ << " with invalid distance parameter " << filterState.state_.dep(i).p_ << "!\033[0m" << std::endl;
-              filterState.fsm_.isValid_[i] = false;
-              filterState.resetFeatureCovariance(i,Eigen::Matrix3d::Identity());
-            }
-          }
-        }
-      }
+      removeInvalidDistanceFeatures(filterState);
 
       if(filterState.fsm_.isValid_[ID]){
-        // Update status and visualization
-        transformFeatureOutputCT_.setFeatureID(ID);
-        transformFeatureOutputCT_.setOutputCameraID(activeCamID);
-        transformFeatureOutputCT_.transformState(filterState.state_,featureOutput_);
-
-        // Draw information ellipse
-        bool doInformationGainVizualization = false;
-        if ((doFrameVisualisation_ || publishFrames_) && doInformationGainVizualization) {
-          MXD F(2, 2);
-          F = A_red_;
-          F = F.transpose() * F * 1.0 / updateNoiseInt_;
-          featureOutput_.c().setPixelCov(F);
-          featureOutput_.c().drawEllipse(drawImg_, cv::Scalar(0, 255, 0), 10, false);
-          F.setIdentity();
-          F = F.transpose() * F * 1.0 / updateNoisePix_;
-          featureOutput_.c().setPixelCov(F);
-          featureOutput_.c().drawEllipse(drawImg_, cv::Scalar(0, 0, 255), 10, false);
-        }
         filterState.mlpErrorLog_[ID] = alignment_.mlpError_;
-
-        if((filterState.mode_ == LWF::ModeIEKF && successfulUpdate_) || (filterState.mode_ == LWF::ModeEKF && !outlierDetection.isOutlier(0))){
-          if(mlpTemp1_.isMultilevelPatchInFrame(meas.aux().pyr_[camID],featureOutput_.c(),startLevel_,false)){
-            f.mpStatistics_->status_[activeCamID] = TRACKED;
-            if(doFrameVisualisation_ || publishFrames_) mlpTemp1_.drawMultilevelPatchBorder(drawImg_,featureOutput_.c(),1.0,cv::Scalar(0,150+(activeCamID == camID)*105,0));
-          } else {
-            f.mpStatistics_->status_[activeCamID] = FAILED_TRACKING;
-            if(doFrameVisualisation_ || publishFrames_){
-              mlpTemp1_.drawMultilevelPatchBorder(drawImg_,featureOutput_.c(),1.0,cv::Scalar(0,0,150+(activeCamID == camID)*105));
-              featureOutput_.c().drawText(drawImg_,"NIF",cv::Scalar(0,0,150+(activeCamID == camID)*105));
-            }
-            if(verbose_) std::cout << "    \033[31mNot in frame after update!\033[0m" << std::endl;
-          }
-        } else {
-          f.mpStatistics_->status_[activeCamID] = FAILED_TRACKING;
-          if(outlierDetection.isOutlier(0)){
-            if(doFrameVisualisation_ || publishFrames_){
-              mlpTemp1_.drawMultilevelPatchBorder(drawImg_,featureOutput_.c(),1.0,cv::Scalar(0,0,150+(activeCamID == camID)*105));
-              featureOutput_.c().drawText(drawImg_,"MD: " + std::to_string(outlierDetection.getMahalDistance(0)),cv::Scalar(0,0,150+(activeCamID == camID)*105));
-            }
-            if(verbose_) std::cout << "    \033[31mRecognized as outlier by filter: " << outlierDetection.getMahalDistance(0) << "\033[0m" << std::endl;
-          } else if(!hasConverged_){
-            if(doFrameVisualisation_ || publishFrames_){
-              mlpTemp1_.drawMultilevelPatchBorder(drawImg_,featureOutput_.c(),1.0,cv::Scalar(0,0,150+(activeCamID == camID)*105));
-              featureOutput_.c().drawText(drawImg_,"INC",cv::Scalar(0,0,150+(activeCamID == camID)*105));
-            }
-            if(verbose_) std::cout << "    \033[31mIterations not converged!\033[0m" << std::endl;
-          } else {
-            if(doFrameVisualisation_ || publishFrames_){
-              mlpTemp1_.drawMultilevelPatchBorder(drawImg_,featureOutput_.c(),1.0,cv::Scalar(0,0,150+(activeCamID == camID)*105));
-              featureOutput_.c().drawText(drawImg_,"PE",cv::Scalar(0,0,150+(activeCamID == camID)*105));
-            }
-            if(verbose_) std::cout << "    \033[31mToo large pixel intesity error!\033[0m" << std::endl;
-          }
-        }
-
-        // Visualize patch tracking
-        if(visualizePatches_){
-          if(mlpTemp1_.isMultilevelPatchInFrame(meas.aux().pyr_[activeCamID],featureOutput_.c(),mtState::nLevels_-1,false)){
-            mlpTemp1_.extractMultilevelPatchFromImage(meas.aux().pyr_[activeCamID],featureOutput_.c(),mtState::nLevels_-1,false);
-            mlpTemp1_.drawMultilevelPatch(filterState.patchDrawing_,cv::Point2i(filterState.drawPB_+(2+2*activeCamID)*filterState.drawPS_,filterState.drawPB_+ID*filterState.drawPS_),1,false);
-            // mlpTemp1_.drawMultilevelPatch(filterState.patchDrawingClean_,cv::Point2i(filterState.drawPB_+(2+2*activeCamID)*filterState.drawPS_,filterState.drawPB_+ID*filterState.drawPS_),1,false);
-          }
-          
-          if(f.mpStatistics_->status_[activeCamID] == TRACKED){
-            cv::rectangle(filterState.patchDrawing_,cv::Point2i((2+2*activeCamID)*filterState.drawPS_,ID*filterState.drawPS_),cv::Point2i((3+2*activeCamID)*filterState.drawPS_-1,(ID+1)*filterState.drawPS_-1),cv::Scalar(0,255,0),1,8,0);
-          } else {
-            cv::rectangle(filterState.patchDrawing_,cv::Point2i((2+2*activeCamID)*filterState.drawPS_,ID*filterState.drawPS_),cv::Point2i((3+2*activeCamID)*filterState.drawPS_-1,(ID+1)*filterState.drawPS_-1),cv::Scalar(0,0,255),1,8,0);
-          }
+        // In batch mode the status of the stacked pairs is set after the update (see \ref updateBatchStatus)
+        if(!(useBatchUpdate_ && isBatchStacked_[ID][activeCamID])){
+          const bool isSuccessful = (filterState.mode_ == LWF::ModeIEKF && successfulUpdate_) || (filterState.mode_ == LWF::ModeEKF && !outlierDetection.isOutlier(0));
+          updateFeatureStatus(filterState,meas,outlierDetection,ID,activeCamID,isSuccessful);
         }
       }
       activeCamCounter++;
-      if(activeCamCounter == mtState::nCam_ || !useCrossCameraMeasurements_){
+      if(activeCamCounter == mtState::nCam_ || !useCrossCameraUpdates()){
         activeCamCounter = 0;
         ID++;
       }
     }
   };
 
+  /** \brief Removes the features with a distance outside [\ref minAllowedFeatureDistance_,
+   *  \ref maxAllowedFeatureDistance_] (if \ref removeNegativeFeatureAfterUpdate_ is set).
+   *
+   *  @param filterState - Filter state.
+   */
+  void removeInvalidDistanceFeatures(mtFilterState& filterState) const{
+    if(!removeNegativeFeatureAfterUpdate_) return;
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      if(filterState.fsm_.isValid_[i]){
+        if(filterState.state_.dep(i).getDistance() < minAllowedFeatureDistance_ ||
+           filterState.state_.dep(i).getDistance() > maxAllowedFeatureDistance_){
+          if(verbose_) std::cout << "    \033[33mRemoved feature " << filterState.fsm_.features_[i].idx_ << " with invalid distance parameter " << filterState.state_.dep(i).p_ << "!\033[0m" << std::endl;
+          filterState.fsm_.isValid_[i] = false;
+          filterState.resetFeatureCovariance(i,Eigen::Matrix3d::Identity());
+        }
+      }
+    }
+  }
+
+  /** \brief Sets the tracking status of a feature in a camera after its update, including the visualization.
+   *
+   *  @param filterState      - Filter state.
+   *  @param meas             - Update measurement.
+   *  @param outlierDetection - Outlier detection.
+   *  @param ID               - Feature ID.
+   *  @param activeCamID      - Camera in which the feature was updated.
+   *  @param isSuccessful     - True, if the update of the feature was successful.
+   */
+  void updateFeatureStatus(mtFilterState& filterState, const mtMeas& meas, const mtOutlierDetection& outlierDetection, const int ID, const int activeCamID, const bool isSuccessful){
+    FeatureManager<mtState::nLevels_,mtState::patchSize_,mtState::nCam_>& f = filterState.fsm_.features_[ID];
+    const int camID = f.mpCoordinates_->camID_;
+    // Update status and visualization
+    transformFeatureOutputCT_.setFeatureID(ID);
+    transformFeatureOutputCT_.setOutputCameraID(activeCamID);
+    transformFeatureOutputCT_.transformState(filterState.state_,featureOutput_);
+
+    // Draw information ellipse
+    bool doInformationGainVizualization = false;
+    if (isDrawing() && doInformationGainVizualization) {
+      MXD F(2, 2);
+      F = A_red_;
+      F = F.transpose() * F * 1.0 / updateNoiseInt_;
+      featureOutput_.c().setPixelCov(F);
+      mpDrawOverlay_->addEllipse(featureOutput_.c(), cv::Scalar(0, 255, 0), 10, false);
+      F.setIdentity();
+      F = F.transpose() * F * 1.0 / updateNoisePix_;
+      featureOutput_.c().setPixelCov(F);
+      mpDrawOverlay_->addEllipse(featureOutput_.c(), cv::Scalar(0, 0, 255), 10, false);
+    }
+
+    if(isSuccessful){
+      if(mlpTemp1_.isMultilevelPatchInFrame(meas.aux().pyr_[camID],featureOutput_.c(),startLevel_,false)){
+        f.mpStatistics_->status_[activeCamID] = TRACKED;
+        if(isDrawing()) drawPatchBorder(featureOutput_.c(),cv::Scalar(0,150+(activeCamID == camID)*105,0));
+      } else {
+        f.mpStatistics_->status_[activeCamID] = FAILED_TRACKING;
+        if(isDrawing()){
+          drawPatchBorder(featureOutput_.c(),cv::Scalar(0,0,150+(activeCamID == camID)*105));
+          mpDrawOverlay_->addText(featureOutput_.c(), "NIF",cv::Scalar(0,0,150+(activeCamID == camID)*105));
+        }
+        if(verbose_) std::cout << "    \033[31mNot in frame after update!\033[0m" << std::endl;
+      }
+    } else {
+      f.mpStatistics_->status_[activeCamID] = FAILED_TRACKING;
+      if(outlierDetection.isOutlier(0)){
+        if(isDrawing()){
+          drawPatchBorder(featureOutput_.c(),cv::Scalar(0,0,150+(activeCamID == camID)*105));
+          mpDrawOverlay_->addText(featureOutput_.c(), "MD: " + std::to_string(outlierDetection.getMahalDistance(0)),cv::Scalar(0,0,150+(activeCamID == camID)*105));
+        }
+        if(verbose_) std::cout << "    \033[31mRecognized as outlier by filter: " << outlierDetection.getMahalDistance(0) << "\033[0m" << std::endl;
+      } else if(!hasConverged_){
+        if(isDrawing()){
+          drawPatchBorder(featureOutput_.c(),cv::Scalar(0,0,150+(activeCamID == camID)*105));
+          mpDrawOverlay_->addText(featureOutput_.c(), "INC",cv::Scalar(0,0,150+(activeCamID == camID)*105));
+        }
+        if(verbose_) std::cout << "    \033[31mIterations not converged!\033[0m" << std::endl;
+      } else {
+        if(isDrawing()){
+          drawPatchBorder(featureOutput_.c(),cv::Scalar(0,0,150+(activeCamID == camID)*105));
+          mpDrawOverlay_->addText(featureOutput_.c(), "PE",cv::Scalar(0,0,150+(activeCamID == camID)*105));
+        }
+        if(verbose_) std::cout << "    \033[31mToo large pixel intesity error!\033[0m" << std::endl;
+      }
+    }
+
+    // Visualize patch tracking
+    if(visualizePatches_){
+      if(mlpTemp1_.isMultilevelPatchInFrame(meas.aux().pyr_[activeCamID],featureOutput_.c(),mtState::nLevels_-1,false)){
+        mlpTemp1_.extractMultilevelPatchFromImage(meas.aux().pyr_[activeCamID],featureOutput_.c(),mtState::nLevels_-1,false);
+        mlpTemp1_.drawMultilevelPatch(filterState.patchDrawing_,cv::Point2i(filterState.drawPB_+(2+2*activeCamID)*filterState.drawPS_,filterState.drawPB_+ID*filterState.drawPS_),1,false);
+        // mlpTemp1_.drawMultilevelPatch(filterState.patchDrawingClean_,cv::Point2i(filterState.drawPB_+(2+2*activeCamID)*filterState.drawPS_,filterState.drawPB_+ID*filterState.drawPS_),1,false);
+      }
+      
+      if(f.mpStatistics_->status_[activeCamID] == TRACKED){
+        cv::rectangle(filterState.patchDrawing_,cv::Point2i((2+2*activeCamID)*filterState.drawPS_,ID*filterState.drawPS_),cv::Point2i((3+2*activeCamID)*filterState.drawPS_-1,(ID+1)*filterState.drawPS_-1),cv::Scalar(0,255,0),1,8,0);
+      } else {
+        cv::rectangle(filterState.patchDrawing_,cv::Point2i((2+2*activeCamID)*filterState.drawPS_,ID*filterState.drawPS_),cv::Point2i((3+2*activeCamID)*filterState.drawPS_-1,(ID+1)*filterState.drawPS_-1),cv::Scalar(0,0,255),1,8,0);
+      }
+    }
+  }
+
+  /** \brief Projects a feature at inverse distance rho into camera D, including its patch warping.
+   *
+   *  The warping is transformed like in \ref TransformFeatureOutputCT (the scaling of the point by rho cancels out).
+   *
+   *   @param cOut - Projected coordinates in camera D.
+   *   @param cIn  - Coordinates of the feature in its camera.
+   *   @param D    - Camera ID of the output.
+   *   @param rho  - Inverse distance along the bearing vector of cIn (0: point at infinity).
+   *   @return true, if the projection is valid.
+   */
+  bool projectOnEpipolarCurve(FeatureCoordinates& cOut, const FeatureCoordinates& cIn, const int D, const double rho) const{
+    const QPD& qDC = mpMultiCamera_->qDC_[D][cIn.camID_];
+    const V3D DrDP = qDC.rotate(V3D(cIn.get_nor().getVec()-rho*mpMultiCamera_->CrCD_[D][cIn.camID_]));
+    cOut.camID_ = D;
+    cOut.mpCamera_ = &mpMultiCamera_->cameras_[D];
+    cOut.set_nor(LWF::NormalVectorElement(DrDP));
+    if(cIn.trackWarping_ && cIn.com_warp_nor()){
+      const Eigen::Matrix<double,2,3> J_nor_DrDP = cOut.get_nor().getM().transpose()/DrDP.norm();
+      cOut.set_warp_nor(J_nor_DrDP*MPD(qDC).matrix()*cIn.get_nor().getM()*cIn.get_warp_nor());
+    } else {
+      cOut.set_warp_identity();
+    }
+    return cOut.isInFront() && cOut.com_c();
+  }
+
+  /** \brief Searches the match of a (new) feature in another camera along its epipolar curve.
+   *
+   *  The curve is sampled in inverse distance between \ref stereoMaxDistance_ and \ref stereoMinDistance_ with a
+   *  spacing of about one pixel on the start level, using the patch of the start level only. Around the best sample the
+   *  search is repeated with a spacing of one pixel on the end level and all levels, and the minimum is refined with a
+   *  parabola. The projection goes through the camera model of the other camera, such that the refraction is taken into
+   *  account (the epipolar "line" is then a curve). The relative camera transforms are the ones cached in the
+   *  \ref MultiCamera. The patches are compared with the cross-camera warping of the feature. Finally, the match is
+   *  refined by a 2D alignment seeded from the epipolar match (the epipolar match is kept if it does not converge).
+   *
+   *   @param cOut     - Best match in the other camera.
+   *   @param pyr      - Image pyramid of the other camera.
+   *   @param mlp      - Patch of the feature.
+   *   @param cIn      - Coordinates of the feature in its camera.
+   *   @param otherCam - ID of the other camera.
+   *   @return true, if a match was found.
+   */
+  bool searchEpipolarMatch(FeatureCoordinates& cOut, const ImagePyramid<mtState::nLevels_>& pyr, const MultilevelPatch<mtState::nLevels_,mtState::patchSize_>& mlp,
+                           const FeatureCoordinates& cIn, const int otherCam) const{
+    const double rhoMin = stereoMaxDistance_ > 0.0 ? 1.0/std::max(stereoMaxDistance_,stereoMinDistance_) : 0.0;
+    const double rhoMax = 1.0/std::max(stereoMinDistance_,1e-3);
+    tempCoordinates_ = cIn;
+
+    // Number of samples such that the spacing is about one pixel on the start level
+    int nSamples = 64;
+    if(projectOnEpipolarCurve(tempCoordinates_,cIn,otherCam,rhoMin)){
+      const cv::Point2f c0 = tempCoordinates_.get_c();
+      if(projectOnEpipolarCurve(tempCoordinates_,cIn,otherCam,rhoMax)){
+        nSamples = std::ceil(cv::norm(tempCoordinates_.get_c()-c0)/(1 << startLevel_))+1;
+      }
+    }
+    nSamples = std::min(std::max(nSamples,3),512);
+
+    // Coarse search on the start level
+    const double coarseStep = (rhoMax-rhoMin)/(nSamples-1);
+    double bestRho = -1.0;
+    float bestError = std::numeric_limits<float>::max();
+    for(int k=0;k<nSamples;k++){
+      const double rho = rhoMin + k*coarseStep;
+      if(!projectOnEpipolarCurve(tempCoordinates_,cIn,otherCam,rho)) continue;
+      if(!mlpTemp1_.isMultilevelPatchInFrame(pyr,tempCoordinates_,startLevel_,false)) continue;
+      mlpTemp1_.extractSinglelevelPatchFromImage(pyr,tempCoordinates_,startLevel_,false);
+      const float error = mlpTemp1_.computeAverageDifference(mlp,startLevel_,startLevel_);
+      if(error < bestError){
+        bestError = error;
+        bestRho = rho;
+      }
+    }
+    if(bestRho < 0.0) return false;
+
+    // Fine search around the best coarse sample on all levels
+    const int nFine = 2*(1 << (startLevel_-endLevel_))+1;
+    const double fineStep = 2.0*coarseStep/(nFine-1);
+    std::vector<float> errors(nFine,std::numeric_limits<float>::max());
+    int bestFine = -1;
+    for(int k=0;k<nFine;k++){
+      const double rho = bestRho + (k-nFine/2)*fineStep;
+      if(rho < rhoMin || rho > rhoMax) continue;
+      if(!projectOnEpipolarCurve(tempCoordinates_,cIn,otherCam,rho)) continue;
+      if(!mlpTemp1_.isMultilevelPatchInFrame(pyr,tempCoordinates_,startLevel_,false)) continue;
+      mlpTemp1_.extractMultilevelPatchFromImage(pyr,tempCoordinates_,startLevel_,false);
+      errors[k] = mlpTemp1_.computeAverageDifference(mlp,endLevel_,startLevel_);
+      if(bestFine < 0 || errors[k] < errors[bestFine]) bestFine = k;
+    }
+    if(bestFine < 0) return false;
+
+    // Sub-sample refinement with a parabola through the neighbouring errors
+    double offset = 0.0;
+    if(bestFine > 0 && bestFine < nFine-1 && errors[bestFine-1] < std::numeric_limits<float>::max() && errors[bestFine+1] < std::numeric_limits<float>::max()){
+      const double curvature = errors[bestFine-1]-2.0*errors[bestFine]+errors[bestFine+1];
+      if(curvature > 0.0) offset = 0.5*(errors[bestFine-1]-errors[bestFine+1])/curvature;
+    }
+    if(!projectOnEpipolarCurve(tempCoordinates_,cIn,otherCam,bestRho+(bestFine-nFine/2+offset)*fineStep)) return false;
+
+    // 2D refinement (absorbs small calibration errors across the epipolar curve)
+    if(!alignment_.align2D(cOut,pyr,mlp,tempCoordinates_,endLevel_,startLevel_)){
+      cOut = tempCoordinates_;
+    }
+    return true;
+  }
+
   /** \brief Final Post-Processing step for the image update.
    *
    *  Summary:
@@ -1142,12 +2165,14 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
    *  @param meas             - Update measurement.
    */
   void commonPostProcess(mtFilterState& filterState, const mtMeas& meas){
+    ROVIO_PROFILE_SCOPE("img_common_post_process");
     typename mtFilterState::mtState& state = filterState.state_;
     MXD& cov = filterState.cov_;
 
     // Actualize camera extrinsics and refractive index
     state.updateMultiCameraExtrinsics(mpMultiCamera_);
-    state.updateRefIndex(mpMultiCamera_);
+    state.updateRefIndex(mpMultiCamera_,refIndexUpdateEpsilon_);
+    updateCalibrationFreezing(filterState);
 
     int countTracked = 0;
     // For all features in the state.
@@ -1158,7 +2183,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
         if(f.mpStatistics_->trackedInSomeFrame()){
           countTracked++;
         }
-        if(f.mpStatistics_->status_[camID] == TRACKED && filterState.t_ - f.mpStatistics_->lastPatchUpdate_ > minTimeBetweenPatchUpdate_){
+        if(isActiveFeature_[i] && f.mpStatistics_->status_[camID] == TRACKED && filterState.t_ - f.mpStatistics_->lastPatchUpdate_ > minTimeBetweenPatchUpdate_){
           tempCoordinates_ = *f.mpCoordinates_;
           tempCoordinates_.set_warp_identity();
           if(mlpTemp1_.isMultilevelPatchInFrame(meas.aux().pyr_[camID],tempCoordinates_,startLevel_,true)){
@@ -1240,25 +2265,42 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
 
       // Get Candidates      
       for(int camID = 0;camID<mtState::nCam_;camID++){
+        ROVIO_PROFILE_SCOPE("feature_detection");
         const double t1 = (double) cv::getTickCount();
         candidates_[camID].clear();
-        for(int l=endLevel_;l<=startLevel_;l++){
-          meas.aux().pyr_[camID].detectFastCorners(candidates_[camID],l,fastDetectionThreshold_);
-
+        if(useGridDetection_){
+          // Pixel coordinates of the current features in this camera, their grid cells are skipped
+          trackedPixels_.clear();
+          for(unsigned int i=0;i<mtState::nMax_;i++){
+            if(filterState.fsm_.isValid_[i]){
+              mpMultiCamera_->transformFeature(camID,*(filterState.fsm_.features_[i].mpCoordinates_),*(filterState.fsm_.features_[i].mpDistance_),tempCoordinates_,tempDistance_);
+              if(tempCoordinates_.isInFront() && tempCoordinates_.com_c()){
+                trackedPixels_.push_back(tempCoordinates_.get_c());
+              }
+            }
+          }
+          for(int l=endLevel_;l<=startLevel_;l++){
+            fastGridDetector_[camID].detect(meas.aux().pyr_[camID],l,fastDetectionThreshold_,trackedPixels_,candidates_[camID],mpMultiCamera_->cameras_[camID].valid_radius_);
+          }
+        } else {
+          for(int l=endLevel_;l<=startLevel_;l++){
+            meas.aux().pyr_[camID].detectFastCorners(candidates_[camID],l,fastDetectionThreshold_);
+          }
         }
 
         const double t2 = (double) cv::getTickCount();
         if(verbose_) std::cout << "== Detected " << candidates_[camID].size() << " candidates in Camera" << camID << " on levels " << endLevel_ << "-" << startLevel_ << " (" << (t2-t1)/cv::getTickFrequency()*1000 << " ms)" << std::endl;
         
         // visualization of detected candidates
-        if (candidates_[camID].size() > 0 && (doFrameVisualisation_ || publishFrames_)) {
+        if (candidates_[camID].size() > 0 && isDrawing()) {
           for(int i=0;i<candidates_[camID].size();i++){
-            candidates_[camID][i].drawPoint(filterState.img_[camID], cv::Scalar(0,0,255));
+            filterState.overlay_[camID].addPoint(candidates_[camID][i], cv::Scalar(0,0,255));
           }
         }
       }
 
       if(addGlobalBest_ && candidates_[0].size() > 0){
+        ROVIO_PROFILE_SCOPE("candidate_selection");
         const double t2 = (double) cv::getTickCount();
         std::unordered_set<unsigned int> newSet = filterState.fsm_.addBestGlobalCandidates(candidates_,meas.aux().pyr_,filterState.t_,
                                                                   endLevel_,startLevel_,(mtState::nMax_-filterState.fsm_.getValidCount()),nDetectionBuckets_, scoreDetectionExponent_,
@@ -1275,17 +2317,18 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
           initCovFeature_(0,0) = initRelDepthCovTemp_*pow(f.mpDistance_->getParameterDerivative()*f.mpDistance_->getDistance(),2);
           filterState.resetFeatureCovariance(*it,initCovFeature_);
           initCovFeature_(0,0) = initRelDepthCovTemp_;
-          if(doFrameVisualisation_ || publishFrames_){
-            f.mpCoordinates_->drawPoint(filterState.img_[f.mpCoordinates_->camID_], cv::Scalar(255,255,0));                                    //changed color from blue to aquamarin
-            f.mpCoordinates_->drawText(filterState.img_[f.mpCoordinates_->camID_],std::to_string(f.idx_),cv::Scalar(255,255,0));               //changed color from blue to aquamarin
+          if(isDrawing()){
+            filterState.overlay_[f.mpCoordinates_->camID_].addPoint(*f.mpCoordinates_, cv::Scalar(255,255,0));                                    //changed color from blue to aquamarin
+            filterState.overlay_[f.mpCoordinates_->camID_].addText(*f.mpCoordinates_,std::to_string(f.idx_),cv::Scalar(255,255,0));               //changed color from blue to aquamarin
           }
         }
       } else {
         for(int camID = 0;camID<mtState::nCam_;camID++){
+          ROVIO_PROFILE_SCOPE("candidate_selection");
           const double t2 = (double) cv::getTickCount();
           std::unordered_set<unsigned int> newSet = filterState.fsm_.addBestCandidates(candidates_[camID],meas.aux().pyr_[camID],camID,filterState.t_,
                                                                     endLevel_,startLevel_,(mtState::nMax_-filterState.fsm_.getValidCount())/(mtState::nCam_-camID),nDetectionBuckets_, scoreDetectionExponent_,
-                                                                    penaltyDistance_, zeroDistancePenalty_,false,minAbsoluteSTScore_);
+                                                                    penaltyDistance_, zeroDistancePenalty_,false,minAbsoluteSTScore_,candidateCullingFactor_);
         const double t3 = (double) cv::getTickCount();
         if(verbose_) std::cout << "== Got " << filterState.fsm_.getValidCount() << " after adding " << newSet.size() << " features in camera " << camID << " (" << (t3-t2)/cv::getTickFrequency()*1000 << " ms)" << std::endl;
         // std::cout << "== Got " << filterState.fsm_.getValidCount() << " after adding " << newSet.size() << " features in camera " << camID << " (" << (t3-t2)/cv::getTickFrequency()*1000 << " ms)" << std::endl;
@@ -1299,18 +2342,24 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
           initCovFeature_(0,0) = initRelDepthCovTemp_*pow(f.mpDistance_->getParameterDerivative()*f.mpDistance_->getDistance(),2);
           filterState.resetFeatureCovariance(*it,initCovFeature_);
           initCovFeature_(0,0) = initRelDepthCovTemp_;
-          if(doFrameVisualisation_ || publishFrames_){
-              f.mpCoordinates_->drawPoint(filterState.img_[camID], cv::Scalar(255,255,0));                                    //changed color from blue to aquamarin
-              f.mpCoordinates_->drawText(filterState.img_[camID],std::to_string(f.idx_),cv::Scalar(255,255,0));               //changed color from blue to aquamarin
+          if(isDrawing()){
+              filterState.overlay_[camID].addPoint(*f.mpCoordinates_, cv::Scalar(255,255,0));                                    //changed color from blue to aquamarin
+              filterState.overlay_[camID].addText(*f.mpCoordinates_,std::to_string(f.idx_),cv::Scalar(255,255,0));               //changed color from blue to aquamarin
           }
 
           if(mtState::nCam_>1 && doStereoInitialization_){
             const int otherCam = (camID+1)%mtState::nCam_;
-            transformFeatureOutputCT_.setFeatureID(*it);
-            transformFeatureOutputCT_.setOutputCameraID(otherCam);
-            transformFeatureOutputCT_.transformState(filterState.state_,featureOutput_);
-            if(alignment_.align2DAdaptive(alignedCoordinates_,meas.aux().pyr_[otherCam],*f.mpMultilevelPatch_,featureOutput_.c(),startLevel_,endLevel_,
-                                            alignConvergencePixelRange_,alignCoverageRatio_,alignMaxUniSample_)){
+            bool isMatched = false;
+            if(stereoEpipolarSearch_){
+              isMatched = searchEpipolarMatch(alignedCoordinates_,meas.aux().pyr_[otherCam],*f.mpMultilevelPatch_,*f.mpCoordinates_,otherCam);
+            } else {
+              transformFeatureOutputCT_.setFeatureID(*it);
+              transformFeatureOutputCT_.setOutputCameraID(otherCam);
+              transformFeatureOutputCT_.transformState(filterState.state_,featureOutput_);
+              isMatched = alignment_.align2DAdaptive(alignedCoordinates_,meas.aux().pyr_[otherCam],*f.mpMultilevelPatch_,featureOutput_.c(),startLevel_,endLevel_,
+                                                     alignConvergencePixelRange_,alignCoverageRatio_,alignMaxUniSample_);
+            }
+            if(isMatched){
               bool valid = mlpTemp1_.isMultilevelPatchInFrame(meas.aux().pyr_[otherCam],alignedCoordinates_,startLevel_,false);
               if(valid && patchRejectionTh_ >= 0){
                 mlpTemp1_.extractMultilevelPatchFromImage(meas.aux().pyr_[otherCam],alignedCoordinates_,startLevel_,false);
@@ -1320,23 +2369,23 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
                 }
               }
               if(valid == true){
-                if(doFrameVisualisation_ || publishFrames_){
-                  alignedCoordinates_.drawPoint(filterState.img_[otherCam], cv::Scalar(150,0,0));
-                  alignedCoordinates_.drawText(filterState.img_[otherCam],std::to_string(f.idx_),cv::Scalar(150,0,0));
+                if(isDrawing()){
+                  filterState.overlay_[otherCam].addPoint(alignedCoordinates_, cv::Scalar(150,0,0));
+                  filterState.overlay_[otherCam].addText(alignedCoordinates_,std::to_string(f.idx_),cv::Scalar(150,0,0));
                 }
-                if(f.mpCoordinates_->getDepthFromTriangulation(alignedCoordinates_,state.qCM(otherCam).rotate(V3D(state.MrMC(camID)-state.MrMC(otherCam))),state.qCM(otherCam)*state.qCM(camID).inverted(), *f.mpDistance_, 0.01)){
+                if(f.mpCoordinates_->getDepthFromTriangulation(alignedCoordinates_,mpMultiCamera_->CrCD_[camID][otherCam],mpMultiCamera_->qDC_[otherCam][camID], *f.mpDistance_, 0.01)){
                   filterState.resetFeatureCovariance(*it,initCovFeature_); // TODO: improve
                 }
               } else {
-                if(doFrameVisualisation_ || publishFrames_){
-                  alignedCoordinates_.drawPoint(filterState.img_[otherCam], cv::Scalar(0,0,150));
-                  alignedCoordinates_.drawText(filterState.img_[otherCam],std::to_string(f.idx_),cv::Scalar(0,0,150));
+                if(isDrawing()){
+                  filterState.overlay_[otherCam].addPoint(alignedCoordinates_, cv::Scalar(0,0,150));
+                  filterState.overlay_[otherCam].addText(alignedCoordinates_,std::to_string(f.idx_),cv::Scalar(0,0,150));
                 }
               }
             } else {
-              if(doFrameVisualisation_ || publishFrames_){
-                alignedCoordinates_.drawPoint(filterState.img_[otherCam], cv::Scalar(0,150,0));
-                alignedCoordinates_.drawText(filterState.img_[otherCam],std::to_string(f.idx_),cv::Scalar(0,150,0));
+              if(isDrawing()){
+                filterState.overlay_[otherCam].addPoint(alignedCoordinates_, cv::Scalar(0,150,0));
+                filterState.overlay_[otherCam].addText(alignedCoordinates_,std::to_string(f.idx_),cv::Scalar(0,150,0));
                 }
               }
             }
@@ -1349,7 +2398,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
         filterState.fsm_.features_[i].log_previous_ = *filterState.fsm_.features_[i].mpCoordinates_;
       }
     }
-    if (doFrameVisualisation_ || publishFrames_){
+    if(isDrawing()){
       for(int i=0;i<mtState::nCam_;i++){
         drawVirtualHorizon(filterState,i);
       }
@@ -1363,7 +2412,7 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
       }
     }
 
-    // Copy image pyramid to state
+    // Share image pyramid with state (no pixel data is copied, see ImagePyramid::operator=)
     for(int i=0;i<mtState::nCam_;i++){
       filterState.prevPyr_[i] = meas.aux().pyr_[i];
     }
@@ -1372,47 +2421,49 @@ ImgOutlierDetection<typename FILTERSTATE::mtState>,false>{
     if(isZeroVelocityUpdateEnabled_
         && doVisualMotionDetection_ && filterState.state_.aux().timeSinceLastImageMotion_ > minTimeForZeroVelocityUpdate_
         && filterState.state_.aux().timeSinceLastInertialMotion_ > minTimeForZeroVelocityUpdate_){
-      cv::putText(filterState.img_[0],"Performing Zero Velocity Updates!",cv::Point2f(150,25),cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0,255,255));
+      filterState.overlay_[0].addText(cv::Point2f(150,25),"Performing Zero Velocity Updates!",cv::Scalar(0,255,255),1.0);
       zeroVelocityUpdate_.performUpdateEKF(filterState,ZeroVelocityUpdateMeas<mtState>());
     }
+
+    mpDrawOverlay_ = &disabledOverlay();
+    updateCpuGovernor();
   }
 
   ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  /** \brief Draws a virtual horizon into the current image of the camera with ID camID
+  /** \brief Records the virtual horizon of the camera with ID camID into its overlay.
    *
    *  @param filterState - Filter state.
    *  @param camID       - ID of the camera, in which image the horizon should be drawn.
    */
   void drawVirtualHorizon(mtFilterState& filterState, const int camID = 0){
     typename mtFilterState::mtState& state = filterState.state_;
-    cv::rectangle(filterState.img_[camID],cv::Point2f(0,0),cv::Point2f(82,92),cv::Scalar(50,50,50),-1,8,0);
-    cv::rectangle(filterState.img_[camID],cv::Point2f(0,0),cv::Point2f(80,90),cv::Scalar(100,100,100),-1,8,0);
-    cv::putText(filterState.img_[camID],std::to_string(filterState.imageCounter_),cv::Point2f(5,85),cv::FONT_HERSHEY_SIMPLEX, 0.4, cv::Scalar(255,0,0));
-    cv::Point2f rollCenter = cv::Point2f(40,40);
-    cv::Scalar rollColor1(50,50,50);
-    cv::Scalar rollColor2(200,200,200);
-    cv::Scalar rollColor3(120,120,120);
-    cv::circle(filterState.img_[camID],rollCenter,32,rollColor1,-1,8,0);
-    cv::circle(filterState.img_[camID],rollCenter,30,rollColor2,-1,8,0);
     Eigen::Vector3d Vg = (state.qCM(camID)*state.qWM().inverted()).rotate(Eigen::Vector3d(0,0,-1));
     double roll = atan2(Vg(1),Vg(0))-0.5*M_PI;
     double pitch = acos(Vg.dot(Eigen::Vector3d(0,0,1)))-0.5*M_PI;
-    double pixelFor10Pitch = 5.0;
-    double pitchOffsetAngle = -asin(pitch/M_PI*180.0/10.0*pixelFor10Pitch/30.0);
-    cv::Point2f rollVector1 = 30*cv::Point2f(cos(roll),sin(roll));
-    cv::Point2f rollVector2 = cv::Point2f(25,0);
-    cv::Point2f rollVector3 = cv::Point2f(10,0);
-    std::vector<cv::Point> pts;
-    cv::ellipse2Poly(rollCenter,cv::Size(30,30),0,(roll-pitchOffsetAngle)/M_PI*180,(roll+pitchOffsetAngle)/M_PI*180+180,1,pts);
-    cv::Point *points;
-    points = &pts[0];
-    int nbtab = pts.size();
-    cv::fillPoly(filterState.img_[camID],(const cv::Point**)&points,&nbtab,1,rollColor3);
-    cv::line(filterState.img_[camID],rollCenter+rollVector2,rollCenter+rollVector3,rollColor1, 2);
-    cv::line(filterState.img_[camID],rollCenter-rollVector2,rollCenter-rollVector3,rollColor1, 2);
-    cv::ellipse(filterState.img_[camID],rollCenter,cv::Size(10,10),0,0,180,rollColor1,2,8,0);
-    cv::circle(filterState.img_[camID],rollCenter,2,rollColor1,-1,8,0);
+    filterState.overlay_[camID].setHorizon(roll,pitch,filterState.imageCounter_);
+  }
+
+  /** \brief Records the border of a multilevel patch (size of the coarsest level) into the current overlay.
+   *
+   *  @param c     - Coordinates of the patch.
+   *  @param color - Color.
+   */
+  void drawPatchBorder(const FeatureCoordinates& c, const cv::Scalar& color) const{
+    mpDrawOverlay_->addPatchBorder(c,0.5*mtState::patchSize_*pow(2.0,mtState::nLevels_-1),color);
+  }
+
+  /** \brief Returns an overlay which never records (target of \ref mpDrawOverlay_ outside of an image update).
+   */
+  static FrameOverlay& disabledOverlay(){
+    static FrameOverlay overlay;
+    return overlay;
+  }
+
+  /** \brief Checks if the frame overlays are recorded (shown with doFrameVisualisation or published with publishFrames).
+   */
+  bool isDrawing() const{
+    return doFrameVisualisation_ || (publishFrames_ && hasFrameSubscribers_);
   }
 };
 
@@ -0,0 +1,129 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_IMUPOSEINTEGRATOR_HPP_
+#define ROVIO_IMUPOSEINTEGRATOR_HPP_
+
+#include <deque>
+#include "lightweight_filtering/common.hpp"
+
+namespace rovio{
+
+/** \brief Cheap strapdown integration of the IMU pose on top of the last filter (safe) state.
+ *
+ *  Uses the noise-free core part of the transition model of ImuPrediction (no features, no covariance). All IMU
+ *  samples newer than the safe state are kept, such that the pose can be re-integrated whenever the safe state moves.
+ */
+class ImuPoseIntegrator{
+ public:
+  /** \brief IMU sample.
+   */
+  struct Sample{
+    double t_;
+    V3D acc_;
+    V3D gyr_;
+  };
+
+  double t_; /**<Time of the integrated pose.*/
+  V3D WrWM_; /**<Position of the IMU in the world frame.*/
+  V3D MvM_; /**<Velocity (robocentric, see ImuPrediction).*/
+  QPD qWM_; /**<Attitude.*/
+  V3D MwWM_; /**<Bias corrected rotational rate of the last sample.*/
+  V3D acb_; /**<Accelerometer bias of the safe state.*/
+  V3D gyb_; /**<Gyroscope bias of the safe state.*/
+  V3D g_; /**<Gravity in the world frame.*/
+
+  ImuPoseIntegrator(): t_(0.0), WrWM_(V3D::Zero()), MvM_(V3D::Zero()), MwWM_(V3D::Zero()), acb_(V3D::Zero()),
+      gyb_(V3D::Zero()), g_(0,0,-9.806550000150684), isValid_(false){}
+
+  /** \brief Restarts the integration from a new safe state and re-integrates the buffered newer samples.
+   *
+   *   @param state - Safe filter state.
+   *   @param t     - Time of the safe state.
+   */
+  template<typename STATE>
+  void reset(const STATE& state, const double t){
+    t_ = t;
+    WrWM_ = state.WrWM();
+    MvM_ = state.MvM();
+    qWM_ = state.qWM();
+    acb_ = state.acb();
+    gyb_ = state.gyb();
+    MwWM_ = state.aux().MwWMest_;
+    isValid_ = true;
+    while(!samples_.empty() && samples_.front().t_ <= t_) samples_.pop_front();
+    for(const Sample& sample : samples_) integrate(sample);
+  }
+
+  /** \brief Adds a new IMU sample and integrates the pose up to its time.
+   *
+   *   @param sample - IMU sample.
+   */
+  void add(const Sample& sample){
+    if(!samples_.empty() && sample.t_ <= samples_.back().t_) return;
+    samples_.push_back(sample);
+    if(isValid_) integrate(sample);
+  }
+
+  /** \brief Returns true once the integrator got a safe state.
+   */
+  bool isValid() const{
+    return isValid_;
+  }
+
+  /** \brief Invalidates the pose (e.g. on a filter reset).
+   */
+  void invalidate(){
+    isValid_ = false;
+    samples_.clear();
+  }
+
+ private:
+  /** \brief Euler step from t_ to the time of the sample (same discretization as ImuPrediction::evalTransition).
+   */
+  void integrate(const Sample& sample){
+    const double dt = sample.t_-t_;
+    if(dt <= 0.0) return;
+    MwWM_ = sample.gyr_-gyb_;
+    const V3D dOmega = dt*MwWM_;
+    QPD dQ = dQ.exponentialMap(dOmega);
+    WrWM_ = WrWM_-dt*qWM_.rotate(MvM_);
+    MvM_ = (M3D::Identity()-gSM(dOmega))*MvM_-dt*(sample.acc_-acb_+qWM_.inverseRotate(g_));
+    qWM_ = qWM_*dQ;
+    qWM_.fix();
+    t_ = sample.t_;
+  }
+
+  bool isValid_;
+  std::deque<Sample> samples_;
+};
+
+}
+
+
+#endif /* ROVIO_IMUPOSEINTEGRATOR_HPP_ */
@@ -33,6 +33,10 @@
 #include "lightweight_filtering/Prediction.hpp"
 #include "lightweight_filtering/State.hpp"
 #include "rovio/FilterStates.hpp"
+#include "rovio/SymmetricCovariance.hpp"
+#include "rovio/Profiler.hpp"
+#include <iterator>
+#include <map>
 
 namespace rovio {
 
@@ -56,11 +60,26 @@ class ImuPrediction: public LWF::Prediction<FILTERSTATE>{
   mutable FeatureCoordinates oldC_;
   mutable FeatureDistance oldD_;
   mutable Eigen::Matrix2d bearingVectorJac_;
-  ImuPrediction():g_(0,0,-9.806550000150684){
+  bool useStructuredPropagation_; /**<If true, merged predictions integrate every IMU sample and propagate the covariance block-wise.*/
+  mutable MXD structuredF_; /**<Jacobian w.r.t. the previous state of the merged prediction.*/
+  mutable MXD structuredG_; /**<Jacobian w.r.t. the noise of the merged prediction.*/
+  mutable MXD structuredTemp_;
+  mutable MXD structuredCov_;
+  mutable MXD structuredNoiseCov_;
+  mutable mtNoise zeroNoise_;
+  ImuPrediction():g_(0,0,-9.806550000150684),
+      structuredF_((int)(mtState::D_),(int)(mtState::D_)),
+      structuredG_((int)(mtState::D_),(int)(mtNoise::D_)),
+      structuredTemp_((int)(mtState::D_),(int)(mtState::D_)),
+      structuredCov_((int)(mtState::D_),(int)(mtState::D_)),
+      structuredNoiseCov_((int)(mtState::D_),(int)(mtState::D_)){
     int ind;
     inertialMotionRorTh_ = 0.1;
     inertialMotionAccTh_ = 0.1;
+    useStructuredPropagation_ = true;
+    zeroNoise_.setIdentity();
     doubleRegister_.registerVector("GravityVector.g", g_);
+    boolRegister_.registerScalar("useStructuredPropagation",useStructuredPropagation_);
     doubleRegister_.registerScalar("MotionDetection.inertialMotionRorTh",inertialMotionRorTh_);
     doubleRegister_.registerScalar("MotionDetection.inertialMotionAccTh",inertialMotionAccTh_);
     for(int i=0;i<mtState::nMax_;i++){
@@ -215,7 +234,7 @@ class ImuPrediction: public LWF::Prediction<FILTERSTATE>{
                 - (M3D::Identity()-oldC_.get_nor().getVec()*oldC_.get_nor().getVec().transpose())
                 +1.0/oldD_.getDistance()*gSM(oldC_.get_nor().getVec())*gSM(state.qCM(camID).rotate(state.MrMC(camID)))
             )*dt*MPD(state.qCM(camID)).matrix();
-        if(state.aux().doVECalibration_){
+        if(state.aux().doVECalibration_ && !state.aux().isExtrinsicsFrozen_[camID]){
           F.template block<1,3>(mtState::template getId<mtState::_fea>(i)+2,mtState::template getId<mtState::_vea>(camID)) =
               dt*oldD_.getParameterDerivative()*oldC_.get_nor().getVec().transpose()*gSM(camVel);
           F.template block<1,3>(mtState::template getId<mtState::_fea>(i)+2,mtState::template getId<mtState::_vep>(camID)) =
@@ -252,9 +271,13 @@ class ImuPrediction: public LWF::Prediction<FILTERSTATE>{
     G.template block<3,3>(mtState::template getId<mtState::_acb>(),mtNoise::template getId<mtNoise::_acb>()) = M3D::Identity()*sqrt(dt);
     G.template block<3,3>(mtState::template getId<mtState::_gyb>(),mtNoise::template getId<mtNoise::_gyb>()) = M3D::Identity()*sqrt(dt);
     G.template block<3,3>(mtState::template getId<mtState::_att>(),mtNoise::template getId<mtNoise::_att>()) = MPD(state.qWM()).matrix()*Lmat(dOmega)*sqrt(dt);
-    G.template block<1,1>(mtState::template getId<mtState::_ref>(),mtNoise::template getId<mtNoise::_ref>()) = M1D::Identity()*sqrt(dt);
+    // Frozen calibration states receive no process noise
+    if(!state.aux().isRefFrozen_){
+      G.template block<1,1>(mtState::template getId<mtState::_ref>(),mtNoise::template getId<mtNoise::_ref>()) = M1D::Identity()*sqrt(dt);
+    }
 
     for(unsigned int i=0;i<mtState::nCam_;i++){
+      if(state.aux().isExtrinsicsFrozen_[i]) continue;
       G.template block<3,3>(mtState::template getId<mtState::_vep>(i),mtNoise::template getId<mtNoise::_vep>(i)) = M3D::Identity()*sqrt(dt);
       G.template block<3,3>(mtState::template getId<mtState::_vea>(i),mtNoise::template getId<mtNoise::_vea>(i)) = M3D::Identity()*sqrt(dt);
     }
@@ -287,6 +310,106 @@ class ImuPrediction: public LWF::Prediction<FILTERSTATE>{
       }
     }
   }
+  /** \brief Computes out = M*X*M^T for a Jacobian M with the block structure of the IMU prediction, see
+   *         rovio::structuredSandwich. Requires that the rows and columns of M have the same element layout (true for
+   *         jacPreviousState and jacNoise).
+   *
+   *  The core states from ca to the end of the core are frozen calibration states (see \ref activeCoreEnd).
+   *
+   *   @param M   - Structured Jacobian (D x D).
+   *   @param X   - Symmetric matrix (D x D).
+   *   @param out - Output (D x D, symmetric), must not alias X.
+   *   @param ca  - End of the active core states.
+   */
+  void structuredSandwich(const MXD& M, const MXD& X, MXD& out, const int ca) const{
+    rovio::structuredSandwich(M,X,out,structuredTemp_,mtState::template getId<mtState::_fea>(0),mtState::nMax_,ca);
+  }
+
+  /** \brief Returns the end of the active core states, i.e., the start of the frozen calibration states at the end of
+   *  the core (refractive index, then the extrinsics from the last camera backwards, see \ref structuredSandwich).
+   *
+   *   @param state - Filter state.
+   *   @return end of the active core states.
+   */
+  int activeCoreEnd(const mtState& state) const{
+    int ca = mtState::template getId<mtState::_fea>(0);
+    if(!state.aux().isRefFrozen_) return ca;
+    ca = mtState::template getId<mtState::_ref>();
+    for(int i=mtState::nCam_-1;i>=0;i--){
+      if(!state.aux().isExtrinsicsFrozen_[i]) return ca;
+      ca = mtState::template getId<mtState::_vea>(i);
+    }
+    for(int i=mtState::nCam_-1;i>=0;i--){
+      if(!state.aux().isExtrinsicsFrozen_[i]) return ca;
+      ca = mtState::template getId<mtState::_vep>(i);
+    }
+    return ca;
+  }
+
+  /** \brief Merged EKF prediction over all IMU samples up to tTarget.
+   *
+   *  In contrast to the merged prediction of the base class the state is integrated exactly with every IMU sample.
+   *  The covariance is propagated in a single step, linearized with the mean measurement over the interval (as in the
+   *  base class), where the structure of the Jacobians is exploited (see \ref structuredSandwich).
+   *
+   *   @param filterState - Filter state.
+   *   @param tTarget     - Target time.
+   *   @param measMap     - IMU measurements, stamped with the end time of their integration interval.
+   *   @return 0 if successful.
+   */
+  int predictMergedEKF(mtFilterState& filterState, const double tTarget, const std::map<double,mtMeas>& measMap){
+    ROVIO_PROFILE_SCOPE("imu_prediction");
+    if(!useStructuredPropagation_ || mtNoise::D_ != mtState::D_
+        || mtNoise::template getId<mtNoise::_fea>(0) != mtState::template getId<mtState::_fea>(0)){
+      return Base::predictMergedEKF(filterState,tTarget,measMap);
+    }
+    const typename std::map<double,mtMeas>::const_iterator itMeasStart = measMap.upper_bound(filterState.t_);
+    if(itMeasStart == measMap.end()) return 0;
+    typename std::map<double,mtMeas>::const_iterator itMeasEnd = measMap.lower_bound(tTarget);
+    if(itMeasEnd != measMap.end()) ++itMeasEnd;
+    const double tEnd = std::min(std::prev(itMeasEnd)->first,tTarget);
+    const double dT = tEnd-filterState.t_;
+    if(dT <= 0) return 0;
+
+    // Mean measurement for the linearization of the covariance propagation
+    mtMeas meanMeas;
+    typename mtMeas::mtDifVec vec;
+    typename mtMeas::mtDifVec difVec;
+    vec.setZero();
+    double t = filterState.t_;
+    for(typename std::map<double,mtMeas>::const_iterator itMeas=itMeasStart;itMeas!=itMeasEnd;itMeas++){
+      itMeas->second.boxMinus(itMeasStart->second,difVec);
+      vec = vec + difVec*(std::min(itMeas->first,tTarget)-t);
+      t = std::min(itMeas->first,tTarget);
+    }
+    vec = vec/dT;
+    itMeasStart->second.boxPlus(vec,meanMeas);
+    meas_ = meanMeas;
+    jacPreviousState(structuredF_,filterState.state_,dT);
+    jacNoise(structuredG_,filterState.state_,dT);
+
+    // Exact integration of the IMU samples
+    t = filterState.t_;
+    for(typename std::map<double,mtMeas>::const_iterator itMeas=itMeasStart;itMeas!=itMeasEnd;itMeas++){
+      const double dt = std::min(itMeas->first,tTarget)-t;
+      if(dt > 0){
+        meas_ = itMeas->second;
+        evalPrediction(filterState.state_,filterState.state_,zeroNoise_,dt);
+        t += dt;
+      }
+    }
+
+    // Block-wise covariance propagation
+    const int ca = activeCoreEnd(filterState.state_);
+    structuredSandwich(structuredF_,filterState.cov_,structuredCov_,ca);
+    structuredSandwich(structuredG_,prenoiP_,structuredNoiseCov_,ca);
+    structuredCov_ += structuredNoiseCov_;
+    filterState.cov_.swap(structuredCov_);
+    filterState.state_.fix();
+    filterState.t_ = tEnd;
+    return 0;
+  }
+
   bool detectInertialMotion(const mtState& state, const mtMeas& meas) const{
     const V3D imuRor = meas.template get<mtMeas::_gyr>()-state.gyb();
     const V3D imuAcc = meas.template get<mtMeas::_acc>()-state.acb()+state.qWM().inverseRotate(g_);
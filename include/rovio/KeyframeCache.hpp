@@ -0,0 +1,180 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_KEYFRAMECACHE_HPP_
+#define ROVIO_KEYFRAMECACHE_HPP_
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "lightweight_filtering/common.hpp"
+#include "rovio/FeatureCoordinates.hpp"
+#include "rovio/FeatureDistance.hpp"
+#include "rovio/FeatureStatistics.hpp"
+#include "rovio/MultiCamera.hpp"
+#include "rovio/MultilevelPatch.hpp"
+
+namespace rovio{
+
+/** \brief Bounded cache of recent healthy filter states, used to re-seed the features after a reset (warm recovery).
+ *
+ *  Each keyframe holds the pose and, for every valid feature, its patch, bearing vector, distance and the 3x3
+ *  covariance block of bearing and distance (in the order of \ref FilterState::resetFeatureCovariance). The cross
+ *  covariances to the other states are dropped. All methods are thread-safe.
+ *
+ *  @tparam FILTERSTATE - Filter state.
+ */
+template<typename FILTERSTATE>
+class KeyframeCache{
+ public:
+  typedef typename FILTERSTATE::mtState mtState;
+
+  /** \brief Cached feature.
+   */
+  struct CachedFeature{
+    FeatureCoordinates coordinates_; /**<Bearing vector (and camera ID).*/
+    FeatureDistance distance_; /**<Distance parameter.*/
+    MultilevelPatch<mtState::nLevels_,mtState::patchSize_> patch_; /**<Patch.*/
+    Eigen::Matrix3d cov_; /**<Covariance of distance and bearing (distance first).*/
+  };
+
+  /** \brief Cached keyframe.
+   */
+  struct Keyframe{
+    double t_; /**<Time of the filter state.*/
+    V3D WrWM_; /**<Position of the IMU.*/
+    QPD qMW_; /**<Attitude of the IMU (as used for the reset with pose).*/
+    std::vector<CachedFeature> features_; /**<Valid features.*/
+  };
+
+  unsigned int capacity_; /**<Maximal number of keyframes.*/
+  double minPeriod_; /**<Minimal time between two keyframes.*/
+
+  /** \brief Constructor.
+   *
+   *   @param capacity  - Maximal number of keyframes.
+   *   @param minPeriod - Minimal time between two keyframes.
+   */
+  KeyframeCache(const unsigned int capacity = 5, const double minPeriod = 1.0): capacity_(capacity), minPeriod_(minPeriod){}
+
+  /** \brief Adds a keyframe from a (healthy) filter state, if it is at least \ref minPeriod_ newer than the last one.
+   *
+   *   @param filterState - Filter state.
+   *   @return true, if the keyframe was added.
+   */
+  bool add(const FILTERSTATE& filterState){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(capacity_ == 0 || (!keyframes_.empty() && filterState.t_ < keyframes_.back().t_ + minPeriod_)) return false;
+    if(keyframes_.size() >= capacity_){
+      Keyframe recycled = std::move(keyframes_.front()); // Recycle the oldest keyframe (keeps its allocations)
+      keyframes_.pop_front();
+      keyframes_.push_back(std::move(recycled));
+    } else {
+      keyframes_.emplace_back();
+    }
+    Keyframe& keyframe = keyframes_.back();
+    keyframe.t_ = filterState.t_;
+    keyframe.WrWM_ = filterState.state_.WrWM();
+    keyframe.qMW_ = filterState.state_.qWM().inverted();
+    keyframe.features_.clear();
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      if(!filterState.fsm_.isValid_[i]) continue;
+      keyframe.features_.emplace_back();
+      CachedFeature& cached = keyframe.features_.back();
+      cached.coordinates_ = filterState.state_.CfP(i);
+      cached.distance_ = filterState.state_.dep(i);
+      cached.patch_ = *filterState.fsm_.features_[i].mpMultilevelPatch_;
+      const int id = mtState::template getId<mtState::_fea>(i);
+      cached.cov_(0,0) = filterState.cov_(id+2,id+2);
+      cached.cov_.template block<1,2>(0,1) = filterState.cov_.template block<1,2>(id+2,id);
+      cached.cov_.template block<2,1>(1,0) = filterState.cov_.template block<2,1>(id,id+2);
+      cached.cov_.template block<2,2>(1,1) = filterState.cov_.template block<2,2>(id,id);
+    }
+    return true;
+  }
+
+  /** \brief Returns a copy of the most recent keyframe.
+   *
+   *   @param keyframe - Most recent keyframe.
+   *   @return false, if the cache is empty.
+   */
+  bool getLatest(Keyframe& keyframe) const{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(keyframes_.empty()) return false;
+    keyframe = keyframes_.back();
+    return true;
+  }
+
+  /** \brief Removes all keyframes.
+   */
+  void clear(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    keyframes_.clear();
+  }
+
+  /** \brief Re-seeds the features of a keyframe into a (freshly reset) filter state.
+   *
+   *  The features get new IDs and fresh statistics, their covariance blocks are inflated. Features which cannot be
+   *  re-tracked are removed by the usual quality checks of the image update.
+   *
+   *   @param filterState   - Filter state, should be reset to the pose of the keyframe.
+   *   @param keyframe      - Keyframe.
+   *   @param mpMultiCamera - Cameras of the filter.
+   *   @param covInflation  - Factor applied to the cached covariance blocks.
+   *   @return the number of re-seeded features.
+   */
+  static int seed(FILTERSTATE& filterState, const Keyframe& keyframe, const MultiCamera<mtState::nCam_>* mpMultiCamera, const double covInflation){
+    int count = 0;
+    for(const CachedFeature& cached : keyframe.features_){
+      const int camID = cached.coordinates_.camID_;
+      if(camID < 0 || camID >= mtState::nCam_) continue;
+      const int i = filterState.fsm_.makeNewFeature(camID);
+      if(i < 0) break;
+      auto& f = filterState.fsm_.features_[i];
+      *f.mpCoordinates_ = cached.coordinates_;
+      f.mpCoordinates_->mpCamera_ = &mpMultiCamera->cameras_[camID];
+      *f.mpDistance_ = cached.distance_;
+      *f.mpMultilevelPatch_ = cached.patch_;
+      f.mpStatistics_->resetStatistics(filterState.t_);
+      f.mpStatistics_->status_[camID] = TRACKED;
+      f.mpStatistics_->lastPatchUpdate_ = filterState.t_;
+      filterState.resetFeatureCovariance(i,covInflation*cached.cov_);
+      count++;
+    }
+    return count;
+  }
+
+ private:
+  std::deque<Keyframe> keyframes_; /**<Keyframes, oldest first.*/
+  mutable std::mutex mutex_; /**<Protects \ref keyframes_.*/
+};
+
+}
+
+
+#endif /* ROVIO_KEYFRAMECACHE_HPP_ */
@@ -41,6 +41,8 @@ class MultiCamera{
   V3D BrBC_[nCam]; //!< Translational extrinsic parameter
   QPD qCB_[nCam]; //!< Rotational extrinsic parameter
   Camera cameras_[nCam]; //!< Camera array
+  QPD qDC_[nCam][nCam]; //!< Cached relative rotations, qDC_[D][C] rotates from camera C to camera D
+  V3D CrCD_[nCam][nCam]; //!< Cached relative translations, CrCD_[D][C] is the position of camera D in camera C
 
   /** \brief Constructor.
    *
@@ -51,18 +53,61 @@ class MultiCamera{
       qCB_[i].setIdentity();
       BrBC_[i].setZero();
     }
+    for(unsigned int i=0;i<nCam;i++){
+      updateRelativeTransforms(i);
+    }
   };
   virtual ~MultiCamera(){};
 
-  /** \brief Sets the extrinsics of the i'th camera
+  /** \brief Sets the extrinsics of the i'th camera and updates the cached relative transforms if they changed
    *
    *   @param i - Camera index
    *   @param BrBC - Translational extrinsic parameter
    *   @param qCB - Rotational extrinsic parameter
+   *   @return true, if the extrinsics were changed
    */
-  void setExtrinsics(const int i, const V3D& BrBC, const QPD& qCB){
+  bool setExtrinsics(const int i, const V3D& BrBC, const QPD& qCB){
+    if(BrBC_[i] == BrBC && qCB_[i].toImplementation().coeffs() == qCB.toImplementation().coeffs()){
+      return false;
+    }
     BrBC_[i] = BrBC;
     qCB_[i] = qCB;
+    updateRelativeTransforms(i);
+    return true;
+  }
+
+  /** \brief Recomputes the cached relative transforms between the i'th camera and all other cameras
+   *
+   *   @param i - Camera index
+   */
+  void updateRelativeTransforms(const int i){
+    for(unsigned int j=0;j<nCam;j++){
+      qDC_[i][j] = qCB_[i]*qCB_[j].inverted();
+      qDC_[j][i] = qCB_[j]*qCB_[i].inverted();
+      CrCD_[i][j] = qCB_[j].rotate(V3D(BrBC_[i]-BrBC_[j]));
+      CrCD_[j][i] = qCB_[i].rotate(V3D(BrBC_[j]-BrBC_[i]));
+    }
+  }
+
+  /** \brief Sets the refractive index of all cameras, if it differs by more than epsilon from the current one.
+   *
+   *   @param n       - Refractive index
+   *   @param epsilon - Minimal change
+   *   @return true, if the refractive index was changed
+   */
+  bool setRefractiveIndex(const double n, const double epsilon = 0.0){
+    bool changed = false;
+    for(unsigned int i=0;i<nCam;i++){
+      if(std::fabs(cameras_[i].refrac_ind_-n) > epsilon){
+        changed = true;
+      }
+    }
+    if(changed){
+      for(unsigned int i=0;i<nCam;i++){
+        cameras_[i].refrac_ind_ = n;
+      }
+    }
+    return changed;
   }
 
   /** \brief Loads and sets the distortion model and the corresponding distortion coefficients from yaml-file for camera i
@@ -81,7 +126,6 @@ class MultiCamera{
    *   @param dIn - Corresponding distance
    *   @param cOut - Transformed feature coordinates
    *   @param dOut - Corresponding distance of output
-   *   @todo avoid double computation
    */
   void transformFeature(const int i, const FeatureCoordinates& vecIn, const FeatureDistance& dIn, FeatureCoordinates& vecOut, FeatureDistance& dOut) const{
     if(vecIn.camID_ != i){
@@ -91,10 +135,8 @@ class MultiCamera{
       // DrDP = qDC*(d_in*nor_in-CrCD)
       // d_out = ||DrDP||
       // nor_out = DrDP/d_out
-      const QPD qDC = qCB_[i]*qCB_[vecIn.camID_].inverted();
-      const V3D CrCD = qCB_[vecIn.camID_].rotate(V3D(BrBC_[i]-BrBC_[vecIn.camID_]));
       const V3D CrCP = dIn.getDistance()*vecIn.get_nor().getVec();
-      const V3D DrDP = qDC.rotate(V3D(CrCP-CrCD));
+      const V3D DrDP = qDC_[i][vecIn.camID_].rotate(V3D(CrCP-CrCD_[i][vecIn.camID_]));
       dOut.setParameter(DrDP.norm());
       vecOut.nor_.setFromVector(DrDP);
       vecOut.valid_c_ = false;
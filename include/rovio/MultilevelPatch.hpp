@@ -200,12 +200,27 @@ class MultilevelPatch{
    * @param mpCoor      - Coordinates of the patch in the reference image (subpixel coordinates possible).
    * @param mpWarp      - Affine warping matrix. If nullptr not warping is considered.
    * @param withBorder  - If true, both, the general patches and the corresponding expanded patches are extracted.
+   *
+   * Whether a level is extracted with warping is decided on the coordinates of that level. The warping of all warped
+   * levels is the one of c, the pixel offsets are therefore only computed once.
    */
   void extractMultilevelPatchFromImage(const ImagePyramid<nLevels>& pyr,const FeatureCoordinates& c, const int l = nLevels-1,const bool withBorder = false){
+    float wdx[(patchSize+2)*(patchSize+2)];
+    float wdy[(patchSize+2)*(patchSize+2)];
+    bool hasWarpOffsets = false;
     for(unsigned int i=0;i<=l;i++){
       const auto coorTemp = pyr.levelTranformCoordinates(c,0,i);
+      assert(Patch<patchSize>::isPatchInFrame(pyr.imgs_[i],coorTemp,withBorder));
       isValidPatch_[i] = true;
-      patches_[i].extractPatchFromImage(pyr.imgs_[i],coorTemp,withBorder);
+      if(coorTemp.isNearIdentityWarping()){
+        patches_[i].extractUnwarpedPatchFromImage(pyr.imgs_[i],coorTemp.get_c(),withBorder);
+      } else {
+        if(!hasWarpOffsets){
+          Patch<patchSize>::computeWarpOffsets(coorTemp.get_warp_c(),withBorder,wdx,wdy);
+          hasWarpOffsets = true;
+        }
+        patches_[i].extractWarpedPatchFromImage(pyr.imgs_[i],coorTemp.get_c(),withBorder,wdx,wdy);
+      }
     }
   }
 
@@ -29,6 +29,7 @@
 #ifndef ROVIO_MULTILEVELPATCHALIGNMENT_HPP_
 #define ROVIO_MULTILEVELPATCHALIGNMENT_HPP_
 
+#include <chrono>
 #include "lightweight_filtering/common.hpp"
 #include "rovio/ImagePyramid.hpp"
 #include "rovio/MultilevelPatch.hpp"
@@ -46,8 +47,6 @@ class MultilevelPatchAlignment {
  public:
   mutable Eigen::MatrixXf A_;  /**<A matrix of the linear system of equations, needed for the multilevel patch alignment.*/
   mutable Eigen::MatrixXf b_;  /**<b matrix/vector of the linear system of equations, needed for the multilevel patch alignment.*/
-  mutable Eigen::ColPivHouseholderQR<Eigen::MatrixXf> mColPivHouseholderQR_;  /**<QR decomposition module. Used for computiong reduces system of equations.*/
-  mutable Eigen::JacobiSVD<Eigen::MatrixXf> svd_; /**<SVD module. Used for solving linear equation systems.*/
   mutable FeatureCoordinates bestCoordinateMatch_; /**<Best current pixel coordinate match.*/
   mutable double bestIntensityError_; /**<Intensity error for the match.*/
   mutable MultilevelPatch<nLevels,patch_size> mlpTemp_; /**<Temporary multilevel patch used for various computations.*/
@@ -59,6 +58,12 @@ class MultilevelPatchAlignment {
   bool useIntensityOffset_; /**<Should an intensity offset between the patches be considered.*/
   bool useIntensitySqew_; /**<Should an intensity sqewing between the patches be considered.*/
   float gradientExponent_;  /**<Exponent used for gradient based weighting of residuals.*/
+  bool useCoarseToFine_;  /**<Align level by level (coarse to fine) in align2DAdaptive, with early termination on each level.*/
+  double minLevelPixUpd_;  /**<Termination condition on the pixel update on coarse levels (in pixel of the respective level).*/
+  double coarseErrorThreshold_;  /**<If >= 0, the finer levels are skipped if the average intensity error on the coarsest level exceeds this value.*/
+  bool useDeadline_;  /**<Abort the alignment once \ref deadline_ has passed.*/
+  std::chrono::steady_clock::time_point deadline_;  /**<Deadline for the alignment, \see useDeadline_.*/
+  mutable int iterationCount_;  /**<Number of Gauss-Newton iterations of the last alignment (for profiling).*/
 
   /** \brief Constructor
    */
@@ -69,6 +74,11 @@ class MultilevelPatchAlignment {
     useIntensityOffset_ = true;
     useIntensitySqew_ = true;
     gradientExponent_ = 0.0;
+    useCoarseToFine_ = false;
+    minLevelPixUpd_ = 0.1;
+    coarseErrorThreshold_ = -1.0;
+    useDeadline_ = false;
+    iterationCount_ = 0;
   }
 
   /** \brief Computes the weigting mask for patches
@@ -113,182 +123,35 @@ class MultilevelPatchAlignment {
                                Eigen::MatrixXf& A, Eigen::MatrixXf& b){
     A.resize(0,0);
     b.resize(0,0);
-    Eigen::Matrix2f affInv;
-    if(!c.com_c() || !c.com_warp_c()){
-      return false;
-    }
-    affInv = c.get_warp_c().inverse();
-    int numLevel = 0;
-    const int halfpatch_size = patch_size/2;
-    float wTot = 0;
-    float mean_x = 0;
-    float mean_xx = 0;
-    float mean_xy = 0;
-    float mean_xy_dx = 0;
-    float mean_xy_dy = 0;
-    float mean_y = 0;
-    float mean_y_dx = 0;
-    float mean_y_dy = 0;
+    DenseAccumulator acc(A,b);
+    return computeLinearAlignEquations(pyr,mp,c,l1,l2,acc);
+  }
 
-    // Compute raw error and gradients, as well as mean
-    for(int l = 0; l < nLevels; l++){
-      mlpError_.isValidPatch_[l] = false;
-    }
-    for(int l = l1; l <= l2; l++){
-      const auto c_level = pyr.levelTranformCoordinates(c,0,l);
-      if(mp.isValidPatch_[l] && extractedPatches_[l].isPatchInFrame(pyr.imgs_[l],c_level,false)){
-        mp.patches_[l].computeGradientParameters();
-        if(mp.patches_[l].validGradientParameters_){
-          mlpError_.isValidPatch_[l] = true;
-          numLevel++;
-          extractedPatches_[l].extractPatchFromImage(pyr.imgs_[l],c_level,false);
-          const float* it_patch_extracted = extractedPatches_[l].patch_;
-          const float* it_patch = mp.patches_[l].patch_;
-          const float* it_dx = mp.patches_[l].dx_;
-          const float* it_dy = mp.patches_[l].dy_;
-          float* it_error = mlpError_.patches_[l].patch_;
-          float* it_dx_error = mlpError_.patches_[l].dx_;
-          float* it_dy_error = mlpError_.patches_[l].dy_;
-          const float* it_w = &w_[l*patch_size*patch_size];
-          for(int y=0; y<patch_size; ++y){
-            for(int x=0; x<patch_size; ++x, ++it_patch, ++it_patch_extracted, ++it_dx, ++it_dy, ++it_error, ++it_dx_error, ++it_dy_error, ++it_w){
-              *it_error = *it_patch_extracted - *it_patch;
-              const float Jx = -pow(0.5,l)*(*it_dx); // TODO: make pre-computation in Patch
-              const float Jy = -pow(0.5,l)*(*it_dy);
-              if(c.isNearIdentityWarping()){
-                *it_dx_error = Jx;
-                *it_dy_error = Jy;
-              } else {
-                *it_dx_error = Jx*affInv(0,0)+Jy*affInv(1,0);
-                *it_dy_error = Jx*affInv(0,1)+Jy*affInv(1,1);
-              }
-              if(useIntensityOffset_ || useIntensitySqew_){
-                if(useWeighting_){
-                  mean_x += (*it_w)*(*it_patch);
-                  mean_y += (*it_w)*(*it_patch_extracted);
-                  mean_y_dx += (*it_w)*(*it_dx_error);
-                  mean_y_dy += (*it_w)*(*it_dy_error);
-                  wTot += *it_w;
-                } else {
-                  mean_x += *it_patch;
-                  mean_y += *it_patch_extracted;
-                  mean_y_dx += *it_dx_error;
-                  mean_y_dy += *it_dy_error;
-                  wTot += 1.0;
-                }
-              }
-              if(useIntensitySqew_){
-                if(useWeighting_){
-                  mean_xx += (*it_w)*(*it_patch)*(*it_patch);
-                  mean_xy += (*it_w)*(*it_patch)*(*it_patch_extracted);
-                  mean_xy_dx += (*it_w)*(*it_patch)*(*it_dx_error);
-                  mean_xy_dy += (*it_w)*(*it_patch)*(*it_dy_error);
-                } else {
-                  mean_xx += (*it_patch)*(*it_patch);
-                  mean_xy += (*it_patch)*(*it_patch_extracted);
-                  mean_xy_dx += (*it_patch)*(*it_dx_error);
-                  mean_xy_dy += (*it_patch)*(*it_dy_error);
-                }
-              }
-            }
-          }
-        }
-      }
-    }
-    if(numLevel==0){
+  /** \brief Get the normal equations (A^T*A*x=A^T*b) of the linear align equations, accumulated on the fly without storing A and b.
+   *
+   *  \see Function getLinearAlignEquations() to get the raw linear align equations.
+   *
+   * @param pyr         - Considered image pyramid.
+   * @param mp          - \ref MultilevelPatch, which contains the patches.
+   * @param c           - Coordinates of the patch in the reference image.
+   * @param l1          - Start pyramid level (l1<l2)
+   * @param l2          - End pyramid level (l1<l2)
+   * @param AtA         - A^T*A
+   * @param Atb         - A^T*b
+   * @return true, if successful.
+   */
+  bool getLinearAlignNormalEquations(const ImagePyramid<nLevels>& pyr, const MultilevelPatch<nLevels,patch_size>& mp, const FeatureCoordinates& c, const int l1, const int l2,
+                                     Eigen::Matrix2f& AtA, Eigen::Vector2f& Atb){
+    NormalAccumulator acc;
+    if(!computeLinearAlignEquations(pyr,mp,c,l1,l2,acc)){
       return false;
     }
-
-    float reg_a, reg_a_dx, reg_a_dy, reg_b, reg_b_dx, reg_b_dy;
-    if(useIntensityOffset_ || useIntensitySqew_){
-      mean_x = mean_x/wTot;
-      mean_xx = mean_xx/wTot;
-      mean_xy = mean_xy/wTot;
-      mean_xy_dx = mean_xy_dx/wTot;
-      mean_xy_dy = mean_xy_dy/wTot;
-      mean_y = mean_y/wTot;
-      mean_y_dx = mean_y_dx/wTot;
-      mean_y_dy = mean_y_dy/wTot;
-
-      if(useIntensitySqew_){
-        reg_a = (mean_xy-mean_x*mean_y)/(mean_xx-mean_x*mean_x);
-        reg_a_dx = (mean_xy_dx-mean_x*mean_y_dx)/(mean_xx-mean_x*mean_x);
-        reg_a_dy = (mean_xy_dy-mean_x*mean_y_dy)/(mean_xx-mean_x*mean_x);
-        if(reg_a < 0.5f){
-          reg_a = 0.5;
-          reg_a_dx = 0.0;
-          reg_a_dy = 0.0;
-        }
-      } else {
-        reg_a = 1.0;
-        reg_a_dx = 0.0;
-        reg_a_dy = 0.0;
-      }
-      if(useIntensityOffset_){
-        reg_b = mean_y-reg_a*mean_x;
-        reg_b_dx = mean_y_dx-reg_a_dx*mean_x;
-        reg_b_dy = mean_y_dy-reg_a_dy*mean_x;
-      } else {
-        reg_b = 0.0;
-        reg_b_dx = 0.0;
-        reg_b_dy = 0.0;
-      }
-    }
-
-    // Compute correct patch error and gradient (based on linear brightness fix), apply Huber norm, apply weighting
-    numLevel = 0;
-    for(int l = l1; l <= l2; l++){
-      if(mlpError_.isValidPatch_[l]){
-        numLevel++;
-        A.conservativeResize(numLevel*patch_size*patch_size,2);
-        b.conservativeResize(numLevel*patch_size*patch_size,1);
-        const float* it_patch = mp.patches_[l].patch_;
-        const float* it_patch_extracted = extractedPatches_[l].patch_;
-        float* it_error = mlpError_.patches_[l].patch_;
-        float* it_dx_error = mlpError_.patches_[l].dx_;
-        float* it_dy_error = mlpError_.patches_[l].dy_;
-        const float* it_w = &w_[l*patch_size*patch_size];
-        for(int y=0; y<patch_size; ++y){
-          for(int x=0; x<patch_size; ++x, ++it_patch, ++it_patch_extracted, ++it_error,  ++it_dx_error, ++it_dy_error, ++it_w){
-            if(useIntensityOffset_ || useIntensitySqew_){
-              *it_error = *it_patch_extracted - reg_a*(*it_patch) - reg_b;
-              *it_dx_error = reg_a*(*it_dx_error - reg_a_dx*(*it_patch) - reg_b_dx);
-              *it_dy_error = reg_a*(*it_dy_error - reg_a_dy*(*it_patch) - reg_b_dy);
-            }
-            b((numLevel-1)*patch_size*patch_size+y*patch_size+x,0) = *it_error;
-            A((numLevel-1)*patch_size*patch_size+y*patch_size+x,0) = *it_dx_error;
-            A((numLevel-1)*patch_size*patch_size+y*patch_size+x,1) = *it_dy_error;
-
-            if(huberNormThreshold_ > 0.0){ // TODO: investigate why 1.0 leads to non-deterministic behavior
-              const float b_abs = std::fabs(*it_error);
-              if(b_abs > huberNormThreshold_){
-                b((numLevel-1)*patch_size*patch_size+y*patch_size+x,0) = std::sqrt(huberNormThreshold_*(2.0*b_abs - huberNormThreshold_))*copysign(1.0, *it_error);
-                const float f = huberNormThreshold_/b((numLevel-1)*patch_size*patch_size+y*patch_size+x,0)*copysign(1.0, *it_error);
-                A((numLevel-1)*patch_size*patch_size+y*patch_size+x,0) = f*A((numLevel-1)*patch_size*patch_size+y*patch_size+x,0);
-                A((numLevel-1)*patch_size*patch_size+y*patch_size+x,1) = f*A((numLevel-1)*patch_size*patch_size+y*patch_size+x,1);
-              }
-            }
-
-            if(gradientExponent_ >0.0){
-              const float gradientBasedWeighting = 1.0-std::pow(((*it_dx_error)*(*it_dx_error)+(*it_dy_error)*(*it_dy_error))/(2*128*128),0.5*gradientExponent_);
-              b((numLevel-1)*patch_size*patch_size+y*patch_size+x,0) *= gradientBasedWeighting;
-              A((numLevel-1)*patch_size*patch_size+y*patch_size+x,0) *= gradientBasedWeighting;
-              A((numLevel-1)*patch_size*patch_size+y*patch_size+x,1) *= gradientBasedWeighting;
-            }
-
-            if(useWeighting_){
-              b((numLevel-1)*patch_size*patch_size+y*patch_size+x,0) *= *it_w;
-              A((numLevel-1)*patch_size*patch_size+y*patch_size+x,0) *= *it_w;
-              A((numLevel-1)*patch_size*patch_size+y*patch_size+x,1) *= *it_w;
-            }
-          }
-        }
-      }
-    }
+    AtA << acc.a00_, acc.a01_, acc.a01_, acc.a11_;
+    Atb << acc.b0_, acc.b1_;
     return true;
   }
 
-  /** \brief Get the reduced (QR-decomposition) linear align equations (A*x=b), given by the [2x2] Matrix A (float)
+  /** \brief Get the reduced (Cholesky of the normal equations) linear align equations (A*x=b), given by the [2x2] Matrix A (float)
    *         and the [2x1] vector b (float).
    *
    *  \see MultilevelPatchFeature::A_ and MultilevelPatchFeature::b_.
@@ -307,18 +170,39 @@ class MultilevelPatchAlignment {
    */
   bool getLinearAlignEquationsReduced(const ImagePyramid<nLevels>& pyr, const MultilevelPatch<nLevels,patch_size>& mp, const FeatureCoordinates& c, const int l1, const int l2,
                                       Eigen::Matrix2f& A_red, Eigen::Vector2f& b_red){
-    bool success = getLinearAlignEquations(pyr,mp,c,l1,l2,A_,b_);
+    Eigen::Matrix2f AtA;
+    Eigen::Vector2f Atb;
+    bool success = getLinearAlignNormalEquations(pyr,mp,c,l1,l2,AtA,Atb);
     if(success){
-      mColPivHouseholderQR_.compute(A_);
-      b_red = (mColPivHouseholderQR_.householderQ().inverse()*b_).template block<2,1>(0,0); // TODO: reduce
-      A_red = mColPivHouseholderQR_.matrixR().template block<2,2>(0,0);
-      A_red(1,0) = 0.0;
-      A_red = A_red*mColPivHouseholderQR_.colsPermutation();
+      // A_red^T*A_red = A^T*A and A_red^T*b_red = A^T*b, with A_red upper triangular (Cholesky factor)
+      const float l00 = AtA(0,0) > 0.0f ? std::sqrt(AtA(0,0)) : 0.0f;
+      const float l10 = l00 > 0.0f ? AtA(1,0)/l00 : 0.0f;
+      const float d11 = AtA(1,1)-l10*l10;
+      if(l00 > 0.0f && d11 > 0.0f){
+        const float l11 = std::sqrt(d11);
+        A_red << l00, l10, 0.0f, l11;
+        b_red(0) = Atb(0)/l00;
+        b_red(1) = (Atb(1)-l10*b_red(0))/l11;
+      } else {
+        // Rank deficient: factorize via eigen decomposition, the degenerate direction gets a zero row
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix2f> eig;
+        eig.computeDirect(AtA);
+        for(int i=0;i<2;i++){
+          const float ev = eig.eigenvalues()(i);
+          if(ev > 0.0f){
+            A_red.row(i) = std::sqrt(ev)*eig.eigenvectors().col(i).transpose();
+            b_red(i) = eig.eigenvectors().col(i).dot(Atb)/std::sqrt(ev);
+          } else {
+            A_red.row(i).setZero();
+            b_red(i) = 0.0f;
+          }
+        }
+      }
     }
     return success;
   }
 
-  /** \brief Get the reduced (QR-decomposition) linear align equations (A*x=b), given by the [2x2] Matrix A (double)
+  /** \brief Get the reduced (Cholesky of the normal equations) linear align equations (A*x=b), given by the [2x2] Matrix A (double)
    *         and the [2x1] vector b (double).
    *
    *         \see MultilevelPatchFeature::A_ and MultilevelPatchFeature::b_.
@@ -390,7 +274,7 @@ class MultilevelPatchAlignment {
     for(int l = l1; l <= l2; l++){
       pyr.levelTranformCoordinates(cInit,c_level,0,l);
       if(mp.isValidPatch_[l] && mp.patches_[l].isPatchInFrame(pyr.imgs_[l],c_level,false)){
-        mp.patches_[l].computeGradientParameters();
+        mp.patches_[l].computeScaledGradients(pow(0.5,l));
         H(0,0) += pow(0.25,l)*mp.patches_[l].H_(0,0);
         H(0,1) += pow(0.25,l)*mp.patches_[l].H_(0,1);
         H(1,0) += pow(0.25,l)*mp.patches_[l].H_(1,0);
@@ -422,8 +306,8 @@ class MultilevelPatchAlignment {
           const int refStep = pyr.imgs_[l].step.p[0];
 
           const float* it_patch = mp.patches_[l].patch_;
-          const float* it_dx = mp.patches_[l].dx_;
-          const float* it_dy = mp.patches_[l].dy_;
+          const float* it_dx = mp.patches_[l].dxScaled_;
+          const float* it_dy = mp.patches_[l].dyScaled_;
           if(cInit.isNearIdentityWarping()){
             const int u_r = floor(c_level.get_c().x);
             const int v_r = floor(c_level.get_c().y);
@@ -444,8 +328,8 @@ class MultilevelPatchAlignment {
               for(int x=0; x<patch_size; ++x, ++it_img, ++it_patch, ++it_dx, ++it_dy){
                 const float intensity = wTL*it_img[0] + wTR*it_img[1] + wBL*it_img[refStep] + wBR*it_img[refStep+1];
                 const float res = intensity - *it_patch + mean_diff;
-                Jres[0] -= pow(0.5,l)*res*(*it_dx);
-                Jres[1] -= pow(0.5,l)*res*(*it_dy);
+                Jres[0] -= res*(*it_dx);
+                Jres[1] -= res*(*it_dy);
                 Jres[2] -= res;
               }
             }
@@ -472,8 +356,8 @@ class MultilevelPatchAlignment {
                 const uint8_t* pixel_data = (uint8_t*) pyr.imgs_[l].data + v_pixel_r*refStep + u_pixel_r;
                 const float pixel_intensity = pixel_wTL*pixel_data[0] + pixel_wTR*pixel_data[1] + pixel_wBL*pixel_data[refStep] + pixel_wBR*pixel_data[refStep+1];
                 const float res = pixel_intensity - *it_patch + mean_diff;
-                Jres[0] -= pow(0.5,l)*res*(*it_dx);
-                Jres[1] -= pow(0.5,l)*res*(*it_dy);
+                Jres[0] -= res*(*it_dx);
+                Jres[1] -= res*(*it_dy);
                 Jres[2] -= res;
               }
             }
@@ -525,14 +409,20 @@ class MultilevelPatchAlignment {
         assert(false);
         return false;
       }
-      if(!getLinearAlignEquations(pyr,mp,cOut,l1,l2,A_,b_)){
+      if(useDeadline_ && std::chrono::steady_clock::now() > deadline_){
+        return false;
+      }
+      iterationCount_++;
+      Eigen::Matrix2f AtA;
+      Eigen::Vector2f Atb;
+      if(!getLinearAlignNormalEquations(pyr,mp,cOut,l1,l2,AtA,Atb)){
         return false;
       }
-      svd_.compute(A_, Eigen::ComputeThinU | Eigen::ComputeThinV);
-      if(svd_.nonzeroSingularValues()<2){
+      const float det = AtA(0,0)*AtA(1,1)-AtA(0,1)*AtA(1,0);
+      if(!(det > 0.0f)){
         return false;
       }
-      update = svd_.solve(b_);
+      update << (AtA(1,1)*Atb(0)-AtA(0,1)*Atb(1))/det, (AtA(0,0)*Atb(1)-AtA(1,0)*Atb(0))/det;
       cOut.set_c(cv::Point2f(cOut.get_c().x + update[0],cOut.get_c().y + update[1]),false);
 
       if(update[0]*update[0]+update[1]*update[1] < min_update_squared){
@@ -569,6 +459,7 @@ class MultilevelPatchAlignment {
    */
   bool align2DComposed(FeatureCoordinates& cOut, const ImagePyramid<nLevels>& pyr, const MultilevelPatch<nLevels,patch_size>& mp, const FeatureCoordinates& cInit,
                        const int lowest_level,const int highest_level, const int start_level){
+    iterationCount_ = 0;
     cOut = cInit;
     for(int l = start_level;l>=highest_level;--l){
       if(!align2D(cOut,pyr,mp,cOut,l,lowest_level)){
@@ -594,14 +485,15 @@ class MultilevelPatchAlignment {
   bool align2DAdaptive(FeatureCoordinates& cOut, const ImagePyramid<nLevels>& pyr, const MultilevelPatch<nLevels,patch_size>& mp, const FeatureCoordinates& cInit,
                        const int lowest_level = nLevels,const int highest_level = 0, const double convergencePixelRange = 1.0,  const double coverageRatio = 2.0, const int maxUniSample = 5){
     bestIntensityError_ = -1;
+    iterationCount_ = 0;
     cOut = cInit;
     const int n = std::min(std::max(static_cast<int>(ceil((cInit.sigma1_*coverageRatio)/(convergencePixelRange*pow(2.0,lowest_level+1))-0.5)),0),maxUniSample); // (n+0.5)*r*2^(l+1) > s*f
     if(n==0){ // Catch simple case
-      return align2D(cOut,pyr,mp,cInit,highest_level,lowest_level);
+      return alignLevels(cOut,pyr,mp,cInit,lowest_level,highest_level);
     }
     for(int i = -n;i<=n;i++){ // i is the multiple of steps which should be taken along the directions
       cOut.set_c(cInit.get_c() + vecToPoint2f(cInit.eigenVector1_.cast<float>()*i*convergencePixelRange*pow(2.0,lowest_level+1)),false);
-      if(align2D(cOut,pyr,mp,cOut,highest_level,lowest_level)){
+      if(alignLevels(cOut,pyr,mp,cOut,lowest_level,highest_level)){
         if(mlpTemp_.isMultilevelPatchInFrame(pyr,cOut,lowest_level,false)){
           mlpTemp_.extractMultilevelPatchFromImage(pyr,cOut,lowest_level,false);
           const float avgError = mlpTemp_.computeAverageDifference(mp,highest_level,lowest_level);
@@ -619,6 +511,267 @@ class MultilevelPatchAlignment {
       return true;
     }
   }
+
+ private:
+  /** \brief Aligns all levels between highest_level and lowest_level, either jointly or coarse to fine (\ref useCoarseToFine_).
+   *
+   *  In the coarse to fine mode each coarse level terminates as soon as the update falls below \ref minLevelPixUpd_ (scaled to the level),
+   *  non-converged coarse levels are not considered as failure. If a coarse level yields an invalid estimate, the next level is seeded
+   *  from the last valid one. If \ref coarseErrorThreshold_ >= 0 and the average intensity error on the
+   *  coarsest level exceeds it, the finer levels are skipped and the alignment fails.
+   *
+   * @param cOut          - Estimated coordinates for the patch alignment.
+   * @param pyr           - Considered image pyramid.
+   * @param mp            - \ref MultilevelPatch, which contains the patches.
+   * @param cInit         - Coordinates of the patch in the reference image, initial guess.
+   * @param lowest_level  - Lowest pyramid level to be considered
+   * @param highest_level - Highest pyramid level to be considered (should be smaller than lowest_level)
+   * @return true, if alignment converged!
+   */
+  bool alignLevels(FeatureCoordinates& cOut, const ImagePyramid<nLevels>& pyr, const MultilevelPatch<nLevels,patch_size>& mp, const FeatureCoordinates& cInit,
+                   const int lowest_level, const int highest_level){
+    if(!useCoarseToFine_ || lowest_level <= highest_level){
+      return align2D(cOut,pyr,mp,cInit,highest_level,lowest_level);
+    }
+    cOut = cInit;
+    for(int l = lowest_level;l>highest_level;--l){
+      const FeatureCoordinates cLast = cOut;
+      if(!align2D(cOut,pyr,mp,cLast,l,lowest_level,10,minLevelPixUpd_*pow(2.0,l))){
+        // A non-converged level is accepted, an invalid estimate (NaN or the patch left the next level) is discarded
+        if(!std::isfinite(cOut.get_c().x) || !std::isfinite(cOut.get_c().y)
+            || !Patch<patch_size>::isPatchInFrame(pyr.imgs_[l-1],pyr.levelTranformCoordinates(cOut,0,l-1),false)){
+          cOut = cLast;
+        }
+      }
+      if(useDeadline_ && std::chrono::steady_clock::now() > deadline_){
+        return false;
+      }
+      if(l == lowest_level && coarseErrorThreshold_ >= 0){
+        if(!mlpTemp_.isMultilevelPatchInFrame(pyr,cOut,lowest_level,false)){
+          return false;
+        }
+        mlpTemp_.extractMultilevelPatchFromImage(pyr,cOut,lowest_level,false);
+        if(mlpTemp_.computeAverageDifference(mp,lowest_level,lowest_level) > coarseErrorThreshold_){
+          return false;
+        }
+      }
+    }
+    return align2D(cOut,pyr,mp,cOut,highest_level,lowest_level);
+  }
+
+  /** \brief Computes the linear align equations and passes every row (pixel) to an accumulator.
+   *
+   *  \see getLinearAlignEquations() and getLinearAlignNormalEquations()
+   */
+  template<typename Accumulator>
+  bool computeLinearAlignEquations(const ImagePyramid<nLevels>& pyr, const MultilevelPatch<nLevels,patch_size>& mp, const FeatureCoordinates& c, const int l1, const int l2,
+                                   Accumulator& acc){
+    Eigen::Matrix2f affInv;
+    if(!c.com_c() || !c.com_warp_c()){
+      return false;
+    }
+    affInv = c.get_warp_c().inverse();
+    int numLevel = 0;
+    const int halfpatch_size = patch_size/2;
+    float wTot = 0;
+    float mean_x = 0;
+    float mean_xx = 0;
+    float mean_xy = 0;
+    float mean_xy_dx = 0;
+    float mean_xy_dy = 0;
+    float mean_y = 0;
+    float mean_y_dx = 0;
+    float mean_y_dy = 0;
+
+    // Compute raw error and gradients, as well as mean
+    for(int l = 0; l < nLevels; l++){
+      mlpError_.isValidPatch_[l] = false;
+    }
+    for(int l = l1; l <= l2; l++){
+      const auto c_level = pyr.levelTranformCoordinates(c,0,l);
+      if(mp.isValidPatch_[l] && extractedPatches_[l].isPatchInFrame(pyr.imgs_[l],c_level,false)){
+        mp.patches_[l].computeScaledGradients(pow(0.5,l));
+        if(mp.patches_[l].validGradientParameters_){
+          mlpError_.isValidPatch_[l] = true;
+          numLevel++;
+          extractedPatches_[l].extractPatchFromImage(pyr.imgs_[l],c_level,false);
+          const float* it_patch_extracted = extractedPatches_[l].patch_;
+          const float* it_patch = mp.patches_[l].patch_;
+          const float* it_dx = mp.patches_[l].dxScaled_;
+          const float* it_dy = mp.patches_[l].dyScaled_;
+          float* it_error = mlpError_.patches_[l].patch_;
+          float* it_dx_error = mlpError_.patches_[l].dx_;
+          float* it_dy_error = mlpError_.patches_[l].dy_;
+          const float* it_w = &w_[l*patch_size*patch_size];
+          for(int y=0; y<patch_size; ++y){
+            for(int x=0; x<patch_size; ++x, ++it_patch, ++it_patch_extracted, ++it_dx, ++it_dy, ++it_error, ++it_dx_error, ++it_dy_error, ++it_w){
+              *it_error = *it_patch_extracted - *it_patch;
+              const float Jx = -(*it_dx);
+              const float Jy = -(*it_dy);
+              if(c.isNearIdentityWarping()){
+                *it_dx_error = Jx;
+                *it_dy_error = Jy;
+              } else {
+                *it_dx_error = Jx*affInv(0,0)+Jy*affInv(1,0);
+                *it_dy_error = Jx*affInv(0,1)+Jy*affInv(1,1);
+              }
+              if(useIntensityOffset_ || useIntensitySqew_){
+                if(useWeighting_){
+                  mean_x += (*it_w)*(*it_patch);
+                  mean_y += (*it_w)*(*it_patch_extracted);
+                  mean_y_dx += (*it_w)*(*it_dx_error);
+                  mean_y_dy += (*it_w)*(*it_dy_error);
+                  wTot += *it_w;
+                } else {
+                  mean_x += *it_patch;
+                  mean_y += *it_patch_extracted;
+                  mean_y_dx += *it_dx_error;
+                  mean_y_dy += *it_dy_error;
+                  wTot += 1.0;
+                }
+              }
+              if(useIntensitySqew_){
+                if(useWeighting_){
+                  mean_xx += (*it_w)*(*it_patch)*(*it_patch);
+                  mean_xy += (*it_w)*(*it_patch)*(*it_patch_extracted);
+                  mean_xy_dx += (*it_w)*(*it_patch)*(*it_dx_error);
+                  mean_xy_dy += (*it_w)*(*it_patch)*(*it_dy_error);
+                } else {
+                  mean_xx += (*it_patch)*(*it_patch);
+                  mean_xy += (*it_patch)*(*it_patch_extracted);
+                  mean_xy_dx += (*it_patch)*(*it_dx_error);
+                  mean_xy_dy += (*it_patch)*(*it_dy_error);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+    if(numLevel==0){
+      return false;
+    }
+
+    float reg_a, reg_a_dx, reg_a_dy, reg_b, reg_b_dx, reg_b_dy;
+    if(useIntensityOffset_ || useIntensitySqew_){
+      mean_x = mean_x/wTot;
+      mean_xx = mean_xx/wTot;
+      mean_xy = mean_xy/wTot;
+      mean_xy_dx = mean_xy_dx/wTot;
+      mean_xy_dy = mean_xy_dy/wTot;
+      mean_y = mean_y/wTot;
+      mean_y_dx = mean_y_dx/wTot;
+      mean_y_dy = mean_y_dy/wTot;
+
+      if(useIntensitySqew_){
+        reg_a = (mean_xy-mean_x*mean_y)/(mean_xx-mean_x*mean_x);
+        reg_a_dx = (mean_xy_dx-mean_x*mean_y_dx)/(mean_xx-mean_x*mean_x);
+        reg_a_dy = (mean_xy_dy-mean_x*mean_y_dy)/(mean_xx-mean_x*mean_x);
+        if(reg_a < 0.5f){
+          reg_a = 0.5;
+          reg_a_dx = 0.0;
+          reg_a_dy = 0.0;
+        }
+      } else {
+        reg_a = 1.0;
+        reg_a_dx = 0.0;
+        reg_a_dy = 0.0;
+      }
+      if(useIntensityOffset_){
+        reg_b = mean_y-reg_a*mean_x;
+        reg_b_dx = mean_y_dx-reg_a_dx*mean_x;
+        reg_b_dy = mean_y_dy-reg_a_dy*mean_x;
+      } else {
+        reg_b = 0.0;
+        reg_b_dx = 0.0;
+        reg_b_dy = 0.0;
+      }
+    }
+
+    // Compute correct patch error and gradient (based on linear brightness fix), apply Huber norm, apply weighting
+    acc.init(numLevel*patch_size*patch_size);
+    int row = 0;
+    for(int l = l1; l <= l2; l++){
+      if(mlpError_.isValidPatch_[l]){
+        const float* it_patch = mp.patches_[l].patch_;
+        const float* it_patch_extracted = extractedPatches_[l].patch_;
+        float* it_error = mlpError_.patches_[l].patch_;
+        float* it_dx_error = mlpError_.patches_[l].dx_;
+        float* it_dy_error = mlpError_.patches_[l].dy_;
+        const float* it_w = &w_[l*patch_size*patch_size];
+        for(int y=0; y<patch_size; ++y){
+          for(int x=0; x<patch_size; ++x, ++it_patch, ++it_patch_extracted, ++it_error,  ++it_dx_error, ++it_dy_error, ++it_w, ++row){
+            if(useIntensityOffset_ || useIntensitySqew_){
+              *it_error = *it_patch_extracted - reg_a*(*it_patch) - reg_b;
+              *it_dx_error = reg_a*(*it_dx_error - reg_a_dx*(*it_patch) - reg_b_dx);
+              *it_dy_error = reg_a*(*it_dy_error - reg_a_dy*(*it_patch) - reg_b_dy);
+            }
+            float e = *it_error;
+            float a0 = *it_dx_error;
+            float a1 = *it_dy_error;
+
+            if(huberNormThreshold_ > 0.0){ // TODO: investigate why 1.0 leads to non-deterministic behavior
+              const float b_abs = std::fabs(*it_error);
+              if(b_abs > huberNormThreshold_){
+                e = std::sqrt(huberNormThreshold_*(2.0*b_abs - huberNormThreshold_))*copysign(1.0, *it_error);
+                const float f = huberNormThreshold_/e*copysign(1.0, *it_error);
+                a0 = f*a0;
+                a1 = f*a1;
+              }
+            }
+
+            if(gradientExponent_ >0.0){
+              const float gradientBasedWeighting = 1.0-std::pow(((*it_dx_error)*(*it_dx_error)+(*it_dy_error)*(*it_dy_error))/(2*128*128),0.5*gradientExponent_);
+              e *= gradientBasedWeighting;
+              a0 *= gradientBasedWeighting;
+              a1 *= gradientBasedWeighting;
+            }
+
+            if(useWeighting_){
+              e *= *it_w;
+              a0 *= *it_w;
+              a1 *= *it_w;
+            }
+            acc.add(row,a0,a1,e);
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  /** \brief Stores the linear align equations into dynamic matrices.
+   */
+  struct DenseAccumulator{
+    Eigen::MatrixXf& A_;
+    Eigen::MatrixXf& b_;
+    DenseAccumulator(Eigen::MatrixXf& A, Eigen::MatrixXf& b): A_(A), b_(b){}
+    void init(const int rows){
+      A_.resize(rows,2);
+      b_.resize(rows,1);
+    }
+    void add(const int row, const float a0, const float a1, const float e){
+      A_(row,0) = a0;
+      A_(row,1) = a1;
+      b_(row,0) = e;
+    }
+  };
+
+  /** \brief Accumulates the normal equations of the linear align equations.
+   */
+  struct NormalAccumulator{
+    float a00_, a01_, a11_, b0_, b1_;
+    void init(const int rows){
+      a00_ = 0.0f; a01_ = 0.0f; a11_ = 0.0f; b0_ = 0.0f; b1_ = 0.0f;
+    }
+    void add(const int row, const float a0, const float a1, const float e){
+      a00_ += a0*a0;
+      a01_ += a0*a1;
+      a11_ += a1*a1;
+      b0_ += a0*e;
+      b1_ += a1*e;
+    }
+  };
 };
 
 }
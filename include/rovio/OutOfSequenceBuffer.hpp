@@ -0,0 +1,239 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_OUTOFSEQUENCEBUFFER_HPP_
+#define ROVIO_OUTOFSEQUENCEBUFFER_HPP_
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <type_traits>
+#include "lightweight_filtering/common.hpp"
+
+namespace rovio{
+
+/** \brief Rollback buffer for out-of-sequence (late) update measurements.
+ *
+ *  Keeps a bounded ring of safe state checkpoints (one per advance of the safe state, i.e. per processed image) and
+ *  logs the prediction and update measurements received since the oldest checkpoint. A measurement older than the
+ *  safe state is applied in \ref rollback by resetting the safe state to the last checkpoint before it and
+ *  re-adding the logged measurements after the checkpoint (together with the late one) to the filter. Only the
+ *  updates after the late measurement are reprocessed (the images between the checkpoint and the measurement are
+ *  already contained in the checkpoint). The safe state is re-advanced image by image in \ref replay, such that
+ *  the dropped checkpoints are rebuilt. The checkpoints include the adaptive state of the image update (update 0),
+ *  such that the replay detects and governs as the original processing did. Feature IDs are never reused, the
+ *  feature counter of the safe state is kept monotonic across rollbacks. Not thread-safe, must be used with the
+ *  filter mutex held.
+ *
+ *  @tparam FILTER - Filter (\ref rovio::RovioFilter).
+ */
+template<typename FILTER>
+class OutOfSequenceBuffer{
+ public:
+  typedef typename FILTER::mtFilterState mtFilterState;
+  typedef typename FILTER::mtPrediction::mtMeas mtPredictionMeas;
+  typedef typename FILTER::mtUpdates mtUpdates;
+  typedef typename std::tuple_element<0,mtUpdates>::type mtImgUpdate;
+  static constexpr int nUpdates_ = std::tuple_size<mtUpdates>::value;
+
+  /** \brief Checkpoint of the safe state.
+   */
+  struct Checkpoint{
+    mtFilterState safe_;
+    typename mtImgUpdate::AdaptiveState imgUpdateState_; /**<Adaptive state of the image update at safe_.*/
+  };
+
+  /** \brief Maps the update tuple to a tuple of measurement logs.
+   */
+  template<typename TUPLE> struct MeasLogs;
+  template<typename... UPDATES> struct MeasLogs<std::tuple<UPDATES...>>{
+    typedef std::tuple<std::map<double,typename UPDATES::mtMeas>...> type;
+  };
+
+  double maxDelay_; /**<Maximal delay of a late measurement [s], older ones are dropped.*/
+  int rollbackCount_; /**<Number of performed rollbacks.*/
+  int droppedCount_; /**<Number of late measurements older than the oldest checkpoint.*/
+
+  /** \brief Constructor.
+   *
+   *   @param maxDelay - Maximal delay of a late measurement [s].
+   */
+  OutOfSequenceBuffer(const double maxDelay = 0.5): maxDelay_(maxDelay), rollbackCount_(0), droppedCount_(0){}
+
+  /** \brief Removes all checkpoints and measurements (after a reset of the filter).
+   */
+  void clear(){
+    checkpoints_.clear();
+    predictionLog_.clear();
+    clearLogs(std::integral_constant<int,0>());
+  }
+
+  /** \brief Logs a prediction measurement (additionally to adding it to the filter).
+   */
+  void logPredictionMeas(const mtPredictionMeas& meas, const double t){
+    predictionLog_[t] = meas;
+  }
+
+  /** \brief Logs an update measurement (additionally to adding it to the filter).
+   */
+  template<int i>
+  void logUpdateMeas(const typename std::tuple_element<i,mtUpdates>::type::mtMeas& meas, const double t){
+    std::get<i>(logs_)[t] = meas;
+  }
+
+  /** \brief Adds a checkpoint of the safe state, should be called whenever the safe state advanced.
+   *
+   *   Drops the checkpoints which are older than \ref maxDelay_ (except the last one before) and the measurements
+   *   before the oldest checkpoint.
+   *
+   *   @param filter - Filter.
+   */
+  void addCheckpoint(const FILTER& filter){
+    const mtFilterState& safe = filter.safe_;
+    if(!checkpoints_.empty() && safe.t_ <= checkpoints_.back().safe_.t_) return;
+    checkpoints_.emplace_back();
+    checkpoints_.back().safe_ = safe;
+    std::get<0>(filter.mUpdates_).saveAdaptiveState(checkpoints_.back().imgUpdateState_);
+    while(checkpoints_.size() > 1 && checkpoints_[1].safe_.t_ <= safe.t_ - maxDelay_){
+      checkpoints_.pop_front();
+    }
+    const double tOldest = checkpoints_.front().safe_.t_;
+    predictionLog_.erase(predictionLog_.begin(),predictionLog_.upper_bound(tOldest));
+    cleanLogs(tOldest,std::integral_constant<int,0>());
+  }
+
+  /** \brief Checks if a measurement is late, i.e. not newer than the safe state.
+   */
+  static bool isLate(const FILTER& filter, const double t){
+    return t <= filter.safe_.t_;
+  }
+
+  /** \brief Rolls the safe state back to the last checkpoint before a late update measurement.
+   *
+   *   The logged measurements after the checkpoint and the late measurement are (re-)added to the filter. Call
+   *   \ref replay afterwards to advance the safe state to where it was.
+   *
+   *   @param filter - Filter.
+   *   @param meas   - Late measurement.
+   *   @param t      - Time of the late measurement.
+   *   @return false if the measurement is older than the oldest checkpoint (it is dropped).
+   */
+  template<int i>
+  bool rollback(FILTER& filter, const typename std::tuple_element<i,mtUpdates>::type::mtMeas& meas, const double t){
+    if(checkpoints_.empty() || t <= checkpoints_.front().safe_.t_){
+      droppedCount_++;
+      return false;
+    }
+    logUpdateMeas<i>(meas,t);
+    if(replayEnd_ < filter.safe_.t_) replayEnd_ = filter.safe_.t_;
+    while(checkpoints_.back().safe_.t_ >= t){
+      checkpoints_.pop_back();
+    }
+    const int maxIdx = filter.safe_.fsm_.maxIdx_;
+    filter.safe_ = checkpoints_.back().safe_;
+    filter.safe_.fsm_.maxIdx_ = std::max(filter.safe_.fsm_.maxIdx_,maxIdx); // IDs of dropped features are not reused
+    filter.front_ = filter.safe_;
+    std::get<0>(filter.mUpdates_).restoreAdaptiveState(checkpoints_.back().imgUpdateState_);
+    const double tStart = filter.safe_.t_;
+    // Rewind the late-measurement bookkeeping of the filter, the re-added measurements are not late w.r.t. the restored
+    // safe and front state
+    filter.safeWarningTime_ = tStart;
+    filter.frontWarningTime_ = tStart;
+    filter.gotFrontWarning_ = false;
+    for(auto it = predictionLog_.upper_bound(tStart);it != predictionLog_.end();++it){
+      filter.addPredictionMeas(it->second,it->first);
+    }
+    addLogs(filter,tStart,std::integral_constant<int,0>());
+    rollbackCount_++;
+    return true;
+  }
+
+  /** \brief Advances the safe state of a rolled back filter to the state before the rollback, adding a checkpoint
+   *         at every logged image (update 0).
+   *
+   *   @param filter - Filter.
+   *   @return the number of reprocessed images.
+   */
+  int replay(FILTER& filter){
+    int count = 0;
+    const auto& imgLog = std::get<0>(logs_);
+    for(auto it = imgLog.upper_bound(filter.safe_.t_);it != imgLog.end() && it->first <= replayEnd_;++it){
+      double tImg = it->first;
+      filter.updateSafe(&tImg);
+      addCheckpoint(filter);
+      count++;
+    }
+    if(filter.safe_.t_ < replayEnd_){
+      double tEnd = replayEnd_;
+      filter.updateSafe(&tEnd);
+    }
+    replayEnd_ = 0.0;
+    return count;
+  }
+
+  /** \brief Returns the number of checkpoints.
+   */
+  int checkpointCount() const{
+    return checkpoints_.size();
+  }
+
+ private:
+  std::deque<Checkpoint> checkpoints_; /**<Checkpoints of the safe state, oldest first.*/
+  std::map<double,mtPredictionMeas> predictionLog_; /**<Prediction measurements after the oldest checkpoint.*/
+  typename MeasLogs<mtUpdates>::type logs_; /**<Update measurements after the oldest checkpoint.*/
+  double replayEnd_ = 0.0; /**<Safe time before the first pending rollback.*/
+
+  template<int i>
+  void clearLogs(std::integral_constant<int,i>){
+    std::get<i>(logs_).clear();
+    clearLogs(std::integral_constant<int,i+1>());
+  }
+  void clearLogs(std::integral_constant<int,nUpdates_>){}
+
+  template<int i>
+  void cleanLogs(const double t, std::integral_constant<int,i>){
+    std::get<i>(logs_).erase(std::get<i>(logs_).begin(),std::get<i>(logs_).upper_bound(t));
+    cleanLogs(t,std::integral_constant<int,i+1>());
+  }
+  void cleanLogs(const double, std::integral_constant<int,nUpdates_>){}
+
+  template<int i>
+  void addLogs(FILTER& filter, const double t, std::integral_constant<int,i>){
+    for(auto it = std::get<i>(logs_).upper_bound(t);it != std::get<i>(logs_).end();++it){
+      filter.template addUpdateMeas<i>(it->second,it->first);
+    }
+    addLogs(filter,t,std::integral_constant<int,i+1>());
+  }
+  void addLogs(FILTER&, const double, std::integral_constant<int,nUpdates_>){}
+};
+
+}
+
+
+#endif /* ROVIO_OUTOFSEQUENCEBUFFER_HPP_ */
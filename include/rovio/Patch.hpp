@@ -32,6 +32,13 @@
 #include "lightweight_filtering/common.hpp"
 #include "rovio/FeatureCoordinates.hpp"
 
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 namespace rovio{
 
 /** \brief %Patch with selectable patchSize.
@@ -46,6 +53,9 @@ class Patch {
                                                                                  This expanded patch is necessary for the intensity gradient calculation.*/
   mutable float dx_[patchSize*patchSize] __attribute__ ((aligned (16)));  /**<Array, containing the intensity gradient component in x-direction for each patch pixel.*/
   mutable float dy_[patchSize*patchSize] __attribute__ ((aligned (16)));  /**<Array, containing the intensity gradient component in y-direction for each patch pixel.*/
+  mutable float dxScaled_[patchSize*patchSize] __attribute__ ((aligned (16)));  /**<Array, containing dx_ multiplied by gradientScale_.*/
+  mutable float dyScaled_[patchSize*patchSize] __attribute__ ((aligned (16)));  /**<Array, containing dy_ multiplied by gradientScale_.*/
+  mutable float gradientScale_;  /**<Scale of dxScaled_ and dyScaled_ (0 if not computed). \see computeScaledGradients()*/
   mutable Eigen::Matrix3f H_;  /**<Hessian matrix of the patch (necessary for the patch alignment).*/
   mutable float s_;  /**<Shi-Tomasi Score (smaller eigenvalue of H_).*/
   mutable float e0_;  /**<Smaller eigenvalue of H_.*/
@@ -57,6 +67,7 @@ class Patch {
   Patch(){
     static_assert(patchSize%2==0,"Patch patchSize must be a multiple of 2");
     validGradientParameters_ = false;
+    gradientScale_ = 0.0;
     s_ = 0.0;
     e0_ = 0.0;
     e1_ = 0.0;
@@ -71,24 +82,88 @@ class Patch {
    */
   void computeGradientParameters() const{
     if(!validGradientParameters_){
-      H_.setZero();
       const int refStep = patchSize+2;
-      float* it_dx = dx_;
-      float* it_dy = dy_;
-      const float* it;
-      Eigen::Vector3f J;
-      J.setZero();
+      float sXX = 0, sXY = 0, sYY = 0, sX = 0, sY = 0;
+      int xSimd = 0;
+#if defined(__SSE2__)
+      xSimd = patchSize-patchSize%4;
+      const __m128 half = _mm_set1_ps(0.5f);
+      __m128 aXX = _mm_setzero_ps(), aXY = _mm_setzero_ps(), aYY = _mm_setzero_ps(), aX = _mm_setzero_ps(), aY = _mm_setzero_ps();
+      for(int y=0; y<patchSize; ++y){
+        const float* it = patchWithBorder_ + (y+1)*refStep + 1;
+        for(int x=0; x<xSimd; x+=4){
+          const __m128 gx = _mm_mul_ps(half,_mm_sub_ps(_mm_loadu_ps(it+x+1),_mm_loadu_ps(it+x-1)));
+          const __m128 gy = _mm_mul_ps(half,_mm_sub_ps(_mm_loadu_ps(it+x+refStep),_mm_loadu_ps(it+x-refStep)));
+          _mm_storeu_ps(dx_+y*patchSize+x,gx);
+          _mm_storeu_ps(dy_+y*patchSize+x,gy);
+          aXX = _mm_add_ps(aXX,_mm_mul_ps(gx,gx));
+          aXY = _mm_add_ps(aXY,_mm_mul_ps(gx,gy));
+          aYY = _mm_add_ps(aYY,_mm_mul_ps(gy,gy));
+          aX = _mm_add_ps(aX,gx);
+          aY = _mm_add_ps(aY,gy);
+        }
+      }
+      float lanes[5][4] __attribute__ ((aligned (16)));
+      _mm_store_ps(lanes[0],aXX);
+      _mm_store_ps(lanes[1],aXY);
+      _mm_store_ps(lanes[2],aYY);
+      _mm_store_ps(lanes[3],aX);
+      _mm_store_ps(lanes[4],aY);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+      xSimd = patchSize-patchSize%4;
+      float32x4_t aXX = vdupq_n_f32(0.0f), aXY = vdupq_n_f32(0.0f), aYY = vdupq_n_f32(0.0f), aX = vdupq_n_f32(0.0f), aY = vdupq_n_f32(0.0f);
+      for(int y=0; y<patchSize; ++y){
+        const float* it = patchWithBorder_ + (y+1)*refStep + 1;
+        for(int x=0; x<xSimd; x+=4){
+          const float32x4_t gx = vmulq_n_f32(vsubq_f32(vld1q_f32(it+x+1),vld1q_f32(it+x-1)),0.5f);
+          const float32x4_t gy = vmulq_n_f32(vsubq_f32(vld1q_f32(it+x+refStep),vld1q_f32(it+x-refStep)),0.5f);
+          vst1q_f32(dx_+y*patchSize+x,gx);
+          vst1q_f32(dy_+y*patchSize+x,gy);
+          aXX = vmlaq_f32(aXX,gx,gx);
+          aXY = vmlaq_f32(aXY,gx,gy);
+          aYY = vmlaq_f32(aYY,gy,gy);
+          aX = vaddq_f32(aX,gx);
+          aY = vaddq_f32(aY,gy);
+        }
+      }
+      float lanes[5][4] __attribute__ ((aligned (16)));
+      vst1q_f32(lanes[0],aXX);
+      vst1q_f32(lanes[1],aXY);
+      vst1q_f32(lanes[2],aYY);
+      vst1q_f32(lanes[3],aX);
+      vst1q_f32(lanes[4],aY);
+#endif
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+      sXX = (lanes[0][0]+lanes[0][1])+(lanes[0][2]+lanes[0][3]);
+      sXY = (lanes[1][0]+lanes[1][1])+(lanes[1][2]+lanes[1][3]);
+      sYY = (lanes[2][0]+lanes[2][1])+(lanes[2][2]+lanes[2][3]);
+      sX = (lanes[3][0]+lanes[3][1])+(lanes[3][2]+lanes[3][3]);
+      sY = (lanes[4][0]+lanes[4][1])+(lanes[4][2]+lanes[4][3]);
+#endif
+      // Remaining columns (all columns if no SIMD is available)
       for(int y=0; y<patchSize; ++y){
-        it = patchWithBorder_ + (y+1)*refStep + 1;
-        for(int x=0; x<patchSize; ++x, ++it, ++it_dx, ++it_dy){
-          J[0] = 0.5 * (it[1] - it[-1]);
-          J[1] = 0.5 * (it[refStep] - it[-refStep]);
-          J[2] = 1;
-          *it_dx = J[0];
-          *it_dy = J[1];
-          H_ += J*J.transpose();
+        const float* it = patchWithBorder_ + (y+1)*refStep + 1;
+        for(int x=xSimd; x<patchSize; ++x){
+          const float gx = 0.5 * (it[x+1] - it[x-1]);
+          const float gy = 0.5 * (it[x+refStep] - it[x-refStep]);
+          dx_[y*patchSize+x] = gx;
+          dy_[y*patchSize+x] = gy;
+          sXX += gx*gx;
+          sXY += gx*gy;
+          sYY += gy*gy;
+          sX += gx;
+          sY += gy;
         }
       }
+      H_(0,0) = sXX;
+      H_(0,1) = sXY;
+      H_(0,2) = sX;
+      H_(1,0) = sXY;
+      H_(1,1) = sYY;
+      H_(1,2) = sY;
+      H_(2,0) = sX;
+      H_(2,1) = sY;
+      H_(2,2) = patchSize*patchSize;
       const float dXX = H_(0,0)/(patchSize*patchSize);
       const float dYY = H_(1,1)/(patchSize*patchSize);
       const float dXY = H_(0,1)/(patchSize*patchSize);
@@ -96,10 +171,27 @@ class Patch {
       e0_ = 0.5 * (dXX + dYY - sqrtf((dXX + dYY) * (dXX + dYY) - 4 * (dXX * dYY - dXY * dXY)));
       e1_ = 0.5 * (dXX + dYY + sqrtf((dXX + dYY) * (dXX + dYY) - 4 * (dXX * dYY - dXY * dXY)));
       s_ = e0_+e1_;
+      gradientScale_ = 0.0;
       validGradientParameters_ = true;
     }
   }
 
+  /** \brief Computes the gradient parameters (if required) and the gradients scaled by a given factor (dxScaled_ dyScaled_).
+   *         The scaled gradients are only recomputed if the scale changed or the gradient parameters were invalidated.
+   *
+   *   @param scale - Scaling factor of the gradients (typically pow(0.5,l) for a patch on pyramid level l), must be non-zero.
+   */
+  void computeScaledGradients(const float scale) const{
+    computeGradientParameters();
+    if(gradientScale_ != scale){
+      for(int i=0; i<patchSize*patchSize; ++i){
+        dxScaled_[i] = scale*dx_[i];
+        dyScaled_[i] = scale*dy_[i];
+      }
+      gradientScale_ = scale;
+    }
+  }
+
   /** \brief Extracts and sets the patch intensity values (patch_) from the intensity values of the
    *         expanded patch (patchWithBorder_).
    */
@@ -244,6 +336,27 @@ class Patch {
     }
   }
 
+  /** \brief Computes the warped pixel offsets of the (expanded) patch pixels with respect to the patch center.
+   *
+   *   The offsets only depend on the warping matrix and can therefore be shared between all pyramid levels.
+   *
+   *   @param warp       - Affine warping matrix.
+   *   @param withBorder - If true, the offsets of the expanded patch Patch::patchWithBorder_ are computed.
+   *   @param wdx        - Output, x-offsets (size (patchSize+2)*(patchSize+2)).
+   *   @param wdy        - Output, y-offsets (size (patchSize+2)*(patchSize+2)).
+   */
+  static void computeWarpOffsets(const Eigen::Matrix2f& warp,const bool withBorder,float* wdx,float* wdy){
+    const int halfpatch_size = patchSize/2+(int)withBorder;
+    for(int y=0; y<2*halfpatch_size; ++y){
+      for(int x=0; x<2*halfpatch_size; ++x, ++wdx, ++wdy){
+        const float dx = x - halfpatch_size + 0.5;
+        const float dy = y - halfpatch_size + 0.5;
+        *wdx = warp(0,0)*dx + warp(0,1)*dy;
+        *wdy = warp(1,0)*dx + warp(1,1)*dy;
+      }
+    }
+  }
+
   /** \brief Extracts a patch from an image.
    *
    *   @param img        - Reference Image.
@@ -254,69 +367,133 @@ class Patch {
    */
   void extractPatchFromImage(const cv::Mat& img,const FeatureCoordinates& c,const bool withBorder = false){
     assert(isPatchInFrame(img,c,withBorder));
+    if(c.isNearIdentityWarping()){
+      extractUnwarpedPatchFromImage(img,c.get_c(),withBorder);
+    } else {
+      float wdx[(patchSize+2)*(patchSize+2)];
+      float wdy[(patchSize+2)*(patchSize+2)];
+      computeWarpOffsets(c.get_warp_c(),withBorder,wdx,wdy);
+      extractWarpedPatchFromImage(img,c.get_c(),withBorder,wdx,wdy);
+    }
+  }
+
+  /** \brief Extracts a patch from an image, assuming identity warping.
+   *
+   *   All patch pixels share the same bilinear interpolation weights, the interpolation is done with SIMD (if available).
+   *
+   *   @param img        - Reference Image.
+   *   @param center     - Center of the patch in the reference image (subpixel coordinates possible).
+   *   @param withBorder - \see extractPatchFromImage()
+   */
+  void extractUnwarpedPatchFromImage(const cv::Mat& img,const cv::Point2f& center,const bool withBorder = false){
     const int halfpatch_size = patchSize/2+(int)withBorder;
     const int refStep = img.step.p[0];
+    float* patch_ptr = withBorder ? patchWithBorder_ : patch_;
 
-    // Get Pointers
-    uint8_t* img_ptr;
-    float* patch_ptr;
+    const int u_r = floor(center.x);
+    const int v_r = floor(center.y);
+
+    // compute interpolation weights
+    const float subpix_x = center.x-u_r;
+    const float subpix_y = center.y-v_r;
+    const float wTL = (1.0-subpix_x)*(1.0-subpix_y);
+    const float wTR = subpix_x * (1.0-subpix_y);
+    const float wBL = (1.0-subpix_x)*subpix_y;
+    const float wBR = subpix_x * subpix_y;
+    // Neighbours with zero weight are replaced by the pixel itself (avoids reading outside of the image)
+    const int offX = subpix_x > 0 ? 1 : 0;
+    const int offY = subpix_y > 0 ? refStep : 0;
+    const int width = 2*halfpatch_size;
+    int xSimd = 0;
+#if defined(__SSE2__)
+    xSimd = width-width%4;
+    const __m128 vTL = _mm_set1_ps(wTL);
+    const __m128 vTR = _mm_set1_ps(wTR);
+    const __m128 vBL = _mm_set1_ps(wBL);
+    const __m128 vBR = _mm_set1_ps(wBR);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    xSimd = width-width%4;
+#endif
+    for(int y=0; y<width; ++y, patch_ptr += width){
+      const uint8_t* img_ptr = (uint8_t*) img.data + (v_r+y-halfpatch_size)*refStep + u_r-halfpatch_size;
+#if defined(__SSE2__)
+      for(int x=0; x<xSimd; x+=4){
+        __m128 r = _mm_mul_ps(vTL,loadFourPixels(img_ptr+x));
+        r = _mm_add_ps(r,_mm_mul_ps(vTR,loadFourPixels(img_ptr+x+offX)));
+        r = _mm_add_ps(r,_mm_mul_ps(vBL,loadFourPixels(img_ptr+x+offY)));
+        r = _mm_add_ps(r,_mm_mul_ps(vBR,loadFourPixels(img_ptr+x+offY+offX)));
+        _mm_storeu_ps(patch_ptr+x,r);
+      }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+      for(int x=0; x<xSimd; x+=4){
+        float32x4_t r = vmulq_n_f32(loadFourPixels(img_ptr+x),wTL);
+        r = vaddq_f32(r,vmulq_n_f32(loadFourPixels(img_ptr+x+offX),wTR));
+        r = vaddq_f32(r,vmulq_n_f32(loadFourPixels(img_ptr+x+offY),wBL));
+        r = vaddq_f32(r,vmulq_n_f32(loadFourPixels(img_ptr+x+offY+offX),wBR));
+        vst1q_f32(patch_ptr+x,r);
+      }
+#endif
+      for(int x=xSimd; x<width; ++x){
+        patch_ptr[x] = wTL*img_ptr[x] + wTR*img_ptr[x+offX] + wBL*img_ptr[x+offY] + wBR*img_ptr[x+offY+offX];
+      }
+    }
     if(withBorder){
-      patch_ptr = patchWithBorder_;
-    } else {
-      patch_ptr = patch_;
+      extractPatchFromPatchWithBorder();
     }
+    validGradientParameters_ = false;
+  }
 
-    if(c.isNearIdentityWarping()){
-      const int u_r = floor(c.get_c().x);
-      const int v_r = floor(c.get_c().y);
-
-      // compute interpolation weights
-      const float subpix_x = c.get_c().x-u_r;
-      const float subpix_y = c.get_c().y-v_r;
-      const float wTL = (1.0-subpix_x)*(1.0-subpix_y);
+  /** \brief Extracts a patch from an image using precomputed warped pixel offsets.
+   *
+   *   @param img        - Reference Image.
+   *   @param center     - Center of the patch in the reference image (subpixel coordinates possible).
+   *   @param withBorder - \see extractPatchFromImage()
+   *   @param wdx        - Warped x-offsets, \see computeWarpOffsets()
+   *   @param wdy        - Warped y-offsets, \see computeWarpOffsets()
+   */
+  void extractWarpedPatchFromImage(const cv::Mat& img,const cv::Point2f& center,const bool withBorder,const float* wdx,const float* wdy){
+    const int halfpatch_size = patchSize/2+(int)withBorder;
+    const int refStep = img.step.p[0];
+    float* patch_ptr = withBorder ? patchWithBorder_ : patch_;
+    for(int i=0; i<4*halfpatch_size*halfpatch_size; ++i, ++patch_ptr){
+      const float u_pixel = center.x+wdx[i] - 0.5;
+      const float v_pixel = center.y+wdy[i] - 0.5;
+      const int u_r = floor(u_pixel);
+      const int v_r = floor(v_pixel);
+      const float subpix_x = u_pixel-u_r;
+      const float subpix_y = v_pixel-v_r;
+      const float wTL = (1.0-subpix_x) * (1.0-subpix_y);
       const float wTR = subpix_x * (1.0-subpix_y);
-      const float wBL = (1.0-subpix_x)*subpix_y;
+      const float wBL = (1.0-subpix_x) * subpix_y;
       const float wBR = subpix_x * subpix_y;
-      for(int y=0; y<2*halfpatch_size; ++y){
-        img_ptr = (uint8_t*) img.data + (v_r+y-halfpatch_size)*refStep + u_r-halfpatch_size;
-        for(int x=0; x<2*halfpatch_size; ++x, ++img_ptr, ++patch_ptr)
-        {
-          *patch_ptr = wTL*img_ptr[0];
-          if(subpix_x > 0) *patch_ptr += wTR*img_ptr[1];
-          if(subpix_y > 0) *patch_ptr += wBL*img_ptr[refStep];
-          if(subpix_x > 0 && subpix_y > 0) *patch_ptr += wBR*img_ptr[refStep+1];
-        }
-      }
-    } else {
-      for(int y=0; y<2*halfpatch_size; ++y){
-        for(int x=0; x<2*halfpatch_size; ++x, ++patch_ptr){
-          const float dx = x - halfpatch_size + 0.5;
-          const float dy = y - halfpatch_size + 0.5;
-          const float wdx = c.get_warp_c()(0,0)*dx + c.get_warp_c()(0,1)*dy;
-          const float wdy = c.get_warp_c()(1,0)*dx + c.get_warp_c()(1,1)*dy;
-          const float u_pixel = c.get_c().x+wdx - 0.5;
-          const float v_pixel = c.get_c().y+wdy - 0.5;
-          const int u_r = floor(u_pixel);
-          const int v_r = floor(v_pixel);
-          const float subpix_x = u_pixel-u_r;
-          const float subpix_y = v_pixel-v_r;
-          const float wTL = (1.0-subpix_x) * (1.0-subpix_y);
-          const float wTR = subpix_x * (1.0-subpix_y);
-          const float wBL = (1.0-subpix_x) * subpix_y;
-          const float wBR = subpix_x * subpix_y;
-          img_ptr = (uint8_t*) img.data + v_r*refStep + u_r;
-          *patch_ptr = wTL*img_ptr[0];
-          if(subpix_x > 0) *patch_ptr += wTR*img_ptr[1];
-          if(subpix_y > 0) *patch_ptr += wBL*img_ptr[refStep];
-          if(subpix_x > 0 && subpix_y > 0) *patch_ptr += wBR*img_ptr[refStep+1];
-        }
-      }
+      const uint8_t* img_ptr = (uint8_t*) img.data + v_r*refStep + u_r;
+      *patch_ptr = wTL*img_ptr[0];
+      if(subpix_x > 0) *patch_ptr += wTR*img_ptr[1];
+      if(subpix_y > 0) *patch_ptr += wBL*img_ptr[refStep];
+      if(subpix_x > 0 && subpix_y > 0) *patch_ptr += wBR*img_ptr[refStep+1];
     }
     if(withBorder){
       extractPatchFromPatchWithBorder();
     }
     validGradientParameters_ = false;
   }
+
+ private:
+#if defined(__SSE2__)
+  static inline __m128 loadFourPixels(const uint8_t* ptr){
+    int32_t v;
+    std::memcpy(&v,ptr,4);
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v),zero),zero));
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  static inline float32x4_t loadFourPixels(const uint8_t* ptr){
+    uint32_t v;
+    std::memcpy(&v,ptr,4);
+    const uint16x8_t w = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(v)));
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(w)));
+  }
+#endif
 };
 
 }
@@ -0,0 +1,201 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_PROFILER_HPP_
+#define ROVIO_PROFILER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rovio{
+
+/** \brief Lock-free timing histogram of a profiled stage.
+ *
+ *  Logarithmic buckets with 4 buckets per octave, starting at 1 microsecond (relative bucket width ~19%).
+ */
+class ProfilerStage{
+ public:
+  static constexpr int nBuckets_ = 96;
+  static constexpr int bucketsPerOctave_ = 4;
+
+  /** \brief Summary of the recorded timings.
+   */
+  struct Statistics{
+    std::string name_;
+    unsigned long count_ = 0;
+    double mean_ = 0.0; /**<[ms]*/
+    double p50_ = 0.0; /**<[ms]*/
+    double p99_ = 0.0; /**<[ms]*/
+    double max_ = 0.0; /**<[ms]*/
+  };
+
+  ProfilerStage(){
+    reset();
+  }
+
+  /** \brief Records a timing (thread-safe).
+   *
+   *   @param ns - Duration [ns].
+   */
+  void add(const long ns){
+    buckets_[bucketIndex(ns)].fetch_add(1,std::memory_order_relaxed);
+    count_.fetch_add(1,std::memory_order_relaxed);
+    sum_.fetch_add(ns,std::memory_order_relaxed);
+    long oldMax = max_.load(std::memory_order_relaxed);
+    while(ns > oldMax && !max_.compare_exchange_weak(oldMax,ns,std::memory_order_relaxed)){}
+  }
+
+  /** \brief Computes the statistics of the recorded timings (percentiles at the upper bucket bound).
+   */
+  Statistics statistics() const{
+    Statistics s;
+    s.name_ = name_;
+    s.count_ = count_.load(std::memory_order_relaxed);
+    if(s.count_ == 0) return s;
+    s.mean_ = sum_.load(std::memory_order_relaxed)*1e-6/s.count_;
+    s.max_ = max_.load(std::memory_order_relaxed)*1e-6;
+    unsigned long cumulated = 0;
+    bool got50 = false;
+    for(int i=0;i<nBuckets_;i++){
+      cumulated += buckets_[i].load(std::memory_order_relaxed);
+      if(!got50 && cumulated >= 0.5*s.count_){
+        s.p50_ = std::min(bucketUpperBound(i),s.max_);
+        got50 = true;
+      }
+      if(cumulated >= 0.99*s.count_){
+        s.p99_ = std::min(bucketUpperBound(i),s.max_);
+        break;
+      }
+    }
+    return s;
+  }
+
+  /** \brief Clears the recorded timings.
+   */
+  void reset(){
+    for(int i=0;i<nBuckets_;i++) buckets_[i].store(0,std::memory_order_relaxed);
+    count_.store(0,std::memory_order_relaxed);
+    sum_.store(0,std::memory_order_relaxed);
+    max_.store(0,std::memory_order_relaxed);
+  }
+
+  std::string name_;
+
+ private:
+  static int bucketIndex(const long ns){
+    if(ns <= 1000) return 0;
+    const int i = (int)(std::log2(ns*1e-3)*bucketsPerOctave_);
+    return std::min(i,nBuckets_-1);
+  }
+  static double bucketUpperBound(const int i){
+    return 1e-3*std::pow(2.0,(double)(i+1)/bucketsPerOctave_); // [ms]
+  }
+
+  std::atomic<unsigned long> buckets_[nBuckets_];
+  std::atomic<unsigned long> count_;
+  std::atomic<long> sum_;
+  std::atomic<long> max_;
+};
+
+/** \brief Process-wide registry of the profiled stages, see ROVIO_PROFILE_SCOPE.
+ */
+class Profiler{
+ public:
+  static constexpr int nMaxStages_ = 64;
+
+  static Profiler& instance(){
+    static Profiler profiler;
+    return profiler;
+  }
+
+  /** \brief Returns the stage with the given name, creates it if needed.
+   */
+  ProfilerStage& stage(const std::string& name){
+    std::lock_guard<std::mutex> lock(m_);
+    for(int i=0;i<nStages_;i++){
+      if(stages_[i].name_ == name) return stages_[i];
+    }
+    if(nStages_ == nMaxStages_) return stages_[nMaxStages_-1];
+    stages_[nStages_].name_ = name;
+    return stages_[nStages_++];
+  }
+
+  /** \brief Returns the statistics of all stages and optionally resets them.
+   */
+  std::vector<ProfilerStage::Statistics> statistics(const bool doReset = false){
+    std::lock_guard<std::mutex> lock(m_);
+    std::vector<ProfilerStage::Statistics> out;
+    for(int i=0;i<nStages_;i++){
+      out.push_back(stages_[i].statistics());
+      if(doReset) stages_[i].reset();
+    }
+    return out;
+  }
+
+ private:
+  Profiler(): nStages_(0){}
+  std::mutex m_;
+  ProfilerStage stages_[nMaxStages_];
+  int nStages_;
+};
+
+/** \brief Records the lifetime of the object into a stage.
+ */
+class ScopedProfilerTimer{
+ public:
+  ScopedProfilerTimer(ProfilerStage& stage): stage_(stage), start_(std::chrono::steady_clock::now()){}
+  ~ScopedProfilerTimer(){
+    stage_.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start_).count());
+  }
+ private:
+  ProfilerStage& stage_;
+  const std::chrono::steady_clock::time_point start_;
+};
+
+}
+
+#define ROVIO_PROFILE_CONCAT_IMPL(a,b) a##b
+#define ROVIO_PROFILE_CONCAT(a,b) ROVIO_PROFILE_CONCAT_IMPL(a,b)
+
+/** \brief Times the rest of the enclosing scope as stage <name> (compiled out without ROVIO_PROFILING).
+ */
+#ifdef ROVIO_PROFILING
+#define ROVIO_PROFILE_SCOPE(name) \
+  static rovio::ProfilerStage& ROVIO_PROFILE_CONCAT(rovioProfilerStage,__LINE__) = rovio::Profiler::instance().stage(name); \
+  rovio::ScopedProfilerTimer ROVIO_PROFILE_CONCAT(rovioProfilerTimer,__LINE__)(ROVIO_PROFILE_CONCAT(rovioProfilerStage,__LINE__))
+#else
+#define ROVIO_PROFILE_SCOPE(name)
+#endif
+
+
+#endif /* ROVIO_PROFILER_HPP_ */
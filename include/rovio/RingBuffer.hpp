@@ -0,0 +1,101 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_RINGBUFFER_HPP_
+#define ROVIO_RINGBUFFER_HPP_
+
+#include <atomic>
+#include <vector>
+
+namespace rovio{
+
+/** \brief Lock-free single-producer single-consumer ring buffer.
+ *
+ *  push() and pop() never block. Exactly one thread may push and exactly one thread may pop at a time (the
+ *  consumer side can be shared between threads as long as they serialize, e.g. by holding a mutex).
+ *
+ *  @tparam T - Element type (copied by value).
+ */
+template<typename T>
+class SpscRingBuffer{
+ public:
+  /** \brief Constructor
+   *
+   *   @param capacity - Maximal number of stored elements, rounded up to a power of two.
+   */
+  SpscRingBuffer(const unsigned int capacity = 1024): head_(0), tail_(0){
+    unsigned int size = 2;
+    while(size < capacity+1) size *= 2;
+    buffer_.resize(size);
+    mask_ = size-1;
+  }
+
+  /** \brief Appends an element (producer side).
+   *
+   *   @param element - Element to append.
+   *   @return false if the buffer is full (element is dropped).
+   */
+  bool push(const T& element){
+    const unsigned int head = head_.load(std::memory_order_relaxed);
+    const unsigned int next = (head+1) & mask_;
+    if(next == tail_.load(std::memory_order_acquire)) return false;
+    buffer_[head] = element;
+    head_.store(next,std::memory_order_release);
+    return true;
+  }
+
+  /** \brief Removes the oldest element (consumer side).
+   *
+   *   @param element - Output, oldest element.
+   *   @return false if the buffer is empty.
+   */
+  bool pop(T& element){
+    const unsigned int tail = tail_.load(std::memory_order_relaxed);
+    if(tail == head_.load(std::memory_order_acquire)) return false;
+    element = buffer_[tail];
+    tail_.store((tail+1) & mask_,std::memory_order_release);
+    return true;
+  }
+
+  /** \brief Returns true if the buffer is empty (exact on the consumer side).
+   */
+  bool empty() const{
+    return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+  }
+
+ private:
+  std::vector<T> buffer_;
+  unsigned int mask_;
+  alignas(64) std::atomic<unsigned int> head_; /**<Next write index, written by the producer only.*/
+  alignas(64) std::atomic<unsigned int> tail_; /**<Next read index, written by the consumer only.*/
+};
+
+}
+
+
+#endif /* ROVIO_RINGBUFFER_HPP_ */
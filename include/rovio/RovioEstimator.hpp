@@ -0,0 +1,443 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_ROVIOESTIMATOR_HPP_
+#define ROVIO_ROVIOESTIMATOR_HPP_
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "rovio/RovioFilter.hpp"
+#include "rovio/ImagePreprocessor.hpp"
+#include "rovio/KeyframeCache.hpp"
+#include "rovio/FilterCheckpoint.hpp"
+#include "rovio/Profiler.hpp"
+#include "rovio/CoordinateTransform/RovioOutput.hpp"
+
+namespace rovio {
+
+/** \brief ROS-free interface of the filter, data is fed directly from memory.
+ *
+ *  Owns the measurement ingestion shared with \ref RovioNode: the pending (re-)initialization of the filter, the
+ *  image preprocessing and pyramid construction and the assembly of the camera frames of a timestamp into one
+ *  image measurement. addImu/addImage/update are the complete single threaded pipeline. The node uses the
+ *  individual steps (processImu, buildPyramid, assembleFrame) and adds its own locking around them.
+ *
+ *  @tparam FILTER  - \ref rovio::RovioFilter
+ */
+template<typename FILTER>
+class RovioEstimator{
+ public:
+  typedef FILTER mtFilter;
+  typedef typename mtFilter::mtFilterState mtFilterState;
+  typedef typename mtFilterState::mtState mtState;
+  typedef typename mtFilter::mtPrediction::mtMeas mtPredictionMeas;
+  typedef typename std::tuple_element<0,typename mtFilter::mtUpdates>::type mtImgUpdate;
+  typedef typename mtImgUpdate::mtMeas mtImgMeas;
+
+  /** \brief Pose and velocity of the IMU (as published on rovio/odometry by the node).
+   */
+  struct Output{
+    double t_; /**<Time of the state.*/
+    V3D WrWB_; /**<Position of the IMU, expressed in the world frame.*/
+    QPD qBW_; /**<Attitude of the IMU (world to IMU).*/
+    V3D BvB_; /**<Velocity of the IMU, expressed in the IMU frame.*/
+    V3D BwWB_; /**<Rotational rate of the IMU, expressed in the IMU frame.*/
+    V3D acb_; /**<Accelerometer bias.*/
+    V3D gyb_; /**<Gyroscope bias.*/
+    Eigen::Matrix<double,6,6> poseCov_; /**<Covariance of position and attitude.*/
+    int nFeatures_; /**<Number of features in the state.*/
+  };
+
+  /** \brief Pending initialization of the filter, executed with the next IMU measurement.
+   */
+  struct FilterInitializationState {
+    FilterInitializationState()
+        : WrWM_(V3D::Zero()),
+          state_(State::WaitForInitUsingAccel) {}
+
+    enum class State {
+      // Initialize the filter using accelerometer measurement on the next
+      // opportunity.
+      WaitForInitUsingAccel,
+      // Initialize the filter using an external pose on the next opportunity.
+      WaitForInitExternalPose,
+      // Initialize the filter using a refractive index on the next opportunity.
+      WaitForInitRefractiveIndex,
+      // Initialize the filter from a checkpoint on the next opportunity.
+      WaitForInitCheckpoint,
+      // The filter is initialized.
+      Initialized
+    } state_;
+
+    // Buffer to hold the initial pose that should be set during initialization
+    // with the state WaitForInitExternalPose.
+    V3D WrWM_;
+    QPD qMW_;
+    float refractiveIndex_;
+
+    explicit operator bool() const {
+      return isInitialized();
+    }
+
+    bool isInitialized() const {
+      return (state_ == State::Initialized);
+    }
+  };
+
+  std::shared_ptr<mtFilter> mpFilter_;
+  mtImgUpdate* mpImgUpdate_;
+  ImagePreprocessor preprocessors_[mtState::nCam_]; /**<Image preprocessing per camera, configured from the image update (change and call configure() for other settings).*/
+  double imuOffset_; /**<Time offset added to the IMU timestamps by addImu.*/
+  double warmRecoveryCovInflation_; /**<Inflation of the covariance of the features re-seeded by a warm recovery.*/
+
+  /** \brief Constructor.
+   *
+   *   @param mpFilter - Filter, with the configuration already read (readFromInfo and refreshProperties).
+   */
+  RovioEstimator(std::shared_ptr<mtFilter> mpFilter): mpFilter_(mpFilter), imuOutputCov_((int)(StandardOutput::D_),(int)(StandardOutput::D_)){
+    mpImgUpdate_ = &std::get<0>(mpFilter_->mUpdates_);
+    imuOffset_ = 0.0;
+    warmRecoveryCovInflation_ = 4.0;
+    warmRecoveryPending_ = false;
+    restoreCalibrationOnly_ = false;
+    for(int i=0;i<mtState::nCam_;i++){
+      preprocessors_[i].histogramEqualize_ = mpImgUpdate_->histogramEqualize_;
+      preprocessors_[i].claheClipLimit_ = 7.0;
+      preprocessors_[i].claheGridSize_ = 8.0;
+      preprocessors_[i].bilateralBlur_ = mpImgUpdate_->bilateralBlur_;
+      preprocessors_[i].medianBlur_ = mpImgUpdate_->medianBlur_;
+      preprocessors_[i].medianKernelSize_ = mpImgUpdate_->medianKernelSize_;
+      preprocessors_[i].configure();
+    }
+    imgUpdateMeas_.template get<mtImgMeas::_aux>().reset(0.0);
+  }
+
+  /** \brief Destructor.
+   */
+  virtual ~RovioEstimator(){}
+
+  /** \brief Adds an IMU sample. The first sample (and the first one after a reset request) initializes the filter.
+   *
+   *   @param t   - Time [s], \ref imuOffset_ is added.
+   *   @param acc - Measured specific force [m/s^2].
+   *   @param gyr - Measured rotational rate [rad/s].
+   *   @return true if the safe state advanced.
+   */
+  bool addImu(const double t, const V3D& acc, const V3D& gyr){
+    if(!processImu(t+imuOffset_,acc,gyr)) return false;
+    return update();
+  }
+
+  /** \brief Adds an IMU measurement to the filter or executes the pending initialization with it.
+   *
+   *   @param t   - Time [s] (offset corrected).
+   *   @param acc - Measured specific force [m/s^2].
+   *   @param gyr - Measured rotational rate [rad/s].
+   *   @return true if the measurement was added to the (initialized) filter, false if it initialized the filter.
+   */
+  bool processImu(const double t, const V3D& acc, const V3D& gyr){
+    predictionMeas_.template get<mtPredictionMeas::_acc>() = acc;
+    predictionMeas_.template get<mtPredictionMeas::_gyr>() = gyr;
+    if(init_state_.isInitialized()){
+      mpFilter_->addPredictionMeas(predictionMeas_,t);
+      return true;
+    }
+    initialize(t);
+    return false;
+  }
+
+  /** \brief Adds the image of a camera. Once the images of all cameras with the same timestamp are added, the
+   *  frame is passed to the filter.
+   *
+   *   The image data is only read (the pyramid is built from it), i.e. img can wrap external memory.
+   *
+   *   @param t     - Time [s].
+   *   @param camID - Camera ID.
+   *   @param img   - Grayscale (8 or 16 bit) or BGR image.
+   *   @return true if the safe state advanced.
+   */
+  bool addImage(const double t, const int camID, const cv::Mat& img){
+    if(!init_state_.isInitialized() || camID < 0 || camID >= mtState::nCam_) return false;
+    if(!buildPyramid(camID,img) || !assembleFrame(t,camID)) return false;
+    mpFilter_->template addUpdateMeas<0>(imgUpdateMeas_,t);
+    clearFrame(t);
+    return update();
+  }
+
+  /** \brief Converts, preprocesses and downsamples the image of a camera into the working pyramid of the camera.
+   *
+   *   Only touches the buffers of camID, i.e. can be called concurrently for different cameras.
+   *
+   *   @param camID - Camera ID.
+   *   @param img   - Grayscale (8 or 16 bit) or BGR image, only read.
+   *   @return false if the image is empty.
+   */
+  bool buildPyramid(const int camID, const cv::Mat& img){
+    if(img.empty()) return false;
+    cv::Mat src = img;
+    if(src.channels() == 3){
+      cv::cvtColor(img, gray_[camID], cv::COLOR_BGR2GRAY);
+      src = gray_[camID];
+    }
+    // The preprocessing writes directly into level 0 of the working pyramid, which is reused across frames as
+    // long as it is not shared with a pending measurement.
+    ImagePyramid<mtState::nLevels_>& pyr = pyr_[camID];
+    bool isPreprocessed;
+    {
+      ROVIO_PROFILE_SCOPE("preprocessing");
+      isPreprocessed = preprocessors_[camID].process(src, pyr.imgs_[0]);
+    }
+    const PyramidKernel kernel = static_cast<PyramidKernel>(mpImgUpdate_->pyramidKernel_);
+    {
+      ROVIO_PROFILE_SCOPE("pyramid");
+      if(isPreprocessed){
+        pyr.computeFromLevel0(kernel);
+      } else {
+        // No preprocessing was applied, the copy of the input is fused with the downsampling
+        pyr.computeFromImage(src,kernel);
+      }
+    }
+    return true;
+  }
+
+  /** \brief Moves the working pyramid of a camera into the frame under assembly. A frame with another timestamp
+   *  is dropped (failed synchronization).
+   *
+   *   Not thread safe, concurrent callers have to serialize the calls together with the use of \ref getFrame.
+   *
+   *   @param t     - Time of the image [s].
+   *   @param camID - Camera ID.
+   *   @return true if the frame is complete (images of all cameras available).
+   */
+  bool assembleFrame(const double t, const int camID){
+    auto& aux = imgUpdateMeas_.template get<mtImgMeas::_aux>();
+    if(t != aux.imgTime_){
+      for(int i=0;i<mtState::nCam_;i++){
+        if(aux.isValidPyr_[i]){
+          std::cout << "    \033[31mFailed Synchronization of Camera Frames, t = " << t << "\033[0m" << std::endl;
+        }
+      }
+      aux.reset(t);
+    }
+    aux.pyr_[camID].swap(pyr_[camID]);
+    aux.isValidPyr_[camID] = true;
+    return aux.areAllValid();
+  }
+
+  /** \brief Returns the frame under assembly (complete after assembleFrame returned true).
+   */
+  const mtImgMeas& getFrame() const{
+    return imgUpdateMeas_;
+  }
+
+  /** \brief Starts the assembly of a new frame.
+   *
+   *   @param t - Time of the last frame [s].
+   */
+  void clearFrame(const double t){
+    imgUpdateMeas_.template get<mtImgMeas::_aux>().reset(t);
+  }
+
+  /** \brief Returns the last IMU measurement passed to processImu.
+   */
+  const mtPredictionMeas& getPredictionMeas() const{
+    return predictionMeas_;
+  }
+
+  /** \brief Updates the safe state up to the last complete camera frame.
+   *
+   *   @return true if the safe state advanced.
+   */
+  bool update(){
+    if(!init_state_.isInitialized()) return false;
+    const double oldSafeTime = mpFilter_->safe_.t_;
+    double lastImageTime;
+    if(std::get<0>(mpFilter_->updateTimelineTuple_).getLastTime(lastImageTime)){
+      mpFilter_->updateSafe(&lastImageTime);
+    }
+    return mpFilter_->safe_.t_ > oldSafeTime;
+  }
+
+  /** \brief Re-initializes the filter with the accelerometer of the next IMU sample.
+   */
+  void requestReset(){
+    init_state_.state_ = FilterInitializationState::State::WaitForInitUsingAccel;
+  }
+
+  /** \brief Re-initializes the filter to the passed pose with the next IMU sample.
+   *
+   *   @param WrWM - Position Vector, pointing from the World-Frame to the IMU-Frame, expressed in World-Coordinates.
+   *   @param qMW  - Quaternion, expressing World-Frame in IMU-Coordinates (World Coordinates->IMU Coordinates).
+   */
+  void requestResetToPose(const V3D& WrWM, const QPD& qMW){
+    init_state_.WrWM_ = WrWM;
+    init_state_.qMW_ = qMW;
+    init_state_.state_ = FilterInitializationState::State::WaitForInitExternalPose;
+    warmRecoveryPending_ = false;
+  }
+
+  /** \brief Re-initializes the filter to the pose of a keyframe with the next IMU sample and re-seeds its features.
+   *
+   *   @param keyframe - Healthy keyframe.
+   */
+  void requestWarmRecovery(const typename KeyframeCache<mtFilterState>::Keyframe& keyframe){
+    requestResetToPose(keyframe.WrWM_,keyframe.qMW_);
+    recoveryKeyframe_ = keyframe;
+    warmRecoveryPending_ = true;
+  }
+
+  /** \brief Re-initializes the filter with the passed refractive index with the next IMU sample.
+   *
+   *   @param n - Refractive index.
+   */
+  void requestResetToRefractiveIndex(const double n){
+    init_state_.refractiveIndex_ = n;
+    init_state_.state_ = FilterInitializationState::State::WaitForInitRefractiveIndex;
+  }
+
+  /** \brief Re-initializes the filter from a checkpoint with the next IMU sample.
+   *
+   *   @param checkpoint      - Checkpoint.
+   *   @param calibrationOnly - If true, only the IMU biases, the extrinsics and the refractive index are restored.
+   */
+  void requestResetToCheckpoint(const FilterCheckpoint<mtFilterState>& checkpoint, const bool calibrationOnly){
+    restoreCheckpoint_ = checkpoint;
+    restoreCalibrationOnly_ = calibrationOnly;
+    init_state_.state_ = FilterInitializationState::State::WaitForInitCheckpoint;
+  }
+
+  /** \brief Checks if the filter is initialized (no initialization pending).
+   */
+  bool isInitialized() const{
+    return init_state_.isInitialized();
+  }
+
+  /** \brief Returns the safe filter state (features, covariance and images of the last update).
+   */
+  const mtFilterState& getFilterState() const{
+    return mpFilter_->safe_;
+  }
+
+  /** \brief Computes the IMU output of the safe state.
+   *
+   *   @param output - Output.
+   */
+  void getOutput(Output& output){
+    const mtFilterState& filterState = mpFilter_->safe_;
+    imuOutputCT_.transformState(filterState.state_,imuOutput_);
+    imuOutputCT_.transformCovMat(filterState.state_,filterState.cov_,imuOutputCov_);
+    output.t_ = filterState.t_;
+    output.WrWB_ = imuOutput_.WrWB();
+    output.qBW_ = imuOutput_.qBW();
+    output.BvB_ = imuOutput_.BvB();
+    output.BwWB_ = imuOutput_.BwWB();
+    output.acb_ = filterState.state_.acb();
+    output.gyb_ = filterState.state_.gyb();
+    const int posId = StandardOutput::template getId<StandardOutput::_pos>();
+    const int attId = StandardOutput::template getId<StandardOutput::_att>();
+    output.poseCov_.template block<3,3>(0,0) = imuOutputCov_.template block<3,3>(posId,posId);
+    output.poseCov_.template block<3,3>(0,3) = imuOutputCov_.template block<3,3>(posId,attId);
+    output.poseCov_.template block<3,3>(3,0) = imuOutputCov_.template block<3,3>(attId,posId);
+    output.poseCov_.template block<3,3>(3,3) = imuOutputCov_.template block<3,3>(attId,attId);
+    output.nFeatures_ = 0;
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      if(filterState.fsm_.isValid_[i]) output.nFeatures_++;
+    }
+  }
+
+ private:
+  /** \brief Executes the pending initialization with the last IMU measurement.
+   *
+   *   @param t - Time of the IMU measurement [s].
+   */
+  void initialize(const double t){
+    switch(init_state_.state_) {
+      case FilterInitializationState::State::WaitForInitExternalPose: {
+        std::cout << "-- Filter: Initializing using external pose ..." << std::endl;
+        mpFilter_->resetWithPose(init_state_.WrWM_, init_state_.qMW_, t);
+        if(warmRecoveryPending_){
+          const int count = KeyframeCache<mtFilterState>::seed(mpFilter_->safe_,recoveryKeyframe_,&mpFilter_->multiCamera_,warmRecoveryCovInflation_);
+          mpFilter_->front_ = mpFilter_->safe_;
+          std::cout << "-- Filter: Warm recovery, re-seeded " << count << " features from the keyframe at t = " << recoveryKeyframe_.t_ << std::endl;
+          warmRecoveryPending_ = false;
+        }
+        break;
+      }
+      case FilterInitializationState::State::WaitForInitUsingAccel: {
+        std::cout << "-- Filter: Initializing using accel. measurement ..." << std::endl;
+        mpFilter_->resetWithAccelerometer(predictionMeas_.template get<mtPredictionMeas::_acc>(),t);
+        break;
+      }
+      case FilterInitializationState::State::WaitForInitRefractiveIndex: {
+        std::cout << "-- Filter: Initializing using refractive index (experimental, relocates to origin, DO NOT USE ON ROBOT) ..." << std::endl;
+        mpFilter_->resetWithRefractiveIndex(init_state_.refractiveIndex_, t);
+        break;
+      }
+      case FilterInitializationState::State::WaitForInitCheckpoint: {
+        std::cout << "-- Filter: Initializing from checkpoint" << (restoreCalibrationOnly_ ? " (calibration only)" : "") << " ..." << std::endl;
+        mpFilter_->resetWithAccelerometer(predictionMeas_.template get<mtPredictionMeas::_acc>(),t);
+        std::string error;
+        if(restoreCheckpoint_.restore(mpFilter_->safe_,&mpFilter_->multiCamera_,restoreCalibrationOnly_,error)){
+          mpFilter_->front_ = mpFilter_->safe_;
+          std::cout << "-- Filter: Restored the checkpoint of t = " << restoreCheckpoint_.t_ << ", refractive index " << mpFilter_->safe_.state_.ref() << std::endl;
+        } else {
+          std::cout << "-- Filter: Could not restore the checkpoint (" << error << "), initialized using accel. measurement" << std::endl;
+        }
+        break;
+      }
+      default: {
+        std::cout << "Unhandeld initialization type." << std::endl;
+        abort();
+        break;
+      }
+    }
+    std::cout << std::setprecision(12);
+    std::cout << "-- Filter: Initialized at t = " << t << std::endl;
+    init_state_.state_ = FilterInitializationState::State::Initialized;
+  }
+
+  FilterInitializationState init_state_;
+  FilterCheckpoint<mtFilterState> restoreCheckpoint_; /**<Checkpoint of a pending initialization from checkpoint.*/
+  bool restoreCalibrationOnly_; /**<If true, only the calibration of \ref restoreCheckpoint_ is restored.*/
+  typename KeyframeCache<mtFilterState>::Keyframe recoveryKeyframe_; /**<Keyframe of a pending warm recovery.*/
+  bool warmRecoveryPending_; /**<True if \ref recoveryKeyframe_ is re-seeded at the next initialization with pose.*/
+  mtPredictionMeas predictionMeas_;
+  mtImgMeas imgUpdateMeas_; /**<Frame under assembly.*/
+  ImagePyramid<mtState::nLevels_> pyr_[mtState::nCam_]; /**<Working pyramids (swapped into the measurement).*/
+  cv::Mat gray_[mtState::nCam_]; /**<Buffers for the grayscale conversion of color images.*/
+  ImuOutputCT<mtState> imuOutputCT_;
+  StandardOutput imuOutput_;
+  MXD imuOutputCov_;
+};
+
+}
+
+
+#endif /* ROVIO_ROVIOESTIMATOR_HPP_ */
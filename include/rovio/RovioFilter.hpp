@@ -98,6 +98,7 @@ class RovioFilter:public LWF::FilterBase<ImuPrediction<FILTERSTATE>,
     for(int camID=0;camID<mtState::nCam_;camID++){
       cameraCalibrationFile_[camID] = "";
       stringRegister_.registerScalar("Camera" + std::to_string(camID) + ".CalibrationFile",cameraCalibrationFile_[camID]);
+      intRegister_.registerScalar("Camera" + std::to_string(camID) + ".bearingLutStep",multiCamera_.cameras_[camID].bearingLutStep_);
       doubleRegister_.registerVector("Camera" + std::to_string(camID) + ".MrMC",init_.state_.aux().MrMC_[camID]);
       doubleRegister_.registerQuaternion("Camera" + std::to_string(camID) + ".qCM",init_.state_.aux().qCM_[camID]);
       doubleRegister_.registerScalar("Init.State.ref", multiCamera_.cameras_[camID].refrac_ind_);
@@ -182,7 +183,8 @@ class RovioFilter:public LWF::FilterBase<ImuPrediction<FILTERSTATE>,
     reset(0.0);
   }
 
-  /** \brief Reloads the camera calibration for all cameras and resets the depth map type.
+  /** \brief Reloads the camera calibration for all cameras, resets the depth map type and freezes the calibration
+   *  states which are not estimated online.
    */
   void refreshProperties(){
     if(std::get<0>(mUpdates_).useDirectMethod_){
@@ -198,6 +200,7 @@ class RovioFilter:public LWF::FilterBase<ImuPrediction<FILTERSTATE>,
     for(int i=0;i<FILTERSTATE::mtState::nMax_;i++){
       init_.state_.dep(i).setType(depthTypeInt_);
     }
+    std::get<0>(mUpdates_).freezeUncalibratedStates(init_);
   };
 
   /**
@@ -206,9 +209,7 @@ class RovioFilter:public LWF::FilterBase<ImuPrediction<FILTERSTATE>,
    */
   void setRefractiveIndex(double refractive_index){
     init_.state_.ref() = refractive_index;
-    for(int camID = 0;camID<mtState::nCam_;camID++){
-      multiCamera_.cameras_[camID].refrac_ind_ = refractive_index;
-    }
+    multiCamera_.setRefractiveIndex(refractive_index);
     std::cout << "WARNING: Refractive index set to " << refractive_index << " using setRefractiveIndex" << std::endl;
   }
 
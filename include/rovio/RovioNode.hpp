@@ -32,8 +32,11 @@
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <thread>
+#include <condition_variable>
 
 #include <cv_bridge/cv_bridge.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <geometry_msgs/Pose.h>
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 #include <geometry_msgs/TransformStamped.h>
@@ -53,8 +56,19 @@
 
 #include <rovio/SrvResetToPose.h>
 #include <rovio/SrvResetToRefractiveIndex.h>
+#include <rovio/SrvSaveCheckpoint.h>
+#include <rovio/SrvRestoreCheckpoint.h>
 #include "rovio/RovioFilter.hpp"
+#include "rovio/RovioEstimator.hpp"
+#include "rovio/RingBuffer.hpp"
+#include "rovio/Profiler.hpp"
+#include "rovio/ImuPoseIntegrator.hpp"
 #include "rovio/HealthMonitor.hpp"
+#include "rovio/KeyframeCache.hpp"
+#include "rovio/FilterCheckpoint.hpp"
+#include "rovio/OutOfSequenceBuffer.hpp"
+#include "rovio/TelemetryLog.hpp"
+#include "rovio/ImagePreprocessor.hpp"
 #include "rovio/CoordinateTransform/RovioOutput.hpp"
 #include "rovio/CoordinateTransform/FeatureOutput.hpp"
 #include "rovio/CoordinateTransform/FeatureOutputReadable.hpp"
@@ -64,6 +78,10 @@
 namespace rovio {
 
 /** \brief Class, defining the Rovio Node
+ *
+ *  ROS adapter of \ref RovioEstimator, which owns the initialization, the image preprocessing and the frame
+ *  assembly. The node adds the ROS interface, the threading and the features around the filter (publishing,
+ *  health monitor, checkpoints, out-of-sequence updates).
  *
  *  @tparam FILTER  - \ref rovio::RovioFilter
  */
@@ -76,12 +94,11 @@ class RovioNode{
   typedef typename mtFilter::mtFilterState mtFilterState;
   typedef typename mtFilterState::mtState mtState;
   typedef typename mtFilter::mtPrediction::mtMeas mtPredictionMeas;
-  mtPredictionMeas predictionMeas_;
+  RovioEstimator<mtFilter> estimator_; /**<Initialization, image preprocessing and frame assembly.*/
 
   // Image Update
   typedef typename std::tuple_element<0,typename mtFilter::mtUpdates>::type mtImgUpdate;
   typedef typename mtImgUpdate::mtMeas mtImgMeas;
-  mtImgMeas imgUpdateMeas_;
   mtImgUpdate* mpImgUpdate_;
 
   // Pose Update 
@@ -106,38 +123,25 @@ class RovioNode{
 
   RovioHealthMonitor healthMonitor_;
 
-  struct FilterInitializationState {
-    FilterInitializationState()
-        : WrWM_(V3D::Zero()),
-          state_(State::WaitForInitUsingAccel) {}
-
-    enum class State {
-      // Initialize the filter using accelerometer measurement on the next
-      // opportunity.
-      WaitForInitUsingAccel,
-      // Initialize the filter using an external pose on the next opportunity.
-      WaitForInitExternalPose,
-      // Initialize the filter using a refractive index on the next opportunity.
-      WaitForInitRefractiveIndex,
-      // The filter is initialized.
-      Initialized
-    } state_;
-
-    // Buffer to hold the initial pose that should be set during initialization
-    // with the state WaitForInitExternalPose.
-    V3D WrWM_;
-    QPD qMW_;
-    float refractiveIndex_;
-
-    explicit operator bool() const {
-      return isInitialized();
-    }
-
-    bool isInitialized() const {
-      return (state_ == State::Initialized);
-    }
-  };
-  FilterInitializationState init_state_;
+  // Warm recovery after health monitor resets
+  bool warmRecovery_; /**<If true, the features of the last healthy keyframe are re-seeded after a health monitor reset.*/
+  KeyframeCache<mtFilterState> keyframeCache_; /**<Recent healthy keyframes.*/
+
+  // Checkpoints for warm restarts
+  std::string checkpointFile_; /**<Default checkpoint file (empty to disable the periodic checkpoints).*/
+  double checkpointPeriod_; /**<Period of the background checkpoints [s], 0 to disable.*/
+  double lastCheckpointTime_; /**<Filter time of the last periodic checkpoint.*/
+  std::thread checkpointThread_;
+  std::mutex m_checkpoint_; /**<Protects the checkpoint indices and stopCheckpointWriter_.*/
+  std::condition_variable cv_checkpoint_;
+  FilterCheckpoint<mtFilterState> checkpoints_[2]; /**<Double buffer of the periodic checkpoints.*/
+  int readyCheckpoint_ = -1; /**<Index of the latest checkpoint which is waiting to be written, -1 if none.*/
+  int writingCheckpoint_ = -1; /**<Index of the checkpoint currently being written, -1 if none.*/
+  bool stopCheckpointWriter_ = false;
+
+  // Out-of-sequence updates
+  bool outOfSequenceUpdates_ = false; /**<If true, late update measurements are applied by rolling back the safe state, see \ref addFilterUpdateMeas.*/
+  OutOfSequenceBuffer<mtFilter> oosmBuffer_; /**<Safe state checkpoints and logged measurements for the rollbacks.*/
 
   bool forceOdometryPublishing_;
   bool forcePoseWithCovariancePublishing_;
@@ -148,7 +152,94 @@ class RovioNode{
   bool forceMarkersPublishing_;
   bool forcePatchPublishing_;
   bool gotFirstMessages_;
+
+  /** \brief Landmark as sent in the delta point cloud.
+   */
+  struct DeltaPclPoint{
+    int idx_;
+    uint8_t camID_;
+    uint8_t status_;
+    Eigen::Vector3f MrMP_;
+    Eigen::Vector3f bearing_;
+    float distance_;
+    Eigen::Matrix3f cov_;
+    float distanceCov_;
+  };
+  enum DeltaPclFlag{
+    DELTA_PCL_UPDATE = 0, /**<New or changed landmark.*/
+    DELTA_PCL_KEYFRAME = 1, /**<Landmark of a full keyframe (receivers drop all landmarks not contained in it).*/
+    DELTA_PCL_REMOVED = 2 /**<Removed landmark (only the id is valid).*/
+  };
+  bool deltaPclPublishing_; /**<If true, the compact delta point cloud is published on rovio/pcl_delta. The full point cloud and the markers are then only built if forced.*/
+  bool deltaPclHalfPrecision_; /**<If true, the covariance fields of the delta point cloud are IEEE half precision floats (UINT16 fields).*/
+  int deltaPclKeyframePeriod_; /**<Every n-th delta point cloud is a full keyframe.*/
+  double deltaPclPositionThreshold_; /**<Minimal change of the landmark position for a resend [m].*/
+  double deltaPclCovarianceThreshold_; /**<Minimal relative change of the distance covariance for a resend.*/
+  int deltaPclCounter_; /**<Number of published delta point clouds.*/
+  DeltaPclPoint currentPclPoints_[mtState::nMax_]; /**<Landmarks of the current state.*/
+  bool isCurrentPclPointValid_[mtState::nMax_];
+  DeltaPclPoint publishedPclPoints_[mtState::nMax_]; /**<Landmarks as last sent to the receivers.*/
+  bool isPublishedPclPointValid_[mtState::nMax_];
   std::mutex m_filter_;
+  std::mutex m_img_; /**<Protects the frame assembly of estimator_.*/
+
+  /** \brief Per-camera image processing worker (conversion, preprocessing and pyramid construction).
+   */
+  struct ImageWorker{
+    std::thread thread_;
+    std::mutex m_queue_;
+    std::condition_variable cv_queue_;
+    std::deque<sensor_msgs::ImageConstPtr> queue_;
+    bool stop_ = false;
+  };
+  ImageWorker imageWorkers_[mtState::nCam_];
+  bool parallelImageProcessing_ = false; /**<If true, the images are processed on the per-camera workers.*/
+  int imageQueueSize_ = 4; /**<Maximal number of queued images per camera worker (oldest get dropped).*/
+
+  /** \brief Copy of the safe filter state handed off to the publisher thread.
+   */
+  struct PublishSnapshot{
+    mtFilterState filterState_;
+    MultiCamera<mtState::nCam_> multiCamera_; /**<Calibration the feature coordinates of filterState_ point to.*/
+  };
+  bool asyncPublishing_ = false; /**<If true, the messages are built and published on a separate publisher thread.*/
+  std::thread publisherThread_;
+  std::mutex m_publish_; /**<Protects the snapshot indices and stopPublisher_.*/
+  std::condition_variable cv_publish_;
+  PublishSnapshot snapshots_[2]; /**<Double buffer of snapshots.*/
+  int readySnapshot_ = -1; /**<Index of the latest snapshot which is waiting to be published, -1 if none.*/
+  int publishingSnapshot_ = -1; /**<Index of the snapshot currently being published, -1 if none.*/
+  bool stopPublisher_ = false;
+
+  /** \brief Measurements handed from the callbacks to the filter without taking m_filter_.
+   */
+  struct ImuIngress{
+    double t_;
+    V3D acc_;
+    V3D gyr_;
+  };
+  struct VelocityIngress{
+    double t_;
+    V3D vel_;
+    Eigen::Matrix<double,3,3> cov_;
+  };
+  struct BaroIngress{
+    double t_;
+    double pressure_;
+  };
+  bool lockFreeIngress_ = false; /**<If true, the IMU, velocity and baro callbacks only enqueue and never block on m_filter_.*/
+  SpscRingBuffer<ImuIngress> imuQueue_;
+  SpscRingBuffer<VelocityIngress> velocityQueue_;
+  SpscRingBuffer<BaroIngress> baroQueue_;
+  bool publishImuRatePose_ = false; /**<If true, the IMU-propagated pose is published with every IMU measurement.*/
+  ImuPoseIntegrator imuPoseIntegrator_;
+  double lastImuRatePoseTime_ = 0.0;
+
+  double timingT_ = 0.0; /**<Accumulated filter update time [ms].*/
+  int timingC_ = 0; /**<Number of images processed within timingT_.*/
+  double profilingPeriod_ = 1.0; /**<Period [s] of the profiling diagnostics (only with ROVIO_PROFILING).*/
+  ros::WallTime lastProfilingTime_;
+  TelemetryWriter<mtFilterState> telemetryWriter_; /**<Flight recorder of the filter internals (only open if telemetry_file is set).*/
 
   // Nodes, Subscriber, Publishers
   ros::NodeHandle nh_;
@@ -166,7 +257,10 @@ class RovioNode{
   ros::ServiceServer srvResetFilter_;
   ros::ServiceServer srvResetToPoseFilter_;
   ros::ServiceServer srvResetToRefractiveIndexFilter_;
+  ros::ServiceServer srvSaveCheckpoint_;
+  ros::ServiceServer srvRestoreCheckpoint_;
   ros::Publisher pubOdometry_;
+  ros::Publisher pubImuOdometry_;
   ros::Publisher pubTransform_;
   ros::Publisher pubPoseWithCovStamped_;
   ros::Publisher pub_T_J_W_transform;
@@ -174,6 +268,7 @@ class RovioNode{
   tf::TransformListener tf_listener_;
   
   ros::Publisher pubPcl_;            /**<Publisher: Ros point cloud, visualizing the landmarks.*/
+  ros::Publisher pubPclDelta_;       /**<Publisher: Compact point cloud with the changed landmarks only, see \ref publishDeltaPcl.*/
   ros::Publisher pubPatch_;            /**<Publisher: Patch data.*/
   ros::Publisher pubMarkers_;          /**<Publisher: Ros line marker, indicating the depth uncertainty of a landmark.*/
   ros::Publisher pubFeatureIds;
@@ -181,6 +276,7 @@ class RovioNode{
   ros::Publisher pubExtrinsics_[mtState::nCam_];
   ros::Publisher pubImuBias_;
   ros::Publisher pubRefractiveIndex_;
+  ros::Publisher pubProfiling_;
 
   image_transport::Publisher pubImg_;
   image_transport::Publisher pubPatchImg_;
@@ -191,9 +287,11 @@ class RovioNode{
   geometry_msgs::TransformStamped transformMsg_;
   geometry_msgs::TransformStamped T_J_W_Msg_;
   nav_msgs::Odometry odometryMsg_;
+  nav_msgs::Odometry imuOdometryMsg_;
   geometry_msgs::PoseWithCovarianceStamped estimatedPoseWithCovarianceStampedMsg_;
   geometry_msgs::PoseWithCovarianceStamped extrinsicsMsg_[mtState::nCam_];
   sensor_msgs::PointCloud2 pclMsg_;
+  sensor_msgs::PointCloud2 deltaPclMsg_;
   sensor_msgs::PointCloud2 patchMsg_;
   visualization_msgs::Marker markerMsg_;
   visualization_msgs::Marker featureIdsMsgs_;
@@ -210,6 +308,8 @@ class RovioNode{
   MXD imuOutputCov_;
   CameraOutputCT<mtState> cameraOutputCT_;
   ImuOutputCT<mtState> imuOutputCT_;
+  mtOutput relativeMotionOutput_; /**<IMU output used for the relative camera motion (computed on the filter thread).*/
+  ImuOutputCT<mtState> relativeMotionOutputCT_;
   rovio::TransformFeatureOutputCT<mtState> transformFeatureOutputCT_;
   rovio::LandmarkOutputImuCT<mtState> landmarkOutputImuCT_;
   rovio::FeatureOutput featureOutput_;
@@ -226,13 +326,10 @@ class RovioNode{
   std::string camera_frame_;
   std::string imu_frame_;
 
-  double imu_offset_= 0.0;
-
   // CUSTOMIZATION
   bool resize_input_image_ = false;
   double resize_factor_ = 1.0; 
   bool histogram_equalize_8bit_images_ = false;
-  cv::Ptr<cv::CLAHE> clahe;
   double clahe_clip_limit_ = 2.0;  //number of pixels used to clip the CDF for histogram equalization
   double clahe_grid_size_ = 8.0;   //clahe_grid_size_ x clahe_grid_size_ pixel neighborhood used
   double img_gamma = 1.0;
@@ -252,7 +349,7 @@ class RovioNode{
   /** \brief Constructor
    */
   RovioNode(ros::NodeHandle& nh, ros::NodeHandle& nh_private, std::shared_ptr<mtFilter> mpFilter)
-      : nh_(nh), nh_private_(nh_private), mpFilter_(mpFilter), transformFeatureOutputCT_(&mpFilter->multiCamera_), landmarkOutputImuCT_(&mpFilter->multiCamera_),
+      : nh_(nh), nh_private_(nh_private), mpFilter_(mpFilter), estimator_(mpFilter), transformFeatureOutputCT_(&mpFilter->multiCamera_), landmarkOutputImuCT_(&mpFilter->multiCamera_),
         cameraOutputCov_((int)(mtOutput::D_),(int)(mtOutput::D_)), featureOutputCov_((int)(FeatureOutput::D_),(int)(FeatureOutput::D_)), landmarkOutputCov_(3,3),
         featureOutputReadableCov_((int)(FeatureOutputReadable::D_),(int)(FeatureOutputReadable::D_)){
     #ifndef NDEBUG
@@ -286,12 +383,19 @@ class RovioNode{
     srvResetFilter_ = nh_.advertiseService("rovio/reset", &RovioNode::resetServiceCallback, this);
     srvResetToPoseFilter_ = nh_.advertiseService("rovio/reset_to_pose", &RovioNode::resetToPoseServiceCallback, this);
     srvResetToRefractiveIndexFilter_ = nh_.advertiseService("rovio/reset_to_refractive_index", &RovioNode::resetToRefractiveIndexServiceCallback, this);
+    srvSaveCheckpoint_ = nh_.advertiseService("rovio/save_checkpoint", &RovioNode::saveCheckpointServiceCallback, this);
+    srvRestoreCheckpoint_ = nh_.advertiseService("rovio/restore_checkpoint", &RovioNode::restoreCheckpointServiceCallback, this);
 
     // Advertise topics
     pubTransform_ = nh_.advertise<geometry_msgs::TransformStamped>("rovio/transform", 1);
     pubOdometry_ = nh_.advertise<nav_msgs::Odometry>("rovio/odometry", 1);
+    pubImuOdometry_ = nh_.advertise<nav_msgs::Odometry>("rovio/imu_odometry", 10);
+#ifdef ROVIO_PROFILING
+    pubProfiling_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("rovio/profiling", 1);
+#endif
     pubPoseWithCovStamped_ = nh_.advertise<geometry_msgs::PoseWithCovarianceStamped>("rovio/pose_with_covariance_stamped", 1);
     pubPcl_ = nh_.advertise<sensor_msgs::PointCloud2>("rovio/pcl", 1);
+    pubPclDelta_ = nh_.advertise<sensor_msgs::PointCloud2>("rovio/pcl_delta", 10);
     pubPatch_ = nh_.advertise<sensor_msgs::PointCloud2>("rovio/patch", 1);
     pubMarkers_ = nh_.advertise<visualization_msgs::Marker>("rovio/markers", 1 );
     pubFeatureIds = nh_.advertise<visualization_msgs::Marker>("rovio/featureIds", 1 );
@@ -324,7 +428,7 @@ class RovioNode{
     nh_private_.param("camera_frame", camera_frame_, camera_frame_);
     nh_private_.param("imu_frame", imu_frame_, imu_frame_);
 
-    nh_private_.param("imu_offset", imu_offset_, 0.0);  
+    nh_private_.param("imu_offset", estimator_.imuOffset_, 0.0);
 
       //CLAHE
     nh_private_.param("histogram_equalize_8bit_images", histogram_equalize_8bit_images_, true);
@@ -333,11 +437,14 @@ class RovioNode{
     if (histogram_equalize_8bit_images_) {
       nh_private_.param("clahe_clip_limit", clahe_clip_limit_, 7.0);
       nh_private_.param("clahe_grid_size", clahe_grid_size_, 8.0);
-      clahe = cv::createCLAHE();
-      clahe->setClipLimit(clahe_clip_limit_);
-      clahe->setTilesGridSize(cv::Size(clahe_grid_size_, clahe_grid_size_));
     }
     nh_private_.param("img_gamma", img_gamma, 1.0);
+    for(int i=0;i<mtState::nCam_;i++){
+      estimator_.preprocessors_[i].claheClipLimit_ = clahe_clip_limit_;
+      estimator_.preprocessors_[i].claheGridSize_ = clahe_grid_size_;
+      estimator_.preprocessors_[i].gamma_ = img_gamma;
+      estimator_.preprocessors_[i].configure();
+    }
     nh_private_.param("resize_input_image", resize_input_image_, false);
     nh_private_.param("resize_factor", resize_factor_, 0.5);
     //Image resize
@@ -346,6 +453,75 @@ class RovioNode{
     if (resize_input_image_)
       ROS_WARN_ONCE("ROVIO - Input Images Resized to %d pct of Original Size", static_cast<int>(resize_factor_ * 100));
 
+    // Per-camera image workers
+    nh_private_.param("parallel_image_processing", parallelImageProcessing_, false);
+    nh_private_.param("image_queue_size", imageQueueSize_, 4);
+    if (parallelImageProcessing_) {
+      for(int i=0;i<mtState::nCam_;i++){
+        imageWorkers_[i].thread_ = std::thread(&RovioNode::imageWorkerLoop, this, i);
+      }
+    }
+
+    // Publisher thread
+    nh_private_.param("async_publishing", asyncPublishing_, false);
+    if (asyncPublishing_) {
+      publisherThread_ = std::thread(&RovioNode::publisherLoop, this);
+    }
+
+    // Measurement ingress and IMU rate pose
+    nh_private_.param("lock_free_ingress", lockFreeIngress_, false);
+    nh_private_.param("publish_imu_rate_pose", publishImuRatePose_, false);
+    nh_private_.param("profiling_period", profilingPeriod_, 1.0);
+
+    // Out-of-sequence updates
+    nh_private_.param("out_of_sequence_updates", outOfSequenceUpdates_, false);
+    nh_private_.param("oosm_max_delay", oosmBuffer_.maxDelay_, 0.5);
+
+    // Warm recovery
+    int warmRecoveryCacheSize;
+    nh_private_.param("warm_recovery", warmRecovery_, false);
+    nh_private_.param("warm_recovery_cache_size", warmRecoveryCacheSize, 5);
+    nh_private_.param("warm_recovery_period", keyframeCache_.minPeriod_, 1.0);
+    nh_private_.param("warm_recovery_cov_inflation", estimator_.warmRecoveryCovInflation_, 4.0);
+    keyframeCache_.capacity_ = std::max(warmRecoveryCacheSize,0);
+    lastProfilingTime_ = ros::WallTime::now();
+
+    // Telemetry (memory-mapped ring file, read with rovio_telemetry_reader)
+    std::string telemetryFile;
+    int telemetryCapacity;
+    nh_private_.param("telemetry_file", telemetryFile, std::string(""));
+    nh_private_.param("telemetry_capacity", telemetryCapacity, 36000);
+    if(!telemetryFile.empty()){
+      if(telemetryWriter_.open(telemetryFile,std::max(telemetryCapacity,1))){
+        ROS_INFO("ROVIO - Writing telemetry to %s (%d records)", telemetryFile.c_str(), std::max(telemetryCapacity,1));
+      } else {
+        ROS_ERROR("ROVIO - Could not create the telemetry file %s", telemetryFile.c_str());
+      }
+    }
+    imuPoseIntegrator_.g_ = mpFilter_->mPrediction_.g_;
+
+    // Checkpoints (periodically written in the background, optionally restored on startup)
+    bool checkpointRestoreOnStartup;
+    bool restoreCalibrationOnly;
+    nh_private_.param("checkpoint_file", checkpointFile_, std::string(""));
+    nh_private_.param("checkpoint_period", checkpointPeriod_, 10.0);
+    nh_private_.param("checkpoint_restore_on_startup", checkpointRestoreOnStartup, false);
+    nh_private_.param("checkpoint_restore_calibration_only", restoreCalibrationOnly, false);
+    lastCheckpointTime_ = 0.0;
+    if(!checkpointFile_.empty() && checkpointRestoreOnStartup){
+      std::string error;
+      std::unique_ptr<FilterCheckpoint<mtFilterState>> checkpoint(new FilterCheckpoint<mtFilterState>());
+      if(checkpoint->load(checkpointFile_,error)){
+        ROS_INFO("ROVIO - Initializing from the checkpoint %s (t = %f)%s", checkpointFile_.c_str(), checkpoint->t_, restoreCalibrationOnly ? ", calibration only" : "");
+        estimator_.requestResetToCheckpoint(*checkpoint,restoreCalibrationOnly);
+      } else {
+        ROS_WARN("ROVIO - Could not read the checkpoint %s (%s), initializing from scratch", checkpointFile_.c_str(), error.c_str());
+      }
+    }
+    if(!checkpointFile_.empty() && checkpointPeriod_ > 0.0){
+      checkpointThread_ = std::thread(&RovioNode::checkpointLoop, this);
+    }
+
     // Initialize messages
     transformMsg_.header.frame_id = world_frame_;
     transformMsg_.child_frame_id = imu_frame_;
@@ -355,6 +531,8 @@ class RovioNode{
 
     odometryMsg_.header.frame_id = world_frame_;
     odometryMsg_.child_frame_id = imu_frame_;
+    imuOdometryMsg_.header.frame_id = world_frame_;
+    imuOdometryMsg_.child_frame_id = imu_frame_;
     msgSeq_ = 1;
     for(int camID=0;camID<mtState::nCam_;camID++){
       extrinsicsMsg_[camID].header.frame_id = imu_frame_;
@@ -417,6 +595,41 @@ class RovioNode{
     patchMsg_.data.resize(patchMsg_.row_step * patchMsg_.height);
     patchMsg_.is_dense = false;
 
+    // Delta point cloud message (compact layout, see publishDeltaPcl)
+    nh_private_.param("delta_pcl_publishing", deltaPclPublishing_, false);
+    nh_private_.param("delta_pcl_half_precision", deltaPclHalfPrecision_, false);
+    nh_private_.param("delta_pcl_keyframe_period", deltaPclKeyframePeriod_, 20);
+    nh_private_.param("delta_pcl_position_threshold", deltaPclPositionThreshold_, 0.02);
+    nh_private_.param("delta_pcl_covariance_threshold", deltaPclCovarianceThreshold_, 0.2);
+    deltaPclCounter_ = 0;
+    for(int i=0;i<mtState::nMax_;i++){
+      isCurrentPclPointValid_[i] = false;
+      isPublishedPclPointValid_[i] = false;
+    }
+    deltaPclMsg_.header.frame_id = imu_frame_;
+    deltaPclMsg_.height = 1;
+    deltaPclMsg_.width = 0;
+    const int nFieldsDeltaPcl = 18;
+    std::string nameDeltaPcl[nFieldsDeltaPcl] = {"id","camId","status","flags","x","y","z","b_x","b_y","b_z","d","c_00","c_01","c_02","c_11","c_12","c_22","c_d"};
+    const int covSize = deltaPclHalfPrecision_ ? 2 : 4;
+    const int covType = deltaPclHalfPrecision_ ? sensor_msgs::PointField::UINT16 : sensor_msgs::PointField::FLOAT32;
+    int sizeDeltaPcl[nFieldsDeltaPcl] = {4,1,1,1,4,4,4,4,4,4,4,covSize,covSize,covSize,covSize,covSize,covSize,covSize};
+    int datatypeDeltaPcl[nFieldsDeltaPcl] = {sensor_msgs::PointField::INT32,sensor_msgs::PointField::UINT8,sensor_msgs::PointField::UINT8,sensor_msgs::PointField::UINT8,
+        sensor_msgs::PointField::FLOAT32,sensor_msgs::PointField::FLOAT32,sensor_msgs::PointField::FLOAT32,
+        sensor_msgs::PointField::FLOAT32,sensor_msgs::PointField::FLOAT32,sensor_msgs::PointField::FLOAT32,sensor_msgs::PointField::FLOAT32,
+        covType,covType,covType,covType,covType,covType,covType};
+    deltaPclMsg_.fields.resize(nFieldsDeltaPcl);
+    byteCounter = 0;
+    for(int i=0;i<nFieldsDeltaPcl;i++){
+      deltaPclMsg_.fields[i].name     = nameDeltaPcl[i];
+      deltaPclMsg_.fields[i].offset   = byteCounter;
+      deltaPclMsg_.fields[i].count    = 1;
+      deltaPclMsg_.fields[i].datatype = datatypeDeltaPcl[i];
+      byteCounter += sizeDeltaPcl[i];
+    }
+    deltaPclMsg_.point_step = byteCounter;
+    deltaPclMsg_.is_dense = true;
+
     // Marker message (vizualization of uncertainty)
     markerMsg_.header.frame_id = imu_frame_;
     markerMsg_.id = 0;
@@ -464,7 +677,28 @@ class RovioNode{
 
   /** \brief Destructor
    */
-  virtual ~RovioNode(){}
+  virtual ~RovioNode(){
+    for(int i=0;i<mtState::nCam_;i++){
+      {
+        std::lock_guard<std::mutex> lock(imageWorkers_[i].m_queue_);
+        imageWorkers_[i].stop_ = true;
+      }
+      imageWorkers_[i].cv_queue_.notify_one();
+      if(imageWorkers_[i].thread_.joinable()) imageWorkers_[i].thread_.join();
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_publish_);
+      stopPublisher_ = true;
+    }
+    cv_publish_.notify_one();
+    if(publisherThread_.joinable()) publisherThread_.join();
+    {
+      std::lock_guard<std::mutex> lock(m_checkpoint_);
+      stopCheckpointWriter_ = true;
+    }
+    cv_checkpoint_.notify_one();
+    if(checkpointThread_.joinable()) checkpointThread_.join();
+  }
 
   /** \brief Tests the functionality of the rovio node.
    *
@@ -477,8 +711,11 @@ class RovioNode{
     mtState& testState = mpTestFilterState->state_;
     unsigned int s = 2;
     testState.setRandom(s);
-    predictionMeas_.setRandom(s);
-    imgUpdateMeas_.setRandom(s);
+    mtPredictionMeas predictionMeas;
+    predictionMeas.setRandom(s);
+    std::unique_ptr<mtImgMeas> mpImgUpdateMeas(new mtImgMeas());
+    mtImgMeas& imgUpdateMeas = *mpImgUpdateMeas;
+    imgUpdateMeas.setRandom(s);
 
     LWF::NormalVectorElement tempNor;
     for(int i=0;i<mtState::nMax_;i++){
@@ -502,7 +739,7 @@ class RovioNode{
 
     // Prediction
     std::cout << "Testing Prediction" << std::endl;
-    mpFilter_->mPrediction_.testPredictionJacs(testState,predictionMeas_,1e-8,1e-6,0.1);
+    mpFilter_->mPrediction_.testPredictionJacs(testState,predictionMeas,1e-8,1e-6,0.1);
 
     // Update
     if(!mpImgUpdate_->useDirectMethod_){
@@ -510,9 +747,9 @@ class RovioNode{
       for(int i=0;i<(std::min((int)mtState::nMax_,2));i++){
         testState.aux().activeFeature_ = i;
         testState.aux().activeCameraCounter_ = 0;
-        mpImgUpdate_->testUpdateJacs(testState,imgUpdateMeas_,1e-4,1e-5);
+        mpImgUpdate_->testUpdateJacs(testState,imgUpdateMeas,1e-4,1e-5);
         testState.aux().activeCameraCounter_ = mtState::nCam_-1;
-        mpImgUpdate_->testUpdateJacs(testState,imgUpdateMeas_,1e-4,1e-5);
+        mpImgUpdate_->testUpdateJacs(testState,imgUpdateMeas,1e-4,1e-5);
       }
     }
 
@@ -571,40 +808,101 @@ class RovioNode{
   /** \brief Callback for IMU-Messages. Adds IMU measurements (as prediction measurements) to the filter.
    */
   void imuCallback(const sensor_msgs::Imu::ConstPtr& imu_msg){
+    ImuIngress imu;
+    imu.t_ = imu_msg->header.stamp.toSec() + estimator_.imuOffset_;
+    imu.acc_ = Eigen::Vector3d(imu_msg->linear_acceleration.x,imu_msg->linear_acceleration.y,imu_msg->linear_acceleration.z);
+    imu.gyr_ = Eigen::Vector3d(imu_msg->angular_velocity.x,imu_msg->angular_velocity.y,imu_msg->angular_velocity.z);
+    if(lockFreeIngress_){
+      if(!imuQueue_.push(imu)) ROS_WARN_THROTTLE(1.0, "ROVIO - IMU ingress queue full, dropping measurement");
+      processIngress();
+      return;
+    }
     std::lock_guard<std::mutex> lock(m_filter_);
-    predictionMeas_.template get<mtPredictionMeas::_acc>() = Eigen::Vector3d(imu_msg->linear_acceleration.x,imu_msg->linear_acceleration.y,imu_msg->linear_acceleration.z);
-    predictionMeas_.template get<mtPredictionMeas::_gyr>() = Eigen::Vector3d(imu_msg->angular_velocity.x,imu_msg->angular_velocity.y,imu_msg->angular_velocity.z);
-    if(init_state_.isInitialized()){
-      mpFilter_->addPredictionMeas(predictionMeas_,imu_msg->header.stamp.toSec() + imu_offset_);
+    if(processImu(imu)){
       updateAndPublish();
-    } else {
-      switch(init_state_.state_) {
-        case FilterInitializationState::State::WaitForInitExternalPose: {
-          std::cout << "-- Filter: Initializing using external pose ..." << std::endl;
-          mpFilter_->resetWithPose(init_state_.WrWM_, init_state_.qMW_, imu_msg->header.stamp.toSec()+imu_offset_);
-          break;
-        }
-        case FilterInitializationState::State::WaitForInitUsingAccel: {
-          std::cout << "-- Filter: Initializing using accel. measurement ..." << std::endl;
-          mpFilter_->resetWithAccelerometer(predictionMeas_.template get<mtPredictionMeas::_acc>(),imu_msg->header.stamp.toSec()+imu_offset_);
-          break;
-        }
-        case FilterInitializationState::State::WaitForInitRefractiveIndex: {
-          std::cout << "-- Filter: Initializing using refractive index (experimental, relocates to origin, DO NOT USE ON ROBOT) ..." << std::endl;
-          mpFilter_->resetWithRefractiveIndex(init_state_.refractiveIndex_, imu_msg->header.stamp.toSec()+imu_offset_);
-          break;
-        }
-        default: {
-          std::cout << "Unhandeld initialization type." << std::endl;
-          abort();
-          break;
-        }
-      }
+      publishImuRatePose();
+    }
+  }
 
-      std::cout << std::setprecision(12);
-      std::cout << "-- Filter: Initialized at t = " << imu_msg->header.stamp.toSec() + imu_offset_ << std::endl;
-      init_state_.state_ = FilterInitializationState::State::Initialized;
+  /** \brief Adds an IMU measurement to the filter or initializes the filter with it (m_filter_ locked).
+   *
+   * @param imu - IMU measurement (offset corrected time).
+   * @return true if the measurement was added to the (initialized) filter.
+   */
+  bool processImu(const ImuIngress& imu){
+    if(estimator_.isInitialized()){
+      estimator_.processImu(imu.t_,imu.acc_,imu.gyr_);
+      if(outOfSequenceUpdates_) oosmBuffer_.logPredictionMeas(estimator_.getPredictionMeas(),imu.t_);
+      if(publishImuRatePose_) imuPoseIntegrator_.add({imu.t_,imu.acc_,imu.gyr_});
+      return true;
+    }
+    estimator_.processImu(imu.t_,imu.acc_,imu.gyr_);
+    imuPoseIntegrator_.invalidate();
+    oosmBuffer_.clear();
+    lastCheckpointTime_ = imu.t_; // First periodic checkpoint one period after the initialization
+    return false;
+  }
+
+  /** \brief Moves all queued IMU, velocity and baro measurements into the filter (m_filter_ locked).
+   *
+   * @return true if at least one IMU measurement was added to the filter.
+   */
+  bool drainIngress(){
+    bool gotImu = false;
+    ImuIngress imu;
+    while(imuQueue_.pop(imu)){
+      gotImu = processImu(imu) || gotImu;
+    }
+    VelocityIngress velocity;
+    while(velocityQueue_.pop(velocity)){
+      processVelocity(velocity);
     }
+    BaroIngress baro;
+    while(baroQueue_.pop(baro)){
+      processBaro(baro);
+    }
+    return gotImu;
+  }
+
+  /** \brief Processes the queued measurements if the filter is not busy.
+   *
+   * Never blocks: if another thread holds m_filter_ the queues are drained by that thread (at the latest
+   * with its next update), otherwise the measurements are added and the filter is updated here.
+   */
+  void processIngress(){
+    std::unique_lock<std::mutex> lock(m_filter_,std::try_to_lock);
+    if(!lock.owns_lock()) return;
+    do {
+      const bool gotImu = drainIngress();
+      if(estimator_.isInitialized()){
+        updateAndPublish(gotImu);
+        publishImuRatePose();
+      }
+    } while(!imuQueue_.empty() || !velocityQueue_.empty() || !baroQueue_.empty());
+  }
+
+  /** \brief Publishes the IMU-propagated pose of the latest IMU measurement (m_filter_ locked).
+   */
+  void publishImuRatePose(){
+    if(!publishImuRatePose_ || !imuPoseIntegrator_.isValid() || imuPoseIntegrator_.t_ <= lastImuRatePoseTime_) return;
+    lastImuRatePoseTime_ = imuPoseIntegrator_.t_;
+    if(pubImuOdometry_.getNumSubscribers() == 0) return;
+    const QPD qBW = imuPoseIntegrator_.qWM_.inverted();
+    imuOdometryMsg_.header.stamp = ros::Time(imuPoseIntegrator_.t_);
+    imuOdometryMsg_.pose.pose.position.x = imuPoseIntegrator_.WrWM_(0);
+    imuOdometryMsg_.pose.pose.position.y = imuPoseIntegrator_.WrWM_(1);
+    imuOdometryMsg_.pose.pose.position.z = imuPoseIntegrator_.WrWM_(2);
+    imuOdometryMsg_.pose.pose.orientation.w = -qBW.w();
+    imuOdometryMsg_.pose.pose.orientation.x = qBW.x();
+    imuOdometryMsg_.pose.pose.orientation.y = qBW.y();
+    imuOdometryMsg_.pose.pose.orientation.z = qBW.z();
+    imuOdometryMsg_.twist.twist.linear.x = -imuPoseIntegrator_.MvM_(0);
+    imuOdometryMsg_.twist.twist.linear.y = -imuPoseIntegrator_.MvM_(1);
+    imuOdometryMsg_.twist.twist.linear.z = -imuPoseIntegrator_.MvM_(2);
+    imuOdometryMsg_.twist.twist.angular.x = imuPoseIntegrator_.MwWM_(0);
+    imuOdometryMsg_.twist.twist.angular.y = imuPoseIntegrator_.MwWM_(1);
+    imuOdometryMsg_.twist.twist.angular.z = imuPoseIntegrator_.MwWM_(2);
+    pubImuOdometry_.publish(imuOdometryMsg_);
   }
 
   /** \brief Image callback for the camera with ID 0
@@ -613,8 +911,7 @@ class RovioNode{
    * @todo generalize
    */
   void imgCallback0(const sensor_msgs::ImageConstPtr & img){
-    std::lock_guard<std::mutex> lock(m_filter_);
-    imgCallback(img,0);
+    dispatchImage(img,0);
   }
 
   /** \brief Image callback for the camera with ID 1
@@ -623,8 +920,7 @@ class RovioNode{
    * @todo generalize
    */
   void imgCallback1(const sensor_msgs::ImageConstPtr & img) {
-    std::lock_guard<std::mutex> lock(m_filter_);
-    if(mtState::nCam_ > 1) imgCallback(img,1);
+    if(mtState::nCam_ > 1) dispatchImage(img,1);
   }
 
   /** \brief Image callback for the camera with ID 2
@@ -633,8 +929,7 @@ class RovioNode{
    * @todo generalize
    */
   void imgCallback2(const sensor_msgs::ImageConstPtr & img) {
-    std::lock_guard<std::mutex> lock(m_filter_);
-    if(mtState::nCam_ > 2) imgCallback(img,2);
+    if(mtState::nCam_ > 2) dispatchImage(img,2);
   }
 
     /** \brief Image callback for the camera with ID 3
@@ -643,8 +938,7 @@ class RovioNode{
    * @todo generalize
    */
   void imgCallback3(const sensor_msgs::ImageConstPtr & img) {
-    std::lock_guard<std::mutex> lock(m_filter_);
-    if(mtState::nCam_ > 3) imgCallback(img,3);
+    if(mtState::nCam_ > 3) dispatchImage(img,3);
   }
 
   /** \brief Image callback for the camera with ID 4
@@ -653,21 +947,71 @@ class RovioNode{
    * @todo generalize
    */
   void imgCallback4(const sensor_msgs::ImageConstPtr & img) {
-    std::lock_guard<std::mutex> lock(m_filter_);
-    if(mtState::nCam_ > 4) imgCallback(img,4);
+    if(mtState::nCam_ > 4) dispatchImage(img,4);
+  }
+
+  /** \brief Hands an image over to the worker of the corresponding camera or processes it directly.
+   *
+   *   @param img   - Image message.
+   *   @param camID - Camera ID.
+   */
+  void dispatchImage(const sensor_msgs::ImageConstPtr & img, const int camID){
+    if(!parallelImageProcessing_){
+      imgCallback(img,camID);
+      return;
+    }
+    ImageWorker& worker = imageWorkers_[camID];
+    {
+      std::lock_guard<std::mutex> lock(worker.m_queue_);
+      worker.queue_.push_back(img);
+      while(static_cast<int>(worker.queue_.size()) > std::max(imageQueueSize_,1)){
+        ROS_WARN_THROTTLE(5, "ROVIO - Image worker of camera %d cannot keep up, dropping frames", camID);
+        worker.queue_.pop_front();
+      }
+    }
+    worker.cv_queue_.notify_one();
+  }
+
+  /** \brief Main loop of the image worker of a camera.
+   *
+   *   @param camID - Camera ID.
+   */
+  void imageWorkerLoop(const int camID){
+    ImageWorker& worker = imageWorkers_[camID];
+    while(true){
+      sensor_msgs::ImageConstPtr img;
+      {
+        std::unique_lock<std::mutex> lock(worker.m_queue_);
+        worker.cv_queue_.wait(lock,[&worker]{return worker.stop_ || !worker.queue_.empty();});
+        if(worker.stop_) return;
+        img = worker.queue_.front();
+        worker.queue_.pop_front();
+      }
+      imgCallback(img,camID);
+    }
   }
 
   /** \brief Image callback. Adds images (as update measurements) to the filter.
+   *
+   *   The conversion, preprocessing and pyramid construction (\ref RovioEstimator::buildPyramid) is done without
+   *   holding the filter mutex. Only the frame assembly (m_img_) and, once the images of all cameras are available,
+   *   adding the measurement and updating the filter (m_filter_) is locked. Can be called concurrently for
+   *   different cameras, but not for the same camera.
    *
    *   @param img   - Image message.
    *   @param camID - Camera ID.
    */
   void imgCallback(const sensor_msgs::ImageConstPtr & img, const int camID = 0){
-    // Get image from msg
-    cv_bridge::CvImagePtr cv_ptr;
+    {
+      std::lock_guard<std::mutex> lock(m_filter_);
+      if(!estimator_.isInitialized()) return;
+    }
+    // Get image from msg (MONO8 images are shared with the message, no copy)
+    cv_bridge::CvImageConstPtr cv_ptr;
     try {
+      ROVIO_PROFILE_SCOPE("image_conversion");
       if (img->encoding == sensor_msgs::image_encodings::MONO8) {
-        cv_ptr = cv_bridge::toCvCopy(img, sensor_msgs::image_encodings::MONO8);
+        cv_ptr = cv_bridge::toCvShare(img, sensor_msgs::image_encodings::MONO8);
       } else if (img->encoding == sensor_msgs::image_encodings::MONO16) {
         cv_ptr = cv_bridge::toCvCopy(img, sensor_msgs::image_encodings::MONO16);
       } else if (img->encoding == sensor_msgs::image_encodings::BGR8) {
@@ -678,113 +1022,25 @@ class RovioNode{
         ROS_ERROR("Unsupported image encoding");
         return;
       }
-       // fix for color images
-      if (cv_ptr->image.channels() == 3) {
-        cv::Mat gray;
-        cv::cvtColor(cv_ptr->image, gray, cv::COLOR_BGR2GRAY);
-        // take blue channel as grayscale image
-        // cv::extractChannel(cv_ptr->image, gray, 0);
-        cv_ptr->image = gray;
-      }
     } catch (cv_bridge::Exception& e) {
       ROS_ERROR("cv_bridge exception: %s", e.what());
       return;
     }
-    cv::Mat cv_img;
-    cv_ptr->image.copyTo(cv_img);
-
-    // multiply image by 0.5 to dim it
-    // cv_img = cv_img * 0.5;
-
-    if (mpImgUpdate_->histogramEqualize_) {
-      //Check if input image is actually 8-bit
-      double imgMin, imgMax;
-      cv::minMaxLoc(cv_img, &imgMin, &imgMax);
-      if (imgMax <= max_8bit_image_val) {
-        cv::Mat inImg, outImg;
-        cv_img.convertTo(inImg, CV_8UC1);
-        clahe->apply(inImg, outImg);
-        outImg.convertTo(cv_img, CV_8UC1); 
-
-        // apply bilateral filter
-        if (mpImgUpdate_->bilateralBlur_){
-            cv_img.convertTo(inImg, CV_8UC1);
-            cv::bilateralFilter(inImg, outImg, 9, 50, 50);
-            outImg.convertTo(cv_img, CV_8UC1); 
-        }        
-        // median blur
-        if (mpImgUpdate_->medianBlur_){
-            cv_img.convertTo(inImg, CV_8UC1);
-            cv::medianBlur( inImg, outImg, mpImgUpdate_->medianKernelSize_);
-            outImg.convertTo(cv_img, CV_8UC1); 
-
-        }
-        
-      } else
-        ROS_WARN_THROTTLE(5, "Histogram Equaliztion for 8-bit intensity images is turned on but input Image is not 8-bit");
-    }
-
-    // // Histogram equalization
-    // if(mpImgUpdate_->histogramEqualize_){
-    //   constexpr size_t hist_bins = 256;
-    //   cv::Mat hist;
-    //   std::vector<cv::Mat> img_vec = {cv_img};
-    //   cv::calcHist(img_vec, {0}, cv::Mat(), hist, {hist_bins},
-    //                {0, hist_bins-1}, false);
-    //    cv::Mat lut(1, hist_bins, CV_8UC1);
-    //    double sum = 0.0;
-    //   //prevents an image full of noise if in total darkness
-    //   float max_per_bin = cv_img.cols * cv_img.rows * 0.02;
-    //   float min_per_bin = cv_img.cols * cv_img.rows * 0.002;
-    //   float total_pixels = 0;
-    //   for(size_t i = 0; i < hist_bins; ++i){
-    //     float& bin = hist.at<float>(i);
-    //     if(bin > max_per_bin){
-    //       bin = max_per_bin;
-    //     } else if(bin < min_per_bin){
-    //       bin = min_per_bin;
-    //     }
-    //     total_pixels += bin;
-    //   }
-    //   for(size_t i = 0; i < hist_bins; ++i){
-    //     sum += hist.at<float>(i) / total_pixels;
-    //     lut.at<uchar>(i) = (hist_bins-1)*sum;
-    //   }
-    //   cv::LUT(cv_img, lut, cv_img);
-    // }
-
-    
-    // // // // To dim the images 
-    if(init_state_.isInitialized() && !cv_img.empty()){
-
-    //   //>>> Gamma correction
-
-      cv::Mat lookUpTable(1, 256, CV_8U);
-      for (int i = 0; i < 256; i++)
-      {
-          lookUpTable.at<uchar>(i) = cv::saturate_cast<uchar>(pow(i / 255.0, img_gamma) * 255.0);
-      }
-      cv::Mat res = cv_img.clone();
-      LUT(cv_img, lookUpTable, res);
-      cv_img = res;
-    }
-
-    if(init_state_.isInitialized() && !cv_img.empty()){
-      double msgTime = img->header.stamp.toSec();
-      if(msgTime != imgUpdateMeas_.template get<mtImgMeas::_aux>().imgTime_){
-        for(int i=0;i<mtState::nCam_;i++){
-          if(imgUpdateMeas_.template get<mtImgMeas::_aux>().isValidPyr_[i]){
-            std::cout << "    \033[31mFailed Synchronization of Camera Frames, t = " << msgTime << "\033[0m" << std::endl;
-          }
-        }
-        imgUpdateMeas_.template get<mtImgMeas::_aux>().reset(msgTime);
+    if(!estimator_.buildPyramid(camID,cv_ptr->image)) return;
+    if (!estimator_.preprocessors_[camID].lastInputWas8bit_)
+      ROS_WARN_THROTTLE(5, "Histogram Equaliztion for 8-bit intensity images is turned on but input Image is not 8-bit");
+
+    double msgTime = img->header.stamp.toSec();
+    std::unique_lock<std::mutex> imgLock(m_img_);
+    if(estimator_.assembleFrame(msgTime,camID)){
+      // The filter mutex is acquired before releasing m_img_ such that complete frames are added in order
+      std::lock_guard<std::mutex> lock(m_filter_);
+      if(estimator_.isInitialized()){
+        addFilterUpdateMeas<0>(estimator_.getFrame(),msgTime);
       }
-      imgUpdateMeas_.template get<mtImgMeas::_aux>().pyr_[camID].computeFromImage(cv_img,true);
-      imgUpdateMeas_.template get<mtImgMeas::_aux>().isValidPyr_[camID] = true;
-
-      if(imgUpdateMeas_.template get<mtImgMeas::_aux>().areAllValid()){
-        mpFilter_->template addUpdateMeas<0>(imgUpdateMeas_,msgTime);
-        imgUpdateMeas_.template get<mtImgMeas::_aux>().reset(msgTime);
+      estimator_.clearFrame(msgTime);
+      imgLock.unlock();
+      if(estimator_.isInitialized()){
         updateAndPublish();
       }
     }
@@ -796,12 +1052,12 @@ class RovioNode{
    */
   void groundtruthCallback(const geometry_msgs::TransformStamped::ConstPtr& transform){
     std::lock_guard<std::mutex> lock(m_filter_);
-    if(init_state_.isInitialized()){
+    if(estimator_.isInitialized()){
       Eigen::Vector3d JrJV(transform->transform.translation.x,transform->transform.translation.y,transform->transform.translation.z);
       poseUpdateMeas_.pos() = JrJV;
       QPD qJV(transform->transform.rotation.w,transform->transform.rotation.x,transform->transform.rotation.y,transform->transform.rotation.z);
       poseUpdateMeas_.att() = qJV.inverted();
-      mpFilter_->template addUpdateMeas<1>(poseUpdateMeas_,transform->header.stamp.toSec()+mpPoseUpdate_->timeOffset_);
+      addFilterUpdateMeas<1>(poseUpdateMeas_,transform->header.stamp.toSec()+mpPoseUpdate_->timeOffset_);
       updateAndPublish();
     }
   }
@@ -812,7 +1068,7 @@ class RovioNode{
    */
   void groundtruthOdometryCallback(const nav_msgs::Odometry::ConstPtr& odometry) {
     std::lock_guard<std::mutex> lock(m_filter_);
-    if(init_state_.isInitialized()) {
+    if(estimator_.isInitialized()) {
       Eigen::Vector3d JrJV(odometry->pose.pose.position.x,odometry->pose.pose.position.y,odometry->pose.pose.position.z);
       poseUpdateMeas_.pos() = JrJV;
 
@@ -822,7 +1078,7 @@ class RovioNode{
       const Eigen::Matrix<double,6,6> measuredCov = Eigen::Map<const Eigen::Matrix<double,6,6,Eigen::RowMajor>>(odometry->pose.covariance.data());
       poseUpdateMeas_.measuredCov() = measuredCov;
 
-      mpFilter_->template addUpdateMeas<1>(poseUpdateMeas_,odometry->header.stamp.toSec()+mpPoseUpdate_->timeOffset_);
+      addFilterUpdateMeas<1>(poseUpdateMeas_,odometry->header.stamp.toSec()+mpPoseUpdate_->timeOffset_);
       updateAndPublish();
     }
   }
@@ -832,20 +1088,59 @@ class RovioNode{
    *  @param transform - Groundtruth message.
    */
   void velocityCallback(const geometry_msgs::TwistWithCovarianceStamped::ConstPtr& velocity){
+    VelocityIngress vel;
+    vel.t_ = velocity->header.stamp.toSec();
+    vel.vel_ = Eigen::Vector3d(velocity->twist.twist.linear.x,velocity->twist.twist.linear.y,velocity->twist.twist.linear.z);
+    const Eigen::Matrix<double,6,6> measuredVelCov = Eigen::Map<const Eigen::Matrix<double,6,6,Eigen::RowMajor>>(velocity->twist.covariance.data());
+    vel.cov_ = measuredVelCov.block(0,0, 3,3);
+    if(lockFreeIngress_){
+      if(!velocityQueue_.push(vel)) ROS_WARN_THROTTLE(1.0, "ROVIO - Velocity ingress queue full, dropping measurement");
+      processIngress();
+      return;
+    }
     std::lock_guard<std::mutex> lock(m_filter_);
-    if(init_state_.isInitialized()){
-      Eigen::Vector3d AvM(velocity->twist.twist.linear.x,velocity->twist.twist.linear.y,velocity->twist.twist.linear.z);
-      velocityUpdateMeas_.vel() = AvM;
-
-      const Eigen::Matrix<double,6,6> measuredVelCov = Eigen::Map<const Eigen::Matrix<double,6,6,Eigen::RowMajor>>(velocity->twist.covariance.data());
-      velocityUpdateMeas_.measuredVelCov() = measuredVelCov.block(0,0, 3,3);
-      Eigen::Vector3d AvC(measuredVelCov(0,0),measuredVelCov(1,1),measuredVelCov(2,2));
+    if(processVelocity(vel)) updateAndPublish(false);
+  }
 
-      velocityUpdateNoise_.vel() = AvC;
+  /** \brief Adds a velocity measurement to the filter (m_filter_ locked).
+   *
+   * @param vel - Velocity measurement.
+   * @return true if the measurement was added.
+   */
+  bool processVelocity(const VelocityIngress& vel){
+    if(!estimator_.isInitialized()) return false;
+    velocityUpdateMeas_.vel() = vel.vel_;
+    velocityUpdateMeas_.measuredVelCov() = vel.cov_;
+    velocityUpdateNoise_.vel() = vel.cov_.diagonal();
+    return addFilterUpdateMeas<2>(velocityUpdateMeas_,vel.t_);
+  }
 
-      mpFilter_->template addUpdateMeas<2>(velocityUpdateMeas_,velocity->header.stamp.toSec());
-      updateAndPublish(false);
+  /** \brief Adds an update measurement to the filter (m_filter_ locked).
+   *
+   *  With \ref outOfSequenceUpdates_, the measurement is logged and a late measurement (not newer than the safe
+   *  state) is applied by rolling the safe state back to the last checkpoint before it and re-advancing it to the
+   *  current safe time. Otherwise late measurements are ignored by the filter.
+   *
+   * @param meas - Update measurement.
+   * @param t    - Time of the measurement.
+   * @return false if the measurement was dropped.
+   */
+  template<int i>
+  bool addFilterUpdateMeas(const typename std::tuple_element<i,typename mtFilter::mtUpdates>::type::mtMeas& meas, const double t){
+    if(!outOfSequenceUpdates_ || !OutOfSequenceBuffer<mtFilter>::isLate(*mpFilter_,t)){
+      mpFilter_->template addUpdateMeas<i>(meas,t);
+      if(outOfSequenceUpdates_) oosmBuffer_.template logUpdateMeas<i>(meas,t);
+      return true;
+    }
+    const double delay = mpFilter_->safe_.t_-t;
+    if(!oosmBuffer_.template rollback<i>(*mpFilter_,meas,t)){
+      ROS_WARN_THROTTLE(1.0, "ROVIO - Dropping late measurement of update %d, %f s behind the safe state (oosm_max_delay %f s)", i, delay, oosmBuffer_.maxDelay_);
+      return false;
     }
+    const int replayedImages = oosmBuffer_.replay(*mpFilter_);
+    ROS_DEBUG("ROVIO - Late measurement of update %d (%f s behind), rolled back and reprocessed %d images", i, delay, replayedImages);
+    if(publishImuRatePose_) imuPoseIntegrator_.reset(mpFilter_->safe_.state_,mpFilter_->safe_.t_);
+    return true;
   }
 
   /** \brief ROS service handler for resetting the filter.
@@ -858,25 +1153,35 @@ class RovioNode{
 
   /** \brief Callback for static barometer pressure for underwater (can be used for ariel later) */  
   void baroCallback(const sensor_msgs::FluidPressure::ConstPtr& barometer){
+    BaroIngress baro;
+    baro.t_ = barometer->header.stamp.toSec();
+    baro.pressure_ = barometer->fluid_pressure;
+    if(lockFreeIngress_){
+      if(!baroQueue_.push(baro)) ROS_WARN_THROTTLE(1.0, "ROVIO - Baro ingress queue full, dropping measurement");
+      processIngress();
+      return;
+    }
     std::lock_guard<std::mutex> lock(m_filter_);
-    if(init_state_.isInitialized()){
-
-      double depth = -(barometer->fluid_pressure - baro_pressure_offset_) / baro_pressure_scale_; 
-
-      if (!baro_offset_initialized_) {
-        baro_depth_offset_ = imuOutput_.WrWB()(2) - depth;
-        baro_offset_initialized_ = true;
-      }
-      else{
-        depth += baro_depth_offset_;
-        Eigen::Vector3d JrJV(0.0,0.0,depth);
-        baroUpdateMeas_.pos() = JrJV;
-        mpFilter_->template addUpdateMeas<3>(baroUpdateMeas_,barometer->header.stamp.toSec());
-        updateAndPublish(false);
-      }
-      
+    if(processBaro(baro)) updateAndPublish(false);
+  }
 
+  /** \brief Adds a barometer measurement to the filter, the first one initializes the depth offset (m_filter_ locked).
+   *
+   * @param baro - Pressure measurement.
+   * @return true if the measurement was added.
+   */
+  bool processBaro(const BaroIngress& baro){
+    if(!estimator_.isInitialized()) return false;
+    double depth = -(baro.pressure_ - baro_pressure_offset_) / baro_pressure_scale_;
+    if (!baro_offset_initialized_) {
+      baro_depth_offset_ = mpFilter_->safe_.state_.WrWM()(2) - depth;
+      baro_offset_initialized_ = true;
+      return false;
     }
+    depth += baro_depth_offset_;
+    Eigen::Vector3d JrJV(0.0,0.0,depth);
+    baroUpdateMeas_.pos() = JrJV;
+    return addFilterUpdateMeas<3>(baroUpdateMeas_,baro.t_);
   }
 
   /** \brief ROS service handler for resetting the filter to a given pose.
@@ -899,17 +1204,57 @@ class RovioNode{
     return true;
   }
 
+  /** \brief ROS service handler for writing a checkpoint of the current filter state.
+   */
+  bool saveCheckpointServiceCallback(rovio::SrvSaveCheckpoint::Request& request,
+                                     rovio::SrvSaveCheckpoint::Response& response){
+    const std::string file = request.file.empty() ? checkpointFile_ : request.file;
+    response.success = false;
+    if(file.empty()){
+      response.message = "no checkpoint file given";
+      return true;
+    }
+    std::unique_ptr<FilterCheckpoint<mtFilterState>> checkpoint(new FilterCheckpoint<mtFilterState>());
+    {
+      std::lock_guard<std::mutex> lock(m_filter_);
+      if(!estimator_.isInitialized()){
+        response.message = "filter is not initialized";
+        return true;
+      }
+      checkpoint->capture(mpFilter_->safe_);
+    }
+    response.success = checkpoint->save(file);
+    response.message = response.success ? "saved the state of t = " + std::to_string(checkpoint->t_) + " to " + file : "cannot write " + file;
+    return true;
+  }
+
+  /** \brief ROS service handler for resetting the filter to a checkpoint.
+   */
+  bool restoreCheckpointServiceCallback(rovio::SrvRestoreCheckpoint::Request& request,
+                                        rovio::SrvRestoreCheckpoint::Response& response){
+    const std::string file = request.file.empty() ? checkpointFile_ : request.file;
+    std::unique_ptr<FilterCheckpoint<mtFilterState>> checkpoint(new FilterCheckpoint<mtFilterState>());
+    std::string error = "no checkpoint file given";
+    response.success = !file.empty() && checkpoint->load(file,error);
+    if(!response.success){
+      response.message = "cannot read " + file + ": " + error;
+      return true;
+    }
+    requestResetToCheckpoint(*checkpoint, request.calibration_only);
+    response.message = "resetting to the state of t = " + std::to_string(checkpoint->t_);
+    return true;
+  }
+
   /** \brief Reset the filter when the next IMU measurement is received.
    *         The orientaetion is initialized using an accel. measurement.
    */
   void requestReset() {
     std::lock_guard<std::mutex> lock(m_filter_);
-    if (!init_state_.isInitialized()) {
+    if (!estimator_.isInitialized()) {
       std::cout << "Reinitialization already triggered. Ignoring request...";
       return;
     }
-
-    init_state_.state_ = FilterInitializationState::State::WaitForInitUsingAccel;
+    estimator_.requestReset();
   }
 
   /** \brief Reset the filter when the next IMU measurement is received.
@@ -919,14 +1264,11 @@ class RovioNode{
    */
   void requestResetToPose(const V3D& WrWM, const QPD& qMW) {
     std::lock_guard<std::mutex> lock(m_filter_);
-    if (!init_state_.isInitialized()) {
+    if (!estimator_.isInitialized()) {
       std::cout << "Reinitialization already triggered. Ignoring request...";
       return;
     }
-
-    init_state_.WrWM_ = WrWM;
-    init_state_.qMW_ = qMW;
-    init_state_.state_ = FilterInitializationState::State::WaitForInitExternalPose;
+    estimator_.requestResetToPose(WrWM,qMW);
   }
 
   /** \brief Reset the filter when the next IMU measurement is received.
@@ -935,539 +1277,812 @@ class RovioNode{
    */
   void requestResetRefractiveIndex(const double n) {
     std::lock_guard<std::mutex> lock(m_filter_);
-    if (!init_state_.isInitialized()) {
+    if (!estimator_.isInitialized()) {
+      std::cout << "Reinitialization already triggered. Ignoring request...";
+      return;
+    }
+    estimator_.requestResetToRefractiveIndex(n);
+  }
+
+  /** \brief Reset the filter when the next IMU measurement is received.
+   *         The state is restored from the passed checkpoint.
+   *  @param checkpoint      - Checkpoint.
+   *  @param calibrationOnly - If true, only the IMU biases, the extrinsics and the refractive index are restored.
+   */
+  void requestResetToCheckpoint(const FilterCheckpoint<mtFilterState>& checkpoint, const bool calibrationOnly) {
+    std::lock_guard<std::mutex> lock(m_filter_);
+    if (!estimator_.isInitialized()) {
       std::cout << "Reinitialization already triggered. Ignoring request...";
       return;
     }
-    init_state_.refractiveIndex_ = n;
-    init_state_.state_ = FilterInitializationState::State::WaitForInitRefractiveIndex;
+    estimator_.requestResetToCheckpoint(checkpoint,calibrationOnly);
   }
 
   /** \brief Executes the update step of the filter and publishes the updated data.
    */
   void updateAndPublish(bool doPublish = true){
-    if(init_state_.isInitialized()){
+    if(lockFreeIngress_) doPublish = drainIngress() || doPublish;
+    bool hasFrameSubscribers = pubImg_.getNumSubscribers() > 0;
+    for(int i=0;i<mtState::nCam_;i++){
+      hasFrameSubscribers |= pubFrames_[i].getNumSubscribers() > 0;
+    }
+    mpImgUpdate_->hasFrameSubscribers_ = hasFrameSubscribers;
+    if(estimator_.isInitialized()){
       // Execute the filter update.
       const double t1 = (double) cv::getTickCount();
-      static double timing_T = 0;
-      static int timing_C = 0;
       const double oldSafeTime = mpFilter_->safe_.t_;
       int c1 = std::get<0>(mpFilter_->updateTimelineTuple_).measMap_.size();
       double lastImageTime;
       if(std::get<0>(mpFilter_->updateTimelineTuple_).getLastTime(lastImageTime)){
+        ROVIO_PROFILE_SCOPE("filter_update");
         mpFilter_->updateSafe(&lastImageTime);
       }
       const double t2 = (double) cv::getTickCount();
       int c2 = std::get<0>(mpFilter_->updateTimelineTuple_).measMap_.size();
-      timing_T += (t2-t1)/cv::getTickFrequency()*1000;
-      timing_C += c1-c2;
+      timingT_ += (t2-t1)/cv::getTickFrequency()*1000;
+      timingC_ += c1-c2;
+      if(mpImgUpdate_->useInformationGainScheduling_ && c1 > c2){
+        ROS_INFO_THROTTLE(10, "ROVIO - Information gain scheduling: %d updates performed, %d skipped in the last frame", mpImgUpdate_->lastScheduledUpdates_, mpImgUpdate_->lastSkippedUpdates_);
+      }
       bool plotTiming = false;
       if(plotTiming){
-        ROS_INFO_STREAM(" == Filter Update: " << (t2-t1)/cv::getTickFrequency()*1000 << " ms for processing " << c1-c2 << " images, average: " << timing_T/timing_C);
+        ROS_INFO_STREAM(" == Filter Update: " << (t2-t1)/cv::getTickFrequency()*1000 << " ms for processing " << c1-c2 << " images, average: " << timingT_/timingC_);
+      }
+#ifdef ROVIO_PROFILING
+      publishProfiling();
+#endif
+      if(mpFilter_->safe_.t_ > oldSafeTime && telemetryWriter_.isOpen()){
+        const float timings[TELEMETRY_N_TIMINGS] = {static_cast<float>((t2-t1)/cv::getTickFrequency()*1000), static_cast<float>(c1-c2)};
+        telemetryWriter_.write(mpFilter_->safe_,timings);
+      }
+      if(outOfSequenceUpdates_ && mpFilter_->safe_.t_ > oldSafeTime){
+        oosmBuffer_.addCheckpoint(*mpFilter_);
+      }
+      if(checkpointThread_.joinable() && mpFilter_->safe_.t_ >= lastCheckpointTime_ + checkpointPeriod_){
+        handOffCheckpoint();
+      }
+      if(mpFilter_->safe_.t_ > oldSafeTime && publishImuRatePose_){
+        imuPoseIntegrator_.reset(mpFilter_->safe_.state_,mpFilter_->safe_.t_);
       }
       if(mpFilter_->safe_.t_ > oldSafeTime && doPublish){ // Publish only if something changed and publishing is enabled (can be disabled when velocity update is from learned inertial).
-        for(int i=0;i<mtState::nCam_;i++){
-          if(!mpFilter_->safe_.img_[i].empty() && mpImgUpdate_->doFrameVisualisation_){
-            cv::imshow("Tracker" + std::to_string(i), mpFilter_->safe_.img_[i]);
-            cv::waitKey(3);
-          }
-          //Custom message for publishing the tracked features
-          if (!mpFilter_->safe_.img_[i].empty() && pubFrames_[0].getNumSubscribers() > 0 && mpImgUpdate_->publishFrames_){
-          //   // // patchesMsg_ = cv_bridge::CvImage(mpFilter_->safe_.patchDrawing_).toImageMsg();
-            std_msgs::Header header;
-            header.stamp = ros::Time(mpFilter_->safe_.t_);
-            header.frame_id = camera_frame_ + std::to_string(i);
-            sensor_msgs::ImagePtr frameMsg_ = cv_bridge::CvImage(std_msgs::Header(), "bgr8", mpFilter_->safe_.img_[i]).toImageMsg();
-
-            pubFrames_[i].publish(frameMsg_);
-          }
-
+        updateRelativeCameraMotion(mpFilter_->safe_.state_);
+        if(asyncPublishing_){
+          handOffSnapshot();
+        } else {
+          publishSnapshot(mpFilter_->safe_,mpFilter_->multiCamera_);
         }
-        if(!mpFilter_->safe_.patchDrawing_.empty() && mpImgUpdate_->visualizePatches_){
-          cv::imshow("Patches", mpFilter_->safe_.patchDrawing_);
-          cv::imshow("PatchesClean", mpFilter_->safe_.patchDrawingClean_);
-          cv::waitKey(3);
+      }
+    }
+  }
 
-          sensor_msgs::ImagePtr PatchImgMsg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", mpFilter_->safe_.patchDrawingClean_).toImageMsg();
-          pubPatchImg_.publish(PatchImgMsg);
-        }
+  /** \brief Publishes (and resets) the stage timings of the profiler once per \ref profilingPeriod_.
+   *
+   *   One status per stage, with the count, mean, p50, p99 and max [ms] of the last period.
+   */
+  void publishProfiling(){
+    const ros::WallTime now = ros::WallTime::now();
+    if((now-lastProfilingTime_).toSec() < profilingPeriod_) return;
+    lastProfilingTime_ = now;
+    const std::vector<ProfilerStage::Statistics> stats = Profiler::instance().statistics(true);
+    if(pubProfiling_.getNumSubscribers() == 0) return;
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = ros::Time::now();
+    for(const ProfilerStage::Statistics& stage : stats){
+      diagnostic_msgs::DiagnosticStatus status;
+      status.level = diagnostic_msgs::DiagnosticStatus::OK;
+      status.name = "rovio: " + stage.name_;
+      status.hardware_id = "rovio";
+      const std::pair<std::string,double> values[] = {{"count",(double)stage.count_},{"mean_ms",stage.mean_},{"p50_ms",stage.p50_},
+                                                      {"p99_ms",stage.p99_},{"max_ms",stage.max_}};
+      for(const auto& value : values){
+        diagnostic_msgs::KeyValue keyValue;
+        keyValue.key = value.first;
+        keyValue.value = std::to_string(value.second);
+        status.values.push_back(keyValue);
+      }
+      msg.status.push_back(status);
+    }
+    pubProfiling_.publish(msg);
+  }
 
-        if(pubImg_.getNumSubscribers() > 0){
-          for(int i=0;i<mtState::nCam_;i++){
-            sensor_msgs::ImagePtr ImgMsg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", mpFilter_->safe_.img_[i]).toImageMsg();
-            pubImg_.publish(ImgMsg);
-          }
-        }
+  /** \brief Updates the relative motion of camera 0 between the last two published states (used by the image update).
+   *
+   *   @param state - Current safe state.
+   */
+  void updateRelativeCameraMotion(const mtState& state){
+    relativeMotionOutputCT_.transformState(state,relativeMotionOutput_);
+    tf::Transform tf_transform_CM0;
+    int camID = 0;
+    tf_transform_CM0.setOrigin(tf::Vector3(state.MrMC(camID)(0),state.MrMC(camID)(1),state.MrMC(camID)(2)));
+    tf_transform_CM0.setRotation(tf::Quaternion(state.qCM(camID).x(),state.qCM(camID).y(),state.qCM(camID).z(),-state.qCM(camID).w()));
 
-        // Obtain the save filter state.
-        mtFilterState& filterState = mpFilter_->safe_;
-	      mtState& state = mpFilter_->safe_.state_;
-        state.updateMultiCameraExtrinsics(&mpFilter_->multiCamera_);        
-        state.updateRefIndex(&mpFilter_->multiCamera_);                    // Updates the refractive index to be use by functions in camera class, eg pixelToBearing()
-
-        MXD& cov = mpFilter_->safe_.cov_;
-        imuOutputCT_.transformState(state,imuOutput_);
-
-        // Cout verbose for pose measurements
-        if(mpImgUpdate_->verbose_){
-          if(mpPoseUpdate_->inertialPoseIndex_ >=0){
-            std::cout << "Transformation between inertial frames, IrIW, qWI: " << std::endl;
-            std::cout << "  " << state.poseLin(mpPoseUpdate_->inertialPoseIndex_).transpose() << std::endl;
-            std::cout << "  " << state.poseRot(mpPoseUpdate_->inertialPoseIndex_) << std::endl;
-          }
-          if(mpPoseUpdate_->bodyPoseIndex_ >=0){
-            std::cout << "Transformation between body frames, MrMV, qVM: " << std::endl;
-            std::cout << "  " << state.poseLin(mpPoseUpdate_->bodyPoseIndex_).transpose() << std::endl;
-            std::cout << "  " << state.poseRot(mpPoseUpdate_->bodyPoseIndex_) << std::endl;
-          }
-        }
+    // Get relative pose betwwen last and current camera frame
 
-        // Send Map (Pose Sensor, I) to World (rovio-intern, W) transformation
-        if(mpPoseUpdate_->inertialPoseIndex_ >=0){
-          Eigen::Vector3d IrIW = state.poseLin(mpPoseUpdate_->inertialPoseIndex_);
-          QPD qWI = state.poseRot(mpPoseUpdate_->inertialPoseIndex_);
-          tf::StampedTransform tf_transform_WI;
-          tf_transform_WI.frame_id_ = map_frame_;
-          tf_transform_WI.child_frame_id_ = world_frame_;
-          tf_transform_WI.stamp_ = ros::Time(mpFilter_->safe_.t_);
-          tf_transform_WI.setOrigin(tf::Vector3(IrIW(0),IrIW(1),IrIW(2)));
-          tf_transform_WI.setRotation(tf::Quaternion(qWI.x(),qWI.y(),qWI.z(),-qWI.w()));
-          tb_.sendTransform(tf_transform_WI);
-        }
+    Eigen::Matrix4d camera_imu_tf = Eigen::Matrix4d::Identity();
 
-        // Send IMU pose.
-        tf::StampedTransform tf_transform_MW;
-        tf_transform_MW.frame_id_ = world_frame_;
-        tf_transform_MW.child_frame_id_ = imu_frame_;
-        tf_transform_MW.stamp_ = ros::Time(mpFilter_->safe_.t_);
-        tf_transform_MW.setOrigin(tf::Vector3(imuOutput_.WrWB()(0),imuOutput_.WrWB()(1),imuOutput_.WrWB()(2)));
-        tf_transform_MW.setRotation(tf::Quaternion(imuOutput_.qBW().x(),imuOutput_.qBW().y(),imuOutput_.qBW().z(),-imuOutput_.qBW().w()));
-        tb_.sendTransform(tf_transform_MW);
-
-        // Send camera pose.
-        for(int camID=0;camID<mtState::nCam_;camID++){
-          tf::StampedTransform tf_transform_CM;
-          tf_transform_CM.frame_id_ = imu_frame_;
-          tf_transform_CM.child_frame_id_ = camera_frame_ + std::to_string(camID);
-          tf_transform_CM.stamp_ = ros::Time(mpFilter_->safe_.t_);
-          tf_transform_CM.setOrigin(tf::Vector3(state.MrMC(camID)(0),state.MrMC(camID)(1),state.MrMC(camID)(2)));
-          tf_transform_CM.setRotation(tf::Quaternion(state.qCM(camID).x(),state.qCM(camID).y(),state.qCM(camID).z(),-state.qCM(camID).w()));
-          tb_.sendTransform(tf_transform_CM);
-        }
+    Eigen::Quaterniond current_quat(relativeMotionOutput_.qBW().w(), relativeMotionOutput_.qBW().x(), relativeMotionOutput_.qBW().y(), relativeMotionOutput_.qBW().z());
+    
+    current_pose_.block<3,3>(0,0) = current_quat.toRotationMatrix();
+    current_pose_.block<3,1>(0,3) = relativeMotionOutput_.WrWB();
 
-        tf::Transform tf_transform_CM0;
-        int camID = 0;
-        tf_transform_CM0.setOrigin(tf::Vector3(state.MrMC(camID)(0),state.MrMC(camID)(1),state.MrMC(camID)(2)));
-        tf_transform_CM0.setRotation(tf::Quaternion(state.qCM(camID).x(),state.qCM(camID).y(),state.qCM(camID).z(),-state.qCM(camID).w()));
+    Eigen::Quaterniond camera_rot(tf_transform_CM0.getRotation().w(), tf_transform_CM0.getRotation().x(), tf_transform_CM0.getRotation().y(), tf_transform_CM0.getRotation().z());
+    camera_imu_tf.block<3,3>(0,0) = camera_rot.toRotationMatrix();
+    camera_imu_tf.block<3,1>(0,3) = Eigen::Vector3d(tf_transform_CM0.getOrigin().x(), tf_transform_CM0.getOrigin().y(), tf_transform_CM0.getOrigin().z());
 
-        // Get relative pose betwwen last and current camera frame
+    Eigen::Matrix4d camera_current_tf = current_pose_*camera_imu_tf;
+    Eigen::Matrix4d camera_previous_tf = previous_pose_*camera_imu_tf;
+    Eigen::Matrix4d relative_pose_ = camera_previous_tf.inverse() * camera_current_tf;
 
-        Eigen::Matrix4d camera_imu_tf = Eigen::Matrix4d::Identity();
+    mpImgUpdate_->relativeCameraMotion_ = relative_pose_;
 
-        Eigen::Quaterniond current_quat(imuOutput_.qBW().w(), imuOutput_.qBW().x(), imuOutput_.qBW().y(), imuOutput_.qBW().z());
-        
-        current_pose_.block<3,3>(0,0) = current_quat.toRotationMatrix();
-        current_pose_.block<3,1>(0,3) = imuOutput_.WrWB();
 
-        Eigen::Quaterniond camera_rot(tf_transform_CM0.getRotation().w(), tf_transform_CM0.getRotation().x(), tf_transform_CM0.getRotation().y(), tf_transform_CM0.getRotation().z());
-        camera_imu_tf.block<3,3>(0,0) = camera_rot.toRotationMatrix();
-        camera_imu_tf.block<3,1>(0,3) = Eigen::Vector3d(tf_transform_CM0.getOrigin().x(), tf_transform_CM0.getOrigin().y(), tf_transform_CM0.getOrigin().z());
+    // std::cout << "Relative Pose: " << std::endl << relative_pose_ << std::endl;
 
-        Eigen::Matrix4d camera_current_tf = current_pose_*camera_imu_tf;
-        Eigen::Matrix4d camera_previous_tf = previous_pose_*camera_imu_tf;
-        Eigen::Matrix4d relative_pose_ = camera_previous_tf.inverse() * camera_current_tf;
+    previous_pose_ = current_pose_;
 
-        mpImgUpdate_->relativeCameraMotion_ = relative_pose_;
+  }
 
+  /** \brief Copies the safe filter state and the camera calibration into the free buffer of the publisher and wakes it up.
+   *
+   *   Called from the filter thread (m_filter_ locked). The buffer currently being published is never written, an
+   *   unpublished older snapshot is overwritten (only the latest state gets published). Thanks to the shared image
+   *   pyramids and images the copy does not copy any pixel data.
+   */
+  void handOffSnapshot(){
+    {
+      std::lock_guard<std::mutex> lock(m_publish_);
+      const int w = publishingSnapshot_ == 0 ? 1 : 0;
+      snapshots_[w].filterState_ = mpFilter_->safe_;
+      snapshots_[w].multiCamera_ = mpFilter_->multiCamera_;
+      snapshots_[w].filterState_.setCamera(&snapshots_[w].multiCamera_);
+      readySnapshot_ = w;
+    }
+    cv_publish_.notify_one();
+  }
 
-        // std::cout << "Relative Pose: " << std::endl << relative_pose_ << std::endl;
+  /** \brief Publisher thread, publishes the latest snapshot handed off by \ref handOffSnapshot.
+   */
+  void publisherLoop(){
+    while(true){
+      {
+        std::unique_lock<std::mutex> lock(m_publish_);
+        cv_publish_.wait(lock,[this]{return stopPublisher_ || readySnapshot_ >= 0;});
+        if(stopPublisher_) return;
+        publishingSnapshot_ = readySnapshot_;
+        readySnapshot_ = -1;
+      }
+      publishSnapshot(snapshots_[publishingSnapshot_].filterState_,snapshots_[publishingSnapshot_].multiCamera_);
+      std::lock_guard<std::mutex> lock(m_publish_);
+      publishingSnapshot_ = -1;
+    }
+  }
 
-        previous_pose_ = current_pose_;
+  /** \brief Captures a checkpoint of the safe state for the checkpoint thread (m_filter_ locked).
+   */
+  void handOffCheckpoint(){
+    {
+      std::lock_guard<std::mutex> lock(m_checkpoint_);
+      const int w = writingCheckpoint_ == 0 ? 1 : 0;
+      checkpoints_[w].capture(mpFilter_->safe_);
+      readyCheckpoint_ = w;
+    }
+    lastCheckpointTime_ = mpFilter_->safe_.t_;
+    cv_checkpoint_.notify_one();
+  }
 
-        // Publish Odometry
-        if(pubOdometry_.getNumSubscribers() > 0 || forceOdometryPublishing_){
-          // Compute covariance of output
-          imuOutputCT_.transformCovMat(state,cov,imuOutputCov_);
+  /** \brief Checkpoint thread, writes the latest checkpoint handed off by \ref handOffCheckpoint to \ref checkpointFile_.
+   */
+  void checkpointLoop(){
+    while(true){
+      {
+        std::unique_lock<std::mutex> lock(m_checkpoint_);
+        cv_checkpoint_.wait(lock,[this]{return stopCheckpointWriter_ || readyCheckpoint_ >= 0;});
+        if(stopCheckpointWriter_) return;
+        writingCheckpoint_ = readyCheckpoint_;
+        readyCheckpoint_ = -1;
+      }
+      if(!checkpoints_[writingCheckpoint_].save(checkpointFile_)){
+        ROS_WARN_THROTTLE(60.0, "ROVIO - Could not write the checkpoint %s", checkpointFile_.c_str());
+      }
+      std::lock_guard<std::mutex> lock(m_checkpoint_);
+      writingCheckpoint_ = -1;
+    }
+  }
 
-          odometryMsg_.header.seq = msgSeq_;
-          odometryMsg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-          odometryMsg_.pose.pose.position.x = imuOutput_.WrWB()(0);
-          odometryMsg_.pose.pose.position.y = imuOutput_.WrWB()(1);
-          odometryMsg_.pose.pose.position.z = imuOutput_.WrWB()(2);
-          odometryMsg_.pose.pose.orientation.w = -imuOutput_.qBW().w();
-          odometryMsg_.pose.pose.orientation.x = imuOutput_.qBW().x();
-          odometryMsg_.pose.pose.orientation.y = imuOutput_.qBW().y();
-          odometryMsg_.pose.pose.orientation.z = imuOutput_.qBW().z();
-          for(unsigned int i=0;i<6;i++){
-            unsigned int ind1 = mtOutput::template getId<mtOutput::_pos>()+i;
-            if(i>=3) ind1 = mtOutput::template getId<mtOutput::_att>()+i-3;
-            for(unsigned int j=0;j<6;j++){
-              unsigned int ind2 = mtOutput::template getId<mtOutput::_pos>()+j;
-              if(j>=3) ind2 = mtOutput::template getId<mtOutput::_att>()+j-3;
-              odometryMsg_.pose.covariance[j+6*i] = imuOutputCov_(ind1,ind2);
-            }
-          }
-          odometryMsg_.twist.twist.linear.x = imuOutput_.BvB()(0);
-          odometryMsg_.twist.twist.linear.y = imuOutput_.BvB()(1);
-          odometryMsg_.twist.twist.linear.z = imuOutput_.BvB()(2);
-          odometryMsg_.twist.twist.angular.x = imuOutput_.BwWB()(0);
-          odometryMsg_.twist.twist.angular.y = imuOutput_.BwWB()(1);
-          odometryMsg_.twist.twist.angular.z = imuOutput_.BwWB()(2);
-          for(unsigned int i=0;i<6;i++){
-            unsigned int ind1 = mtOutput::template getId<mtOutput::_vel>()+i;
-            if(i>=3) ind1 = mtOutput::template getId<mtOutput::_ror>()+i-3;
-            for(unsigned int j=0;j<6;j++){
-              unsigned int ind2 = mtOutput::template getId<mtOutput::_vel>()+j;
-              if(j>=3) ind2 = mtOutput::template getId<mtOutput::_ror>()+j-3;
-              odometryMsg_.twist.covariance[j+6*i] = imuOutputCov_(ind1,ind2);
-            }
-          }
-          pubOdometry_.publish(odometryMsg_);
+  /** \brief Converts a float to IEEE 754 half precision (round to nearest, saturates to infinity).
+   *
+   *   @param value - Value.
+   *   @return bit pattern of the half precision value.
+   */
+  static uint16_t toHalfPrecision(const float value){
+    uint32_t x;
+    memcpy(&x,&value,sizeof(float));
+    const uint16_t sign = (x >> 16) & 0x8000;
+    const uint32_t biasedExponent = (x >> 23) & 0xff;
+    uint32_t mantissa = x & 0x7fffff;
+    if(biasedExponent == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0); // Inf and NaN
+    const int exponent = (int)(biasedExponent) - 127 + 15;
+    if(exponent >= 31) return sign | 0x7c00;
+    if(exponent <= 0){ // Subnormal
+      if(exponent < -10) return sign;
+      mantissa |= 0x800000;
+      const int shift = 14 - exponent;
+      return sign | ((mantissa >> shift) + ((mantissa >> (shift-1)) & 1));
+    }
+    return sign | (((exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1)); // A rounding carry correctly moves into the exponent
+  }
 
-        }
+  /** \brief Writes a covariance entry of the delta point cloud (float or half precision).
+   */
+  void writeDeltaPclCovariance(uint8_t* data, const float value) const{
+    if(deltaPclHalfPrecision_){
+      const uint16_t half = toHalfPrecision(value);
+      memcpy(data,&half,sizeof(uint16_t));
+    } else {
+      memcpy(data,&value,sizeof(float));
+    }
+  }
 
-        if(pubPoseWithCovStamped_.getNumSubscribers() > 0 || forcePoseWithCovariancePublishing_){
-          // Compute covariance of output
-          imuOutputCT_.transformCovMat(state,cov,imuOutputCov_);
-
-          estimatedPoseWithCovarianceStampedMsg_.header.seq = msgSeq_;
-          estimatedPoseWithCovarianceStampedMsg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-          estimatedPoseWithCovarianceStampedMsg_.pose.pose.position.x = imuOutput_.WrWB()(0);
-          estimatedPoseWithCovarianceStampedMsg_.pose.pose.position.y = imuOutput_.WrWB()(1);
-          estimatedPoseWithCovarianceStampedMsg_.pose.pose.position.z = imuOutput_.WrWB()(2);
-          estimatedPoseWithCovarianceStampedMsg_.pose.pose.orientation.w = -imuOutput_.qBW().w();
-          estimatedPoseWithCovarianceStampedMsg_.pose.pose.orientation.x = imuOutput_.qBW().x();
-          estimatedPoseWithCovarianceStampedMsg_.pose.pose.orientation.y = imuOutput_.qBW().y();
-          estimatedPoseWithCovarianceStampedMsg_.pose.pose.orientation.z = imuOutput_.qBW().z();
-
-          for(unsigned int i=0;i<6;i++){
-            unsigned int ind1 = mtOutput::template getId<mtOutput::_pos>()+i;
-            if(i>=3) ind1 = mtOutput::template getId<mtOutput::_att>()+i-3;
-            for(unsigned int j=0;j<6;j++){
-              unsigned int ind2 = mtOutput::template getId<mtOutput::_pos>()+j;
-              if(j>=3) ind2 = mtOutput::template getId<mtOutput::_att>()+j-3;
-              estimatedPoseWithCovarianceStampedMsg_.pose.covariance[j+6*i] = imuOutputCov_(ind1,ind2);
-            }
+  /** \brief Publishes the landmarks which changed since they were last sent (rovio/pcl_delta).
+   *
+   *  The landmarks are keyed by their feature id. A landmark is sent if it is new, if its tracking status changed, if it
+   *  moved by more than \ref deltaPclPositionThreshold_ or if its distance covariance changed by more than
+   *  \ref deltaPclCovarianceThreshold_ (relative). Removed landmarks are sent with the DELTA_PCL_REMOVED flag. Every
+   *  \ref deltaPclKeyframePeriod_ messages all landmarks are sent with the DELTA_PCL_KEYFRAME flag, such that receivers
+   *  can (re-)synchronize. Compared to rovio/pcl the fields are the same except for rgb and the additional flags
+   *  (packed, without padding), the covariances are optionally encoded as half precision floats.
+   *
+   *   @param t - Time of the landmarks.
+   */
+  void publishDeltaPcl(const double t){
+    const bool isKeyframe = deltaPclKeyframePeriod_ <= 1 || deltaPclCounter_ % deltaPclKeyframePeriod_ == 0;
+    deltaPclMsg_.header.seq = msgSeq_;
+    deltaPclMsg_.header.stamp = ros::Time(t);
+    deltaPclMsg_.data.resize(2*mtState::nMax_*deltaPclMsg_.point_step);
+    int count = 0;
+    auto writePoint = [&](const DeltaPclPoint& point, const uint8_t flags){
+      uint8_t* data = &deltaPclMsg_.data[count*deltaPclMsg_.point_step];
+      const std::vector<sensor_msgs::PointField>& fields = deltaPclMsg_.fields;
+      memcpy(data + fields[0].offset, &point.idx_, sizeof(int));
+      memcpy(data + fields[1].offset, &point.camID_, 1);
+      memcpy(data + fields[2].offset, &point.status_, 1);
+      memcpy(data + fields[3].offset, &flags, 1);
+      if(flags != DELTA_PCL_REMOVED){
+        memcpy(data + fields[4].offset, &point.MrMP_[0], 3*sizeof(float));
+        memcpy(data + fields[7].offset, &point.bearing_[0], 3*sizeof(float));
+        memcpy(data + fields[10].offset, &point.distance_, sizeof(float));
+        int f = 11;
+        for(int row=0;row<3;row++){
+          for(int col=row;col<3;col++){
+            writeDeltaPclCovariance(data + fields[f++].offset, point.cov_(row,col));
           }
+        }
+        writeDeltaPclCovariance(data + fields[f].offset, point.distanceCov_);
+      } else {
+        memset(data + fields[4].offset, 0, deltaPclMsg_.point_step - fields[4].offset);
+      }
+      count++;
+    };
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      const DeltaPclPoint& current = currentPclPoints_[i];
+      const DeltaPclPoint& published = publishedPclPoints_[i];
+      const bool isReplaced = isPublishedPclPointValid_[i] && (!isCurrentPclPointValid_[i] || published.idx_ != current.idx_);
+      if(isReplaced && !isKeyframe){
+        writePoint(published,DELTA_PCL_REMOVED);
+      }
+      if(!isCurrentPclPointValid_[i]){
+        isPublishedPclPointValid_[i] = false;
+        continue;
+      }
+      const bool isChanged = !isPublishedPclPointValid_[i] || isReplaced || published.status_ != current.status_
+          || (published.MrMP_-current.MrMP_).norm() > deltaPclPositionThreshold_
+          || std::fabs(published.distanceCov_-current.distanceCov_) > deltaPclCovarianceThreshold_*published.distanceCov_;
+      if(isKeyframe || isChanged){
+        writePoint(current,isKeyframe ? DELTA_PCL_KEYFRAME : DELTA_PCL_UPDATE);
+        publishedPclPoints_[i] = current;
+        isPublishedPclPointValid_[i] = true;
+      }
+    }
+    deltaPclCounter_++;
+    if(count == 0) return;
+    deltaPclMsg_.width = count;
+    deltaPclMsg_.row_step = deltaPclMsg_.point_step*count;
+    deltaPclMsg_.data.resize(deltaPclMsg_.row_step);
+    pubPclDelta_.publish(deltaPclMsg_);
+  }
 
-          pubPoseWithCovStamped_.publish(estimatedPoseWithCovarianceStampedMsg_);
+  /** \brief Builds and publishes all messages (and visualizations) of a filter state.
+   *
+   *   Runs either on the filter thread (synchronous) or on the publisher thread on a snapshot (\ref asyncPublishing_).
+   *   Messages are only built for topics with subscribers or if the publishing is forced.
+   *
+   *   @param filterState - Filter state to be published.
+   *   @param multiCamera - Camera calibration belonging to the filter state.
+   */
+  void publishSnapshot(mtFilterState& filterState, MultiCamera<mtState::nCam_>& multiCamera){
+    ROVIO_PROFILE_SCOPE("publishing");
+    // The overlays recorded during the image update are only rendered here, if the frames are shown or subscribed
+    bool isFrameRendered[mtState::nCam_];
+    for(int i=0;i<mtState::nCam_;i++){
+      const bool isFrameRequested = mpImgUpdate_->doFrameVisualisation_ || pubImg_.getNumSubscribers() > 0
+          || (pubFrames_[i].getNumSubscribers() > 0 && mpImgUpdate_->publishFrames_);
+      isFrameRendered[i] = isFrameRequested && filterState.renderFrame(i);
+    }
+    for(int i=0;i<mtState::nCam_;i++){
+      if(isFrameRendered[i] && mpImgUpdate_->doFrameVisualisation_){
+        cv::imshow("Tracker" + std::to_string(i), filterState.img_[i]);
+        cv::waitKey(3);
+      }
+      //Custom message for publishing the tracked features
+      if (isFrameRendered[i] && pubFrames_[i].getNumSubscribers() > 0 && mpImgUpdate_->publishFrames_){
+      //   // // patchesMsg_ = cv_bridge::CvImage(filterState.patchDrawing_).toImageMsg();
+        std_msgs::Header header;
+        header.stamp = ros::Time(filterState.t_);
+        header.frame_id = camera_frame_ + std::to_string(i);
+        sensor_msgs::ImagePtr frameMsg_ = cv_bridge::CvImage(std_msgs::Header(), "bgr8", filterState.img_[i]).toImageMsg();
+
+        pubFrames_[i].publish(frameMsg_);
+      }
 
-        }
+    }
+    if(!filterState.patchDrawing_.empty() && mpImgUpdate_->visualizePatches_){
+      cv::imshow("Patches", filterState.patchDrawing_);
+      cv::imshow("PatchesClean", filterState.patchDrawingClean_);
+      cv::waitKey(3);
 
-        // Send IMU pose message.
-        if(pubTransform_.getNumSubscribers() > 0 || forceTransformPublishing_){
-          transformMsg_.header.seq = msgSeq_;
-          transformMsg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-          transformMsg_.transform.translation.x = imuOutput_.WrWB()(0);
-          transformMsg_.transform.translation.y = imuOutput_.WrWB()(1);
-          transformMsg_.transform.translation.z = imuOutput_.WrWB()(2);
-          transformMsg_.transform.rotation.x = imuOutput_.qBW().x();
-          transformMsg_.transform.rotation.y = imuOutput_.qBW().y();
-          transformMsg_.transform.rotation.z = imuOutput_.qBW().z();
-          transformMsg_.transform.rotation.w = -imuOutput_.qBW().w();
-          pubTransform_.publish(transformMsg_);
+      sensor_msgs::ImagePtr PatchImgMsg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", filterState.patchDrawingClean_).toImageMsg();
+      pubPatchImg_.publish(PatchImgMsg);
+    }
+
+    if(pubImg_.getNumSubscribers() > 0){
+      for(int i=0;i<mtState::nCam_;i++){
+        if(!isFrameRendered[i]) continue;
+        sensor_msgs::ImagePtr ImgMsg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", filterState.img_[i]).toImageMsg();
+        pubImg_.publish(ImgMsg);
+      }
+    }
+
+    mtState& state = filterState.state_;
+    state.updateMultiCameraExtrinsics(&multiCamera);
+    state.updateRefIndex(&multiCamera,mpImgUpdate_->refIndexUpdateEpsilon_);  // Updates the refractive index to be use by functions in camera class, eg pixelToBearing()
+    transformFeatureOutputCT_.mpMultiCamera_ = &multiCamera;
+    landmarkOutputImuCT_.mpMultiCamera_ = &multiCamera;
+
+    MXD& cov = filterState.cov_;
+    imuOutputCT_.transformState(state,imuOutput_);
+
+    // Cout verbose for pose measurements
+    if(mpImgUpdate_->verbose_){
+      if(mpPoseUpdate_->inertialPoseIndex_ >=0){
+        std::cout << "Transformation between inertial frames, IrIW, qWI: " << std::endl;
+        std::cout << "  " << state.poseLin(mpPoseUpdate_->inertialPoseIndex_).transpose() << std::endl;
+        std::cout << "  " << state.poseRot(mpPoseUpdate_->inertialPoseIndex_) << std::endl;
+      }
+      if(mpPoseUpdate_->bodyPoseIndex_ >=0){
+        std::cout << "Transformation between body frames, MrMV, qVM: " << std::endl;
+        std::cout << "  " << state.poseLin(mpPoseUpdate_->bodyPoseIndex_).transpose() << std::endl;
+        std::cout << "  " << state.poseRot(mpPoseUpdate_->bodyPoseIndex_) << std::endl;
+      }
+    }
+
+    // Send Map (Pose Sensor, I) to World (rovio-intern, W) transformation
+    if(mpPoseUpdate_->inertialPoseIndex_ >=0){
+      Eigen::Vector3d IrIW = state.poseLin(mpPoseUpdate_->inertialPoseIndex_);
+      QPD qWI = state.poseRot(mpPoseUpdate_->inertialPoseIndex_);
+      tf::StampedTransform tf_transform_WI;
+      tf_transform_WI.frame_id_ = map_frame_;
+      tf_transform_WI.child_frame_id_ = world_frame_;
+      tf_transform_WI.stamp_ = ros::Time(filterState.t_);
+      tf_transform_WI.setOrigin(tf::Vector3(IrIW(0),IrIW(1),IrIW(2)));
+      tf_transform_WI.setRotation(tf::Quaternion(qWI.x(),qWI.y(),qWI.z(),-qWI.w()));
+      tb_.sendTransform(tf_transform_WI);
+    }
+
+    // Send IMU pose.
+    tf::StampedTransform tf_transform_MW;
+    tf_transform_MW.frame_id_ = world_frame_;
+    tf_transform_MW.child_frame_id_ = imu_frame_;
+    tf_transform_MW.stamp_ = ros::Time(filterState.t_);
+    tf_transform_MW.setOrigin(tf::Vector3(imuOutput_.WrWB()(0),imuOutput_.WrWB()(1),imuOutput_.WrWB()(2)));
+    tf_transform_MW.setRotation(tf::Quaternion(imuOutput_.qBW().x(),imuOutput_.qBW().y(),imuOutput_.qBW().z(),-imuOutput_.qBW().w()));
+    tb_.sendTransform(tf_transform_MW);
+
+    // Send camera pose.
+    for(int camID=0;camID<mtState::nCam_;camID++){
+      tf::StampedTransform tf_transform_CM;
+      tf_transform_CM.frame_id_ = imu_frame_;
+      tf_transform_CM.child_frame_id_ = camera_frame_ + std::to_string(camID);
+      tf_transform_CM.stamp_ = ros::Time(filterState.t_);
+      tf_transform_CM.setOrigin(tf::Vector3(state.MrMC(camID)(0),state.MrMC(camID)(1),state.MrMC(camID)(2)));
+      tf_transform_CM.setRotation(tf::Quaternion(state.qCM(camID).x(),state.qCM(camID).y(),state.qCM(camID).z(),-state.qCM(camID).w()));
+      tb_.sendTransform(tf_transform_CM);
+    }
+
+    // Publish Odometry
+    if(pubOdometry_.getNumSubscribers() > 0 || forceOdometryPublishing_){
+      // Compute covariance of output
+      imuOutputCT_.transformCovMat(state,cov,imuOutputCov_);
+
+      odometryMsg_.header.seq = msgSeq_;
+      odometryMsg_.header.stamp = ros::Time(filterState.t_);
+      odometryMsg_.pose.pose.position.x = imuOutput_.WrWB()(0);
+      odometryMsg_.pose.pose.position.y = imuOutput_.WrWB()(1);
+      odometryMsg_.pose.pose.position.z = imuOutput_.WrWB()(2);
+      odometryMsg_.pose.pose.orientation.w = -imuOutput_.qBW().w();
+      odometryMsg_.pose.pose.orientation.x = imuOutput_.qBW().x();
+      odometryMsg_.pose.pose.orientation.y = imuOutput_.qBW().y();
+      odometryMsg_.pose.pose.orientation.z = imuOutput_.qBW().z();
+      for(unsigned int i=0;i<6;i++){
+        unsigned int ind1 = mtOutput::template getId<mtOutput::_pos>()+i;
+        if(i>=3) ind1 = mtOutput::template getId<mtOutput::_att>()+i-3;
+        for(unsigned int j=0;j<6;j++){
+          unsigned int ind2 = mtOutput::template getId<mtOutput::_pos>()+j;
+          if(j>=3) ind2 = mtOutput::template getId<mtOutput::_att>()+j-3;
+          odometryMsg_.pose.covariance[j+6*i] = imuOutputCov_(ind1,ind2);
+        }
+      }
+      odometryMsg_.twist.twist.linear.x = imuOutput_.BvB()(0);
+      odometryMsg_.twist.twist.linear.y = imuOutput_.BvB()(1);
+      odometryMsg_.twist.twist.linear.z = imuOutput_.BvB()(2);
+      odometryMsg_.twist.twist.angular.x = imuOutput_.BwWB()(0);
+      odometryMsg_.twist.twist.angular.y = imuOutput_.BwWB()(1);
+      odometryMsg_.twist.twist.angular.z = imuOutput_.BwWB()(2);
+      for(unsigned int i=0;i<6;i++){
+        unsigned int ind1 = mtOutput::template getId<mtOutput::_vel>()+i;
+        if(i>=3) ind1 = mtOutput::template getId<mtOutput::_ror>()+i-3;
+        for(unsigned int j=0;j<6;j++){
+          unsigned int ind2 = mtOutput::template getId<mtOutput::_vel>()+j;
+          if(j>=3) ind2 = mtOutput::template getId<mtOutput::_ror>()+j-3;
+          odometryMsg_.twist.covariance[j+6*i] = imuOutputCov_(ind1,ind2);
         }
+      }
+      pubOdometry_.publish(odometryMsg_);
 
-        // Publish Refractive Index
-        if(pubRefractiveIndex_.getNumSubscribers() > 0){
-          refractiveIndexMsg_.header.seq = msgSeq_;
-          refractiveIndexMsg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-          refractiveIndexMsg_.point.x = imuOutput_.ref();
-          refractiveIndexMsg_.point.z = 1.33;
-          pubRefractiveIndex_.publish(refractiveIndexMsg_);
+    }
+
+    if(pubPoseWithCovStamped_.getNumSubscribers() > 0 || forcePoseWithCovariancePublishing_){
+      // Compute covariance of output
+      imuOutputCT_.transformCovMat(state,cov,imuOutputCov_);
+
+      estimatedPoseWithCovarianceStampedMsg_.header.seq = msgSeq_;
+      estimatedPoseWithCovarianceStampedMsg_.header.stamp = ros::Time(filterState.t_);
+      estimatedPoseWithCovarianceStampedMsg_.pose.pose.position.x = imuOutput_.WrWB()(0);
+      estimatedPoseWithCovarianceStampedMsg_.pose.pose.position.y = imuOutput_.WrWB()(1);
+      estimatedPoseWithCovarianceStampedMsg_.pose.pose.position.z = imuOutput_.WrWB()(2);
+      estimatedPoseWithCovarianceStampedMsg_.pose.pose.orientation.w = -imuOutput_.qBW().w();
+      estimatedPoseWithCovarianceStampedMsg_.pose.pose.orientation.x = imuOutput_.qBW().x();
+      estimatedPoseWithCovarianceStampedMsg_.pose.pose.orientation.y = imuOutput_.qBW().y();
+      estimatedPoseWithCovarianceStampedMsg_.pose.pose.orientation.z = imuOutput_.qBW().z();
+
+      for(unsigned int i=0;i<6;i++){
+        unsigned int ind1 = mtOutput::template getId<mtOutput::_pos>()+i;
+        if(i>=3) ind1 = mtOutput::template getId<mtOutput::_att>()+i-3;
+        for(unsigned int j=0;j<6;j++){
+          unsigned int ind2 = mtOutput::template getId<mtOutput::_pos>()+j;
+          if(j>=3) ind2 = mtOutput::template getId<mtOutput::_att>()+j-3;
+          estimatedPoseWithCovarianceStampedMsg_.pose.covariance[j+6*i] = imuOutputCov_(ind1,ind2);
         }
+      }
 
-        if(pub_T_J_W_transform.getNumSubscribers() > 0 || forceTransformPublishing_){
-          if (mpPoseUpdate_->inertialPoseIndex_ >= 0) {
-            Eigen::Vector3d IrIW = state.poseLin(mpPoseUpdate_->inertialPoseIndex_);
-            QPD qWI = state.poseRot(mpPoseUpdate_->inertialPoseIndex_);
-            T_J_W_Msg_.header.seq = msgSeq_;
-            T_J_W_Msg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-            T_J_W_Msg_.transform.translation.x = IrIW(0);
-            T_J_W_Msg_.transform.translation.y = IrIW(1);
-            T_J_W_Msg_.transform.translation.z = IrIW(2);
-            T_J_W_Msg_.transform.rotation.x = qWI.x();
-            T_J_W_Msg_.transform.rotation.y = qWI.y();
-            T_J_W_Msg_.transform.rotation.z = qWI.z();
-            T_J_W_Msg_.transform.rotation.w = -qWI.w();
-            pub_T_J_W_transform.publish(T_J_W_Msg_);
+      pubPoseWithCovStamped_.publish(estimatedPoseWithCovarianceStampedMsg_);
+
+    }
+
+    // Send IMU pose message.
+    if(pubTransform_.getNumSubscribers() > 0 || forceTransformPublishing_){
+      transformMsg_.header.seq = msgSeq_;
+      transformMsg_.header.stamp = ros::Time(filterState.t_);
+      transformMsg_.transform.translation.x = imuOutput_.WrWB()(0);
+      transformMsg_.transform.translation.y = imuOutput_.WrWB()(1);
+      transformMsg_.transform.translation.z = imuOutput_.WrWB()(2);
+      transformMsg_.transform.rotation.x = imuOutput_.qBW().x();
+      transformMsg_.transform.rotation.y = imuOutput_.qBW().y();
+      transformMsg_.transform.rotation.z = imuOutput_.qBW().z();
+      transformMsg_.transform.rotation.w = -imuOutput_.qBW().w();
+      pubTransform_.publish(transformMsg_);
+    }
+
+    // Publish Refractive Index
+    if(pubRefractiveIndex_.getNumSubscribers() > 0){
+      refractiveIndexMsg_.header.seq = msgSeq_;
+      refractiveIndexMsg_.header.stamp = ros::Time(filterState.t_);
+      refractiveIndexMsg_.point.x = imuOutput_.ref();
+      refractiveIndexMsg_.point.z = 1.33;
+      pubRefractiveIndex_.publish(refractiveIndexMsg_);
+    }
+
+    if(pub_T_J_W_transform.getNumSubscribers() > 0 || forceTransformPublishing_){
+      if (mpPoseUpdate_->inertialPoseIndex_ >= 0) {
+        Eigen::Vector3d IrIW = state.poseLin(mpPoseUpdate_->inertialPoseIndex_);
+        QPD qWI = state.poseRot(mpPoseUpdate_->inertialPoseIndex_);
+        T_J_W_Msg_.header.seq = msgSeq_;
+        T_J_W_Msg_.header.stamp = ros::Time(filterState.t_);
+        T_J_W_Msg_.transform.translation.x = IrIW(0);
+        T_J_W_Msg_.transform.translation.y = IrIW(1);
+        T_J_W_Msg_.transform.translation.z = IrIW(2);
+        T_J_W_Msg_.transform.rotation.x = qWI.x();
+        T_J_W_Msg_.transform.rotation.y = qWI.y();
+        T_J_W_Msg_.transform.rotation.z = qWI.z();
+        T_J_W_Msg_.transform.rotation.w = -qWI.w();
+        pub_T_J_W_transform.publish(T_J_W_Msg_);
+      }
+    }
+
+    // Publish Extrinsics
+    for(int camID=0;camID<mtState::nCam_;camID++){
+      if(pubExtrinsics_[camID].getNumSubscribers() > 0 || forceExtrinsicsPublishing_){
+        extrinsicsMsg_[camID].header.seq = msgSeq_;
+        extrinsicsMsg_[camID].header.stamp = ros::Time(filterState.t_);
+        extrinsicsMsg_[camID].pose.pose.position.x = state.MrMC(camID)(0);
+        extrinsicsMsg_[camID].pose.pose.position.y = state.MrMC(camID)(1);
+        extrinsicsMsg_[camID].pose.pose.position.z = state.MrMC(camID)(2);
+        extrinsicsMsg_[camID].pose.pose.orientation.x = state.qCM(camID).x();
+        extrinsicsMsg_[camID].pose.pose.orientation.y = state.qCM(camID).y();
+        extrinsicsMsg_[camID].pose.pose.orientation.z = state.qCM(camID).z();
+        extrinsicsMsg_[camID].pose.pose.orientation.w = -state.qCM(camID).w();
+        for(unsigned int i=0;i<6;i++){
+          unsigned int ind1 = mtState::template getId<mtState::_vep>(camID)+i;
+          if(i>=3) ind1 = mtState::template getId<mtState::_vea>(camID)+i-3;
+          for(unsigned int j=0;j<6;j++){
+            unsigned int ind2 = mtState::template getId<mtState::_vep>(camID)+j;
+            if(j>=3) ind2 = mtState::template getId<mtState::_vea>(camID)+j-3;
+            extrinsicsMsg_[camID].pose.covariance[j+6*i] = cov(ind1,ind2);
           }
         }
+        pubExtrinsics_[camID].publish(extrinsicsMsg_[camID]);
+      }
+    }
 
-        // Publish Extrinsics
-        for(int camID=0;camID<mtState::nCam_;camID++){
-          if(pubExtrinsics_[camID].getNumSubscribers() > 0 || forceExtrinsicsPublishing_){
-            extrinsicsMsg_[camID].header.seq = msgSeq_;
-            extrinsicsMsg_[camID].header.stamp = ros::Time(mpFilter_->safe_.t_);
-            extrinsicsMsg_[camID].pose.pose.position.x = state.MrMC(camID)(0);
-            extrinsicsMsg_[camID].pose.pose.position.y = state.MrMC(camID)(1);
-            extrinsicsMsg_[camID].pose.pose.position.z = state.MrMC(camID)(2);
-            extrinsicsMsg_[camID].pose.pose.orientation.x = state.qCM(camID).x();
-            extrinsicsMsg_[camID].pose.pose.orientation.y = state.qCM(camID).y();
-            extrinsicsMsg_[camID].pose.pose.orientation.z = state.qCM(camID).z();
-            extrinsicsMsg_[camID].pose.pose.orientation.w = -state.qCM(camID).w();
-            for(unsigned int i=0;i<6;i++){
-              unsigned int ind1 = mtState::template getId<mtState::_vep>(camID)+i;
-              if(i>=3) ind1 = mtState::template getId<mtState::_vea>(camID)+i-3;
-              for(unsigned int j=0;j<6;j++){
-                unsigned int ind2 = mtState::template getId<mtState::_vep>(camID)+j;
-                if(j>=3) ind2 = mtState::template getId<mtState::_vea>(camID)+j-3;
-                extrinsicsMsg_[camID].pose.covariance[j+6*i] = cov(ind1,ind2);
-              }
-            }
-            pubExtrinsics_[camID].publish(extrinsicsMsg_[camID]);
-          }
+    // Publish IMU biases
+    if(pubImuBias_.getNumSubscribers() > 0 || forceImuBiasPublishing_){
+      imuBiasMsg_.header.seq = msgSeq_;
+      imuBiasMsg_.header.stamp = ros::Time(filterState.t_);
+      imuBiasMsg_.angular_velocity.x = state.gyb()(0);
+      imuBiasMsg_.angular_velocity.y = state.gyb()(1);
+      imuBiasMsg_.angular_velocity.z = state.gyb()(2);
+      imuBiasMsg_.linear_acceleration.x = state.acb()(0);
+      imuBiasMsg_.linear_acceleration.y = state.acb()(1);
+      imuBiasMsg_.linear_acceleration.z = state.acb()(2);
+      for(int i=0;i<3;i++){
+        for(int j=0;j<3;j++){
+          imuBiasMsg_.angular_velocity_covariance[3*i+j] = cov(mtState::template getId<mtState::_gyb>()+i,mtState::template getId<mtState::_gyb>()+j);
+        }
+      }
+      for(int i=0;i<3;i++){
+        for(int j=0;j<3;j++){
+          imuBiasMsg_.linear_acceleration_covariance[3*i+j] = cov(mtState::template getId<mtState::_acb>()+i,mtState::template getId<mtState::_acb>()+j);
         }
+      }
+      pubImuBias_.publish(imuBiasMsg_);
+    }
+    
+    std::vector<float> featureDistanceCov;
+    int offset = 0;
+    
+    // Publish featureids and uncertainity
+    if(pubFeatureIds.getNumSubscribers() > 0 || pubBadFeatureIds.getNumSubscribers() > 0){
+      featureIdsMsgs_.header.seq = msgSeq_;
+      featureIdsMsgs_.header.stamp = ros::Time(filterState.t_);
+      featureIdsMsgs_.points.clear();
 
-        // Publish IMU biases
-        if(pubImuBias_.getNumSubscribers() > 0 || forceImuBiasPublishing_){
-          imuBiasMsg_.header.seq = msgSeq_;
-          imuBiasMsg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-          imuBiasMsg_.angular_velocity.x = state.gyb()(0);
-          imuBiasMsg_.angular_velocity.y = state.gyb()(1);
-          imuBiasMsg_.angular_velocity.z = state.gyb()(2);
-          imuBiasMsg_.linear_acceleration.x = state.acb()(0);
-          imuBiasMsg_.linear_acceleration.y = state.acb()(1);
-          imuBiasMsg_.linear_acceleration.z = state.acb()(2);
-          for(int i=0;i<3;i++){
-            for(int j=0;j<3;j++){
-              imuBiasMsg_.angular_velocity_covariance[3*i+j] = cov(mtState::template getId<mtState::_gyb>()+i,mtState::template getId<mtState::_gyb>()+j);
-            }
+      badFeatureIdsMsgs_.header.seq = msgSeq_;
+      badFeatureIdsMsgs_.header.stamp = ros::Time(filterState.t_);
+      badFeatureIdsMsgs_.points.clear();
+
+      for (unsigned int i=0;i<mtState::nMax_; i++) {
+          if(filterState.fsm_.isValid_[i]){
+
+            FeatureManager<mtState::nLevels_,mtState::patchSize_,mtState::nCam_>& f = filterState.fsm_.features_[i];
+
+            geometry_msgs::Point validFeature;
+            validFeature.x = filterState.fsm_.features_[i].idx_;
+            validFeature.y = f.mpStatistics_->getJointLocalVisibility();
+            validFeature.z = f.mpStatistics_->getGlobalQuality();
+
+            featureIdsMsgs_.points.push_back(validFeature);
           }
-          for(int i=0;i<3;i++){
-            for(int j=0;j<3;j++){
-              imuBiasMsg_.linear_acceleration_covariance[3*i+j] = cov(mtState::template getId<mtState::_acb>()+i,mtState::template getId<mtState::_acb>()+j);
-            }
+          else
+          {
+            FeatureManager<mtState::nLevels_,mtState::patchSize_,mtState::nCam_>& f = filterState.fsm_.features_[i];
+
+            geometry_msgs::Point invalidFeature;
+            invalidFeature.x = filterState.fsm_.features_[i].idx_;
+            invalidFeature.y = f.mpStatistics_->getJointLocalVisibility();
+            invalidFeature.z = f.mpStatistics_->getGlobalQuality();
+
+            badFeatureIdsMsgs_.points.push_back(invalidFeature);
           }
-          pubImuBias_.publish(imuBiasMsg_);
-        }
-        
-        std::vector<float> featureDistanceCov;
-        int offset = 0;
-        
-        // Publish featureids and uncertainity
-        featureIdsMsgs_.header.seq = msgSeq_;
-        featureIdsMsgs_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-        featureIdsMsgs_.points.clear();
-
-        badFeatureIdsMsgs_.header.seq = msgSeq_;
-        badFeatureIdsMsgs_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-        badFeatureIdsMsgs_.points.clear();
-
-        for (unsigned int i=0;i<mtState::nMax_; i++) {
-            if(filterState.fsm_.isValid_[i]){
-
-              FeatureManager<mtState::nLevels_,mtState::patchSize_,mtState::nCam_>& f = filterState.fsm_.features_[i];
-
-              geometry_msgs::Point validFeature;
-              validFeature.x = filterState.fsm_.features_[i].idx_;
-              validFeature.y = f.mpStatistics_->getJointLocalVisibility();
-              validFeature.z = f.mpStatistics_->getGlobalQuality();
-
-              featureIdsMsgs_.points.push_back(validFeature);
-            }
-            else
-            {
-              FeatureManager<mtState::nLevels_,mtState::patchSize_,mtState::nCam_>& f = filterState.fsm_.features_[i];
+      }
 
-              geometry_msgs::Point invalidFeature;
-              invalidFeature.x = filterState.fsm_.features_[i].idx_;
-              invalidFeature.y = f.mpStatistics_->getJointLocalVisibility();
-              invalidFeature.z = f.mpStatistics_->getGlobalQuality();
+      if(pubFeatureIds.getNumSubscribers() > 0) pubFeatureIds.publish(featureIdsMsgs_);
+      if(pubBadFeatureIds.getNumSubscribers() > 0) pubBadFeatureIds.publish(badFeatureIdsMsgs_);
+    }
 
-              badFeatureIdsMsgs_.points.push_back(invalidFeature);
+    // PointCloud message. With the delta point cloud the full cloud and the markers are only built if forced (it
+    // replaces them on links which cannot carry the full cloud).
+    const bool isPclBuilt = deltaPclPublishing_ ? forcePclPublishing_ : (pubPcl_.getNumSubscribers() > 0 || forcePclPublishing_);
+    const bool isMarkersBuilt = deltaPclPublishing_ ? forceMarkersPublishing_ : (pubMarkers_.getNumSubscribers() > 0 || forceMarkersPublishing_);
+    if(isPclBuilt || isMarkersBuilt || deltaPclPublishing_){
+      pclMsg_.header.seq = msgSeq_;
+      pclMsg_.header.stamp = ros::Time(filterState.t_);
+      markerMsg_.header.seq = msgSeq_;
+      markerMsg_.header.stamp = ros::Time(filterState.t_);
+      markerMsg_.points.clear();
+
+      float badPoint = std::numeric_limits<float>::quiet_NaN();  // Invalid point.
+      int offset = 0;
+
+      double d_minus,d_plus;
+      const double stretchFactor = 3;
+      for (unsigned int i=0;i<mtState::nMax_; i++, offset += pclMsg_.point_step) {
+        if(filterState.fsm_.isValid_[i]){
+          // Get 3D feature coordinates.
+          int camID = filterState.fsm_.features_[i].mpCoordinates_->camID_;
+
+          // Get human readable output
+          transformFeatureOutputCT_.setFeatureID(i);
+          transformFeatureOutputCT_.setOutputCameraID(filterState.fsm_.features_[i].mpCoordinates_->camID_);
+          transformFeatureOutputCT_.transformState(state,featureOutput_);
+          transformFeatureOutputCT_.transformCovMat(state,cov,featureOutputCov_);
+          featureOutputReadableCT_.transformState(featureOutput_,featureOutputReadable_);
+          featureOutputReadableCT_.transformCovMat(featureOutput_,featureOutputCov_,featureOutputReadableCov_);
+
+          featureDistanceCov.push_back(static_cast<float>(featureOutputReadableCov_(3, 3)));  // for health checker
+
+          // Get landmark output
+          landmarkOutputImuCT_.setFeatureID(i);
+          landmarkOutputImuCT_.transformState(state,landmarkOutput_);
+          landmarkOutputImuCT_.transformCovMat(state,cov,landmarkOutputCov_);
+          const Eigen::Vector3f MrMP = landmarkOutput_.get<LandmarkOutput::_lmk>().template cast<float>();
+
+          const Eigen::Vector3f bearing = featureOutputReadable_.bea().template cast<float>();
+          const float distance = static_cast<float>(featureOutputReadable_.dis());
+          const Eigen::Matrix3f cov_MrMP = landmarkOutputCov_.cast<float>();
+          const float distance_cov = static_cast<float>(featureOutputReadableCov_(3,3));
+          uint32_t status = filterState.fsm_.features_[i].mpStatistics_->status_[0];
+
+          if(isPclBuilt){
+          // Write feature id, camera id, and rgb
+          uint8_t gray = 255;
+          uint32_t rgb = (gray << 16) | (gray << 8) | gray;
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[0].offset], &filterState.fsm_.features_[i].idx_, sizeof(int));  // id
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[1].offset], &camID, sizeof(int));  // cam id
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[2].offset], &rgb, sizeof(uint32_t));  // rgb
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[3].offset], &status, sizeof(int));  // status
+
+          // Write coordinates to pcl message.
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[4].offset], &MrMP[0], sizeof(float));  // x
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[5].offset], &MrMP[1], sizeof(float));  // y
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[6].offset], &MrMP[2], sizeof(float));  // z
+
+          // Add feature bearing vector and distance
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[7].offset], &bearing[0], sizeof(float));  // x
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[8].offset], &bearing[1], sizeof(float));  // y
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[9].offset], &bearing[2], sizeof(float));  // z
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[10].offset], &distance, sizeof(float)); // d
+
+          // Add the corresponding covariance (upper triangular)
+          int mCounter = 11;
+          for(int row=0;row<3;row++){
+            for(int col=row;col<3;col++){
+              memcpy(&pclMsg_.data[offset + pclMsg_.fields[mCounter].offset], &cov_MrMP(row,col), sizeof(float));
+              mCounter++;
             }
-        }
-
-        pubFeatureIds.publish(featureIdsMsgs_);
-        pubBadFeatureIds.publish(badFeatureIdsMsgs_);
+          }
 
-        // PointCloud message.        
-        if(pubPcl_.getNumSubscribers() > 0 || pubMarkers_.getNumSubscribers() > 0 || forcePclPublishing_ || forceMarkersPublishing_){
+          // Add distance uncertainty
+          memcpy(&pclMsg_.data[offset + pclMsg_.fields[mCounter].offset], &distance_cov, sizeof(float));
+          }
 
-          
-          pclMsg_.header.seq = msgSeq_;
-          pclMsg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-          markerMsg_.header.seq = msgSeq_;
-          markerMsg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-          markerMsg_.points.clear();
-
-          float badPoint = std::numeric_limits<float>::quiet_NaN();  // Invalid point.
-          int offset = 0;
-
-          FeatureDistance distance;
-          double d,d_minus,d_plus;
-          const double stretchFactor = 3;
-          for (unsigned int i=0;i<mtState::nMax_; i++, offset += pclMsg_.point_step) {
-            if(filterState.fsm_.isValid_[i]){
-              // Get 3D feature coordinates.
-              int camID = filterState.fsm_.features_[i].mpCoordinates_->camID_;
-              distance = state.dep(i);
-              d = distance.getDistance();
-              const double sigma = sqrt(cov(mtState::template getId<mtState::_fea>(i)+2,mtState::template getId<mtState::_fea>(i)+2));
-              distance.p_ -= stretchFactor*sigma;
-              d_minus = distance.getDistance();
-              if(d_minus > 1000) d_minus = 1000;
-              if(d_minus < 0) d_minus = 0;
-              distance.p_ += 2*stretchFactor*sigma;
-              d_plus = distance.getDistance();
-              if(d_plus > 1000) d_plus = 1000;
-              if(d_plus < 0) d_plus = 0;
-              Eigen::Vector3d bearingVector = filterState.state_.CfP(i).get_nor().getVec();
-              const Eigen::Vector3d CrCPm = bearingVector*d_minus;
-              const Eigen::Vector3d CrCPp = bearingVector*d_plus;
-              const Eigen::Vector3f MrMPm = V3D(mpFilter_->multiCamera_.BrBC_[camID] + mpFilter_->multiCamera_.qCB_[camID].inverseRotate(CrCPm)).cast<float>();
-              const Eigen::Vector3f MrMPp = V3D(mpFilter_->multiCamera_.BrBC_[camID] + mpFilter_->multiCamera_.qCB_[camID].inverseRotate(CrCPp)).cast<float>();
-
-              // Get human readable output
-              transformFeatureOutputCT_.setFeatureID(i);
-              transformFeatureOutputCT_.setOutputCameraID(filterState.fsm_.features_[i].mpCoordinates_->camID_);
-              transformFeatureOutputCT_.transformState(state,featureOutput_);
-              transformFeatureOutputCT_.transformCovMat(state,cov,featureOutputCov_);
-              featureOutputReadableCT_.transformState(featureOutput_,featureOutputReadable_);
-              featureOutputReadableCT_.transformCovMat(featureOutput_,featureOutputCov_,featureOutputReadableCov_);
-
-              featureDistanceCov.push_back(static_cast<float>(featureOutputReadableCov_(3, 3)));  // for health checker
-
-              // Get landmark output
-              landmarkOutputImuCT_.setFeatureID(i);
-              landmarkOutputImuCT_.transformState(state,landmarkOutput_);
-              landmarkOutputImuCT_.transformCovMat(state,cov,landmarkOutputCov_);
-              const Eigen::Vector3f MrMP = landmarkOutput_.get<LandmarkOutput::_lmk>().template cast<float>();
-
-              // Write feature id, camera id, and rgb
-              uint8_t gray = 255;
-              uint32_t rgb = (gray << 16) | (gray << 8) | gray;
-              uint32_t status = filterState.fsm_.features_[i].mpStatistics_->status_[0];
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[0].offset], &filterState.fsm_.features_[i].idx_, sizeof(int));  // id
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[1].offset], &camID, sizeof(int));  // cam id
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[2].offset], &rgb, sizeof(uint32_t));  // rgb
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[3].offset], &status, sizeof(int));  // status
-
-              // Write coordinates to pcl message.
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[4].offset], &MrMP[0], sizeof(float));  // x
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[5].offset], &MrMP[1], sizeof(float));  // y
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[6].offset], &MrMP[2], sizeof(float));  // z
-
-              // Add feature bearing vector and distance
-              const Eigen::Vector3f bearing = featureOutputReadable_.bea().template cast<float>();
-              const float distance = static_cast<float>(featureOutputReadable_.dis());
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[7].offset], &bearing[0], sizeof(float));  // x
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[8].offset], &bearing[1], sizeof(float));  // y
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[9].offset], &bearing[2], sizeof(float));  // z
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[10].offset], &distance, sizeof(float)); // d
-
-              // Add the corresponding covariance (upper triangular)
-              Eigen::Matrix3f cov_MrMP = landmarkOutputCov_.cast<float>();
-              int mCounter = 11;
-              for(int row=0;row<3;row++){
-                for(int col=row;col<3;col++){
-                  memcpy(&pclMsg_.data[offset + pclMsg_.fields[mCounter].offset], &cov_MrMP(row,col), sizeof(float));
-                  mCounter++;
-                }
-              }
+          if(deltaPclPublishing_){
+            DeltaPclPoint& point = currentPclPoints_[i];
+            point.idx_ = filterState.fsm_.features_[i].idx_;
+            point.camID_ = camID;
+            point.status_ = status;
+            point.MrMP_ = MrMP;
+            point.bearing_ = bearing;
+            point.distance_ = distance;
+            point.cov_ = cov_MrMP;
+            point.distanceCov_ = distance_cov;
+            isCurrentPclPointValid_[i] = true;
+          }
 
-              // Add distance uncertainty
-              const float distance_cov = static_cast<float>(featureOutputReadableCov_(3,3));
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[mCounter].offset], &distance_cov, sizeof(float));
-
-              // Line markers (Uncertainty rays).
-              geometry_msgs::Point point_near_msg;
-              geometry_msgs::Point point_far_msg;
-              point_near_msg.x = float(CrCPp[0]);
-              point_near_msg.y = float(CrCPp[1]);
-              point_near_msg.z = float(CrCPp[2]);
-              point_far_msg.x = float(CrCPm[0]);
-              point_far_msg.y = float(CrCPm[1]);
-              point_far_msg.z = float(CrCPm[2]);
-              markerMsg_.points.push_back(point_near_msg);
-              markerMsg_.points.push_back(point_far_msg); 
-
-              
-            }
-            else {
-              // If current feature is not valid copy NaN
-              int id = -1;
-              memcpy(&pclMsg_.data[offset + pclMsg_.fields[0].offset], &id, sizeof(int));  // id
-              for(int j=1;j<pclMsg_.fields.size();j++){
-                memcpy(&pclMsg_.data[offset + pclMsg_.fields[j].offset], &badPoint, sizeof(float));
-              }
-            }
+          // Line markers (Uncertainty rays).
+          if(isMarkersBuilt){
+          FeatureDistance featureDistance = state.dep(i);
+          const double sigma = sqrt(cov(mtState::template getId<mtState::_fea>(i)+2,mtState::template getId<mtState::_fea>(i)+2));
+          featureDistance.p_ -= stretchFactor*sigma;
+          d_minus = featureDistance.getDistance();
+          if(d_minus > 1000) d_minus = 1000;
+          if(d_minus < 0) d_minus = 0;
+          featureDistance.p_ += 2*stretchFactor*sigma;
+          d_plus = featureDistance.getDistance();
+          if(d_plus > 1000) d_plus = 1000;
+          if(d_plus < 0) d_plus = 0;
+          const Eigen::Vector3d bearingVector = filterState.state_.CfP(i).get_nor().getVec();
+          const Eigen::Vector3d CrCPm = bearingVector*d_minus;
+          const Eigen::Vector3d CrCPp = bearingVector*d_plus;
+          geometry_msgs::Point point_near_msg;
+          geometry_msgs::Point point_far_msg;
+          point_near_msg.x = float(CrCPp[0]);
+          point_near_msg.y = float(CrCPp[1]);
+          point_near_msg.z = float(CrCPp[2]);
+          point_far_msg.x = float(CrCPm[0]);
+          point_far_msg.y = float(CrCPm[1]);
+          point_far_msg.z = float(CrCPm[2]);
+          markerMsg_.points.push_back(point_near_msg);
+          markerMsg_.points.push_back(point_far_msg);
           }
-          pubPcl_.publish(pclMsg_);
-          pubMarkers_.publish(markerMsg_);
+
+          
         }
-        if(pubPatch_.getNumSubscribers() > 0 || forcePatchPublishing_){
-          patchMsg_.header.seq = msgSeq_;
-          patchMsg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-          int offset = 0;
-          for (unsigned int i=0;i<mtState::nMax_; i++, offset += patchMsg_.point_step) {
-            if(filterState.fsm_.isValid_[i]){
-              memcpy(&patchMsg_.data[offset + patchMsg_.fields[0].offset], &filterState.fsm_.features_[i].idx_, sizeof(int));  // id
-              // Add patch data
-
-              for(int l=0;l<mtState::nLevels_;l++){
-                for(int y=0;y<mtState::patchSize_;y++){
-                  for(int x=0;x<mtState::patchSize_;x++){
-                    memcpy(&patchMsg_.data[offset + patchMsg_.fields[1].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.fsm_.features_[i].mpMultilevelPatch_->patches_[l].patch_[y*mtState::patchSize_ + x], sizeof(float)); // Patch
-                    memcpy(&patchMsg_.data[offset + patchMsg_.fields[2].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.fsm_.features_[i].mpMultilevelPatch_->patches_[l].dx_[y*mtState::patchSize_ + x], sizeof(float)); // dx
-                    memcpy(&patchMsg_.data[offset + patchMsg_.fields[3].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.fsm_.features_[i].mpMultilevelPatch_->patches_[l].dy_[y*mtState::patchSize_ + x], sizeof(float)); // dy
-                    memcpy(&patchMsg_.data[offset + patchMsg_.fields[4].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.mlpErrorLog_[i].patches_[l].patch_[y*mtState::patchSize_ + x], sizeof(float)); // error
-                  }
-                }
-              }
-            }
-            else {
-              // If current feature is not valid copy NaN
-              int id = -1;
-              memcpy(&patchMsg_.data[offset + patchMsg_.fields[0].offset], &id, sizeof(int));  // id
+        else {
+          // If current feature is not valid copy NaN
+          if(isPclBuilt){
+            int id = -1;
+            memcpy(&pclMsg_.data[offset + pclMsg_.fields[0].offset], &id, sizeof(int));  // id
+            for(int j=1;j<pclMsg_.fields.size();j++){
+              memcpy(&pclMsg_.data[offset + pclMsg_.fields[j].offset], &badPoint, sizeof(float));
             }
           }
-
-          pubPatch_.publish(patchMsg_);
+          isCurrentPclPointValid_[i] = false;
         }
-        if(pubPatch_.getNumSubscribers() > 0 || forcePatchPublishing_){
-          patchMsg_.header.seq = msgSeq_;
-          patchMsg_.header.stamp = ros::Time(mpFilter_->safe_.t_);
-          int offset = 0;
-          for (unsigned int i=0;i<mtState::nMax_; i++, offset += patchMsg_.point_step) {
-            if(filterState.fsm_.isValid_[i]){
-              memcpy(&patchMsg_.data[offset + patchMsg_.fields[0].offset], &filterState.fsm_.features_[i].idx_, sizeof(int));  // id
-              // Add patch data
-              for(int l=0;l<mtState::nLevels_;l++){
-                for(int y=0;y<mtState::patchSize_;y++){
-                  for(int x=0;x<mtState::patchSize_;x++){
-                    memcpy(&patchMsg_.data[offset + patchMsg_.fields[1].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.fsm_.features_[i].mpMultilevelPatch_->patches_[l].patch_[y*mtState::patchSize_ + x], sizeof(float)); // Patch
-                    memcpy(&patchMsg_.data[offset + patchMsg_.fields[2].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.fsm_.features_[i].mpMultilevelPatch_->patches_[l].dx_[y*mtState::patchSize_ + x], sizeof(float)); // dx
-                    memcpy(&patchMsg_.data[offset + patchMsg_.fields[3].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.fsm_.features_[i].mpMultilevelPatch_->patches_[l].dy_[y*mtState::patchSize_ + x], sizeof(float)); // dy
-                    memcpy(&patchMsg_.data[offset + patchMsg_.fields[4].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.mlpErrorLog_[i].patches_[l].patch_[y*mtState::patchSize_ + x], sizeof(float)); // error                    
-                  }
-                }
+      }
+      if(isPclBuilt) pubPcl_.publish(pclMsg_);
+      if(isMarkersBuilt) pubMarkers_.publish(markerMsg_);
+      if(deltaPclPublishing_) publishDeltaPcl(filterState.t_);
+    }
+    if(pubPatch_.getNumSubscribers() > 0 || forcePatchPublishing_){
+      patchMsg_.header.seq = msgSeq_;
+      patchMsg_.header.stamp = ros::Time(filterState.t_);
+      int offset = 0;
+      for (unsigned int i=0;i<mtState::nMax_; i++, offset += patchMsg_.point_step) {
+        if(filterState.fsm_.isValid_[i]){
+          memcpy(&patchMsg_.data[offset + patchMsg_.fields[0].offset], &filterState.fsm_.features_[i].idx_, sizeof(int));  // id
+          // Add patch data
+
+          for(int l=0;l<mtState::nLevels_;l++){
+            for(int y=0;y<mtState::patchSize_;y++){
+              for(int x=0;x<mtState::patchSize_;x++){
+                memcpy(&patchMsg_.data[offset + patchMsg_.fields[1].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.fsm_.features_[i].mpMultilevelPatch_->patches_[l].patch_[y*mtState::patchSize_ + x], sizeof(float)); // Patch
+                memcpy(&patchMsg_.data[offset + patchMsg_.fields[2].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.fsm_.features_[i].mpMultilevelPatch_->patches_[l].dx_[y*mtState::patchSize_ + x], sizeof(float)); // dx
+                memcpy(&patchMsg_.data[offset + patchMsg_.fields[3].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.fsm_.features_[i].mpMultilevelPatch_->patches_[l].dy_[y*mtState::patchSize_ + x], sizeof(float)); // dy
+                memcpy(&patchMsg_.data[offset + patchMsg_.fields[4].offset + (l*mtState::patchSize_*mtState::patchSize_ + y*mtState::patchSize_ + x)*4], &filterState.mlpErrorLog_[i].patches_[l].patch_[y*mtState::patchSize_ + x], sizeof(float)); // error
               }
             }
-            else {
-              // If current feature is not valid copy NaN
-              int id = -1;
-              memcpy(&patchMsg_.data[offset + patchMsg_.fields[0].offset], &id, sizeof(int));  // id
-            }
           }
-
-          pubPatch_.publish(patchMsg_);
         }
-        gotFirstMessages_ = true;
+        else {
+          // If current feature is not valid copy NaN
+          int id = -1;
+          memcpy(&patchMsg_.data[offset + patchMsg_.fields[0].offset], &id, sizeof(int));  // id
+        }
+      }
 
-        if(mpImgUpdate_->healthCheck_){
-          if(healthMonitor_.shouldResetEstimator(featureDistanceCov, imuOutput_)) {
-            if(!init_state_.isInitialized()) {
-              std::cout << "Reinitioalization already triggered. Ignoring request...";
-              return;
-            }
+      pubPatch_.publish(patchMsg_);
+    }
+    gotFirstMessages_ = true;
+
+    if(mpImgUpdate_->healthCheck_){
+      if(healthMonitor_.shouldResetEstimator(featureDistanceCov, imuOutput_)) {
+        // The filter state is owned by the filter thread (m_filter_ is already held in the synchronous case)
+        std::unique_lock<std::mutex> lock(m_filter_,std::defer_lock);
+        if(asyncPublishing_) lock.lock();
+        if(!estimator_.isInitialized()) {
+          std::cout << "Reinitioalization already triggered. Ignoring request...";
+          return;
+        }
 
-            init_state_.WrWM_ = healthMonitor_.failsafe_WrWB();
-            init_state_.qMW_ = healthMonitor_.failsafe_qBW();
-            init_state_.state_ = FilterInitializationState::State::WaitForInitExternalPose;
-          }
+        typename KeyframeCache<mtFilterState>::Keyframe keyframe;
+        if(warmRecovery_ && keyframeCache_.getLatest(keyframe)){
+          // Restart from the last healthy keyframe (its pose matches the cached features)
+          estimator_.requestWarmRecovery(keyframe);
+          keyframeCache_.clear(); // Do not recover repeatedly into the same keyframe
+        } else {
+          estimator_.requestResetToPose(healthMonitor_.failsafe_WrWB(),healthMonitor_.failsafe_qBW());
         }
+      } else if(warmRecovery_ && healthMonitor_.isSafePoseUpdated()){
+        keyframeCache_.add(filterState);
       }
     }
   }
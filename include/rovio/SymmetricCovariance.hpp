@@ -0,0 +1,130 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_SYMMETRICCOVARIANCE_HPP_
+#define ROVIO_SYMMETRICCOVARIANCE_HPP_
+
+#include "lightweight_filtering/common.hpp"
+
+namespace rovio{
+
+/** \brief Copies the lower triangle of a square matrix into its upper triangle.
+ *
+ *  Used after kernels which only compute the lower triangle of a covariance, the result is symmetric by construction
+ *  (no asymmetry drift).
+ *
+ *   @param P - Square matrix.
+ */
+template<typename Derived>
+void mirrorLowerTriangle(Eigen::MatrixBase<Derived>& P){
+  assert(P.rows() == P.cols());
+  for(int j=1;j<P.cols();j++){
+    for(int i=0;i<j;i++){
+      P(i,j) = P(j,i);
+    }
+  }
+}
+
+/** \brief Computes out = M*X*M^T for a Jacobian M with the block structure of the IMU prediction.
+ *
+ *  The rows of the core states only depend on the core states, the rows of a feature only depend on the core states and
+ *  on the feature itself, and the remaining states (additional poses) only depend on themselves.
+ *  M = [A 0 0; B D 0; 0 0 E] with D block-diagonal (3x3 per feature). Requires that the rows and columns of M have the
+ *  same element layout.
+ *
+ *  The core states from ca to c are frozen states: their rows of M only depend on themselves and no other row depends
+ *  on them. The core products are then restricted to the active part.
+ *
+ *   @param M         - Structured Jacobian (D x D).
+ *   @param X         - Symmetric matrix (D x D).
+ *   @param out       - Output (D x D, symmetric), must not alias X.
+ *   @param temp      - Temporary (D x D).
+ *   @param c         - Number of core states (start of the features).
+ *   @param nFeatures - Number of features.
+ *   @param ca        - End of the active core states.
+ */
+template<typename Matrix>
+void structuredSandwich(const Matrix& M, const Matrix& X, Matrix& out, Matrix& temp, const int c, const int nFeatures, const int ca){
+  const int D = M.rows();
+  const int f = 3*nFeatures;
+  const int p = D-c-f;
+  temp.topRows(ca).noalias() = M.topLeftCorner(ca,ca)*X.topRows(ca);
+  temp.middleRows(ca,c-ca).noalias() = M.block(ca,ca,c-ca,c-ca)*X.middleRows(ca,c-ca);
+  temp.middleRows(c,f).noalias() = M.block(c,0,f,ca)*X.topRows(ca);
+  for(int i=0;i<nFeatures;i++){
+    temp.middleRows(c+3*i,3).noalias() += M.template block<3,3>(c+3*i,c+3*i)*X.middleRows(c+3*i,3);
+  }
+  temp.bottomRows(p).noalias() = M.bottomRightCorner(p,p)*X.bottomRows(p);
+  // Only the lower triangle of the output is computed (column block-wise from the diagonal block downwards)
+  out.leftCols(ca).noalias() = temp.leftCols(ca)*M.topLeftCorner(ca,ca).transpose();
+  out.middleCols(ca,c-ca).noalias() = temp.middleCols(ca,c-ca)*M.block(ca,ca,c-ca,c-ca).transpose();
+  for(int i=0;i<nFeatures;i++){
+    const int s = c+3*i;
+    out.block(s,s,D-s,3).noalias() = temp.block(s,0,D-s,ca)*M.block(s,0,3,ca).transpose();
+    out.block(s,s,D-s,3).noalias() += temp.block(s,s,D-s,3)*M.template block<3,3>(s,s).transpose();
+  }
+  out.bottomRightCorner(p,p).noalias() = temp.bottomRightCorner(p,p)*M.bottomRightCorner(p,p).transpose();
+  mirrorLowerTriangle(out);
+}
+
+/** \brief Symmetric covariance downdate P = P - W*W^T.
+ *
+ *  Only the lower triangle is computed (rank-m update), afterwards it is mirrored into the upper triangle.
+ *
+ *   @param P - Covariance matrix (D x D).
+ *   @param W - Downdate factor (D x m).
+ */
+inline void symmetricDowndate(MXD& P, const MXD& W){
+  P.selfadjointView<Eigen::Lower>().rankUpdate(W,-1.0);
+  mirrorLowerTriangle(P);
+}
+
+/** \brief Square-root form of the Kalman gain.
+ *
+ *  With Py = L*L^T the gain K = PHt*Py^-1 and the covariance correction K*Py*K^T are expressed via W = PHt*L^-T:
+ *  K*y = W*(L^-1*y) and K*Py*K^T = W*W^T. This avoids the explicit inverse of Py and allows a symmetric downdate
+ *  (see \ref symmetricDowndate).
+ *
+ *   @param PHt - P*H^T (D x m), overwritten by W.
+ *   @param Py  - Innovation covariance (m x m).
+ *   @param y   - Innovation (m x 1), overwritten by L^-1*y.
+ *   @return false if Py is not positive definite (PHt and y are not altered in this case).
+ */
+template<typename Matrix>
+bool computeSquareRootGain(Matrix& PHt, const Matrix& Py, Matrix& y){
+  Eigen::LLT<Matrix> llt(Py);
+  if(llt.info() != Eigen::Success) return false;
+  llt.matrixL().solveInPlace(y);
+  llt.matrixU().template solveInPlace<Eigen::OnTheRight>(PHt);
+  return true;
+}
+
+}
+
+
+#endif /* ROVIO_SYMMETRICCOVARIANCE_HPP_ */
@@ -0,0 +1,341 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_TELEMETRYLOG_HPP_
+#define ROVIO_TELEMETRYLOG_HPP_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "lightweight_filtering/common.hpp"
+#include "rovio/FeatureStatistics.hpp"
+
+namespace rovio{
+
+/** \brief Header at the beginning of a telemetry file.
+ *
+ *  The file consists of the header (padded to \ref headerSize_) followed by \ref capacity_ records of
+ *  \ref recordSize_ bytes, used as ring buffer. Record n is stored at slot n % capacity_.
+ */
+struct TelemetryFileHeader{
+  char magic_[8]; /**<"ROVIOTLM".*/
+  uint32_t version_;
+  uint32_t headerSize_;
+  uint32_t recordSize_;
+  uint32_t capacity_; /**<Number of record slots.*/
+  uint32_t nMax_; /**<Number of features of the filter state.*/
+  uint32_t nCam_; /**<Number of cameras.*/
+  uint32_t stateDim_; /**<Dimension of the error state (length of the covariance diagonal).*/
+  uint32_t nTimings_; /**<Number of timings per record.*/
+  uint64_t writeCount_; /**<Number of completely written records (updated after the record, release order).*/
+};
+
+/** \brief Timings stored in a telemetry record.
+ */
+enum TelemetryTiming{
+  TELEMETRY_FILTER_UPDATE = 0, /**<Duration of the filter update [ms].*/
+  TELEMETRY_PROCESSED_FRAMES, /**<Number of camera frames processed in the filter update.*/
+  TELEMETRY_N_TIMINGS
+};
+
+/** \brief Fixed size telemetry record of a filter state.
+ *
+ *  @tparam FILTERSTATE - Filter state.
+ */
+template<typename FILTERSTATE>
+struct TelemetryRecord{
+  typedef typename FILTERSTATE::mtState mtState;
+  uint64_t seq_; /**<Record number, written last (allows readers to detect records under modification).*/
+  double t_; /**<Time of the state.*/
+  double WrWM_[3];
+  double qWM_[4]; /**<w, x, y, z.*/
+  double MvM_[3];
+  double acb_[3];
+  double gyb_[3];
+  double refractiveIndex_;
+  float covDiag_[mtState::D_]; /**<Diagonal of the covariance.*/
+  int32_t featureIdx_[mtState::nMax_]; /**<Feature id, -1 if the slot is empty.*/
+  uint8_t featureCamID_[mtState::nMax_];
+  uint8_t featureStatus_[mtState::nMax_]; /**<TrackingStatus in the camera of the feature.*/
+  float featureDistance_[mtState::nMax_];
+  float timings_[TELEMETRY_N_TIMINGS]; /**<See \ref TelemetryTiming.*/
+
+  /** \brief Fills the record from a filter state.
+   *
+   *   @param filterState - Filter state.
+   */
+  void set(const FILTERSTATE& filterState){
+    const mtState& state = filterState.state_;
+    t_ = filterState.t_;
+    for(int i=0;i<3;i++){
+      WrWM_[i] = state.WrWM()(i);
+      MvM_[i] = state.MvM()(i);
+      acb_[i] = state.acb()(i);
+      gyb_[i] = state.gyb()(i);
+    }
+    qWM_[0] = state.qWM().w();
+    qWM_[1] = state.qWM().x();
+    qWM_[2] = state.qWM().y();
+    qWM_[3] = state.qWM().z();
+    refractiveIndex_ = state.ref();
+    for(unsigned int i=0;i<mtState::D_;i++){
+      covDiag_[i] = static_cast<float>(filterState.cov_(i,i));
+    }
+    for(unsigned int i=0;i<mtState::nMax_;i++){
+      if(filterState.fsm_.isValid_[i]){
+        const int camID = filterState.fsm_.features_[i].mpCoordinates_->camID_;
+        featureIdx_[i] = filterState.fsm_.features_[i].idx_;
+        featureCamID_[i] = camID;
+        featureStatus_[i] = filterState.fsm_.features_[i].mpStatistics_->status_[camID];
+        featureDistance_[i] = static_cast<float>(state.dep(i).getDistance());
+      } else {
+        featureIdx_[i] = -1;
+        featureCamID_[i] = 0;
+        featureStatus_[i] = UNKNOWN;
+        featureDistance_[i] = 0.0f;
+      }
+    }
+  }
+};
+
+/** \brief Shared layout of a memory-mapped telemetry file.
+ *
+ *  @tparam FILTERSTATE - Filter state.
+ */
+template<typename FILTERSTATE>
+class TelemetryFile{
+ public:
+  typedef typename FILTERSTATE::mtState mtState;
+  typedef TelemetryRecord<FILTERSTATE> mtRecord;
+  static constexpr uint32_t version_ = 1;
+  static constexpr uint32_t headerSize_ = 4096;
+
+  TelemetryFile(): fd_(-1), data_(nullptr), size_(0){}
+  virtual ~TelemetryFile(){
+    close();
+  }
+
+  /** \brief Checks if a file is mapped.
+   */
+  bool isOpen() const{
+    return data_ != nullptr;
+  }
+
+  /** \brief Unmaps and closes the file.
+   */
+  void close(){
+    if(data_ != nullptr) munmap(data_,size_);
+    if(fd_ >= 0) ::close(fd_);
+    data_ = nullptr;
+    fd_ = -1;
+    size_ = 0;
+  }
+
+  /** \brief Returns the header (only valid if open).
+   */
+  TelemetryFileHeader& header() const{
+    return *reinterpret_cast<TelemetryFileHeader*>(data_);
+  }
+
+  /** \brief Returns the slot of record n (only valid if open).
+   */
+  mtRecord& slot(const uint64_t n) const{
+    return *reinterpret_cast<mtRecord*>(data_ + headerSize_ + (n % header().capacity_)*sizeof(mtRecord));
+  }
+
+ protected:
+  int fd_;
+  char* data_;
+  size_t size_;
+};
+
+/** \brief Writes telemetry records into a preallocated memory-mapped ring file.
+ *
+ *  The file is allocated, mapped and prefaulted on open, such that writing a record is a plain copy into memory
+ *  (no system calls, no allocations). The kernel writes the pages back asynchronously, the data survives a crash
+ *  of the process. Not thread-safe, records are written from the filter thread.
+ *
+ *  @tparam FILTERSTATE - Filter state.
+ */
+template<typename FILTERSTATE>
+class TelemetryWriter: public TelemetryFile<FILTERSTATE>{
+ public:
+  typedef TelemetryFile<FILTERSTATE> Base;
+  typedef typename Base::mtRecord mtRecord;
+  typedef typename Base::mtState mtState;
+  using Base::fd_;
+  using Base::data_;
+  using Base::size_;
+  using Base::headerSize_;
+
+  /** \brief Creates (overwrites) and maps the file.
+   *
+   *   @param filename - Filename.
+   *   @param capacity - Number of records in the ring.
+   *   @return false if the file could not be created or mapped.
+   */
+  bool open(const std::string& filename, const uint32_t capacity){
+    this->close();
+    if(capacity == 0) return false;
+    size_ = headerSize_ + (size_t)(capacity)*sizeof(mtRecord);
+    fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd_ < 0) return false;
+    if(ftruncate(fd_,size_) != 0 || posix_fallocate(fd_,0,size_) != 0){
+      this->close();
+      return false;
+    }
+    void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+    if(data == MAP_FAILED){
+      this->close();
+      return false;
+    }
+    data_ = static_cast<char*>(data);
+    TelemetryFileHeader& header = this->header();
+    memcpy(header.magic_,"ROVIOTLM",8);
+    header.version_ = Base::version_;
+    header.headerSize_ = headerSize_;
+    header.recordSize_ = sizeof(mtRecord);
+    header.capacity_ = capacity;
+    header.nMax_ = mtState::nMax_;
+    header.nCam_ = mtState::nCam_;
+    header.stateDim_ = mtState::D_;
+    header.nTimings_ = TELEMETRY_N_TIMINGS;
+    __atomic_store_n(&header.writeCount_,(uint64_t)0,__ATOMIC_RELEASE);
+    return true;
+  }
+
+  /** \brief Appends a record, overwriting the oldest one if the ring is full.
+   *
+   *   @param filterState - Filter state.
+   *   @param timings     - Timings, see \ref TelemetryTiming.
+   */
+  void write(const FILTERSTATE& filterState, const float (&timings)[TELEMETRY_N_TIMINGS]){
+    if(!this->isOpen()) return;
+    TelemetryFileHeader& header = this->header();
+    const uint64_t n = header.writeCount_;
+    mtRecord& record = this->slot(n);
+    __atomic_store_n(&record.seq_,~(uint64_t)0,__ATOMIC_RELEASE); // Invalid while writing
+    __atomic_thread_fence(__ATOMIC_RELEASE); // The invalidation is visible before any of the record data below
+    record.set(filterState);
+    memcpy(record.timings_,timings,sizeof(record.timings_));
+    __atomic_store_n(&record.seq_,n,__ATOMIC_RELEASE);
+    __atomic_store_n(&header.writeCount_,n+1,__ATOMIC_RELEASE);
+  }
+};
+
+/** \brief Reads a telemetry file (also while it is being written).
+ *
+ *  @tparam FILTERSTATE - Filter state, must match the layout of the writer.
+ */
+template<typename FILTERSTATE>
+class TelemetryReader: public TelemetryFile<FILTERSTATE>{
+ public:
+  typedef TelemetryFile<FILTERSTATE> Base;
+  typedef typename Base::mtRecord mtRecord;
+  typedef typename Base::mtState mtState;
+  using Base::fd_;
+  using Base::data_;
+  using Base::size_;
+  using Base::headerSize_;
+
+  /** \brief Maps the file read-only and checks its layout.
+   *
+   *   @param filename - Filename.
+   *   @param error    - Reason if the file cannot be used.
+   *   @return false if the file could not be mapped or has a different layout.
+   */
+  bool open(const std::string& filename, std::string& error){
+    this->close();
+    fd_ = ::open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd_ < 0 || fstat(fd_,&st) != 0 || (size_t)(st.st_size) < headerSize_){
+      error = "cannot open file";
+      this->close();
+      return false;
+    }
+    size_ = st.st_size;
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if(data == MAP_FAILED){
+      error = "cannot map file";
+      size_ = 0;
+      this->close();
+      return false;
+    }
+    data_ = static_cast<char*>(data);
+    const TelemetryFileHeader& header = this->header();
+    if(memcmp(header.magic_,"ROVIOTLM",8) != 0 || header.version_ != Base::version_){
+      error = "not a telemetry file of version " + std::to_string(Base::version_);
+    } else if(header.recordSize_ != sizeof(mtRecord) || header.nMax_ != mtState::nMax_ || header.nCam_ != mtState::nCam_
+        || header.stateDim_ != mtState::D_ || header.nTimings_ != TELEMETRY_N_TIMINGS){
+      error = "layout mismatch (written with nMax=" + std::to_string(header.nMax_) + ", nCam=" + std::to_string(header.nCam_) + ")";
+    } else if(size_ < headerSize_ + (size_t)(header.capacity_)*header.recordSize_){
+      error = "truncated file";
+    } else {
+      return true;
+    }
+    this->close();
+    return false;
+  }
+
+  /** \brief Returns the number of records written so far.
+   */
+  uint64_t writeCount() const{
+    return __atomic_load_n(&this->header().writeCount_,__ATOMIC_ACQUIRE);
+  }
+
+  /** \brief Returns the number of the oldest record still contained in the ring.
+   */
+  uint64_t firstAvailable() const{
+    const uint64_t count = writeCount();
+    return count > this->header().capacity_ ? count-this->header().capacity_ : 0;
+  }
+
+  /** \brief Copies record n.
+   *
+   *   @param n      - Record number.
+   *   @param record - Copy of the record.
+   *   @return false if the record is not (or no longer) available.
+   */
+  bool read(const uint64_t n, mtRecord& record) const{
+    if(n >= writeCount() || n < firstAvailable()) return false;
+    const mtRecord& slot = this->slot(n);
+    if(__atomic_load_n(&slot.seq_,__ATOMIC_ACQUIRE) != n) return false;
+    memcpy(&record,&slot,sizeof(mtRecord));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); // The copy above completes before seq_ is loaded again
+    return __atomic_load_n(&slot.seq_,__ATOMIC_RELAXED) == n; // Not overwritten during the copy
+  }
+};
+
+}
+
+
+#endif /* ROVIO_TELEMETRYLOG_HPP_ */
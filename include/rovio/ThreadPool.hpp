@@ -0,0 +1,152 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_THREADPOOL_HPP_
+#define ROVIO_THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rovio{
+
+/** \brief Minimal fixed-size thread pool for blocking parallel loops.
+ *
+ *  The workers are started once and wait for jobs, such that a parallel loop only costs a wake-up.
+ *  The calling thread participates in the loop.
+ */
+class ThreadPool{
+ public:
+  /** \brief Constructor
+   *
+   *   @param nThreads - Total number of threads used by \ref parallelFor (including the calling thread).
+   */
+  ThreadPool(const int nThreads = 1){
+    isRunning_ = true;
+    generation_ = 0;
+    busyWorkers_ = 0;
+    jobSize_ = 0;
+    nextIndex_ = 0;
+    job_ = nullptr;
+    for(int i=1;i<nThreads;i++){
+      workers_.push_back(std::thread(&ThreadPool::workerLoop,this));
+    }
+  }
+
+  /** \brief Destructor, joins all workers.
+   */
+  virtual ~ThreadPool(){
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      isRunning_ = false;
+    }
+    startCondition_.notify_all();
+    for(auto& worker : workers_){
+      worker.join();
+    }
+  }
+
+  /** \brief Returns the total number of threads used by \ref parallelFor.
+   */
+  int size() const{
+    return workers_.size()+1;
+  }
+
+  /** \brief Calls job(i) for i = 0..n-1 distributed over all threads and returns once all calls are done.
+   *
+   *   Must not be called concurrently from multiple threads.
+   *
+   *   @param n   - Number of iterations.
+   *   @param job - Job, must be safe to call concurrently for different indices.
+   */
+  void parallelFor(const int n, const std::function<void(int)>& job){
+    if(workers_.empty() || n <= 1){
+      for(int i=0;i<n;i++) job(i);
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_ = &job;
+      jobSize_ = n;
+      nextIndex_ = 0;
+      busyWorkers_ = workers_.size();
+      generation_++;
+    }
+    startCondition_.notify_all();
+    runJobs();
+    std::unique_lock<std::mutex> lock(mutex_);
+    doneCondition_.wait(lock,[this]{return busyWorkers_ == 0;});
+    job_ = nullptr;
+  }
+
+ private:
+  /** \brief Processes iterations of the current job until none are left.
+   */
+  void runJobs(){
+    int i;
+    while((i = nextIndex_++) < jobSize_){
+      (*job_)(i);
+    }
+  }
+
+  /** \brief Worker thread, waits for a new job generation and processes it.
+   */
+  void workerLoop(){
+    int generation = 0;
+    while(true){
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        startCondition_.wait(lock,[this,&generation]{return !isRunning_ || generation_ != generation;});
+        if(!isRunning_) return;
+        generation = generation_;
+      }
+      runJobs();
+      std::unique_lock<std::mutex> lock(mutex_);
+      if(--busyWorkers_ == 0) doneCondition_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> workers_;  /**<Worker threads.*/
+  std::mutex mutex_;
+  std::condition_variable startCondition_;  /**<Signals a new job generation (or shutdown) to the workers.*/
+  std::condition_variable doneCondition_;  /**<Signals that all workers are done with the current job.*/
+  bool isRunning_;
+  int generation_;  /**<Incremented for every job.*/
+  int busyWorkers_;  /**<Number of workers which have not yet finished the current job.*/
+  int jobSize_;
+  std::atomic<int> nextIndex_;  /**<Next iteration to be processed.*/
+  const std::function<void(int)>* job_;
+};
+
+}
+
+
+#endif /* ROVIO_THREADPOOL_HPP_ */
@@ -0,0 +1,175 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef ROVIO_TRAJECTORYEVALUATION_HPP_
+#define ROVIO_TRAJECTORYEVALUATION_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+#include <Eigen/Dense>
+
+namespace rovio{
+
+/** \brief Accuracy metrics of an estimated trajectory with respect to a groundtruth trajectory (positions only).
+ *
+ *  The estimate is associated to the linearly interpolated groundtruth and aligned with a rigid transformation
+ *  (Horn/Umeyama without scale) before the absolute trajectory error (ATE) is computed. The relative pose error
+ *  (RPE) is the translational error of the relative motions over a fixed time delta and does not need an alignment
+ *  (besides the rotation of the relative motion into the groundtruth frame).
+ */
+class TrajectoryEvaluation{
+ public:
+  std::map<double,Eigen::Vector3d> estimate_; /**<Estimated positions over time.*/
+  std::map<double,Eigen::Vector3d> groundtruth_; /**<Groundtruth positions over time.*/
+  double maxInterpolationGap_; /**<Maximal time gap [s] between two groundtruth samples used for the interpolation.*/
+
+  TrajectoryEvaluation(): maxInterpolationGap_(0.1){}
+
+  /** \brief Interpolated groundtruth position.
+   *
+   *   @return false if t is outside of the groundtruth or within a gap.
+   */
+  bool interpolateGroundtruth(const double t, Eigen::Vector3d& p) const{
+    auto itUpper = groundtruth_.lower_bound(t);
+    if(itUpper == groundtruth_.end()) return false;
+    if(itUpper->first == t){
+      p = itUpper->second;
+      return true;
+    }
+    if(itUpper == groundtruth_.begin()) return false;
+    auto itLower = std::prev(itUpper);
+    const double dt = itUpper->first-itLower->first;
+    if(dt > maxInterpolationGap_) return false;
+    const double a = (t-itLower->first)/dt;
+    p = (1.0-a)*itLower->second+a*itUpper->second;
+    return true;
+  }
+
+  /** \brief Associates the estimate with the groundtruth.
+   *
+   *   @param times - Output, times of the associated pairs.
+   *   @param est   - Output, estimated positions (3xN).
+   *   @param gt    - Output, groundtruth positions (3xN).
+   */
+  void associate(std::vector<double>& times, Eigen::Matrix3Xd& est, Eigen::Matrix3Xd& gt) const{
+    times.clear();
+    std::vector<Eigen::Vector3d> estVec, gtVec;
+    Eigen::Vector3d p;
+    for(const auto& entry : estimate_){
+      if(interpolateGroundtruth(entry.first,p)){
+        times.push_back(entry.first);
+        estVec.push_back(entry.second);
+        gtVec.push_back(p);
+      }
+    }
+    est.resize(3,estVec.size());
+    gt.resize(3,gtVec.size());
+    for(unsigned int i=0;i<estVec.size();i++){
+      est.col(i) = estVec[i];
+      gt.col(i) = gtVec[i];
+    }
+  }
+
+  /** \brief Rigid transformation (R,t) minimizing sum |gt - (R*est+t)|^2.
+   */
+  static void alignRigid(const Eigen::Matrix3Xd& est, const Eigen::Matrix3Xd& gt, Eigen::Matrix3d& R, Eigen::Vector3d& t){
+    R.setIdentity();
+    t.setZero();
+    if(est.cols() == 0) return;
+    const Eigen::Vector3d meanEst = est.rowwise().mean();
+    const Eigen::Vector3d meanGt = gt.rowwise().mean();
+    const Eigen::Matrix3d C = (gt.colwise()-meanGt)*(est.colwise()-meanEst).transpose();
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(C,Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Eigen::Matrix3d S = Eigen::Matrix3d::Identity();
+    if((svd.matrixU()*svd.matrixV().transpose()).determinant() < 0) S(2,2) = -1.0;
+    R = svd.matrixU()*S*svd.matrixV().transpose();
+    t = meanGt-R*meanEst;
+  }
+
+  /** \brief RMSE of the aligned positions [m], -1 if nothing could be associated.
+   *
+   *   @param nAssociated - Output, number of associated estimates.
+   */
+  double absoluteTrajectoryError(int* nAssociated = nullptr) const{
+    std::vector<double> times;
+    Eigen::Matrix3Xd est, gt;
+    associate(times,est,gt);
+    if(nAssociated != nullptr) *nAssociated = est.cols();
+    if(est.cols() < 3) return -1.0;
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+    alignRigid(est,gt,R,t);
+    const Eigen::Matrix3Xd error = (R*est).colwise()+t-gt;
+    return std::sqrt(error.colwise().squaredNorm().mean());
+  }
+
+  /** \brief RMSE of the translational error of the relative motions over delta [m], -1 if not available.
+   *
+   *   @param delta - Time delta [s] of the relative motions.
+   */
+  double relativePoseError(const double delta) const{
+    std::vector<double> times;
+    Eigen::Matrix3Xd est, gt;
+    associate(times,est,gt);
+    if(est.cols() < 3) return -1.0;
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+    alignRigid(est,gt,R,t);
+    double sum = 0.0;
+    int count = 0;
+    unsigned int j = 0;
+    for(unsigned int i=0;i<times.size();i++){
+      while(j < times.size() && times[j] < times[i]+delta) j++;
+      if(j == times.size()) break;
+      const Eigen::Vector3d dEst = R*(est.col(j)-est.col(i));
+      const Eigen::Vector3d dGt = gt.col(j)-gt.col(i);
+      sum += (dEst-dGt).squaredNorm();
+      count++;
+    }
+    return count > 0 ? std::sqrt(sum/count) : -1.0;
+  }
+};
+
+/** \brief Percentile (nearest rank) of a set of values, 0 if empty.
+ *
+ *   @param values - Values (get sorted).
+ *   @param p      - Percentile in [0,100].
+ */
+static inline double percentile(std::vector<double>& values, const double p){
+  if(values.empty()) return 0.0;
+  std::sort(values.begin(),values.end());
+  const int rank = std::min((int)values.size()-1,std::max(0,(int)std::ceil(p/100.0*values.size())-1));
+  return values[rank];
+}
+
+}
+
+
+#endif /* ROVIO_TRAJECTORYEVALUATION_HPP_ */
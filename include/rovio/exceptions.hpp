@@ -62,6 +62,11 @@ namespace rovio {
   {
     CameraNullPtrException(std::string function, std::string file, int line): ExceptionBase("Camera pointer is null!",function,file,line){}
   };
+
+  struct PyramidKernelException : public ExceptionBase
+  {
+    PyramidKernelException(std::string function, std::string file, int line): ExceptionBase("Unknown image pyramid kernel (pyramidKernel must be 0 or 1)!",function,file,line){}
+  };
 }
 
 /* Usage:
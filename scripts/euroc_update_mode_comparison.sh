@@ -0,0 +1,50 @@
+#!/bin/bash
+# Compares the batched image update (useBatchUpdate) against the sequential per-feature updates on an EuRoC bag.
+#
+# Both modes are replayed with rovio_regression on cfg/euroc/rovio.info, which only differ in useBatchUpdate. The
+# sequential run is used as baseline of the batched run, such that the regression table lists the ATE/RPE (and latency)
+# change of the batched mode. Requires a sourced workspace with rovio built and a running roscore.
+#
+# Usage: euroc_update_mode_comparison.sh <bag> [output_dir] [groundtruth_pose_topic]
+#   The groundtruth topic defaults to the Vicon pose of the V1/V2 sequences. The MH sequences only provide the Leica
+#   position, which is not supported by rovio_regression (the ATE/RPE are then reported as negative).
+
+set -e
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 <bag> [output_dir] [groundtruth_pose_topic]"
+  exit 1
+fi
+BAG=$(readlink -f "$1")
+OUT=${2:-euroc_update_mode_comparison}
+GT_TOPIC=${3:-/vicon/firefly_sbx/firefly_sbx}
+CFG=$(rospack find rovio)/cfg/euroc
+
+mkdir -p "$OUT"
+OUT=$(readlink -f "$OUT")
+sed -e 's/^\(\s*useBatchUpdate\s\+\)false;/\1true;/' "$CFG/rovio.info" > "$OUT/rovio_batch_update.info"
+if ! grep -q "^\s*useBatchUpdate\s\+true;" "$OUT/rovio_batch_update.info"; then
+  echo "Could not enable useBatchUpdate in $CFG/rovio.info"
+  exit 1
+fi
+
+run(){
+  local baseline=()
+  if [ -n "$3" ]; then baseline=(_baseline:="$3"); fi
+  rosrun rovio rovio_regression __name:=rovio_update_mode_comparison \
+    _filter_config:="$1" \
+    _camera0_config:="$CFG/euroc_cam0.yaml" \
+    _camera1_config:="$CFG/euroc_cam1.yaml" \
+    _rosbag_filename:="$BAG" \
+    _imu_topic_name:=/imu0 \
+    _cam0_topic_name:=/cam0/image_raw \
+    _cam1_topic_name:=/cam1/image_raw \
+    _groundtruth_pose_topic_name:="$GT_TOPIC" \
+    _result:="$2" \
+    "${baseline[@]}" || true # A non-zero exit code only flags a change beyond the tolerances
+}
+
+echo "== Sequential updates"
+run "$CFG/rovio.info" "$OUT/sequential.txt"
+echo "== Batched update"
+run "$OUT/rovio_batch_update.info" "$OUT/batch_update.txt" "$OUT/sequential.txt"
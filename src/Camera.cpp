@@ -12,6 +12,11 @@ namespace rovio{
     K_.setIdentity();
     type_ = RADTAN;
     valid_radius_ = std::numeric_limits<double>::max();
+    imageWidth_ = 0;
+    imageHeight_ = 0;
+    bearingLutStep_ = 0;
+    bearingLutCols_ = 0;
+    bearingLutRows_ = 0;
   };
 
   Camera::~Camera(){};
@@ -27,6 +32,10 @@ namespace rovio{
     K_(2,0) = config["camera_matrix"]["data"][6].as<double>();
     K_(2,1) = config["camera_matrix"]["data"][7].as<double>();
     K_(2,2) = config["camera_matrix"]["data"][8].as<double>();
+    if(config["image_width"] && config["image_height"]){
+      imageWidth_ = config["image_width"].as<int>();
+      imageHeight_ = config["image_height"].as<int>();
+    }
     std::cout << "Set Camera Matrix to:\n" << K_ << std::endl;
   }
 
@@ -97,574 +106,198 @@ namespace rovio{
     } else {
       std::cout << "ERROR: no camera Model detected!";
     }
+    buildBearingLut();
   }
 
-  void Camera::distortRadtan(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
-    const double x2 = in(0) * in(0);
-    const double y2 = in(1) * in(1);
-    const double xy = in(0) * in(1);
-    const double r2 = x2 + y2;
-    const double kr = (1 + ((k3_ * r2 + k2_) * r2 + k1_) * r2);
-    out(0) = in(0) * kr + p1_ * 2 * xy + p2_ * (r2 + 2 * x2);
-    out(1) = in(1) * kr + p1_ * (r2 + 2 * y2) + p2_ * 2 * xy;
-  }
-
-  void Camera::distortRadtan(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
-    const double x2 = in(0) * in(0);
-    const double y2 = in(1) * in(1);
-    const double xy = in(0) * in(1);
-    const double r2 = x2 + y2;
-    const double kr = (1 + ((k3_ * r2 + k2_) * r2 + k1_) * r2);
-    out(0) = in(0) * kr + p1_ * 2 * xy + p2_ * (r2 + 2 * x2);
-    out(1) = in(1) * kr + p1_ * (r2 + 2 * y2) + p2_ * 2 * xy;
-    J(0,0) = kr + 2.0 * k1_ * x2 + 4.0 * k2_ * x2 * r2 + 6.0 * k3_ * x2 * r2 * r2 + 2.0 * p1_ * in(1) + 6.0 * p2_ * in(0);
-    J(0,1) = 2.0 * k1_ * xy + 4.0 * k2_ * xy * r2 + 6.0 * k3_ * xy * r2 * r2 + 2 * p1_ * in(0) + 2 * p2_ * in(1);
-    J(1,0) = J(0,1);
-    J(1,1) = kr + 2.0 * k1_ * y2 + 4.0 * k2_ * y2 * r2 + 6.0 * k3_ * y2 * r2 * r2 + 6.0 * p1_ * in(1) + 2.0 * p2_ * in(0);
-  }
-
-  void Camera::distortRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
-    const double x2 = in(0) * in(0);
-    const double y2 = in(1) * in(1);
-    const double x_y = in(0) * in(1);
-    const double r2 = x2 + y2;
-    const double n = refrac_ind_;
-    const double n2 = n * n;
-
-    const double m_distort = n/sqrt(1 + r2 - (n2*r2));
-    out(0) = in(0) * m_distort;
-    out(1) = in(1) * m_distort;
-
-
-  }
-  void Camera::distortEquiRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
-    Eigen::Vector2d temp;
-    distortRefractive(in, temp);
-    distortEquidist(temp, out);
-
-  }
-
-  void Camera::distortRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index) const{
-    const double x2 = in(0) * in(0);
-    const double y2 = in(1) * in(1);
-    const double x_y = in(0) * in(1);
-    const double r2 = x2 + y2;
-    const double n = refrac_index;    // refractive index from state
-    const double n2 = n * n;
-
-    const double m_distort = n/sqrt(1 + r2 - (n2*r2));
-    out(0) = in(0) * m_distort;
-    out(1) = in(1) * m_distort;
-
-  }
-
-  void Camera::distortRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
-    const double x2 = in(0) * in(0);
-    const double y2 = in(1) * in(1);
-    const double x_y = in(0) * in(1);
-    const double r2 = x2 + y2;
-    const double n = refrac_ind_;
-    const double n2 = n * n;
-
-    const double m_distort = n/sqrt(1 + r2 - (n2*r2));
-    out(0) = in(0) * m_distort;
-    out(1) = in(1) * m_distort;
-
-    const double g = 1  + r2 - (n2*r2);
-
-    J(0,0) = n*pow(g, -2.0)*(sqrt(g)*x2*(n2 - 1) + pow(g, 1.5));
-    J(0,1) = n*pow(g, -1.5)*x_y*(n2 - 1);
-    J(1,0) = n*pow(g, -1.5)*x_y*(n2 - 1);
-    J(1,1) = n*pow(g, -2.0)*(sqrt(g)*y2*(n2 - 1) + pow(g, 1.5));
-  }
-
-  void Camera::distortEquiRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
-    Eigen::Vector2d temp;
-    Eigen::Matrix2d J_temp_refrac;
-    Eigen::Matrix2d J_temp_equi;
-
-    distortRefractive(in, temp, J_temp_refrac);
-    distortEquidist(temp, out, J_temp_equi);
-    J = J_temp_equi * J_temp_refrac;
-  }
-
-  void Camera::distortEquiRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J_equi, Eigen::Matrix2d& J_refrac) const{
-    Eigen::Vector2d temp;
-
-    distortRefractive(in, temp, J_refrac);
-    distortEquidist(temp, out, J_equi);
-  }
-
-  void Camera::distortRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index ,Eigen::Matrix2d& J) const{
-    const double x2 = in(0) * in(0);
-    const double y2 = in(1) * in(1);
-    const double x_y = in(0) * in(1);
-    const double r2 = x2 + y2;
-    const double n = refrac_index; // refractive index from state
-    const double n2 = n * n;
-
-    const double m_distort = n/sqrt(1 + r2 - (n2*r2));
-    out(0) = in(0) * m_distort;
-    out(1) = in(1) * m_distort;
-
-    const double g = 1  + r2 - (n2*r2);
-
-    J(0,0) = n*pow(g, -2.0)*(sqrt(g)*x2*(n2 - 1) + pow(g, 1.5));
-    J(0,1) = n*pow(g, -1.5)*x_y*(n2 - 1);
-    J(1,0) = n*pow(g, -1.5)*x_y*(n2 - 1);
-    J(1,1) = n*pow(g, -2.0)*(sqrt(g)*y2*(n2 - 1) + pow(g, 1.5));
-  }
-
-  void Camera::distortEquiRefractive(const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index, Eigen::Matrix2d& J) const{
-    Eigen::Vector2d temp;
-    Eigen::Matrix2d J_temp_refrac;
-    Eigen::Matrix2d J_temp_equi;
-
-    distortRefractive(in, temp, refrac_index, J_temp_refrac);
-    distortEquidist(temp, out, J_temp_equi);
-    J = J_temp_equi * J_temp_refrac;
-  }
-
-  void Camera::distortEquidist(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
-    const double x2 = in(0) * in(0);
-    const double y2 = in(1) * in(1);
-    const double r = std::sqrt(x2 + y2); // 1/r*x
-
-    if(r < 1e-8){
-      out(0) = in(0);
-      out(1) = in(1);
-      return;
-    }
-
-    const double th = atan(r); // 1/(r^2 + 1)
-    const double th2 = th*th;
-    const double th4 = th2*th2;
-    const double th6 = th2*th4;
-    const double th8 = th2*th6;
-    const double thd = th * (1.0 + k1_ * th2 + k2_ * th4 + k3_ * th6 + k4_ * th8);
-    const double s = thd/r;
-
-    out(0) = in(0) * s;
-    out(1) = in(1) * s;
-  }
-
-  void Camera::distortEquidist(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
-    const double x2 = in(0) * in(0);
-    const double y2 = in(1) * in(1);
-    const double r = std::sqrt(x2 + y2);
-
-    if(r < 1e-8){
-      out(0) = in(0);
-      out(1) = in(1);
-      J.setIdentity();
+  void Camera::buildBearingLut(){
+    bearingLut_.clear();
+    bearingLutValid_.clear();
+    bearingLutCols_ = 0;
+    bearingLutRows_ = 0;
+    if(bearingLutStep_ <= 0 || imageWidth_ <= 0 || imageHeight_ <= 0){
       return;
     }
-
-    const double r_x = 1/r*in(0);
-    const double r_y = 1/r*in(1);
-
-    const double th = atan(r); // 1/(r^2 + 1)
-    const double th_r = 1/(r*r+1);
-    const double th2 = th*th;
-    const double th4 = th2*th2;
-    const double th6 = th2*th4;
-    const double th8 = th2*th6;
-    const double thd = th * (1.0 + k1_ * th2 + k2_ * th4 + k3_ * th6 + k4_ * th8);
-    const double thd_th = 1.0 + 3 * k1_ * th2 + 5* k2_ * th4 + 7 * k3_ * th6 + 9 * k4_ * th8;
-    const double s = thd/r;
-    const double s_r = thd_th*th_r/r - thd/(r*r);
-
-    out(0) = in(0) * s;
-    out(1) = in(1) * s;
-
-    J(0,0) = s + in(0)*s_r*r_x;
-    J(0,1) = in(0)*s_r*r_y;
-    J(1,0) = in(1)*s_r*r_x;
-    J(1,1) = s + in(1)*s_r*r_y;
-  }
-
-  void Camera::distortDoubleSphere(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
-
-      const double x2 = in(0) * in(0);
-      const double y2 = in(1) * in(1);
-
-      if((x2 + y2) < 1e-16){
-        out(0) = in(0);
-        out(1) = in(1);
-        return;
+    // Refractive models: only the index independent (equidistant) part is tabulated, the refraction is applied analytically
+    const bool equidistOnly = (type_ == REFRAC || type_ == EQUIREFRAC);
+    bearingLutCols_ = imageWidth_/bearingLutStep_+2;
+    bearingLutRows_ = imageHeight_/bearingLutStep_+2;
+    bearingLut_.resize(bearingLutCols_*bearingLutRows_);
+    bearingLutValid_.resize(bearingLutCols_*bearingLutRows_);
+    Eigen::Vector2d y;
+    for(int v=0;v<bearingLutRows_;v++){
+      // Warm start along the row (neighbouring entries are close)
+      bool hasPrev = false;
+      for(int u=0;u<bearingLutCols_;u++){
+        const int ind = v*bearingLutCols_+u;
+        y(0) = (static_cast<double>(u*bearingLutStep_) - K_(0, 2)) / K_(0, 0);
+        y(1) = (static_cast<double>(v*bearingLutStep_) - K_(1, 2)) / K_(1, 1);
+        Eigen::Vector2d ybar = hasPrev ? bearingLut_[ind-1] : y;
+        bool success = equidistOnly ? undistortEquidistIterative(y,ybar) : undistortIterative(y,ybar);
+        if(!success && hasPrev){
+          ybar = y;
+          success = equidistOnly ? undistortEquidistIterative(y,ybar) : undistortIterative(y,ybar);
+        }
+        bearingLut_[ind] = ybar;
+        bearingLutValid_[ind] = success;
+        hasPrev = success;
       }
-
-      const double d1 = std::sqrt(x2 + y2 + 1.0);
-      const double d2 = std::sqrt(x2 + y2 + (k1_*d1 + 1.0)*(k1_*d1 + 1.0));
-      const double scaling = 1.0f/(k2_*d2 + (1-k2_)*(k1_*d1+1.0));
-
-      out(0) = in(0) * scaling;
-      out(1) = in(1) * scaling;
+    }
+    std::cout << "Built bearing lookup table (" << bearingLutCols_ << "x" << bearingLutRows_ << ", step " << bearingLutStep_ << ")" << std::endl;
   }
 
-  void Camera::distortDoubleSphere(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
-    const double x2 = in(0) * in(0);
-    const double y2 = in(1) * in(1);
-
-    if((x2 + y2) < 1e-16){
-      out(0) = in(0);
-      out(1) = in(1);
-      J.setIdentity();
-      return;
+  bool Camera::lookupBearingLut(const cv::Point2f& c, Eigen::Vector2d& ybar) const{
+    if(bearingLut_.empty()){
+      return false;
     }
-
-    const double d1 = std::sqrt(x2 + y2 + 1.0);
-    const double d2 = std::sqrt(x2 + y2 + (k1_*d1 + 1.0)*(k1_*d1 + 1.0));
-    const double s = 1.0f/(k2_*d2 + (1-k2_)*(k1_*d1+1.0));
-
-    out(0) = in(0) * s;
-    out(1) = in(1) * s;
-
-    const double d1dx = in(0)/d1;
-    const double d1dy = in(1)/d1;
-    const double d2dx = (in(0) + d1dx*k1_*(d1*k1_ + 1.0))/(d2);
-    const double d2dy = (in(1) + d1dy*k1_*(d1*k1_ + 1.0))/(d2);
-
-    J(0,0) = -in(0)*(d2dx*k2_ - d1dx*k1_*(k2_ - 1.0))*s*s + s;
-    J(0,1) = -s*s*in(0)*(d2dy*k2_ - d1dy*k1_*(k2_ - 1.0));
-    J(1,0) = -s*s*in(1)*(d2dx*k2_ - d1dx*k1_*(k2_ - 1.0));
-    J(1,1) = -in(1)*(d2dy*k2_ - d1dy*k1_*(k2_ - 1.0))*s*s + s;
+    const double gu = static_cast<double>(c.x)/bearingLutStep_;
+    const double gv = static_cast<double>(c.y)/bearingLutStep_;
+    const int u0 = floor(gu);
+    const int v0 = floor(gv);
+    if(u0 < 0 || v0 < 0 || u0 >= bearingLutCols_-1 || v0 >= bearingLutRows_-1){
+      return false;
+    }
+    const int ind = v0*bearingLutCols_+u0;
+    if(!bearingLutValid_[ind] || !bearingLutValid_[ind+1] || !bearingLutValid_[ind+bearingLutCols_] || !bearingLutValid_[ind+bearingLutCols_+1]){
+      return false;
+    }
+    const double su = gu-u0;
+    const double sv = gv-v0;
+    ybar = (1-su)*(1-sv)*bearingLut_[ind] + su*(1-sv)*bearingLut_[ind+1]
+         + (1-su)*sv*bearingLut_[ind+bearingLutCols_] + su*sv*bearingLut_[ind+bearingLutCols_+1];
+    return true;
   }
 
-  void Camera::distort(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
-    switch(type_){
-      case RADTAN:
-        distortRadtan(in,out);
+  /** \brief Forwards a single distortion call to the statically specialized camera model of the camera.
+   *
+   *  The projection functions do not go through here, they select their specialized kernel once per projection.
+   */
+  template<typename... Args>
+  static inline void dispatchDistort(const Camera& cam, Args&... args){
+    switch(cam.type_){
+      case Camera::REFRAC:
+        CameraModel<Camera::REFRAC>::distort(cam,args...);
         break;
-      case REFRAC:
-        distortRefractive(in,out);
-        break;
-      case EQUIDIST:
-        distortEquidist(in,out);
+      case Camera::EQUIDIST:
+        CameraModel<Camera::EQUIDIST>::distort(cam,args...);
         break;
-      case EQUIREFRAC:
-        distortEquiRefractive(in,out);
+      case Camera::EQUIREFRAC:
+        CameraModel<Camera::EQUIREFRAC>::distort(cam,args...);
         break;
-      case DS:
-        distortDoubleSphere(in,out);
+      case Camera::DS:
+        CameraModel<Camera::DS>::distort(cam,args...);
         break;
       default:
-        distortRadtan(in,out);
+        CameraModel<Camera::RADTAN>::distort(cam,args...);
         break;
     }
   }
 
+  void Camera::distort(const Eigen::Vector2d& in, Eigen::Vector2d& out) const{
+    dispatchDistort(*this,in,out);
+  }
+
   void Camera::distort(const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index) const{
-    std:: cout << "in distort with refrac_index" << std::endl;
-    switch(type_){
-      case RADTAN:
-        distortRadtan(in,out);
-        break;
-      case REFRAC:
-        distortRefractive(in,out,refrac_index);
-        break;
-      case EQUIDIST:
-        distortEquidist(in,out);
-        break;
-      case EQUIREFRAC:
-        distortEquiRefractive(in,out);
-        break;
-      case DS:
-        distortDoubleSphere(in,out);
-        break;
-      default:
-        distortRadtan(in,out);
-        break;
-    }
+    dispatchDistort(*this,in,out,refrac_index);
   }
 
   void Camera::distort(const Eigen::Vector2d& in, Eigen::Vector2d& out, Eigen::Matrix2d& J) const{
+    dispatchDistort(*this,in,out,J);
+  }
+
+  void Camera::distort(const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index, Eigen::Matrix2d& J) const{
+    dispatchDistort(*this,in,out,refrac_index,J);
+  }
+  
+
+  bool Camera::bearingToPixelRuntime(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>* J, Eigen::Matrix<double,2,1>* Jdpdn, const double* refrac_index) const{
     switch(type_){
-      case RADTAN:
-        distortRadtan(in,out,J);
-        break;
       case REFRAC:
-        distortRefractive(in,out,J);
-        break;
+        return bearingToPixelModel<REFRAC>(vec,c,J,Jdpdn,refrac_index);
       case EQUIDIST:
-        distortEquidist(in,out,J);
-        break;
+        return bearingToPixelModel<EQUIDIST>(vec,c,J,Jdpdn,refrac_index);
       case EQUIREFRAC:
-        distortEquiRefractive(in,out,J);
-        break;
+        return bearingToPixelModel<EQUIREFRAC>(vec,c,J,Jdpdn,refrac_index);
       case DS:
-        distortDoubleSphere(in,out,J);
-        break;
+        return bearingToPixelModel<DS>(vec,c,J,Jdpdn,refrac_index);
       default:
-        distortRadtan(in,out,J);
-        break;
+        return bearingToPixelModel<RADTAN>(vec,c,J,Jdpdn,refrac_index);
     }
   }
 
-void Camera::distort(const Eigen::Vector2d& in, Eigen::Vector2d& out, const double& refrac_index, Eigen::Matrix2d& J) const{
-
+  bool Camera::pixelToBearingRuntime(const cv::Point2f& c,Eigen::Vector3d& vec) const{
     switch(type_){
-      case RADTAN:
-        distortRadtan(in,out,J);
-        break;
       case REFRAC:
-        distortRefractive(in,out, refrac_index,J);
-        break;
+        return pixelToBearingModel<REFRAC>(c,vec);
       case EQUIDIST:
-        distortEquidist(in,out,J);
-        break;
+        return pixelToBearingModel<EQUIDIST>(c,vec);
       case EQUIREFRAC:
-        distortEquiRefractive(in,out, refrac_index,J);
-        break;
+        return pixelToBearingModel<EQUIREFRAC>(c,vec);
       case DS:
-        distortDoubleSphere(in,out,J);
-        break;
+        return pixelToBearingModel<DS>(c,vec);
       default:
-        distortRadtan(in,out,J);
-        break;
-    }
-  }
-  
-
-  bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c) const{
-    // Project
-    if(vec(2)<=0) return false;
-    const Eigen::Vector2d undistorted = Eigen::Vector2d(vec(0)/vec(2),vec(1)/vec(2));
-
-    // Distort
-    Eigen::Vector2d distorted;
-    distort(undistorted,distorted);
-
-    // Shift origin and scale
-    c.x = static_cast<float>(K_(0, 0)*distorted(0) + K_(0, 2));
-    c.y = static_cast<float>(K_(1, 1)*distorted(1) + K_(1, 2));
-    return true;
-  }
-
-  bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c, const double& refrac_index) const{
-    // Project
-    if(vec(2)<=0) return false;
-    const Eigen::Vector2d undistorted = Eigen::Vector2d(vec(0)/vec(2),vec(1)/vec(2));
-
-    // Distort
-    Eigen::Vector2d distorted;
-    // std::cout << "in bearingToPixel with refrac_index" << std::endl;
-    distort(undistorted,distorted, refrac_index);
-
-    // Shift origin and scale
-    c.x = static_cast<float>(K_(0, 0)*distorted(0) + K_(0, 2));
-    c.y = static_cast<float>(K_(1, 1)*distorted(1) + K_(1, 2));
-    return true;
-  }
-
-  bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>& J, Eigen::Matrix<double,2,1>& Jdpdn, const double& refrac_index) const{
-    // Project
-    if(vec(2)<=0) return false;
-    const Eigen::Vector2d undistorted = Eigen::Vector2d(vec(0)/vec(2),vec(1)/vec(2));
-    Eigen::Matrix<double,2,3> J1; J1.setZero();
-    J1(0,0) = 1.0/vec(2);
-    J1(0,2) = -vec(0)/pow(vec(2),2);
-    J1(1,1) = 1.0/vec(2);
-    J1(1,2) = -vec(1)/pow(vec(2),2);
-
-    // Distort
-    Eigen::Vector2d distorted;
-    Eigen::Matrix2d J2;
-    Eigen::Matrix2d J_equi;
-    Eigen::Matrix2d J_refrac;
-    // std::cout << "in bearingToPixel with distort(undistorted,distorted, refrac_index, J2)" << std::endl;
-    
-    // temporary fix for equirefractive
-    if (type_ == EQUIREFRAC){
-      distortEquiRefractive( undistorted,  distorted, J_equi, J_refrac);
-      J2 = J_equi * J_refrac;
-    }
-    else{
-      distort(undistorted,distorted, refrac_index, J2);
+        return pixelToBearingModel<RADTAN>(c,vec);
     }
-
-    // Shift origin and scale
-    c.x = static_cast<float>(K_(0, 0)*distorted(0) + K_(0, 2));
-    c.y = static_cast<float>(K_(1, 1)*distorted(1) + K_(1, 2));
-    Eigen::Matrix2d J3; J3.setZero();
-    J3(0,0) = K_(0, 0);
-    J3(1,1) = K_(1, 1);
-
-    J = J3*J2*J1;
-    
-    // Jacobian of distorted point w.r.t. refractive index
-    double n = refrac_index;
-    double r2 = undistorted(0)*undistorted(0) + undistorted(1)*undistorted(1);
-    double g = 1 + r2 - (n*n*r2);
-    // clip g to avoid division by zero
-    // common_term = \frac{\g^{1/2}*n^2*r^2 + g^{3/2}}{g^2}
-    double common_term = (sqrt(g)*n*n*r2 + pow(g, 1.5))/(g*g);
-
-    // Jdpdn(0) = (K_(0, 0)*undistorted(0)*common_term);
-    // Jdpdn(1) = (K_(1, 1)*undistorted(1)*common_term);
-
-    Jdpdn(0) = undistorted(0)*common_term;
-    Jdpdn(1) = undistorted(1)*common_term;
-
-    Jdpdn = K_.block<2,2>(0,0)*J_equi*Jdpdn;
-
-    return true;
-  }
-
-  bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>& J) const{
-    // Project
-    if(vec(2)<=0) return false;
-    const Eigen::Vector2d undistorted = Eigen::Vector2d(vec(0)/vec(2),vec(1)/vec(2));
-    Eigen::Matrix<double,2,3> J1; J1.setZero();
-    J1(0,0) = 1.0/vec(2);
-    J1(0,2) = -vec(0)/pow(vec(2),2);
-    J1(1,1) = 1.0/vec(2);
-    J1(1,2) = -vec(1)/pow(vec(2),2);
-
-    // Distort
-    Eigen::Vector2d distorted;
-    Eigen::Matrix2d J2;
-    // std::cout << "in bearingToPixel with distort(undistorted,distorted,J2)" << std::endl;
-
-    distort(undistorted,distorted,J2);
-
-    // Shift origin and scale
-    c.x = static_cast<float>(K_(0, 0)*distorted(0) + K_(0, 2));
-    c.y = static_cast<float>(K_(1, 1)*distorted(1) + K_(1, 2));
-    Eigen::Matrix2d J3; J3.setZero();
-    J3(0,0) = K_(0, 0);
-    J3(1,1) = K_(1, 1);
-
-    J = J3*J2*J1;
-
-    return true;
   }
 
-  bool Camera::bearingToPixel(const Eigen::Vector3d& vec, cv::Point2f& c, Eigen::Matrix<double,2,3>& J, const double& refrac_index) const{
-    // Project
-    if(vec(2)<=0) return false;
-    const Eigen::Vector2d undistorted = Eigen::Vector2d(vec(0)/vec(2),vec(1)/vec(2));
-    Eigen::Matrix<double,2,3> J1; J1.setZero();
-    J1(0,0) = 1.0/vec(2);
-    J1(0,2) = -vec(0)/pow(vec(2),2);
-    J1(1,1) = 1.0/vec(2);
-    J1(1,2) = -vec(1)/pow(vec(2),2);
-
-    // Distort
-    Eigen::Vector2d distorted;
-    Eigen::Matrix2d J2;
-    // std::cout << "in bearingToPixel with distort(undistorted,distorted,refrac_index,J2)" << std::endl;
-
-    distort(undistorted,distorted,refrac_index,J2);
-
-    // Shift origin and scale
-    c.x = static_cast<float>(K_(0, 0)*distorted(0) + K_(0, 2));
-    c.y = static_cast<float>(K_(1, 1)*distorted(1) + K_(1, 2));
-    Eigen::Matrix2d J3; J3.setZero();
-    J3(0,0) = K_(0, 0);
-    J3(1,1) = K_(1, 1);
-
-    J = J3*J2*J1;
-
-    return true;
-  }
-
-  bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c) const{
-    return bearingToPixel(n.getVec(),c);
-  }
-  
-  bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c, const double& refrac_index) const{
-    return bearingToPixel(n.getVec(),c, refrac_index);
-  }
-
-  bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c, Eigen::Matrix<double,2,2>& J) const{
-    Eigen::Matrix<double,3,2> J1;
-    J1 = n.getM();
-    Eigen::Matrix<double,2,3> J2;
-    const bool success = bearingToPixel(n.getVec(),c,J2);
-    J = J2*J1;
-    return success;
-  }
-
-  bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c, Eigen::Matrix<double,2,2>& J, const double& refrac_index) const{
-    Eigen::Matrix<double,3,2> J1;
-    J1 = n.getM();
-    Eigen::Matrix<double,2,3> J2;
-    const bool success = bearingToPixel(n.getVec(),c,J2, refrac_index);
-    J = J2*J1;
-    return success;
-  }
-
-  bool Camera::bearingToPixel(const LWF::NormalVectorElement& n, cv::Point2f& c, Eigen::Matrix<double,2,2>& J, Eigen::Matrix<double,2,1>& Jdpdn, const double& refrac_index) const{
-    Eigen::Matrix<double,3,2> J1;
-    J1 = n.getM();
-    Eigen::Matrix<double,2,3> J2;
-    const bool success = bearingToPixel(n.getVec(),c,J2,Jdpdn, refrac_index);
-    J = J2*J1;
-    return success;
-  }
-
-  bool Camera::pixelToBearing(const cv::Point2f& c,Eigen::Vector3d& vec) const{
-    // Shift origin and scale
-    Eigen::Vector2d y;
-    y(0) = (static_cast<double>(c.x) - K_(0, 2)) / K_(0, 0);
-    y(1) = (static_cast<double>(c.y) - K_(1, 2)) / K_(1, 1);
-
-    // Undistort by optimizing
-    const int max_iter = 100;
+  bool Camera::undistortEquidistIterative(const Eigen::Vector2d& y, Eigen::Vector2d& ybar, const int max_iter) const{
     const double tolerance = 1e-10;
-    Eigen::Vector2d ybar = y; // current guess (undistorted)
     Eigen::Matrix2d J;
-    Eigen::Vector2d y_tmp; // current guess (distorted)
+    Eigen::Vector2d y_tmp;
     Eigen::Vector2d e;
-    Eigen::Vector2d du;
-    bool success = false;
     for (int i = 0; i < max_iter; i++) {
-      distort(ybar,y_tmp,J);
+      distortEquidist(ybar,y_tmp,J);
       e = y - y_tmp;
-      du = (J.transpose() * J).inverse() * J.transpose() * e;
-      ybar += du;
+      ybar += J.inverse() * e;
       if (e.dot(e) <= tolerance){
-        success = true;
-        break;
+        return true;
       }
-      // else{
-      //   std::cout << "Failed"<< std::endl;
-      //   std::cout << "e.dot(e) = " << e.dot(e) << std::endl;
-      //   std::cout << "ybar = " << ybar.transpose() << std::endl;
-        
-      // }
     }
-    if(success){
-      y = ybar;
-      vec = Eigen::Vector3d(y(0),y(1),1.0).normalized();
+    return false;
+  }
+
+  bool Camera::undistortIterative(const Eigen::Vector2d& y, Eigen::Vector2d& ybar, const int max_iter) const{
+    switch(type_){
+      case REFRAC:
+        return undistortIterativeModel<REFRAC>(y,ybar,max_iter);
+      case EQUIDIST:
+        return undistortIterativeModel<EQUIDIST>(y,ybar,max_iter);
+      case EQUIREFRAC:
+        return undistortIterativeModel<EQUIREFRAC>(y,ybar,max_iter);
+      case DS:
+        return undistortIterativeModel<DS>(y,ybar,max_iter);
+      default:
+        return undistortIterativeModel<RADTAN>(y,ybar,max_iter);
     }
-    return success;
   }
 
   bool Camera::pixelToBearingAnalytical(const cv::Point2f& c,Eigen::Vector3d& vec) const{
-    // Shift origin and scale
     Eigen::Vector2d y;
-    // y(0) = (static_cast<double>(c.x) - K_(0, 2)) / K_(0, 0);
-    // y(1) = (static_cast<double>(c.y) - K_(1, 2)) / K_(1, 1);
-    y(0) = static_cast<double>(c.x);
-    y(1) = static_cast<double>(c.y);
-
-    
-    // Convert point to opencv format
-    cv::Mat y_mat(1, 2, CV_32F);
-    y_mat.at<float>(0, 0) = y(0);
-    y_mat.at<float>(0, 1) = y(1);
-    y_mat = y_mat.reshape(2); // Nx1, 2-channel
-
-
-    cv::Matx33d K(K_(0,0), 0, K_(0,2), 0, K_(1,1), K_(1,2), 0, 0, 1);
-    cv::Vec4d D(k1_, k2_, k3_, k4_);
-    // cv::undistortPoints(y_mat, undistorted, K, D);
-    cv::fisheye::undistortPoints(y_mat, y_mat, K, D);
-
-    y(0) = y_mat.at<float>(0, 0);
-    y(1) = y_mat.at<float>(0, 1);
+    Eigen::Vector2d ybar;
+    bool fromLut = false;
+    if(lookupBearingLut(c,ybar)){
+      // Polish the tabulated equidistant undistortion
+      y(0) = (static_cast<double>(c.x) - K_(0, 2)) / K_(0, 0);
+      y(1) = (static_cast<double>(c.y) - K_(1, 2)) / K_(1, 1);
+      fromLut = undistortEquidistIterative(y,ybar,5);
+      y = ybar;
+    }
+    if(!fromLut){
+      y(0) = static_cast<double>(c.x);
+      y(1) = static_cast<double>(c.y);
+
+      // Convert point to opencv format
+      cv::Mat y_mat(1, 2, CV_32F);
+      y_mat.at<float>(0, 0) = y(0);
+      y_mat.at<float>(0, 1) = y(1);
+      y_mat = y_mat.reshape(2); // Nx1, 2-channel
+
+      cv::Matx33d K(K_(0,0), 0, K_(0,2), 0, K_(1,1), K_(1,2), 0, 0, 1);
+      cv::Vec4d D(k1_, k2_, k3_, k4_);
+      cv::fisheye::undistortPoints(y_mat, y_mat, K, D);
+
+      y(0) = y_mat.at<float>(0, 0);
+      y(1) = y_mat.at<float>(0, 1);
+    }
 
     // Undistort by analytical solution
     const double x2 = y(0) * y(0);
@@ -681,22 +314,6 @@ void Camera::distort(const Eigen::Vector2d& in, Eigen::Vector2d& out, const doub
   }
 
 
-  bool Camera::pixelToBearing(const cv::Point2f& c,LWF::NormalVectorElement& n) const{
-    Eigen::Vector3d vec;
-    bool success;
-    if (type_==REFRAC || type_==EQUIREFRAC){
-      success = pixelToBearingAnalytical(c,vec);
-    }
-    else{
-      success = pixelToBearing(c,vec);
-    }
-
-    n.setFromVector(vec);
-    return success;
-  }
-
-
-
   void Camera::testCameraModel(){
     double d = 1e-4;
     LWF::NormalVectorElement b_s;
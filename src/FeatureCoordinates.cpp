@@ -103,6 +103,12 @@ namespace rovio{
     }
   }
 
+  void FeatureCoordinates::set_projected_c(const cv::Point2f& c){
+    assert(valid_nor_);
+    c_ = c;
+    valid_c_ = true;
+  }
+
   bool FeatureCoordinates::com_warp_c() const{
     if(!valid_warp_c_){
       if(valid_warp_nor_ && com_c() && com_nor()){
@@ -0,0 +1,302 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+/* Microbenchmarks of the core kernels on synthetic data.
+ *
+ * Usage: benchmark_kernels [min_seconds_per_kernel]
+ * Output (stdout, CSV): kernel,levels,patch_size,variant,ns_per_op,ops_per_s
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "rovio/Camera.hpp"
+#include "rovio/FeatureCoordinates.hpp"
+#include "rovio/FilterStates.hpp"
+#include "rovio/ImagePyramid.hpp"
+#include "rovio/ImuPrediction.hpp"
+#include "rovio/MultilevelPatch.hpp"
+#include "rovio/MultilevelPatchAlignment.hpp"
+#include "rovio/Patch.hpp"
+
+using namespace rovio;
+
+static double minSeconds_ = 0.2;
+static volatile float sink_ = 0.0f; /**<Keeps the compiler from removing the benchmarked code.*/
+
+/** \brief Runs f repeatedly for at least minSeconds_ and prints its time per call.
+ *
+ *   @param f            - Kernel, returns a value that is accumulated into sink_.
+ *   @param opsPerCall   - Number of operations executed per call of f (e.g. number of patches).
+ */
+void benchmark(const std::string& kernel, const int levels, const int patchSize, const std::string& variant,
+               const std::function<float()>& f, const int opsPerCall = 1){
+  for(int i=0;i<3;i++) sink_ = sink_ + f(); // Warm up
+  long calls = 0;
+  float acc = 0.0f;
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0.0;
+  long batch = 1;
+  while(elapsed < minSeconds_){
+    for(long i=0;i<batch;i++) acc += f();
+    calls += batch;
+    batch *= 2;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+  }
+  sink_ = sink_ + acc;
+  const double nsPerOp = elapsed*1e9/(calls*opsPerCall);
+  std::printf("%s,%d,%d,%s,%.2f,%.1f\n",kernel.c_str(),levels,patchSize,variant.c_str(),nsPerOp,1e9/nsPerOp);
+  std::fflush(stdout);
+}
+
+/** \brief Textured synthetic image (smooth blobs plus noise), such that patches have gradients and corners are found.
+ */
+cv::Mat syntheticImage(const int width, const int height){
+  cv::Mat noise(height,width,CV_8UC1);
+  cv::RNG rng(0);
+  rng.fill(noise,cv::RNG::UNIFORM,0,255);
+  cv::Mat img;
+  cv::GaussianBlur(noise,img,cv::Size(0,0),2.0);
+  cv::normalize(img,img,0,255,cv::NORM_MINMAX);
+  return img;
+}
+
+/** \brief Patch, pyramid, detection and alignment kernels for one patch size / number of levels.
+ */
+template<int nLevels, int patchSize>
+void benchmarkPatchKernels(const cv::Mat& img){
+  const int nPatches = 50;
+  Camera camera;
+  ImagePyramid<nLevels> pyr;
+  pyr.computeFromImage(img);
+  const int border = patchSize*(1<<nLevels)+8;
+  std::vector<FeatureCoordinates> coordinates(nPatches,FeatureCoordinates(&camera));
+  std::vector<FeatureCoordinates> perturbed(nPatches,FeatureCoordinates(&camera));
+  cv::RNG rng(1);
+  for(int i=0;i<nPatches;i++){
+    coordinates[i].set_c(cv::Point2f(rng.uniform(border,img.cols-border),rng.uniform(border,img.rows-border)));
+    coordinates[i].set_warp_identity();
+    perturbed[i].set_c(coordinates[i].get_c()+cv::Point2f(rng.uniform(-1.5f,1.5f),rng.uniform(-1.5f,1.5f)));
+    perturbed[i].set_warp_identity();
+  }
+  std::vector<MultilevelPatch<nLevels,patchSize>> mlps(nPatches);
+  for(int i=0;i<nPatches;i++) mlps[i].extractMultilevelPatchFromImage(pyr,coordinates[i],nLevels-1,true);
+
+  // Patch
+  Patch<patchSize> patch;
+  benchmark("Patch::extractPatchFromImage",nLevels,patchSize,"border",[&](){
+    float s = 0.0f;
+    for(int i=0;i<nPatches;i++){
+      patch.extractPatchFromImage(pyr.imgs_[0],coordinates[i],true);
+      s += patch.patch_[0];
+    }
+    return s;
+  },nPatches);
+  benchmark("Patch::computeGradientParameters",nLevels,patchSize,"",[&](){
+    float s = 0.0f;
+    for(int i=0;i<nPatches;i++){
+      Patch<patchSize>& p = mlps[i].patches_[0];
+      p.validGradientParameters_ = false;
+      p.computeGradientParameters();
+      s += p.s_;
+    }
+    return s;
+  },nPatches);
+
+  // Alignment
+  MultilevelPatchAlignment<nLevels,patchSize> alignment;
+  Eigen::MatrixXf A, b;
+  benchmark("MultilevelPatchAlignment::getLinearAlignEquations",nLevels,patchSize,"",[&](){
+    float s = 0.0f;
+    for(int i=0;i<nPatches;i++){
+      if(alignment.getLinearAlignEquations(pyr,mlps[i],perturbed[i],0,nLevels-1,A,b)) s += b(0);
+    }
+    return s;
+  },nPatches);
+  FeatureCoordinates cOut(&camera);
+  benchmark("MultilevelPatchAlignment::align2DComposed",nLevels,patchSize,"",[&](){
+    float s = 0.0f;
+    for(int i=0;i<nPatches;i++){
+      if(alignment.align2DComposed(cOut,pyr,mlps[i],perturbed[i],nLevels-1,0,nLevels-1)) s += cOut.get_c().x;
+    }
+    return s;
+  },nPatches);
+
+  // Pyramid and detection
+  ImagePyramid<nLevels> pyrTemp;
+  benchmark("ImagePyramid::computeFromImage",nLevels,patchSize,"default",[&](){
+    pyrTemp.computeFromImage(img);
+    return (float)pyrTemp.imgs_[nLevels-1].at<uchar>(0,0);
+  });
+  FeatureCoordinatesVec candidates;
+  benchmark("ImagePyramid::detectFastCorners",nLevels,patchSize,"level1",[&](){
+    candidates.clear();
+    pyr.detectFastCorners(candidates,std::min(1,nLevels-1),10);
+    return (float)candidates.size();
+  });
+}
+
+/** \brief Projection kernels of one distortion model.
+ */
+void benchmarkCamera(const Camera::ModelType type, const std::string& name){
+  Camera camera;
+  camera.type_ = type;
+  camera.K_ << 460.0, 0.0, 376.0, 0.0, 460.0, 240.0, 0.0, 0.0, 1.0;
+  camera.k1_ = -0.28; camera.k2_ = 0.07; camera.k3_ = 0.0; camera.k4_ = 0.0;
+  camera.p1_ = 2e-4; camera.p2_ = 2e-5;
+  if(type == Camera::EQUIDIST || type == Camera::EQUIREFRAC){
+    camera.k1_ = -0.01; camera.k2_ = 0.002; camera.k3_ = -0.001; camera.k4_ = 0.0002;
+  }
+  if(type == Camera::DS){
+    camera.k1_ = -0.2; camera.k2_ = 0.6;
+  }
+  camera.refrac_ind_ = 1.33;
+  const int nPoints = 256;
+  std::vector<cv::Point2f> pixels(nPoints);
+  std::vector<Eigen::Vector3d> bearings(nPoints);
+  cv::RNG rng(2);
+  for(int i=0;i<nPoints;i++){
+    pixels[i] = cv::Point2f(rng.uniform(100.0f,652.0f),rng.uniform(80.0f,400.0f));
+    camera.pixelToBearing(pixels[i],bearings[i]);
+  }
+  cv::Point2f c;
+  benchmark("Camera::bearingToPixel",0,0,name,[&](){
+    float s = 0.0f;
+    for(int i=0;i<nPoints;i++){
+      if(camera.bearingToPixel(bearings[i],c)) s += c.x;
+    }
+    return s;
+  },nPoints);
+  Eigen::Matrix<double,2,3> J;
+  benchmark("Camera::bearingToPixel",0,0,name+"_jacobian",[&](){
+    float s = 0.0f;
+    for(int i=0;i<nPoints;i++){
+      if(camera.bearingToPixel(bearings[i],c,J)) s += J(0,0);
+    }
+    return s;
+  },nPoints);
+  Eigen::Vector3d vec;
+  benchmark("Camera::pixelToBearing",0,0,name,[&](){
+    float s = 0.0f;
+    for(int i=0;i<nPoints;i++){
+      if(camera.pixelToBearing(pixels[i],vec)) s += vec(0);
+    }
+    return s;
+  },nPoints);
+}
+
+/** \brief Single IMU prediction step with the configured filter dimensions.
+ */
+void benchmarkImuPrediction(){
+#ifdef ROVIO_NMAXFEATURE
+  static constexpr int nMax = ROVIO_NMAXFEATURE;
+#else
+  static constexpr int nMax = 25;
+#endif
+#ifdef ROVIO_NLEVELS
+  static constexpr int nLevels = ROVIO_NLEVELS;
+#else
+  static constexpr int nLevels = 4;
+#endif
+#ifdef ROVIO_PATCHSIZE
+  static constexpr int patchSize = ROVIO_PATCHSIZE;
+#else
+  static constexpr int patchSize = 8;
+#endif
+#ifdef ROVIO_NCAM
+  static constexpr int nCam = ROVIO_NCAM;
+#else
+  static constexpr int nCam = 1;
+#endif
+  typedef FilterState<nMax,nLevels,patchSize,nCam,0> mtFilterState;
+  typedef ImuPrediction<mtFilterState> mtPrediction;
+  mtPrediction prediction;
+  mtFilterState prototype;
+  prototype.state_.setIdentity();
+  for(int i=0;i<nMax;i++){
+    prototype.state_.CfP(i).camID_ = 0;
+    prototype.state_.CfP(i).set_nor(LWF::NormalVectorElement(V3D(0.1*(i%5)-0.2,0.1*(i/5)-0.2,1.0).normalized()));
+    prototype.state_.dep(i).p_ = 0.5;
+  }
+  prototype.cov_.setIdentity();
+  prototype.cov_ *= 1e-3;
+  prototype.t_ = 0.0;
+  typename mtPrediction::mtMeas meas;
+  meas.template get<mtPrediction::mtMeas::_acc>() = V3D(0.1,-0.2,9.81);
+  meas.template get<mtPrediction::mtMeas::_gyr>() = V3D(0.01,0.02,-0.03);
+  std::map<double,typename mtPrediction::mtMeas> measMap;
+  measMap[0.005] = meas;
+  typename mtPrediction::mtNoise noise;
+  noise.setIdentity();
+  typename mtPrediction::mtState output;
+  prediction.meas_ = meas;
+  benchmark("ImuPrediction::evalPrediction",nLevels,patchSize,"nMax"+std::to_string(nMax),[&](){
+    prediction.evalPrediction(output,prototype.state_,noise,0.005);
+    return (float)output.WrWM()(0);
+  });
+  MXD F((int)(mtPrediction::mtState::D_),(int)(mtPrediction::mtState::D_));
+  benchmark("ImuPrediction::jacPreviousState",nLevels,patchSize,"nMax"+std::to_string(nMax),[&](){
+    prediction.jacPreviousState(F,prototype.state_,0.005);
+    return (float)F(0,0);
+  });
+  mtFilterState filterState = prototype;
+  for(const bool structured : {false,true}){
+    prediction.useStructuredPropagation_ = structured;
+    benchmark("ImuPrediction::predictMergedEKF",nLevels,patchSize,std::string(structured ? "structured" : "lwf")+"_nMax"+std::to_string(nMax),[&](){
+      filterState.state_ = prototype.state_;
+      filterState.cov_ = prototype.cov_;
+      filterState.t_ = 0.0;
+      prediction.predictMergedEKF(filterState,0.005,measMap);
+      return (float)filterState.cov_(0,0);
+    });
+  }
+}
+
+int main(int argc, char** argv){
+  if(argc > 1) minSeconds_ = std::atof(argv[1]);
+  std::printf("kernel,levels,patch_size,variant,ns_per_op,ops_per_s\n");
+  const cv::Mat img = syntheticImage(752,480);
+  benchmarkPatchKernels<4,8>(img);
+  benchmarkPatchKernels<4,6>(img);
+  benchmarkPatchKernels<3,8>(img);
+  benchmarkPatchKernels<2,4>(img);
+  benchmarkCamera(Camera::RADTAN,"radtan");
+  benchmarkCamera(Camera::EQUIDIST,"equidist");
+  benchmarkCamera(Camera::DS,"ds");
+  benchmarkCamera(Camera::REFRAC,"refrac");
+  benchmarkCamera(Camera::EQUIREFRAC,"equirefrac");
+  benchmarkImuPrediction();
+  return 0;
+}
@@ -0,0 +1,277 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <ros/package.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/info_parser.hpp>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rovio/RovioFilter.hpp"
+#include "rovio/RovioNode.hpp"
+#include "rovio/ThreadPool.hpp"
+
+#ifdef ROVIO_NMAXFEATURE
+static constexpr int nMax_ = ROVIO_NMAXFEATURE;
+#else
+static constexpr int nMax_ = 25; // Maximal number of considered features in the filter state.
+#endif
+
+#ifdef ROVIO_NLEVELS
+static constexpr int nLevels_ = ROVIO_NLEVELS;
+#else
+static constexpr int nLevels_ = 4; // // Total number of pyramid levels considered.
+#endif
+
+#ifdef ROVIO_PATCHSIZE
+static constexpr int patchSize_ = ROVIO_PATCHSIZE;
+#else
+static constexpr int patchSize_ = 8; // Edge length of the patches (in pixel). Must be a multiple of 2!
+#endif
+
+#ifdef ROVIO_NCAM
+static constexpr int nCam_ = ROVIO_NCAM;
+#else
+static constexpr int nCam_ = 1; // Used total number of cameras.
+#endif
+
+#ifdef ROVIO_NPOSE
+static constexpr int nPose_ = ROVIO_NPOSE;
+#else
+static constexpr int nPose_ = 0; // Additional pose states.
+#endif
+
+typedef rovio::RovioFilter<rovio::FilterState<nMax_,nLevels_,patchSize_,nCam_,nPose_>> mtFilter;
+
+/** \brief Single evaluation run (one bag with one set of .info overrides).
+ */
+struct BatchRun{
+  int id_ = 0;
+  std::string bag_;
+  std::vector<std::pair<std::string,std::string>> overrides_; /**<Key (info path, e.g. ImgUpdate.patchRejectionTh) and value.*/
+  std::string infoFile_; /**<Generated filter configuration.*/
+  std::string trajectoryFile_; /**<Output: t, WrWM, qWM of every safe state.*/
+  bool isOk_ = false;
+  std::string error_;
+  double wallTime_ = 0.0;
+  double dataTime_ = 0.0;
+  int nStates_ = 0;
+  double pathLength_ = 0.0;
+  V3D finalWrWM_ = V3D::Zero();
+};
+
+/** \brief Splits a string at the given delimiter.
+ */
+std::vector<std::string> split(const std::string& str, const char delimiter){
+  std::vector<std::string> out;
+  std::stringstream stream(str);
+  std::string token;
+  while(std::getline(stream,token,delimiter)) out.push_back(token);
+  return out;
+}
+
+/** \brief Runs the filter on the bag of the run, without any ROS spinning (the callbacks are called directly).
+ */
+void processRun(BatchRun& run, const std::vector<std::string>& cameraConfigs, const std::string& imuTopic,
+    const std::vector<std::string>& camTopics){
+  const auto wallStart = std::chrono::steady_clock::now();
+  try{
+    std::shared_ptr<mtFilter> mpFilter(new mtFilter);
+    mpFilter->readFromInfo(run.infoFile_);
+    for(unsigned int camID=0;camID<nCam_ && camID<cameraConfigs.size();camID++){
+      if(!cameraConfigs[camID].empty()) mpFilter->cameraCalibrationFile_[camID] = cameraConfigs[camID];
+    }
+    mpFilter->refreshProperties();
+
+    // Every run gets its own namespace, no worker or publisher threads (the runs are the parallelism)
+    ros::NodeHandle nh("rovio_batch/run" + std::to_string(run.id_));
+    ros::NodeHandle nh_private(nh,"private");
+    nh_private.setParam("parallel_image_processing", false);
+    nh_private.setParam("async_publishing", false);
+    nh_private.setParam("lock_free_ingress", false);
+    rovio::RovioNode<mtFilter> rovioNode(nh, nh_private, mpFilter);
+
+    rosbag::Bag bag;
+    bag.open(run.bag_, rosbag::bagmode::Read);
+    std::vector<std::string> topics(1,imuTopic);
+    topics.insert(topics.end(),camTopics.begin(),camTopics.end());
+    rosbag::View view(bag, rosbag::TopicQuery(topics));
+    std::ofstream trajectory(run.trajectoryFile_);
+    trajectory << std::setprecision(12);
+
+    double firstTime = -1.0;
+    double lastTime = 0.0;
+    double lastSafeTime = mpFilter->safe_.t_;
+    V3D lastWrWM = V3D::Zero();
+    for(rosbag::View::iterator it = view.begin();it != view.end() && ros::ok();it++){
+      if(it->getTopic() == imuTopic){
+        sensor_msgs::Imu::ConstPtr imuMsg = it->instantiate<sensor_msgs::Imu>();
+        if(imuMsg != NULL) rovioNode.imuCallback(imuMsg);
+      } else {
+        for(unsigned int camID=0;camID<camTopics.size();camID++){
+          if(it->getTopic() != camTopics[camID]) continue;
+          sensor_msgs::ImageConstPtr imgMsg = it->instantiate<sensor_msgs::Image>();
+          if(imgMsg == NULL) continue;
+          if(camID == 0) rovioNode.imgCallback0(imgMsg);
+          if(camID == 1) rovioNode.imgCallback1(imgMsg);
+          if(camID == 2) rovioNode.imgCallback2(imgMsg);
+          if(camID == 3) rovioNode.imgCallback3(imgMsg);
+          if(camID == 4) rovioNode.imgCallback4(imgMsg);
+        }
+      }
+      if(firstTime < 0.0) firstTime = it->getTime().toSec();
+      lastTime = it->getTime().toSec();
+
+      if(mpFilter->safe_.t_ > lastSafeTime){
+        const auto& state = mpFilter->safe_.state_;
+        trajectory << mpFilter->safe_.t_ << " " << state.WrWM().transpose() << " " << state.qWM().w() << " "
+            << state.qWM().x() << " " << state.qWM().y() << " " << state.qWM().z() << std::endl;
+        if(run.nStates_ > 0) run.pathLength_ += (state.WrWM()-lastWrWM).norm();
+        lastWrWM = state.WrWM();
+        lastSafeTime = mpFilter->safe_.t_;
+        run.nStates_++;
+      }
+    }
+    bag.close();
+    run.finalWrWM_ = lastWrWM;
+    run.dataTime_ = firstTime < 0.0 ? 0.0 : lastTime-firstTime;
+    run.isOk_ = true;
+  } catch(const std::exception& e){
+    run.error_ = e.what();
+  }
+  run.wallTime_ = std::chrono::duration<double>(std::chrono::steady_clock::now()-wallStart).count();
+}
+
+int main(int argc, char** argv){
+  ros::init(argc, argv, "rovio_batch");
+  ros::NodeHandle nh_private("~");
+
+  std::string rootdir = ros::package::getPath("rovio"); // Leaks memory
+  std::string filter_config = rootdir + "/cfg/rovio.info";
+  nh_private.param("filter_config", filter_config, filter_config);
+  std::vector<std::string> bags;
+  nh_private.param("bags", bags, bags);
+  std::vector<std::string> sweep; // Entries "Key=value0,value1,..." (info paths), all combinations are run
+  nh_private.param("sweep", sweep, sweep);
+  std::string output_dir = ".";
+  nh_private.param("output_dir", output_dir, output_dir);
+  int nThreads = std::thread::hardware_concurrency();
+  nh_private.param("threads", nThreads, nThreads);
+  std::vector<std::string> cameraConfigs(nCam_);
+  for(unsigned int camID=0;camID<nCam_;camID++){
+    nh_private.getParam("camera" + std::to_string(camID) + "_config", cameraConfigs[camID]);
+  }
+  std::string imu_topic_name = "/imu0";
+  nh_private.param("imu_topic_name", imu_topic_name, imu_topic_name);
+  std::vector<std::string> camTopics(nCam_);
+  for(unsigned int camID=0;camID<nCam_;camID++){
+    camTopics[camID] = "/cam" + std::to_string(camID) + "/image_raw";
+    nh_private.param("cam" + std::to_string(camID) + "_topic_name", camTopics[camID], camTopics[camID]);
+  }
+  if(bags.empty()){
+    ROS_ERROR("rovio_batch: no bags given (parameter ~bags)");
+    return 1;
+  }
+
+  // Parameter grid
+  std::vector<std::pair<std::string,std::vector<std::string>>> grid;
+  for(const std::string& entry : sweep){
+    const std::size_t eq = entry.find('=');
+    if(eq == std::string::npos){
+      ROS_ERROR_STREAM("rovio_batch: invalid sweep entry " << entry << " (expected Key=value0,value1,...)");
+      return 1;
+    }
+    grid.push_back(std::make_pair(entry.substr(0,eq),split(entry.substr(eq+1),',')));
+  }
+  std::vector<std::vector<std::pair<std::string,std::string>>> combinations(1);
+  for(const auto& axis : grid){
+    std::vector<std::vector<std::pair<std::string,std::string>>> extended;
+    for(const auto& combination : combinations){
+      for(const std::string& value : axis.second){
+        extended.push_back(combination);
+        extended.back().push_back(std::make_pair(axis.first,value));
+      }
+    }
+    combinations.swap(extended);
+  }
+
+  // Runs, each with its own generated .info file
+  boost::property_tree::ptree baseConfig;
+  boost::property_tree::read_info(filter_config,baseConfig);
+  std::vector<BatchRun> runs;
+  for(const std::string& bag : bags){
+    for(const auto& combination : combinations){
+      BatchRun run;
+      run.id_ = runs.size();
+      run.bag_ = bag;
+      run.overrides_ = combination;
+      run.infoFile_ = output_dir + "/run" + std::to_string(run.id_) + ".info";
+      run.trajectoryFile_ = output_dir + "/run" + std::to_string(run.id_) + "_trajectory.txt";
+      boost::property_tree::ptree config = baseConfig;
+      config.put("ImgUpdate.doFrameVisualisation",false);
+      // The runs already occupy all hardware threads, nested alignment threads would distort the timings
+      config.put("ImgUpdate.speculativeAlignmentThreads",1);
+      for(const auto& entry : combination) config.put(entry.first,entry.second);
+      boost::property_tree::write_info(run.infoFile_,config);
+      runs.push_back(run);
+    }
+  }
+  std::cout << "rovio_batch: " << runs.size() << " runs (" << bags.size() << " bags x " << combinations.size()
+      << " configurations) on " << std::max(nThreads,1) << " threads" << std::endl;
+
+  std::mutex m_log;
+  rovio::ThreadPool pool(std::max(nThreads,1));
+  pool.parallelFor(runs.size(),[&](int i){
+    processRun(runs[i],cameraConfigs,imu_topic_name,camTopics);
+    std::lock_guard<std::mutex> lock(m_log);
+    std::cout << "rovio_batch: run " << i << (runs[i].isOk_ ? " done" : " failed: " + runs[i].error_) << " (" << runs[i].wallTime_ << " s)" << std::endl;
+  });
+
+  // Summary table
+  const std::string summaryFile = output_dir + "/summary.csv";
+  std::ofstream summary(summaryFile);
+  summary << "run,bag,overrides,ok,wall_time,data_time,realtime_factor,states,path_length,final_x,final_y,final_z" << std::endl;
+  for(const BatchRun& run : runs){
+    std::string overrides;
+    for(const auto& entry : run.overrides_) overrides += (overrides.empty() ? "" : " ") + entry.first + "=" + entry.second;
+    summary << run.id_ << "," << run.bag_ << ",\"" << overrides << "\"," << run.isOk_ << "," << run.wallTime_ << "," << run.dataTime_
+        << "," << (run.wallTime_ > 0.0 ? run.dataTime_/run.wallTime_ : 0.0) << "," << run.nStates_ << "," << run.pathLength_ << ","
+        << run.finalWrWM_(0) << "," << run.finalWrWM_(1) << "," << run.finalWrWM_(2) << std::endl;
+  }
+  std::cout << "rovio_batch: summary written to " << summaryFile << std::endl;
+  return 0;
+}
@@ -0,0 +1,180 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+/* Replay of a EuRoC/ASL dataset folder through the ROS-free RovioEstimator.
+ *
+ *   rovio_euroc_replay <filter_config> <mav0 folder> <output trajectory> [camera0_config camera1_config ...]
+ *
+ * The IMU (imu0/data.csv) is loaded into memory, the images of each frame (camN/data.csv, camN/data/) are read
+ * just before they are fed. The trajectory of the safe state is written after every update in TUM format
+ * (t x y z qx qy qz qw, pose of the IMU in the world frame).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <opencv2/highgui/highgui.hpp>
+#include "rovio/RovioFilter.hpp"
+#include "rovio/RovioEstimator.hpp"
+
+#ifdef ROVIO_NMAXFEATURE
+static constexpr int nMax_ = ROVIO_NMAXFEATURE;
+#else
+static constexpr int nMax_ = 25; // Maximal number of considered features in the filter state.
+#endif
+
+#ifdef ROVIO_NLEVELS
+static constexpr int nLevels_ = ROVIO_NLEVELS;
+#else
+static constexpr int nLevels_ = 4; // // Total number of pyramid levels considered.
+#endif
+
+#ifdef ROVIO_PATCHSIZE
+static constexpr int patchSize_ = ROVIO_PATCHSIZE;
+#else
+static constexpr int patchSize_ = 8; // Edge length of the patches (in pixel). Must be a multiple of 2!
+#endif
+
+#ifdef ROVIO_NCAM
+static constexpr int nCam_ = ROVIO_NCAM;
+#else
+static constexpr int nCam_ = 1; // Used total number of cameras.
+#endif
+
+#ifdef ROVIO_NPOSE
+static constexpr int nPose_ = ROVIO_NPOSE;
+#else
+static constexpr int nPose_ = 0; // Additional pose states.
+#endif
+
+typedef rovio::RovioFilter<rovio::FilterState<nMax_,nLevels_,patchSize_,nCam_,nPose_>> mtFilter;
+
+/** \brief Reads the rows of an ASL csv file (comment lines starting with # are skipped).
+ */
+std::vector<std::vector<std::string>> readCsv(const std::string& filename){
+  std::vector<std::vector<std::string>> rows;
+  std::ifstream file(filename);
+  std::string line;
+  while(std::getline(file,line)){
+    if(line.empty() || line[0] == '#') continue;
+    if(line.back() == '\r') line.pop_back();
+    std::vector<std::string> row;
+    std::stringstream ss(line);
+    std::string cell;
+    while(std::getline(ss,cell,',')) row.push_back(cell);
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+int main(int argc, char** argv){
+  if(argc < 4){
+    std::cout << "Usage: rovio_euroc_replay <filter_config> <mav0 folder> <output trajectory> [camera0_config ...]" << std::endl;
+    return 1;
+  }
+  const std::string filter_config = argv[1];
+  const std::string datasetFolder = argv[2];
+  const std::string outputFilename = argv[3];
+
+  // Filter
+  std::shared_ptr<mtFilter> mpFilter(new mtFilter);
+  mpFilter->readFromInfo(filter_config);
+  for(int camID=0;camID<nCam_ && 4+camID<argc;camID++){
+    mpFilter->cameraCalibrationFile_[camID] = argv[4+camID];
+  }
+  mpFilter->refreshProperties();
+  rovio::RovioEstimator<mtFilter> estimator(mpFilter);
+
+  // Dataset (timestamps in ns)
+  struct ImuSample{
+    double t_;
+    V3D acc_;
+    V3D gyr_;
+  };
+  std::vector<ImuSample> imu;
+  for(const auto& row : readCsv(datasetFolder + "/imu0/data.csv")){
+    if(row.size() < 7) continue;
+    ImuSample s;
+    s.t_ = std::stoll(row[0])*1e-9;
+    s.gyr_ = V3D(std::stod(row[1]),std::stod(row[2]),std::stod(row[3]));
+    s.acc_ = V3D(std::stod(row[4]),std::stod(row[5]),std::stod(row[6]));
+    imu.push_back(s);
+  }
+  std::vector<std::vector<std::vector<std::string>>> frames(nCam_);
+  for(int camID=0;camID<nCam_;camID++){
+    frames[camID] = readCsv(datasetFolder + "/cam" + std::to_string(camID) + "/data.csv");
+  }
+  std::cout << "Loaded " << imu.size() << " IMU samples and " << frames[0].size() << " frames." << std::endl;
+  if(imu.empty() || frames[0].empty()) return 1;
+
+  std::ofstream output(outputFilename);
+  output << std::setprecision(15);
+  rovio::RovioEstimator<mtFilter>::Output state;
+  auto writeState = [&](){
+    estimator.getOutput(state);
+    const QPD qWB = state.qBW_.inverted();
+    output << state.t_ << " " << state.WrWB_.transpose() << " " << qWB.x() << " " << qWB.y() << " " << qWB.z() << " " << qWB.w() << std::endl;
+  };
+
+  // Replay, the IMU samples up to the timestamp of a frame are added before the frame
+  const auto wallStart = std::chrono::steady_clock::now();
+  size_t imuIndex = 0;
+  std::vector<size_t> frameIndex(nCam_,0);
+  cv::Mat img;
+  for(size_t i=0;i<frames[0].size();i++){
+    const long long stamp = std::stoll(frames[0][i][0]);
+    const double t = stamp*1e-9;
+    for(;imuIndex<imu.size() && imu[imuIndex].t_ <= t;imuIndex++){
+      if(estimator.addImu(imu[imuIndex].t_,imu[imuIndex].acc_,imu[imuIndex].gyr_)) writeState();
+    }
+    for(int camID=0;camID<nCam_;camID++){
+      // The cameras are synchronized, frames without a partner are skipped
+      size_t& j = frameIndex[camID];
+      while(j<frames[camID].size() && std::stoll(frames[camID][j][0]) < stamp) j++;
+      if(j>=frames[camID].size() || std::stoll(frames[camID][j][0]) != stamp || frames[camID][j].size() < 2) continue;
+      img = cv::imread(datasetFolder + "/cam" + std::to_string(camID) + "/data/" + frames[camID][j][1], cv::IMREAD_UNCHANGED);
+      if(img.empty()){
+        std::cout << "Could not read image " << frames[camID][j][1] << std::endl;
+        continue;
+      }
+      if(estimator.addImage(t,camID,img)) writeState();
+    }
+  }
+  for(;imuIndex<imu.size();imuIndex++){
+    if(estimator.addImu(imu[imuIndex].t_,imu[imuIndex].acc_,imu[imuIndex].gyr_)) writeState();
+  }
+  const double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now()-wallStart).count();
+  std::cout << "Replayed " << imu.back().t_-imu.front().t_ << " s of data in " << wallTime << " s." << std::endl;
+  return 0;
+}
@@ -119,7 +119,9 @@ int main(int argc, char** argv){
 
   // Node
   rovio::RovioNode<mtFilter> rovioNode(nh, nh_private, mpFilter);
-  rovioNode.makeTest();
+  bool runSelfTest;
+  nh_private.param("run_self_test", runSelfTest, true);
+  if(runSelfTest) rovioNode.makeTest();
 
 #ifdef MAKE_SCENE
   // Scene
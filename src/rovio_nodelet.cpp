@@ -0,0 +1,137 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <memory>
+
+#include <Eigen/StdVector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#include <ros/ros.h>
+#include <ros/package.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#pragma GCC diagnostic pop
+
+#include "rovio/RovioFilter.hpp"
+#include "rovio/RovioNode.hpp"
+
+#ifdef ROVIO_NMAXFEATURE
+static constexpr int nMax_ = ROVIO_NMAXFEATURE;
+#else
+static constexpr int nMax_ = 25; // Maximal number of considered features in the filter state.
+#endif
+
+#ifdef ROVIO_NLEVELS
+static constexpr int nLevels_ = ROVIO_NLEVELS;
+#else
+static constexpr int nLevels_ = 4; // // Total number of pyramid levels considered.
+#endif
+
+#ifdef ROVIO_PATCHSIZE
+static constexpr int patchSize_ = ROVIO_PATCHSIZE;
+#else
+static constexpr int patchSize_ = 6; // Edge length of the patches (in pixel). Must be a multiple of 2!
+#endif
+
+#ifdef ROVIO_NCAM
+static constexpr int nCam_ = ROVIO_NCAM;
+#else
+static constexpr int nCam_ = 1; // Used total number of cameras.
+#endif
+
+#ifdef ROVIO_NPOSE
+static constexpr int nPose_ = ROVIO_NPOSE;
+#else
+static constexpr int nPose_ = 0; // Additional pose states.
+#endif
+
+typedef rovio::RovioFilter<rovio::FilterState<nMax_,nLevels_,patchSize_,nCam_,nPose_>> mtFilter;
+
+namespace rovio {
+
+/** \brief Nodelet version of rovio_node.
+ *
+ *  Loaded into the same nodelet manager as the camera drivers, the images are passed as shared pointers
+ *  (sensor_msgs::ImageConstPtr) without serialization. Together with the shared MONO8 conversion in
+ *  RovioNode::imgCallback, the image data is only read once while building the pyramid.
+ *  The callbacks are executed on the single-threaded queue of the nodelet, as with ros::spin() in rovio_node.
+ */
+class RovioNodelet : public nodelet::Nodelet{
+ public:
+  RovioNodelet(){}
+  virtual ~RovioNodelet(){
+    rovioNode_.reset(); // Joins the worker threads before the filter is released
+    mpFilter_.reset();
+  }
+
+ private:
+  virtual void onInit(){
+    ros::NodeHandle& nh = getNodeHandle();
+    ros::NodeHandle& nh_private = getPrivateNodeHandle();
+
+    std::string rootdir = ros::package::getPath("rovio");
+    std::string filter_config = rootdir + "/cfg/rovio.info";
+    nh_private.param("filter_config", filter_config, filter_config);
+
+    // Filter
+    mpFilter_.reset(new mtFilter);
+    mpFilter_->readFromInfo(filter_config);
+
+    // Force the camera calibration paths to the ones from ROS parameters.
+    for (unsigned int camID = 0; camID < nCam_; ++camID) {
+      std::string camera_config;
+      if (nh_private.getParam("camera" + std::to_string(camID)
+                              + "_config", camera_config)) {
+        mpFilter_->cameraCalibrationFile_[camID] = camera_config;
+      }
+    }
+    mpFilter_->refreshProperties();
+
+    // Set refractive index from ROS parameter. CUATION: This overwrites the value in rovio.info file.
+    double refractive_index;
+    if (nh_private.getParam("refractive_index", refractive_index)) {
+      NODELET_WARN("Setting refractive index to %f from ROS parameter.", refractive_index);
+      mpFilter_->setRefractiveIndex(refractive_index);
+    }
+
+    // Node
+    rovioNode_.reset(new rovio::RovioNode<mtFilter>(nh, nh_private, mpFilter_));
+    bool runSelfTest;
+    nh_private.param("run_self_test", runSelfTest, true);
+    if(runSelfTest) rovioNode_->makeTest();
+  }
+
+  std::shared_ptr<mtFilter> mpFilter_;
+  std::unique_ptr<rovio::RovioNode<mtFilter>> rovioNode_;
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(rovio::RovioNodelet, nodelet::Nodelet)
@@ -0,0 +1,254 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+/* Replay regression harness.
+ *
+ * Runs the filter on a bag (callbacks called directly, no spinning) and records the per-frame update latency, the
+ * CPU time, the peak RSS and the ATE/RPE against the groundtruth topics of the bag (TransformStamped "pose" or
+ * Odometry "odometry", not fed to the filter). The results are written as "key value" lines and compared against
+ * a stored baseline of the same format; the exit code is non-zero if a metric regressed beyond its tolerance.
+ */
+
+#include <ros/package.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rovio/RovioFilter.hpp"
+#include "rovio/RovioNode.hpp"
+#include "rovio/TrajectoryEvaluation.hpp"
+
+#ifdef ROVIO_NMAXFEATURE
+static constexpr int nMax_ = ROVIO_NMAXFEATURE;
+#else
+static constexpr int nMax_ = 25; // Maximal number of considered features in the filter state.
+#endif
+
+#ifdef ROVIO_NLEVELS
+static constexpr int nLevels_ = ROVIO_NLEVELS;
+#else
+static constexpr int nLevels_ = 4; // // Total number of pyramid levels considered.
+#endif
+
+#ifdef ROVIO_PATCHSIZE
+static constexpr int patchSize_ = ROVIO_PATCHSIZE;
+#else
+static constexpr int patchSize_ = 8; // Edge length of the patches (in pixel). Must be a multiple of 2!
+#endif
+
+#ifdef ROVIO_NCAM
+static constexpr int nCam_ = ROVIO_NCAM;
+#else
+static constexpr int nCam_ = 1; // Used total number of cameras.
+#endif
+
+#ifdef ROVIO_NPOSE
+static constexpr int nPose_ = ROVIO_NPOSE;
+#else
+static constexpr int nPose_ = 0; // Additional pose states.
+#endif
+
+typedef rovio::RovioFilter<rovio::FilterState<nMax_,nLevels_,patchSize_,nCam_,nPose_>> mtFilter;
+
+/** \brief Reads "key value" lines.
+ */
+std::map<std::string,double> readMetrics(const std::string& filename){
+  std::map<std::string,double> metrics;
+  std::ifstream file(filename);
+  std::string key;
+  double value;
+  while(file >> key >> value) metrics[key] = value;
+  return metrics;
+}
+
+int main(int argc, char** argv){
+  ros::init(argc, argv, "rovio_regression");
+  ros::NodeHandle nh;
+  ros::NodeHandle nh_private("~");
+
+  std::string rootdir = ros::package::getPath("rovio"); // Leaks memory
+  std::string filter_config = rootdir + "/cfg/rovio.info";
+  nh_private.param("filter_config", filter_config, filter_config);
+  std::string rosbag_filename = "dataset.bag";
+  nh_private.param("rosbag_filename", rosbag_filename, rosbag_filename);
+  std::string baseline_filename = "";
+  nh_private.param("baseline", baseline_filename, baseline_filename);
+  std::string result_filename = "regression_result.txt";
+  nh_private.param("result", result_filename, result_filename);
+  double rpeDelta = 1.0;
+  nh_private.param("rpe_delta", rpeDelta, rpeDelta);
+  double accuracyTolerance = 0.1; // Allowed relative increase of ATE/RPE
+  nh_private.param("accuracy_tolerance", accuracyTolerance, accuracyTolerance);
+  double latencyTolerance = 0.2; // Allowed relative increase of the latencies and CPU time
+  nh_private.param("latency_tolerance", latencyTolerance, latencyTolerance);
+  std::string imu_topic_name = "/imu0";
+  nh_private.param("imu_topic_name", imu_topic_name, imu_topic_name);
+  std::vector<std::string> camTopics(nCam_);
+  for(unsigned int camID=0;camID<nCam_;camID++){
+    camTopics[camID] = "/cam" + std::to_string(camID) + "/image_raw";
+    nh_private.param("cam" + std::to_string(camID) + "_topic_name", camTopics[camID], camTopics[camID]);
+  }
+  std::string pose_topic_name = "/pose";
+  nh_private.param("groundtruth_pose_topic_name", pose_topic_name, pose_topic_name);
+  std::string odometry_topic_name = "/odometry";
+  nh_private.param("groundtruth_odometry_topic_name", odometry_topic_name, odometry_topic_name);
+
+  // Filter
+  std::shared_ptr<mtFilter> mpFilter(new mtFilter);
+  mpFilter->readFromInfo(filter_config);
+  for (unsigned int camID = 0; camID < nCam_; ++camID) {
+    std::string camera_config;
+    if (nh_private.getParam("camera" + std::to_string(camID) + "_config", camera_config)) {
+      mpFilter->cameraCalibrationFile_[camID] = camera_config;
+    }
+  }
+  mpFilter->refreshProperties();
+  double refractive_index;
+  if (nh_private.getParam("refractive_index", refractive_index)) {
+    mpFilter->setRefractiveIndex(refractive_index);
+  }
+
+  // Node, synchronous processing such that the latency of every callback is measured
+  nh_private.setParam("parallel_image_processing", false);
+  nh_private.setParam("async_publishing", false);
+  nh_private.setParam("lock_free_ingress", false);
+  rovio::RovioNode<mtFilter> rovioNode(nh, nh_private, mpFilter);
+
+  rosbag::Bag bag;
+  bag.open(rosbag_filename, rosbag::bagmode::Read);
+  std::vector<std::string> topics(1,imu_topic_name);
+  topics.insert(topics.end(),camTopics.begin(),camTopics.end());
+  topics.push_back(pose_topic_name);
+  topics.push_back(odometry_topic_name);
+  rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+  rovio::TrajectoryEvaluation evaluation;
+  std::vector<double> latencies; // [ms], per callback which advanced the safe state
+  double lastSafeTime = mpFilter->safe_.t_;
+  int nFrames = 0;
+  rusage usageStart;
+  getrusage(RUSAGE_SELF,&usageStart);
+  const auto wallStart = std::chrono::steady_clock::now();
+  for(rosbag::View::iterator it = view.begin();it != view.end() && ros::ok();it++){
+    const std::string& topic = it->getTopic();
+    if(topic == pose_topic_name){
+      geometry_msgs::TransformStamped::ConstPtr pose = it->instantiate<geometry_msgs::TransformStamped>();
+      if(pose != NULL){
+        evaluation.groundtruth_[pose->header.stamp.toSec()] = Eigen::Vector3d(pose->transform.translation.x,pose->transform.translation.y,pose->transform.translation.z);
+      }
+      continue;
+    }
+    if(topic == odometry_topic_name){
+      nav_msgs::Odometry::ConstPtr odometry = it->instantiate<nav_msgs::Odometry>();
+      if(odometry != NULL){
+        evaluation.groundtruth_[odometry->header.stamp.toSec()] = Eigen::Vector3d(odometry->pose.pose.position.x,odometry->pose.pose.position.y,odometry->pose.pose.position.z);
+      }
+      continue;
+    }
+    const auto t0 = std::chrono::steady_clock::now();
+    if(topic == imu_topic_name){
+      sensor_msgs::Imu::ConstPtr imuMsg = it->instantiate<sensor_msgs::Imu>();
+      if(imuMsg != NULL) rovioNode.imuCallback(imuMsg);
+    } else {
+      for(unsigned int camID=0;camID<camTopics.size();camID++){
+        if(topic != camTopics[camID]) continue;
+        sensor_msgs::ImageConstPtr imgMsg = it->instantiate<sensor_msgs::Image>();
+        if(imgMsg == NULL) continue;
+        if(camID == 0) rovioNode.imgCallback0(imgMsg);
+        if(camID == 1) rovioNode.imgCallback1(imgMsg);
+        if(camID == 2) rovioNode.imgCallback2(imgMsg);
+        if(camID == 3) rovioNode.imgCallback3(imgMsg);
+        if(camID == 4) rovioNode.imgCallback4(imgMsg);
+      }
+    }
+    if(mpFilter->safe_.t_ > lastSafeTime){
+      latencies.push_back(std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t0).count());
+      evaluation.estimate_[mpFilter->safe_.t_] = mpFilter->safe_.state_.WrWM();
+      lastSafeTime = mpFilter->safe_.t_;
+      nFrames++;
+    }
+  }
+  const double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now()-wallStart).count();
+  rusage usageEnd;
+  getrusage(RUSAGE_SELF,&usageEnd);
+  bag.close();
+
+  // Metrics
+  auto seconds = [](const timeval& t){return t.tv_sec+1e-6*t.tv_usec;};
+  std::map<std::string,double> metrics;
+  int nAssociated = 0;
+  metrics["frames"] = nFrames;
+  metrics["latency_p50_ms"] = rovio::percentile(latencies,50);
+  metrics["latency_p95_ms"] = rovio::percentile(latencies,95);
+  metrics["latency_p99_ms"] = rovio::percentile(latencies,99);
+  metrics["latency_max_ms"] = rovio::percentile(latencies,100);
+  metrics["cpu_time_s"] = seconds(usageEnd.ru_utime)-seconds(usageStart.ru_utime)+seconds(usageEnd.ru_stime)-seconds(usageStart.ru_stime);
+  metrics["wall_time_s"] = wallTime;
+  metrics["peak_rss_mb"] = usageEnd.ru_maxrss/1024.0; // ru_maxrss is in kB on Linux
+  metrics["ate_m"] = evaluation.absoluteTrajectoryError(&nAssociated);
+  metrics["rpe_m"] = evaluation.relativePoseError(rpeDelta);
+  metrics["groundtruth_associated"] = nAssociated;
+
+  std::ofstream result(result_filename);
+  for(const auto& metric : metrics) result << metric.first << " " << metric.second << std::endl;
+
+  // Comparison against the baseline (lower is better for all compared metrics)
+  const std::map<std::string,double> tolerances = {{"ate_m",accuracyTolerance},{"rpe_m",accuracyTolerance},
+      {"latency_p50_ms",latencyTolerance},{"latency_p95_ms",latencyTolerance},{"latency_p99_ms",latencyTolerance},
+      {"cpu_time_s",latencyTolerance},{"peak_rss_mb",latencyTolerance}};
+  const std::map<std::string,double> baseline = baseline_filename.empty() ? std::map<std::string,double>() : readMetrics(baseline_filename);
+  bool isRegression = false;
+  std::cout << "== rovio regression: " << filter_config << " on " << rosbag_filename << std::endl;
+  std::cout << std::setw(24) << std::left << "metric" << std::setw(14) << "current" << std::setw(14) << "baseline" << "change" << std::endl;
+  for(const auto& metric : metrics){
+    std::cout << std::setw(24) << std::left << metric.first << std::setw(14) << metric.second;
+    auto itBaseline = baseline.find(metric.first);
+    auto itTolerance = tolerances.find(metric.first);
+    if(itBaseline == baseline.end()){
+      std::cout << "-" << std::endl;
+      continue;
+    }
+    const double change = itBaseline->second != 0.0 ? (metric.second-itBaseline->second)/std::fabs(itBaseline->second) : 0.0;
+    std::cout << std::setw(14) << itBaseline->second << std::showpos << 100.0*change << "%" << std::noshowpos;
+    if(itTolerance != tolerances.end() && (change > itTolerance->second || (metric.second < 0.0 && itBaseline->second >= 0.0))){
+      std::cout << "  REGRESSION";
+      isRegression = true;
+    }
+    std::cout << std::endl;
+  }
+  std::cout << "Results written to " << result_filename << (baseline.empty() ? " (no baseline given)" : "") << std::endl;
+  return isRegression ? 1 : 0;
+}
@@ -31,6 +31,12 @@
 #include <rosbag/view.h>
 #include <memory>
 #include <iostream>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <locale>
 #include <string>
 #include <Eigen/StdVector>
@@ -73,6 +79,79 @@ static constexpr int nPose_ = 0; // Additional pose states.
 
 typedef rovio::RovioFilter<rovio::FilterState<nMax_,nLevels_,patchSize_,nCam_,nPose_>> mtFilter;
 
+/** \brief Bounded blocking queue between the prefetch/writer threads and the filter thread.
+ */
+template<typename T>
+class BlockingQueue{
+ public:
+  BlockingQueue(const unsigned int capacity): capacity_(capacity), isClosed_(false){}
+
+  /** \brief Appends an element, blocks while the queue is full.
+   *
+   *   @return false if the queue was closed (element is dropped).
+   */
+  bool push(T element){
+    std::unique_lock<std::mutex> lock(m_);
+    cvNotFull_.wait(lock,[this]{return queue_.size() < capacity_ || isClosed_;});
+    if(isClosed_) return false;
+    queue_.push_back(std::move(element));
+    cvNotEmpty_.notify_one();
+    return true;
+  }
+
+  /** \brief Removes the oldest element, blocks while the queue is empty (the remaining elements are still returned after closing).
+   *
+   *   @return false if the queue is empty and closed.
+   */
+  bool pop(T& element){
+    std::unique_lock<std::mutex> lock(m_);
+    cvNotEmpty_.wait(lock,[this]{return !queue_.empty() || isClosed_;});
+    if(queue_.empty()) return false;
+    element = std::move(queue_.front());
+    queue_.pop_front();
+    cvNotFull_.notify_one();
+    return true;
+  }
+
+  /** \brief Marks the end of the stream, wakes up all waiting threads.
+   */
+  void close(){
+    std::lock_guard<std::mutex> lock(m_);
+    isClosed_ = true;
+    cvNotEmpty_.notify_all();
+    cvNotFull_.notify_all();
+  }
+
+ private:
+  const unsigned int capacity_;
+  bool isClosed_;
+  std::deque<T> queue_;
+  std::mutex m_;
+  std::condition_variable cvNotEmpty_;
+  std::condition_variable cvNotFull_;
+};
+
+/** \brief Writes a message to the output bag, either directly or as a copy through the queue of the writer thread.
+ */
+template<typename Msg>
+void writeMessage(rosbag::Bag& bag, BlockingQueue<std::function<void()>>* mpQueue, const std::string& topic, const ros::Time& t, const Msg& msg){
+  if(mpQueue == nullptr){
+    bag.write(topic,t,msg);
+    return;
+  }
+  std::shared_ptr<Msg> copy(new Msg(msg));
+  mpQueue->push([&bag,topic,t,copy](){bag.write(topic,t,*copy);});
+}
+
+/** \brief Decoded bag message.
+ */
+struct BagMessage{
+  int type_ = -1; /**<0: IMU, 1: cam0, 2: cam1*/
+  double t_ = 0.0; /**<Bag time.*/
+  sensor_msgs::Imu::ConstPtr imu_;
+  sensor_msgs::ImageConstPtr img_;
+};
+
 int main(int argc, char** argv){
   ros::init(argc, argv, "rovio");
   ros::NodeHandle nh;
@@ -97,7 +176,10 @@ int main(int argc, char** argv){
   }
   mpFilter->refreshProperties();
 
-  // Node
+  // Node (the recorded messages are read from the node directly, hence process and publish on this thread)
+  nh_private.setParam("parallel_image_processing", false);
+  nh_private.setParam("async_publishing", false);
+  nh_private.setParam("lock_free_ingress", false);
   rovio::RovioNode<mtFilter> rovioNode(nh, nh_private, mpFilter);
   rovioNode.makeTest();
   double resetTrigger = 0.0;
@@ -110,6 +192,10 @@ int main(int argc, char** argv){
   nh_private.param("record_markers", rovioNode.forceMarkersPublishing_, rovioNode.forceMarkersPublishing_);
   nh_private.param("record_patch", rovioNode.forcePatchPublishing_, rovioNode.forcePatchPublishing_);
   nh_private.param("reset_trigger", resetTrigger, resetTrigger);
+  bool offlineMode = false; // Decode on a prefetch thread, write on a writer thread, stamp with filter time, no spinning
+  nh_private.param("offline_mode", offlineMode, offlineMode);
+  int prefetchSize = 200;
+  nh_private.param("prefetch_size", prefetchSize, prefetchSize);
 
   std::cout << "Recording";
   if(rovioNode.forceOdometryPublishing_) std::cout << ", odometry";
@@ -176,35 +262,80 @@ int main(int argc, char** argv){
   rosbag::View view(bagIn, rosbag::TopicQuery(topics));
 
 
+  // Reading and decoding of the bag (prefetch thread in offline mode)
+  BlockingQueue<BagMessage> prefetchQueue(std::max(prefetchSize,1));
+  auto decode = [&](const rosbag::MessageInstance& m, BagMessage& msg){
+    msg.t_ = m.getTime().toSec();
+    if(m.getTopic() == imu_topic_name){
+      msg.type_ = 0;
+      msg.imu_ = m.instantiate<sensor_msgs::Imu>();
+      if(msg.imu_ == NULL) msg.type_ = -1;
+    } else if(m.getTopic() == cam0_topic_name || m.getTopic() == cam1_topic_name){
+      msg.type_ = m.getTopic() == cam0_topic_name ? 1 : 2;
+      msg.img_ = m.instantiate<sensor_msgs::Image>();
+      if(msg.img_ == NULL) msg.type_ = -1;
+    }
+  };
+  std::thread prefetchThread;
+  if(offlineMode){
+    prefetchThread = std::thread([&](){
+      for(rosbag::View::iterator it = view.begin();it != view.end() && ros::ok();it++){
+        BagMessage msg;
+        decode(*it,msg);
+        if(msg.type_ >= 0 && !prefetchQueue.push(std::move(msg))) break;
+      }
+      prefetchQueue.close();
+    });
+  }
+
+  // Writing of the output bag (writer thread in offline mode, the messages are copied)
+  BlockingQueue<std::function<void()>> writeQueue(std::max(prefetchSize,1));
+  std::thread writerThread;
+  if(offlineMode){
+    writerThread = std::thread([&](){
+      std::function<void()> job;
+      while(writeQueue.pop(job)) job();
+    });
+  }
+  BlockingQueue<std::function<void()>>* mpWriteQueue = offlineMode ? &writeQueue : nullptr;
+
   bool isTriggerInitialized = false;
   double lastTriggerTime = 0.0;
-  for(rosbag::View::iterator it = view.begin();it != view.end() && ros::ok();it++){
-    if(it->getTopic() == imu_topic_name){
-      sensor_msgs::Imu::ConstPtr imuMsg = it->instantiate<sensor_msgs::Imu>();
-      if (imuMsg != NULL) rovioNode.imuCallback(imuMsg);
-    }
-    if(it->getTopic() == cam0_topic_name){
-      sensor_msgs::ImageConstPtr imgMsg = it->instantiate<sensor_msgs::Image>();
-      if (imgMsg != NULL) rovioNode.imgCallback0(imgMsg);
+  double firstDataTime = -1.0;
+  double lastDataTime = 0.0;
+  const auto wallStart = std::chrono::steady_clock::now();
+  rosbag::View::iterator it = view.begin();
+  while(ros::ok()){
+    BagMessage msg;
+    if(offlineMode){
+      if(!prefetchQueue.pop(msg)) break;
+    } else {
+      if(it == view.end()) break;
+      decode(*it,msg);
+      it++;
     }
-    if(it->getTopic() == cam1_topic_name){
-      sensor_msgs::ImageConstPtr imgMsg = it->instantiate<sensor_msgs::Image>();
-      if (imgMsg != NULL) rovioNode.imgCallback1(imgMsg);
+    if(msg.type_ == 0) rovioNode.imuCallback(msg.imu_);
+    if(msg.type_ == 1) rovioNode.imgCallback0(msg.img_);
+    if(msg.type_ == 2) rovioNode.imgCallback1(msg.img_);
+    if(msg.type_ >= 0){
+      if(firstDataTime < 0.0) firstDataTime = msg.t_;
+      lastDataTime = msg.t_;
     }
-    ros::spinOnce();
+    if(!offlineMode) ros::spinOnce();
 
     if(rovioNode.gotFirstMessages_){
       static double lastSafeTime = rovioNode.mpFilter_->safe_.t_;
       if(rovioNode.mpFilter_->safe_.t_ > lastSafeTime){
-        if(rovioNode.forceOdometryPublishing_) bagOut.write(odometry_topic_name,ros::Time::now(),rovioNode.odometryMsg_);
-        if(rovioNode.forceTransformPublishing_) bagOut.write(transform_topic_name,ros::Time::now(),rovioNode.transformMsg_);
+        const ros::Time stamp = offlineMode ? ros::Time(rovioNode.mpFilter_->safe_.t_) : ros::Time::now();
+        if(rovioNode.forceOdometryPublishing_) writeMessage(bagOut,mpWriteQueue,odometry_topic_name,stamp,rovioNode.odometryMsg_);
+        if(rovioNode.forceTransformPublishing_) writeMessage(bagOut,mpWriteQueue,transform_topic_name,stamp,rovioNode.transformMsg_);
         for(int camID=0;camID<mtFilter::mtState::nCam_;camID++){
-          if(rovioNode.forceExtrinsicsPublishing_) bagOut.write(extrinsics_topic_name[camID],ros::Time::now(),rovioNode.extrinsicsMsg_[camID]);
+          if(rovioNode.forceExtrinsicsPublishing_) writeMessage(bagOut,mpWriteQueue,extrinsics_topic_name[camID],stamp,rovioNode.extrinsicsMsg_[camID]);
         }
-        if(rovioNode.forceImuBiasPublishing_) bagOut.write(imu_bias_topic_name,ros::Time::now(),rovioNode.imuBiasMsg_);
-        if(rovioNode.forcePclPublishing_) bagOut.write(pcl_topic_name,ros::Time::now(),rovioNode.pclMsg_);
-        if(rovioNode.forceMarkersPublishing_) bagOut.write(u_rays_topic_name,ros::Time::now(),rovioNode.markerMsg_);
-        if(rovioNode.forcePatchPublishing_) bagOut.write(patch_topic_name,ros::Time::now(),rovioNode.patchMsg_);
+        if(rovioNode.forceImuBiasPublishing_) writeMessage(bagOut,mpWriteQueue,imu_bias_topic_name,stamp,rovioNode.imuBiasMsg_);
+        if(rovioNode.forcePclPublishing_) writeMessage(bagOut,mpWriteQueue,pcl_topic_name,stamp,rovioNode.pclMsg_);
+        if(rovioNode.forceMarkersPublishing_) writeMessage(bagOut,mpWriteQueue,u_rays_topic_name,stamp,rovioNode.markerMsg_);
+        if(rovioNode.forcePatchPublishing_) writeMessage(bagOut,mpWriteQueue,patch_topic_name,stamp,rovioNode.patchMsg_);
         lastSafeTime = rovioNode.mpFilter_->safe_.t_;
       }
       if(!isTriggerInitialized){
@@ -220,6 +351,16 @@ int main(int argc, char** argv){
     }
   }
 
+  prefetchQueue.close();
+  if(prefetchThread.joinable()) prefetchThread.join();
+  writeQueue.close();
+  if(writerThread.joinable()) writerThread.join();
+
+  // Throughput
+  const double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now()-wallStart).count();
+  const double dataTime = firstDataTime < 0.0 ? 0.0 : lastDataTime-firstDataTime;
+  std::cout << "Processed " << dataTime << " s of data in " << wallTime << " s (" << (wallTime > 0.0 ? dataTime/wallTime : 0.0) << "x real time)" << std::endl;
+
   bagOut.close();
   bagIn.close();
 
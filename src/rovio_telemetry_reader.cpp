@@ -0,0 +1,152 @@
+/*
+* Copyright (c) 2014, Autonomous Systems Lab
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+* * Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+* * Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+* * Neither the name of the Autonomous Systems Lab, ETH Zurich nor the
+* names of its contributors may be used to endorse or promote products
+* derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+/* Reader of the telemetry ring file written by rovio_node (parameter telemetry_file).
+ *
+ *   rovio_telemetry_reader <telemetry file> [--follow] [--features]
+ *
+ * Prints the available records in chronological order as csv. With --follow the file is polled for new records,
+ * with --features the id, status and distance of each feature slot are appended to every line. Must be built with
+ * the same ROVIO_* settings as the node which wrote the file.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include "rovio/FilterStates.hpp"
+#include "rovio/TelemetryLog.hpp"
+
+#ifdef ROVIO_NMAXFEATURE
+static constexpr int nMax_ = ROVIO_NMAXFEATURE;
+#else
+static constexpr int nMax_ = 25; // Maximal number of considered features in the filter state.
+#endif
+
+#ifdef ROVIO_NLEVELS
+static constexpr int nLevels_ = ROVIO_NLEVELS;
+#else
+static constexpr int nLevels_ = 4; // // Total number of pyramid levels considered.
+#endif
+
+#ifdef ROVIO_PATCHSIZE
+static constexpr int patchSize_ = ROVIO_PATCHSIZE;
+#else
+static constexpr int patchSize_ = 8; // Edge length of the patches (in pixel). Must be a multiple of 2!
+#endif
+
+#ifdef ROVIO_NCAM
+static constexpr int nCam_ = ROVIO_NCAM;
+#else
+static constexpr int nCam_ = 1; // Used total number of cameras.
+#endif
+
+#ifdef ROVIO_NPOSE
+static constexpr int nPose_ = ROVIO_NPOSE;
+#else
+static constexpr int nPose_ = 0; // Additional pose states.
+#endif
+
+typedef rovio::FilterState<nMax_,nLevels_,patchSize_,nCam_,nPose_> mtFilterState;
+typedef rovio::TelemetryRecord<mtFilterState> mtRecord;
+
+void printRecord(const mtRecord& r, const bool printFeatures){
+  int nTracked = 0;
+  int nValid = 0;
+  for(int i=0;i<nMax_;i++){
+    if(r.featureIdx_[i] < 0) continue;
+    nValid++;
+    if(r.featureStatus_[i] == rovio::TRACKED) nTracked++;
+  }
+  std::cout << r.seq_ << "," << r.t_;
+  for(int i=0;i<3;i++) std::cout << "," << r.WrWM_[i];
+  for(int i=0;i<4;i++) std::cout << "," << r.qWM_[i];
+  for(int i=0;i<3;i++) std::cout << "," << r.MvM_[i];
+  for(int i=0;i<3;i++) std::cout << "," << r.acb_[i];
+  for(int i=0;i<3;i++) std::cout << "," << r.gyb_[i];
+  std::cout << "," << r.refractiveIndex_;
+  for(int i=0;i<3;i++) std::cout << "," << r.covDiag_[i]; // Position
+  std::cout << "," << nValid << "," << nTracked;
+  for(int i=0;i<rovio::TELEMETRY_N_TIMINGS;i++) std::cout << "," << r.timings_[i];
+  if(printFeatures){
+    for(int i=0;i<nMax_;i++){
+      std::cout << "," << r.featureIdx_[i] << "," << (int)r.featureStatus_[i] << "," << r.featureDistance_[i];
+    }
+  }
+  std::cout << std::endl;
+}
+
+int main(int argc, char** argv){
+  if(argc < 2){
+    std::cout << "Usage: rovio_telemetry_reader <telemetry file> [--follow] [--features]" << std::endl;
+    return 1;
+  }
+  bool follow = false;
+  bool printFeatures = false;
+  for(int i=2;i<argc;i++){
+    if(strcmp(argv[i],"--follow") == 0) follow = true;
+    if(strcmp(argv[i],"--features") == 0) printFeatures = true;
+  }
+  rovio::TelemetryReader<mtFilterState> reader;
+  std::string error;
+  if(!reader.open(argv[1],error)){
+    std::cerr << "Cannot read " << argv[1] << ": " << error << std::endl;
+    return 1;
+  }
+
+  std::cout << std::setprecision(12);
+  std::cout << "seq,t,x,y,z,qw,qx,qy,qz,vx,vy,vz,acb_x,acb_y,acb_z,gyb_x,gyb_y,gyb_z,ref,var_x,var_y,var_z,features,tracked,update_ms,frames";
+  if(printFeatures){
+    for(int i=0;i<nMax_;i++) std::cout << ",id" << i << ",status" << i << ",d" << i;
+  }
+  std::cout << std::endl;
+  std::unique_ptr<mtRecord> record(new mtRecord);
+  uint64_t n = reader.firstAvailable();
+  uint64_t skipped = 0;
+  while(true){
+    for(;n<reader.writeCount();n++){
+      if(n < reader.firstAvailable()){ // Overtaken by the writer
+        skipped += reader.firstAvailable()-n;
+        n = reader.firstAvailable();
+      }
+      if(reader.read(n,*record)){
+        printRecord(*record,printFeatures);
+      } else {
+        skipped++;
+      }
+    }
+    if(!follow) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  if(skipped > 0) std::cerr << skipped << " records were overwritten while reading." << std::endl;
+  return 0;
+}
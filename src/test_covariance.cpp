@@ -0,0 +1,196 @@
+#include "gtest/gtest.h"
+#include <assert.h>
+
+#include "rovio/BlockSparseJacobian.hpp"
+#include "rovio/SymmetricCovariance.hpp"
+
+using namespace rovio;
+
+#ifndef ROVIO_NMAXFEATURE
+#define ROVIO_NMAXFEATURE 25
+#endif
+#ifndef ROVIO_NCAM
+#define ROVIO_NCAM 2
+#endif
+#ifndef ROVIO_NPOSE
+#define ROVIO_NPOSE 0
+#endif
+
+class CovarianceTesting : public virtual ::testing::Test {
+ protected:
+  static const int nMax_ = ROVIO_NMAXFEATURE;
+  static const int nCore_ = 15+6*ROVIO_NCAM+1;  // pos, vel, acb, gyb, att, extrinsics, refractive index
+  static const int D_ = nCore_+3*nMax_+6*ROVIO_NPOSE;
+  MXD P_;
+  MXD R_;
+  CovarianceTesting(){
+    srand(0);
+    const MXD A = MXD::Random(D_,D_);
+    P_ = 1e-2*A*A.transpose()+1e-3*MXD::Identity(D_,D_);
+    R_ = 4.0*MXD::Identity(2,2);
+  }
+  virtual ~CovarianceTesting() {}
+
+  /** \brief Dense 2xD Jacobian of a feature measurement (core states and block of feature i).
+   */
+  MXD featureJacobian(const int i) const{
+    MXD H = MXD::Zero(2,D_);
+    H.leftCols(nCore_).setRandom();
+    H.middleCols(nCore_+3*i,3).setRandom();
+    return H;
+  }
+
+  /** \brief Structured DxD Jacobian with the sparsity and magnitudes of the IMU prediction over dt.
+   */
+  MXD predictionJacobian(const double dt) const{
+    MXD F = MXD::Identity(D_,D_);
+    F.block<3,3>(0,3) = dt*Eigen::Matrix3d::Identity(); // pos <- vel
+    F.block<3,3>(3,6) = -dt*Eigen::Matrix3d::Identity(); // vel <- acb
+    F.block<3,3>(3,12) = dt*9.81*Eigen::Matrix3d::Random(); // vel <- att
+    F.block<3,3>(12,9) = -dt*Eigen::Matrix3d::Identity(); // att <- gyb
+    for(int i=0;i<nMax_;i++){
+      const int s = nCore_+3*i;
+      F.block(s,0,3,15) = dt*MXD::Random(3,15);
+      F.block(s,15,3,6) = dt*MXD::Random(3,6); // Extrinsics of the first camera
+      F.block<3,3>(s,s) += dt*Eigen::Matrix3d::Random();
+    }
+    return F;
+  }
+
+  /** \brief Structured DxD noise Jacobian of the IMU prediction over dt.
+   */
+  MXD predictionNoiseJacobian(const double dt) const{
+    MXD G = std::sqrt(dt)*MXD::Identity(D_,D_);
+    for(int i=0;i<nMax_;i++){
+      G.block(nCore_+3*i,12,3,3) = std::sqrt(dt)*Eigen::Matrix3d::Random(); // Feature <- attitude noise
+    }
+    return G;
+  }
+
+  /** \brief Filter run over nFrames frames, each with one IMU prediction and one EKF update per feature. If
+   *         isStructured is set the covariance is propagated like the structured merged prediction and updated like the
+   *         block-sparse image update, otherwise the dense products and the standard Kalman update are used.
+   */
+  MXD filterSequence(const int nFrames, const bool isStructured) const{
+    srand(2);
+    const double dt = 0.05;
+    const MXD Q = 1e-4*MXD::Identity(D_,D_);
+    MXD H[nMax_];
+    for(int i=0;i<nMax_;i++) H[i] = featureJacobian(i);
+    MXD P = P_;
+    MXD cov(D_,D_), noiseCov(D_,D_), temp(D_,D_);
+    BlockSparseJacobian<2> sparseH;
+    MXD PHt, Py, inn;
+    for(int k=0;k<nFrames;k++){
+      // Prediction
+      const MXD F = predictionJacobian(dt);
+      const MXD G = predictionNoiseJacobian(dt);
+      if(isStructured){
+        rovio::structuredSandwich(F,P,cov,temp,nCore_,nMax_,nCore_);
+        rovio::structuredSandwich(G,Q,noiseCov,temp,nCore_,nMax_,nCore_);
+        P = cov+noiseCov;
+      } else {
+        P = F*P*F.transpose()+G*Q*G.transpose();
+      }
+
+      // Updates
+      for(int i=0;i<nMax_;i++){
+        inn = MXD::Random(2,1);
+        if(isStructured){
+          sparseH.setFromDense(H[i]);
+          sparseH.multiplyCovTransposed(P,PHt);
+          sparseH.multiply(PHt,Py);
+          Py += R_;
+          if(!computeSquareRootGain(PHt,Py,inn)) return MXD();
+          symmetricDowndate(P,PHt);
+        } else {
+          PHt = P*H[i].transpose();
+          Py = H[i]*PHt+R_;
+          P -= PHt*Py.inverse()*PHt.transpose();
+        }
+      }
+    }
+    return P;
+  }
+};
+
+// Test the block-sparse products against the dense ones
+TEST_F(CovarianceTesting, blockSparseProducts) {
+  const MXD H = featureJacobian(nMax_/2);
+  BlockSparseJacobian<2> sparseH;
+  sparseH.setFromDense(H);
+  ASSERT_EQ(sparseH.nonZeroCols(),nCore_+3);
+  MXD PHt;
+  MXD Py;
+  sparseH.multiplyCovTransposed(P_,PHt);
+  sparseH.multiply(PHt,Py);
+  ASSERT_NEAR((PHt-P_*H.transpose()).norm(),0.0,1e-10);
+  ASSERT_NEAR((Py-H*P_*H.transpose()).norm(),0.0,1e-10);
+}
+
+// Test the square-root gain and the symmetric downdate against the standard Kalman update
+TEST_F(CovarianceTesting, symmetricUpdate) {
+  const MXD H = featureJacobian(0);
+  MXD PHt = P_*H.transpose();
+  const MXD Py = H*P_*H.transpose()+R_;
+  const MXD y = MXD::Random(2,1);
+  const MXD K = PHt*Py.inverse();
+  const MXD dx = K*y;
+  const MXD Pref = P_-K*Py*K.transpose();
+  MXD Linvy = y;
+  ASSERT_TRUE(computeSquareRootGain(PHt,Py,Linvy));
+  MXD P = P_;
+  symmetricDowndate(P,PHt);
+  ASSERT_NEAR((PHt*Linvy-dx).norm(),0.0,1e-10);
+  ASSERT_NEAR((P-Pref).norm(),0.0,1e-10);
+  ASSERT_EQ((P-P.transpose()).norm(),0.0);
+}
+
+// Test the structured prediction and block-sparse update sequence against the dense one, with the dimensions of the
+// shipped configuration (ROVIO_NMAXFEATURE, ROVIO_NCAM, ROVIO_NPOSE)
+TEST_F(CovarianceTesting, structuredFilterSequence) {
+  const int nFrames = 200; // 10s at 20Hz
+  const MXD Ps = filterSequence(nFrames,true);
+  const MXD Pd = filterSequence(nFrames,false);
+  ASSERT_EQ(Ps.rows(),P_.rows());
+  ASSERT_EQ(Pd.rows(),P_.rows());
+  ASSERT_EQ((Ps-Ps.transpose()).norm(),0.0);
+  ASSERT_LT((Ps-Pd).norm()/Pd.norm(),1e-8);
+  Eigen::LLT<MXD> llt(Ps);
+  ASSERT_EQ(llt.info(),Eigen::Success);
+}
+
+// Test the structured prediction with frozen calibration states (refractive index and extrinsics of the last camera)
+// against the dense products, once the frozen blocks are decoupled (see ImgUpdate::updateCalibrationFreezing)
+TEST_F(CovarianceTesting, structuredSandwichFrozenCalibration) {
+  const double dt = 0.05;
+  const int nCam = ROVIO_NCAM;
+  const int frozen[3] = {15+3*(nCam-1), 15+3*nCam+3*(nCam-1), nCore_-1}; // vep, vea of the last camera and ref
+  const int n[3] = {3, 3, 1};
+  const int ca = nCam == 1 ? frozen[0] : frozen[1]; // As ImuPrediction::activeCoreEnd
+  MXD F = predictionJacobian(dt);
+  MXD G = predictionNoiseJacobian(dt);
+  MXD P = P_;
+  for(int j=0;j<3;j++){
+    // As ImuPrediction::jacPreviousState and jacNoise: frozen states are constant and receive no process noise
+    F.middleCols(frozen[j],n[j]).setZero();
+    F.block(frozen[j],frozen[j],n[j],n[j]).setIdentity();
+    G.middleRows(frozen[j],n[j]).setZero();
+    // As ImgUpdate::decoupleCovarianceBlock
+    const Eigen::VectorXd var = P.diagonal().segment(frozen[j],n[j]);
+    P.middleRows(frozen[j],n[j]).setZero();
+    P.middleCols(frozen[j],n[j]).setZero();
+    P.diagonal().segment(frozen[j],n[j]) = var;
+  }
+  const MXD Q = 1e-4*MXD::Identity(D_,D_);
+  MXD cov(D_,D_), noiseCov(D_,D_), temp(D_,D_);
+  rovio::structuredSandwich(F,P,cov,temp,nCore_,nMax_,ca);
+  rovio::structuredSandwich(G,Q,noiseCov,temp,nCore_,nMax_,ca);
+  ASSERT_NEAR((cov-F*P*F.transpose()).norm(),0.0,1e-10);
+  ASSERT_NEAR((noiseCov-G*Q*G.transpose()).norm(),0.0,1e-10);
+  ASSERT_EQ((cov-cov.transpose()).norm(),0.0);
+  for(int j=0;j<3;j++){
+    ASSERT_EQ(cov.block(frozen[j],frozen[j],n[j],n[j]),P.block(frozen[j],frozen[j],n[j],n[j]));
+    ASSERT_EQ(noiseCov.middleRows(frozen[j],n[j]).norm(),0.0);
+  }
+}
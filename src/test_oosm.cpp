@@ -0,0 +1,205 @@
+#include "gtest/gtest.h"
+#include <assert.h>
+
+#include "rovio/OutOfSequenceBuffer.hpp"
+
+using namespace rovio;
+
+/** \brief Minimal filter with the interface used by OutOfSequenceBuffer and the safe state handling of the
+ *         lightweight_filtering FilterBase (measurement timelines, late-measurement warnings, updateSafe).
+ *
+ *  The scalar state depends on the order of the processed measurements, such that a wrongly replayed rollback changes
+ *  the result.
+ */
+class MockFilter{
+ public:
+  struct MockFeatureSet{
+    int maxIdx_ = 0;
+  };
+  struct mtFilterState{
+    double t_ = 0.0;
+    double x_ = 0.0;
+    MockFeatureSet fsm_;
+  };
+  struct mtPrediction{
+    struct mtMeas{
+      double v_;
+    };
+  };
+  struct ImgUpdate{
+    struct mtMeas{
+      double v_;
+    };
+    struct AdaptiveState{
+      int threshold_;
+    };
+    int threshold_ = 0; /**<Adaptive state, changes with every processed image.*/
+    void saveAdaptiveState(AdaptiveState& state) const{
+      state.threshold_ = threshold_;
+    }
+    void restoreAdaptiveState(const AdaptiveState& state){
+      threshold_ = state.threshold_;
+    }
+  };
+  struct PoseUpdate{
+    struct mtMeas{
+      double v_;
+    };
+  };
+  typedef std::tuple<ImgUpdate,PoseUpdate> mtUpdates;
+
+  mtFilterState safe_;
+  mtFilterState front_;
+  mtUpdates mUpdates_;
+  double safeWarningTime_ = 0.0;
+  double frontWarningTime_ = 0.0;
+  bool gotFrontWarning_ = false;
+  int warningCount_ = 0; /**<Number of measurements added before the safe time.*/
+
+  void addPredictionMeas(const mtPrediction::mtMeas& meas, const double t){
+    checkTime(t);
+    predictionTimeline_[t] = meas;
+  }
+  template<int i>
+  void addUpdateMeas(const typename std::tuple_element<i,mtUpdates>::type::mtMeas& meas, const double t){
+    checkTime(t);
+    std::get<i>(updateTimelines_)[t] = meas;
+  }
+
+  /** \brief Processes all measurements up to the last update measurement before maxTime (or the last image).
+   */
+  void updateSafe(const double* maxTime = nullptr){
+    double tEnd = safe_.t_;
+    auto& imgTimeline = std::get<0>(updateTimelines_);
+    auto& poseTimeline = std::get<1>(updateTimelines_);
+    for(const auto& entry : imgTimeline) if(maxTime == nullptr || entry.first <= *maxTime) tEnd = std::max(tEnd,entry.first);
+    for(const auto& entry : poseTimeline) if(maxTime != nullptr && entry.first <= *maxTime) tEnd = std::max(tEnd,entry.first);
+    while(true){
+      // Next event: predictions first, then the image update, then the pose update
+      double tNext = tEnd+1.0;
+      if(!predictionTimeline_.empty()) tNext = std::min(tNext,predictionTimeline_.begin()->first);
+      if(!imgTimeline.empty()) tNext = std::min(tNext,imgTimeline.begin()->first);
+      if(!poseTimeline.empty()) tNext = std::min(tNext,poseTimeline.begin()->first);
+      if(tNext > tEnd) break;
+      if(!predictionTimeline_.empty() && predictionTimeline_.begin()->first == tNext){
+        safe_.x_ = 0.9*safe_.x_ + predictionTimeline_.begin()->second.v_*(tNext-safe_.t_);
+        predictionTimeline_.erase(predictionTimeline_.begin());
+      }
+      if(!imgTimeline.empty() && imgTimeline.begin()->first == tNext){
+        ImgUpdate& imgUpdate = std::get<0>(mUpdates_);
+        safe_.x_ += 0.5*(imgTimeline.begin()->second.v_-safe_.x_)+0.01*imgUpdate.threshold_;
+        imgUpdate.threshold_++;
+        safe_.fsm_.maxIdx_++;
+        imgTimeline.erase(imgTimeline.begin());
+      }
+      if(!poseTimeline.empty() && poseTimeline.begin()->first == tNext){
+        safe_.x_ += 0.1*poseTimeline.begin()->second.v_;
+        poseTimeline.erase(poseTimeline.begin());
+      }
+      safe_.t_ = tNext;
+    }
+    safeWarningTime_ = safe_.t_;
+    if(gotFrontWarning_ || front_.t_ < safe_.t_){
+      front_ = safe_;
+      gotFrontWarning_ = false;
+    }
+    frontWarningTime_ = front_.t_;
+  }
+
+ private:
+  std::map<double,mtPrediction::mtMeas> predictionTimeline_;
+  std::tuple<std::map<double,ImgUpdate::mtMeas>,std::map<double,PoseUpdate::mtMeas>> updateTimelines_;
+
+  void checkTime(const double t){
+    if(t <= safeWarningTime_) warningCount_++;
+    if(t <= frontWarningTime_) gotFrontWarning_ = true;
+  }
+};
+
+class OutOfSequenceBufferTesting : public virtual ::testing::Test {
+ protected:
+  static constexpr double imuDt_ = 0.005; // 200 Hz
+  static constexpr int imuPerImage_ = 10; // 20 Hz
+  static const int nImages_ = 40;
+  static const int lateImage_ = 25; // The late pose measurement lies between this image and the next one
+  static const int receivedImage_ = 34; // The late pose measurement is received after this image
+
+  OutOfSequenceBufferTesting(){}
+  virtual ~OutOfSequenceBufferTesting() {}
+
+  static double imuTime(const int k){
+    return (k+1)*imuDt_;
+  }
+  static double imageTime(const int j){
+    return imuTime((j+1)*imuPerImage_-1);
+  }
+  static double lateTime(){
+    return imageTime(lateImage_)+0.5*imuDt_*imuPerImage_;
+  }
+
+  /** \brief Feeds the IMU and image measurements like the node (logging them and adding a checkpoint whenever the
+   *         safe state advanced). If isInOrder is set the pose measurement is added at its time, otherwise it is
+   *         applied after image receivedImage_ by a rollback and a replay.
+   */
+  void run(MockFilter& filter, OutOfSequenceBuffer<MockFilter>& buffer, const bool isInOrder){
+    const MockFilter::PoseUpdate::mtMeas poseMeas = {2.0};
+    bool isPoseAdded = false;
+    for(int j=0;j<nImages_;j++){
+      for(int k=j*imuPerImage_;k<(j+1)*imuPerImage_;k++){
+        const MockFilter::mtPrediction::mtMeas imuMeas = {std::sin(0.1*k)};
+        filter.addPredictionMeas(imuMeas,imuTime(k));
+        buffer.logPredictionMeas(imuMeas,imuTime(k));
+      }
+      if(isInOrder && !isPoseAdded && lateTime() < imageTime(j)){
+        filter.addUpdateMeas<1>(poseMeas,lateTime());
+        buffer.logUpdateMeas<1>(poseMeas,lateTime());
+        isPoseAdded = true;
+      }
+      const MockFilter::ImgUpdate::mtMeas imgMeas = {std::cos(0.3*j)};
+      filter.addUpdateMeas<0>(imgMeas,imageTime(j));
+      buffer.logUpdateMeas<0>(imgMeas,imageTime(j));
+      const double oldSafeTime = filter.safe_.t_;
+      double tImg = imageTime(j);
+      filter.updateSafe(&tImg);
+      if(filter.safe_.t_ > oldSafeTime) buffer.addCheckpoint(filter);
+      if(!isInOrder && j == receivedImage_){
+        ASSERT_TRUE(OutOfSequenceBuffer<MockFilter>::isLate(filter,lateTime()));
+        ASSERT_TRUE(buffer.rollback<1>(filter,poseMeas,lateTime()));
+        ASSERT_EQ(buffer.replay(filter),receivedImage_-lateImage_);
+      }
+    }
+  }
+};
+
+// Test that a rollback followed by a replay yields the same safe state as processing the measurements in order
+TEST_F(OutOfSequenceBufferTesting, rollbackReplay) {
+  MockFilter filterInOrder;
+  OutOfSequenceBuffer<MockFilter> bufferInOrder(0.5);
+  run(filterInOrder,bufferInOrder,true);
+  MockFilter filter;
+  OutOfSequenceBuffer<MockFilter> buffer(0.5);
+  run(filter,buffer,false);
+
+  ASSERT_EQ(buffer.rollbackCount_,1);
+  ASSERT_EQ(buffer.droppedCount_,0);
+  ASSERT_EQ(filter.safe_.t_,filterInOrder.safe_.t_);
+  ASSERT_NEAR(filter.safe_.x_,filterInOrder.safe_.x_,1e-12);
+  ASSERT_EQ(std::get<0>(filter.mUpdates_).threshold_,std::get<0>(filterInOrder.mUpdates_).threshold_);
+  ASSERT_GT(filter.safe_.fsm_.maxIdx_,filterInOrder.safe_.fsm_.maxIdx_); // IDs of the replayed features are new
+  ASSERT_EQ(buffer.checkpointCount(),bufferInOrder.checkpointCount());
+  // The re-added measurements are not reported as late
+  ASSERT_EQ(filter.warningCount_,0);
+  ASSERT_EQ(filterInOrder.warningCount_,0);
+}
+
+// Test that a measurement older than the oldest checkpoint is dropped
+TEST_F(OutOfSequenceBufferTesting, dropTooOld) {
+  MockFilter filter;
+  OutOfSequenceBuffer<MockFilter> buffer(0.2);
+  run(filter,buffer,true);
+  const double safeTime = filter.safe_.t_;
+  const MockFilter::PoseUpdate::mtMeas poseMeas = {1.0};
+  ASSERT_FALSE(buffer.rollback<1>(filter,poseMeas,safeTime-1.0));
+  ASSERT_EQ(buffer.droppedCount_,1);
+  ASSERT_EQ(filter.safe_.t_,safeTime);
+}
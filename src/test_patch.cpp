@@ -250,6 +250,61 @@ TEST_F(PatchTesting, computeGradientParameters) {
   ASSERT_EQ(p_.s_,s);
 }
 
+// Reference bilinear interpolation (used to check the vectorized extraction)
+float bilinearReference(const cv::Mat& img,const float u,const float v){
+  const int u_r = floor(u);
+  const int v_r = floor(v);
+  const float sx = u-u_r;
+  const float sy = v-v_r;
+  float out = (1.0-sx)*(1.0-sy)*img.at<uint8_t>(v_r,u_r);
+  if(sx > 0) out += sx*(1.0-sy)*img.at<uint8_t>(v_r,u_r+1);
+  if(sy > 0) out += (1.0-sx)*sy*img.at<uint8_t>(v_r+1,u_r);
+  if(sx > 0 && sy > 0) out += sx*sy*img.at<uint8_t>(v_r+1,u_r+1);
+  return out;
+}
+
+// Test the vectorized and batched extraction against a scalar reference (larger patch, random image)
+TEST_F(PatchTesting, extractPatchEquivalence) {
+  static const int ps = 8;
+  static const int size = 32;
+  cv::Mat img(size,size,CV_8UC1);
+  cv::randu(img,cv::Scalar(0),cv::Scalar(256));
+  Patch<ps> p;
+  const int N = 5;
+  cv::Point2f centers[N] = {cv::Point2f(size/2,size/2),
+      cv::Point2f(size/2+0.5,size/2),
+      cv::Point2f(size/2,size/2+0.25),
+      cv::Point2f(size/2+0.3712,size/2+0.8123),
+      cv::Point2f(size-ps/2-1,size-ps/2-1)};
+  for(unsigned int n=0;n<N;n++){
+    p.extractUnwarpedPatchFromImage(img,centers[n],true);
+    const float* patch_ptr = p.patchWithBorder_;
+    for(int i=0;i<ps+2;i++){
+      for(int j=0;j<ps+2;j++, ++patch_ptr){
+        ASSERT_NEAR(*patch_ptr,bilinearReference(img,centers[n].x+j-ps/2-1,centers[n].y+i-ps/2-1),1e-3);
+      }
+    }
+  }
+
+  Eigen::Matrix2f aff;
+  aff << cos(M_PI/5.0), -sin(M_PI/5.0), sin(M_PI/5.0), cos(M_PI/5.0);
+  aff *= 1.1;
+  float wdx[(ps+2)*(ps+2)];
+  float wdy[(ps+2)*(ps+2)];
+  Patch<ps>::computeWarpOffsets(aff,true,wdx,wdy);
+  for(unsigned int n=0;n<N-1;n++){
+    p.extractWarpedPatchFromImage(img,centers[n],true,wdx,wdy);
+    const float* patch_ptr = p.patchWithBorder_;
+    for(int i=0;i<ps+2;i++){
+      for(int j=0;j<ps+2;j++, ++patch_ptr){
+        const float dx = j-ps/2-1+0.5;
+        const float dy = i-ps/2-1+0.5;
+        ASSERT_NEAR(*patch_ptr,bilinearReference(img,centers[n].x+aff(0,0)*dx+aff(0,1)*dy-0.5,centers[n].y+aff(1,0)*dx+aff(1,1)*dy-0.5),1e-3);
+      }
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();